@@ -22,6 +22,7 @@
  */
 
 #define __USE_POSIX
+#define _POSIX_C_SOURCE 200809L
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -31,14 +32,19 @@
 #define BK_USE_SDL 1
 #endif
 
+#include <ctype.h>
 #include <getopt.h>
 #include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <sys/resource.h>
 #include <sys/select.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
 
 #if defined(BK_USE_SDL) && defined(BK_SDL_VERSION)
@@ -49,6 +55,18 @@
 #	endif
 #endif
 
+#ifndef BK_USE_WATCH
+#	if BK_USE_SDL && defined(HAVE_SYS_INOTIFY_H)
+#		define BK_USE_WATCH 1
+#	else
+#		define BK_USE_WATCH 0
+#	endif
+#endif
+
+#if BK_USE_WATCH
+#	include <sys/inotify.h>
+#endif
+
 #include "BKTK.h"
 #include "BlipKit.h"
 
@@ -62,6 +80,16 @@
 #define PROGRAM_NAME "bliplay"
 #endif
 
+#define TIMING_QUEUE_CAPACITY 8192
+#define TIMING_BATCH_SIZE 256
+#define BENCH_RUNS 5 // best run is reported except for rendering
+#define BENCH_MAX_SECONDS 300 // song time rendered at most
+#define BENCH_MAX_REGRESSION 10 // percent a value may get worse with --bench-compare
+#define BENCH_MANY_TRACKS 256
+#define BENCH_GROUP_DEPTH 12 // below interpreter stack size
+#define BENCH_DATA_SIZE (3 << 18) // bytes of embedded sample data; multiple of 3 for base64
+#define BENCH_COMPILE_TRACKS 32
+
 enum OUTPUT_TYPE
 {
 	OUTPUT_TYPE_NONE,
@@ -69,6 +97,30 @@ enum OUTPUT_TYPE
 	OUTPUT_TYPE_WAVE,
 };
 
+enum BENCH_VALUE
+{
+	BENCH_VALUE_BYTES,
+	BENCH_VALUE_TOKENIZE,
+	BENCH_VALUE_PARSE,
+	BENCH_VALUE_COMPILE,
+	BENCH_VALUE_CREATE,
+	BENCH_VALUE_SONG_SECONDS,
+	BENCH_VALUE_REALTIME,
+	BENCH_VALUE_COUNT,
+};
+
+enum STATS_PHASE
+{
+	STATS_PHASE_OTHER,
+	STATS_PHASE_READ,
+	STATS_PHASE_TOKENIZE,
+	STATS_PHASE_PARSE,
+	STATS_PHASE_COMPILE,
+	STATS_PHASE_CREATE,
+	STATS_PHASE_RENDER,
+	STATS_PHASE_COUNT,
+};
+
 enum FLAG
 {
 	FLAG_HAS_SEEK_TIME     = 1 << 0,
@@ -79,6 +131,11 @@ enum FLAG
 	FLAG_INFO_EXPLICITE    = 1 << 5,
 	FLAG_YES               = 1 << 6,
 	FLAG_FROM_STDIN        = 1 << 7,
+	FLAG_PROFILE           = 1 << 8,
+	FLAG_TIMING_BINARY     = 1 << 9,
+	FLAG_WATCH             = 1 << 10,
+	FLAG_PROGRESSIVE       = 1 << 11,
+	FLAG_STATS             = 1 << 12,
 	FLAG_TIMING_UNIT_SHIFT = 16,
 	FLAG_TIMING_UNIT_SECS  = 1 << 16,
 	FLAG_TIMING_UNIT_TICKS = 2 << 16,
@@ -92,41 +149,184 @@ static BKContext        renderCtx;
 static BKTKTokenizer    tok;
 static BKTKParser       parser;
 static BKTKCompiler     compiler;
+static BKInt            compileRes;
 static BKUInt           sampleRate = 44100;
 static BKTime           seekTime, endTime;
 static BKInt            numChannels = 2;
 static char const     * filename;
 static char const     * outputFilename;
+static char const     * nativeFilename;
+static char const     * captureFilename;
+static char const     * replayFilename;
+static BKTKEventLog     replayLog;
+static char const     * benchFilename;
+static char const     * benchCompareFilename;
+static char          ** benchFiles;
+static BKInt            numBenchFiles;
+static BKTKStatsTime    statsTimes [STATS_PHASE_COUNT];
+static BKTKStatsTime    statsMark;  // start of current phase
+static BKEnum           statsPhase; // phase of main thread
 static FILE           * outputFile;
 static FILE           * timingFile;
+static FILE           * timingSpool; // binary records written by timing thread
+static BKTKTimingQueue * timingQueue;
+static pthread_t        timingThread;
+static atomic_int       timingDone;
 static BKEnum           outputType = OUTPUT_TYPE_NONE;
 static BKWaveFileWriter waveWriter;
 static char             seekTimeString [64];
 static char             endTimeString [64];
 
 #if BK_USE_SDL
+/**
+ * State of progressive loading
+ */
+enum
+{
+	LOAD_RUNNING,
+	LOAD_PREVIEW, // first tracks are playing while loading
+	LOAD_DONE,
+	LOAD_FAILED,
+};
+
+/**
+ * State of preview
+ */
+enum
+{
+	PREVIEW_NONE,
+	PREVIEW_COMPILING, // waiting for the first track
+	PREVIEW_STARTED,
+};
+
 static int              updateUSecs = 91200;
+static BKTKContext    * liveCtx;  // context of last loaded version
+static BKTKContext    * playCtx;  // context rendered by audio callback
+static BKTKContext    * _Atomic pendingCtx; // handed to audio callback
+static BKTKContext    * _Atomic retiredCtx; // handed back from audio callback
+static atomic_uint      playFrames;
+static atomic_uint      playTicks; // beat ticks rendered when watching or loading
+static BKDivider        tickDivider;
+static pthread_t        loadThread;
+static atomic_int       loadState;
+static FILE           * loadFile;
+static BKString         loadDir = BK_STRING_INIT;
+static BKTKContext    * previewCtx; // plays tracks compiled so far
+static BKInt            previewState;
+#endif
+
+#if BK_USE_WATCH
+/**
+ * Result of `make_context` when reloading
+ */
+enum
+{
+	RELOAD_UNCHANGED = 1, // previous version keeps playing
+	RELOAD_UPDATE    = 2, // changed definitions are appended to playing song
+};
+
+/**
+ * Type of top-level definition
+ */
+enum
+{
+	DEFINITION_OTHER,
+	DEFINITION_TRACK,
+	DEFINITION_GROUP,
+	DEFINITION_INSTRUMENT,
+};
+
+/**
+ * Top-level definition of watched input file
+ */
+struct definition
+{
+	uint64_t   key;        // hash of command and first argument
+	BKUInt     occurrence; // number of previous definitions with same key
+	uint64_t   hash;       // hash of source text
+	BKTKOffset offset;
+	BKEnum     type;
+	BKInt      changed;    // differs from the previous version
+	char       name [48];
+};
+
+static BKArray          definitions = BK_ARRAY_INIT (sizeof (struct definition));
+static BKTKContext    * _Atomic updateBatch; // handed to audio callback until retired
+static uint8_t        * watchSource;
+static BKUSize          watchSourceLen;
+static BKUSize          watchSourceCap;
+static BKString         watchPath = BK_STRING_INIT;
+static BKString         watchLoadPath = BK_STRING_INIT;
+static char const     * watchName;
+static int              watchFd = -1;
 #endif
 
+/**
+ * Value written by --bench
+ */
+struct bench_value
+{
+	char const * key;
+	BKInt        better; // 1: higher is better, -1: lower is better, 0: not compared
+};
+
+static struct bench_value const benchValues [BENCH_VALUE_COUNT] =
+{
+	[BENCH_VALUE_BYTES]        = {"bytes",         0},
+	[BENCH_VALUE_TOKENIZE]     = {"tokenize_mbps", 1},
+	[BENCH_VALUE_PARSE]        = {"parse_mbps",    1},
+	[BENCH_VALUE_COMPILE]      = {"compile_mbps",  1},
+	[BENCH_VALUE_CREATE]       = {"create_ms",    -1},
+	[BENCH_VALUE_SONG_SECONDS] = {"song_seconds",  0},
+	[BENCH_VALUE_REALTIME]     = {"realtime",      1},
+};
+
+/**
+ * Results of song written by --bench
+ */
+struct bench_result
+{
+	char   name [1024];
+	double values [BENCH_VALUE_COUNT];
+};
+
 static char const * colorNormal = "";
 static char const * colorYellow = "";
 static char const * colorRed    = "";
 static char const * colorGreen  = "";
 
+/**
+ * Line of track written to text timing file
+ */
+struct timing_line
+{
+	float    time;
+	uint32_t lineno;
+};
+
 struct option const options [] =
 {
-	{"load-dir",     required_argument, NULL, 'd'},
-	{"fast-forward", required_argument, NULL, 'f'},
-	{"help",         no_argument,       NULL, 'h'},
-	{"info",         required_argument, NULL, 'i'},
-	{"end-time",     required_argument, NULL, 'l'},
-	{"no-time",      no_argument,       NULL, 'n'},
-	{"output",       required_argument, NULL, 'o'},
-	{"samplerate",   required_argument, NULL, 'r'},
-	{"timing-data",  required_argument, NULL, 't'},
-	{"version",      no_argument,       NULL, 'v'},
-	{"yes",          no_argument,       NULL, 'y'},
-	{NULL,           0,                 NULL, 0},
+	{"bench",         required_argument, NULL, 'b'},
+	{"bench-compare", required_argument, NULL, 'B'},
+	{"emit-c",        required_argument, NULL, 'c'},
+	{"load-dir",      required_argument, NULL, 'd'},
+	{"capture",       required_argument, NULL, 'e'},
+	{"replay",        required_argument, NULL, 'E'},
+	{"fast-forward",  required_argument, NULL, 'f'},
+	{"help",          no_argument,       NULL, 'h'},
+	{"info",          required_argument, NULL, 'i'},
+	{"end-time",      required_argument, NULL, 'l'},
+	{"no-time",       no_argument,       NULL, 'n'},
+	{"output",        required_argument, NULL, 'o'},
+	{"profile",       no_argument,       NULL, 'p'},
+	{"progressive",   no_argument,       NULL, 'P'},
+	{"samplerate",    required_argument, NULL, 'r'},
+	{"stats",         no_argument,       NULL, 's'},
+	{"timing-data",   required_argument, NULL, 't'},
+	{"version",       no_argument,       NULL, 'v'},
+	{"watch",         no_argument,       NULL, 'w'},
+	{"yes",           no_argument,       NULL, 'y'},
+	{NULL,            0,                 NULL, 0},
 };
 
 #if BK_USE_SDL
@@ -236,9 +436,27 @@ static void print_help (void)
 		"  sound player and renderer\n"
 		"  more info for file syntax: " PACKAGE_URL "\n"
 		"usage: %1$s [options] file\n"
+		"       %1$s --bench results.json [--bench-compare old.json] [file ...]\n"
+		"       %1$s --bench-compare old.json results.json\n"
+		"  %2$s-b, --bench results.json%3$s\n"
+		"      Measure songs and synthetic stress songs and write results as JSON\n"
+		"      Reports front end throughput, context creation time and render speed\n"
+		"  %2$s-B, --bench-compare old.json%3$s\n"
+		"      Compare results of %2$s-b%3$s or given results file with old results\n"
+		"      Exits with status 4 if a value got more than %4$d%% worse\n"
+		"  %2$s-c, --emit-c file.c%3$s\n"
+		"      Write song as C source and exit\n"
+		"      Tracks are executed by native code instead of the interpreter\n"
+		"      when the song is set with BKTKContextSetNativeSong\n"
 		"  %2$s-d, --load-dir path%3$s\n"
 		"      Sets the path for loading resources\n"
 		"      If not set, the input file's directory is used\n"
+		"  %2$s-e, --capture file%3$s\n"
+		"      Run song without rendering and write attribute events to file\n"
+		"      Stops when all tracks have stopped or repeated or at %2$s-l%3$s\n"
+		"  %2$s-E, --replay file%3$s\n"
+		"      Play events captured with %2$s-e%3$s instead of running the song\n"
+		"      The input file has to be the captured song\n"
 		"  %2$s-f, --fast-forward time%3$s\n"
 		"      Fast forward to time\n"
 		"      Time format: number[s|b|t|f]\n"
@@ -257,16 +475,30 @@ static void print_help (void)
 		"      Write audio data to file\n"
 		"      WAVE format: PCM 16 bit, stereo\n"
 		"      RAW format: headerless native signed 16 bit, stereo\n"
+		"  %2$s-p, --profile%3$s\n"
+		"      Print interpreter statistics to stderr after playing\n"
+		"      Requires build with --enable-profile\n"
+		"  %2$s-P, --progressive%3$s\n"
+		"      Start playing when the first track is loaded\n"
+		"      Later tracks join at the playing position\n"
 		"  %2$s-r, --samplerate value%3$s\n"
 		"      Set output sample rate (default: 44100)\n"
 		"      Range: 16000 - 96000\n"
-		"  %2$s-t, --timing-data [s|t]%3$s\n"
+		"  %2$s-s, --stats%3$s\n"
+		"      Print time of loading phases and rendering, peak memory\n"
+		"      and allocations to stderr after playing\n"
+		"      CPU time is of all threads; allocations are partial\n"
+		"  %2$s-t, --timing-data [s|t|b]%3$s\n"
 		"      Write timing data to [output file].txt\n"
 		"      Units: s: seconds, t: ticks\n"
+		"      b: write indexed binary file to [output file].timing\n"
 		"      Ignored when not used with %2$s-o%3$s\n"
+		"  %2$s-w, --watch%3$s\n"
+		"      Reload input file when it is saved while playing\n"
+		"      Playback continues at the same position\n"
 		"  %2$s-y, --yes%3$s\n"
 		"      Overwrite output file without asking\n",
-		PROGRAM_NAME, colorYellow, colorNormal
+		PROGRAM_NAME, colorYellow, colorNormal, BENCH_MAX_REGRESSION
 	);
 }
 
@@ -342,6 +574,35 @@ static void print_error (char const * format, ...)
 	va_end (args);
 }
 
+static void stats_add_time (BKTKStatsTime * sum, BKTKStatsTime const * start, BKTKStatsTime const * end)
+{
+	sum -> wallNanos += end -> wallNanos - start -> wallNanos;
+	sum -> cpuNanos  += end -> cpuNanos - start -> cpuNanos;
+}
+
+/**
+ * Switch phase of main thread
+ *
+ * Time since the last switch is added to the current phase, so nested
+ * phases are not counted twice. Returns the previous phase.
+ */
+static BKEnum stats_switch (BKEnum phase)
+{
+	BKTKStatsTime time;
+	BKEnum prevPhase = statsPhase;
+
+	if (!(flags & FLAG_STATS)) {
+		return prevPhase;
+	}
+
+	BKTKStatsGetTime (&time);
+	stats_add_time (&statsTimes [statsPhase], &statsMark, &time);
+	statsMark  = time;
+	statsPhase = phase;
+
+	return prevPhase;
+}
+
 static void output_chunk (BKFrame const frames [], BKInt numFrames)
 {
 	switch (outputType) {
@@ -357,18 +618,104 @@ static void output_chunk (BKFrame const frames [], BKInt numFrames)
 }
 
 #if BK_USE_SDL
+/**
+ * Check if context holds tracks to append to the playing context
+ *
+ * The song is the only other context handed over when loading progressively.
+ * When watching, only updates of changed definitions are appended.
+ */
+static BKInt is_batch (BKTKContext const * newCtx)
+{
+	if (flags & FLAG_PROGRESSIVE) {
+		return newCtx != &ctx;
+	}
+
+#if BK_USE_WATCH
+	return newCtx == atomic_load (&updateBatch);
+#else
+	return 0;
+#endif
+}
+
+/**
+ * Get context to render in audio callback
+ *
+ * A reloaded context has no render context; it takes over the one of the
+ * playing context and resumes at its beat tick. Tracks compiled while
+ * loading progressively or changed when watching are appended to the playing
+ * context. The previous context or the appended batch is handed back to be
+ * disposed by the main thread; nothing is allocated or freed here.
+ */
+static BKTKContext * audio_context (BKTKContext * ctx)
+{
+	BKTKContext * newCtx;
+	BKContext * renderContext;
+
+	if (playCtx) {
+		ctx = playCtx;
+	}
+
+	newCtx = atomic_exchange (&pendingCtx, NULL);
+
+	if (newCtx) {
+		if (is_batch (newCtx)) {
+			BKTKContextAppend (ctx, newCtx, atomic_load (&playTicks));
+			atomic_store (&retiredCtx, newCtx);
+		}
+		else {
+			renderContext = ctx -> renderContext;
+			BKTKContextDetach (ctx);
+
+			// objects are shared with the song
+			if (flags & FLAG_PROGRESSIVE) {
+				BKTKContextReleaseObjects (ctx);
+			}
+
+			BKTKContextAttach (newCtx, renderContext);
+			BKTKContextResume (newCtx, atomic_load (&playTicks));
+			atomic_store (&retiredCtx, ctx);
+			ctx = newCtx;
+		}
+	}
+
+	playCtx = ctx;
+
+	return ctx;
+}
+
 static void fill_audio (BKTKContext * ctx, Uint8 * stream, int len)
 {
-	BKUInt numChannels = ctx -> renderContext -> numChannels;
-	BKUInt numFrames   = len / sizeof (BKFrame) / numChannels;
+	BKUInt numChannels, numFrames;
+	BKTKStatsTime startTime, stopTime;
+
+	if (flags & FLAG_STATS) {
+		BKTKStatsGetTime (&startTime);
+	}
+
+	ctx = audio_context (ctx);
+
+	numChannels = ctx -> renderContext -> numChannels;
+	numFrames   = len / sizeof (BKFrame) / numChannels;
 
 	BKContextGenerate (ctx -> renderContext, (BKFrame *) stream, numFrames);
 	output_chunk ((BKFrame *) stream, numFrames * numChannels);
+
+	atomic_store (&playFrames, BKTimeGetTime (ctx -> renderContext -> currentTime));
+
+	// main thread does not render while playing
+	if (flags & FLAG_STATS) {
+		BKTKStatsGetTime (&stopTime);
+		stats_add_time (&statsTimes [STATS_PHASE_RENDER], &startTime, &stopTime);
+	}
 }
 #endif /* BK_USE_SDL */
 
+static void wait_timing_queue (void);
+
 static BKInt push_frames (BKFrame inFrames [], BKUInt size, void * info)
 {
+	wait_timing_queue ();
+
 	return 0;
 }
 
@@ -404,6 +751,12 @@ static BKInt check_tracks_running (BKTKContext const * ctx)
 {
 	BKTKTrack * track;
 	BKSize numActive = 0;
+	BKUInt const * trackFlags = ctx -> trackFlags.items;
+
+	// interpreters are not run when replaying
+	if (ctx -> replayLog) {
+		return ctx -> replayIndex < ctx -> replayLog -> events.len;
+	}
 
 	for (BKInt i = 0; i < ctx -> tracks.len; i ++) {
 		track = *(BKTKTrack **) BKArrayItemAt (&ctx -> tracks, i);
@@ -413,12 +766,12 @@ static BKInt check_tracks_running (BKTKContext const * ctx)
 
 			// exit if tracks have repeated
 			if (flags & FLAG_NO_SOUND) {
-				if (track -> interpreter.object.flags & (BKTKInterpreterFlagHasStopped | BKTKInterpreterFlagHasRepeated)) {
+				if (trackFlags [i] & (BKTKInterpreterFlagHasStopped | BKTKInterpreterFlagHasRepeated)) {
 					numActive --;
 				}
 			}
 			// exit if tracks have stopped
-			else if (track -> interpreter.object.flags & BKTKInterpreterFlagHasStopped) {
+			else if (trackFlags [i] & BKTKInterpreterFlagHasStopped) {
 				numActive --;
 			}
 		}
@@ -522,7 +875,7 @@ static void waveform_get_name (BKTKTrack const * track, char name [], BKSize siz
 		waveformIdx &= ~BK_INTR_CUSTOM_WAVEFORM_FLAG;
 		waveform = *(BKTKWaveform **) BKArrayItemAt (&track -> ctx -> waveforms, waveformIdx);
 
-		snprintf (name, size, "%s", waveform -> name.str);
+		snprintf (name, size, "%s", waveform -> name);
 		return;
 	}
 	else {
@@ -577,7 +930,7 @@ static void print_instruments (BKTKContext const * ctx)
 		instrument = *(BKTKInstrument **) BKArrayItemAt (& ctx -> instruments, i);
 
 		if (instrument) {
-			print_message ("         #%d: %s\n", i, instrument -> name.str);
+			print_message ("         #%d: %s\n", i, instrument -> name);
 		}
 	}
 }
@@ -590,7 +943,7 @@ static void print_waveforms (BKTKContext const * ctx)
 		waveform = *(BKTKWaveform **) BKArrayItemAt (& ctx -> waveforms, i);
 
 		if (waveform) {
-			print_message ("         #%d: %s\n", i, waveform -> name.str);
+			print_message ("         #%d: %s\n", i, waveform -> name);
 		}
 	}
 }
@@ -603,7 +956,7 @@ static void print_samples (BKTKContext const * ctx)
 		sample = *(BKTKSample **) BKArrayItemAt (& ctx -> samples, i);
 
 		if (sample) {
-			print_message ("         #%d: %s\n", i, sample -> name.str);
+			print_message ("         #%d: %s\n", i, sample -> name);
 		}
 	}
 }
@@ -624,537 +977,3072 @@ static void print_info (BKTKContext const * ctx)
 	print_message ("   channels: %d\n", ctx -> renderContext -> numChannels);
 }
 
-static BKInt should_overwrite_output (char const * filename)
+#if BK_TK_PROFILE
+static BKTKContext const * profileCtx;
+
+/**
+ * Sort instructions by dispatch count
+ */
+static int profile_instr_compare (BKUInt const * a, BKUInt const * b)
 {
-	char line [8];
+	uint64_t countA = profileCtx -> dispatches [*a];
+	uint64_t countB = profileCtx -> dispatches [*b];
 
-	print_notice ("Output file already exists. Overwrite? [Y/n] ");
+	return (countA < countB) - (countA > countB);
+}
 
-	strcpy (line, "");
-	fgets (line, sizeof (line), stdin);
+static void print_profile_track (BKTKTrack const * track)
+{
+	BKTKGroup const * group;
 
-	if (line [0] == 'Y') {
-		return 1;
+	if (track -> object.index == 0) {
+		fprintf (stderr, "  global");
+	}
+	else {
+		fprintf (stderr, "  track #%d (line %d:%d)", track -> object.index - 1,
+			track -> object.offset.lineno, track -> object.offset.colno);
 	}
 
-	return 0;
+	fprintf (stderr, ": callbacks %llu, dispatches %llu, time %.3f ms\n",
+		(unsigned long long) track -> profile.calls,
+		(unsigned long long) track -> profile.dispatches,
+		track -> profile.nanos / 1e6);
+
+	for (BKUSize i = 0; i < track -> code -> groups.len; i ++) {
+		group = ((BKTKGroup **) track -> code -> groups.items) [i];
+
+		if (!group || !group -> profile.calls) {
+			continue;
+		}
+
+		if (group -> object.object.flags & BKTKFlagOutlined) {
+			fprintf (stderr, "    group #%d (outlined)", group -> object.index);
+		}
+		else {
+			fprintf (stderr, "    group #%d (line %d:%d)", group -> object.index,
+				group -> object.offset.lineno, group -> object.offset.colno);
+		}
+
+		fprintf (stderr, ": calls %llu, dispatches %llu\n",
+			(unsigned long long) group -> profile.calls,
+			(unsigned long long) group -> profile.dispatches);
+	}
 }
 
-static BKInt put_token (BKTKToken const * token, BKTKParser * parser)
+static void print_profile (BKTKContext const * ctx)
 {
-	BKInt res;
+	uint64_t count;
+	uint64_t total = 0;
+	BKTKTrack const * track;
+	BKUInt instrs [BK_INTR_COUNT];
+
+	for (BKUInt i = 0; i < BK_INTR_COUNT; i ++) {
+		instrs [i] = i;
+		total += ctx -> dispatches [i];
+	}
 
-	if ((res = BKTKParserPutTokens (parser, token, 1)) != 0) {
-		return res;
+	profileCtx = ctx;
+	qsort (instrs, BK_INTR_COUNT, sizeof (BKUInt), (void *) profile_instr_compare);
+
+	fprintf (stderr, "Profile of '%s'\n", filename);
+	fprintf (stderr, "instructions: %llu dispatches\n", (unsigned long long) total);
+
+	for (BKUInt i = 0; i < BK_INTR_COUNT; i ++) {
+		count = ctx -> dispatches [instrs [i]];
+
+		if (!count) {
+			break;
+		}
+
+		fprintf (stderr, "  %-20s %12llu %6.2f%%\n", BKTKInterpreterInstrName (instrs [i]),
+			(unsigned long long) count, 100.0 * count / total);
 	}
 
-	return 0;
+	fprintf (stderr, "tracks:\n");
+
+	for (BKUSize i = 0; i < ctx -> tracks.len; i ++) {
+		track = *(BKTKTrack **) BKArrayItemAt (&ctx -> tracks, i);
+
+		if (track) {
+			print_profile_track (track);
+		}
+	}
 }
+#endif /* BK_TK_PROFILE */
 
-static BKInt context_init (BKTKContext * ctx, BKInt numChannels, BKInt sampleRate, BKUInt flags)
+static char const * const statsPhaseNames [STATS_PHASE_COUNT] =
 {
-	BKInt res = 0;
+	[STATS_PHASE_OTHER]    = "other",
+	[STATS_PHASE_READ]     = "read",
+	[STATS_PHASE_TOKENIZE] = "tokenize",
+	[STATS_PHASE_PARSE]    = "parse",
+	[STATS_PHASE_COMPILE]  = "compile",
+	[STATS_PHASE_CREATE]   = "create",
+	[STATS_PHASE_RENDER]   = "render",
+};
 
-	if ((res = BKTKContextInit (ctx, flags)) != 0) {
-		return res;
+static void print_stats_time (char const * name, uint64_t wallNanos, uint64_t cpuNanos)
+{
+	fprintf (stderr, "  %-10s %10.3f ms wall %10.3f ms cpu\n", name, wallNanos / 1e6, cpuNanos / 1e6);
+}
+
+static void print_stats_track (BKTKTrack const * track)
+{
+	BKUSize numGroups = 0;
+	BKUSize groupSize = 0;
+	BKTKGroup const * group;
+
+	for (BKUSize i = 0; i < track -> code -> groups.len; i ++) {
+		group = ((BKTKGroup **) track -> code -> groups.items) [i];
+
+		if (group) {
+			numGroups ++;
+			groupSize += group -> byteCode.len * sizeof (uint32_t);
+		}
 	}
 
-	if ((res = BKContextInit (&renderCtx, numChannels, sampleRate)) != 0) {
-		print_error ("Context init failed (%s)\n", BKStatusGetName (res));
-		return res;
+	if (track -> object.index == 0) {
+		fprintf (stderr, "  global");
+	}
+	else {
+		fprintf (stderr, "  track #%d (line %d:%d)", track -> object.index - 1,
+			track -> object.offset.lineno, track -> object.offset.colno);
 	}
 
-	return res;
+	fprintf (stderr, ": %llu bytes, %llu groups with %llu bytes\n",
+		(unsigned long long) (track -> code -> byteCode.len * sizeof (uint32_t)),
+		(unsigned long long) numGroups, (unsigned long long) groupSize);
 }
 
-static BKInt make_context (BKTKContext * ctx, FILE * file, BKString * const loadPath)
+/**
+ * Print phase times, peak memory, allocations and byte code sizes
+ *
+ * Sample loading is measured by the context and is subtracted from the
+ * creation phase.
+ */
+static void print_stats (BKTKContext const * ctx)
 {
-	BKInt res = 0;
-	BKTKParserNode * nodeTree;
+	struct rusage usage;
+	long long peakBytes = 0;
+	BKTKStatsCounter counter;
+	BKTKStatsCounter samples;
+	BKTKStatsTime const * time;
+	BKTKTrack const * track;
+
+	stats_switch (STATS_PHASE_OTHER);
+	BKTKStatsGetCounter (BKTKStatsTypeSamples, &samples);
+
+	fprintf (stderr, "Stats of '%s'\n", filename);
+	fprintf (stderr, "phases:\n");
+
+	for (BKEnum i = STATS_PHASE_READ; i < STATS_PHASE_COUNT; i ++) {
+		time = &statsTimes [i];
+
+		if (i == STATS_PHASE_CREATE) {
+			print_stats_time (statsPhaseNames [i], time -> wallNanos - samples.time.wallNanos,
+				time -> cpuNanos - samples.time.cpuNanos);
+			print_stats_time ("samples", samples.time.wallNanos, samples.time.cpuNanos);
+		}
+		else {
+			print_stats_time (statsPhaseNames [i], time -> wallNanos, time -> cpuNanos);
+		}
+	}
 
-	if ((res = BKTKParserInit (&parser)) != 0) {
-		print_error ("BKTKParserInit failed (%s)\n", BKStatusGetName (res));
-		return res;
+	if (getrusage (RUSAGE_SELF, &usage) == 0) {
+		peakBytes = usage.ru_maxrss;
+#ifndef __APPLE__
+		peakBytes *= 1024; // in kilobytes
+#endif
 	}
 
-	if ((res = BKTKTokenizerInit (&tok)) != 0) {
-		print_error ("BKTKTokenizerInit failed (%s)\n", BKStatusGetName (res));
-		return res;
+	fprintf (stderr, "peak memory: %.1f MB\n", peakBytes / (1024.0 * 1024.0));
+	// growth of BlipKit arrays and strings is not counted
+	fprintf (stderr, "allocations (partial):\n");
+
+	for (BKEnum i = 0; i < BKTKStatsTypeCount; i ++) {
+		BKTKStatsGetCounter (i, &counter);
+		fprintf (stderr, "  %-10s %10llu allocs %12llu bytes\n", BKTKStatsTypeName (i),
+			(unsigned long long) counter.numAllocs, (unsigned long long) counter.size);
 	}
 
-	do {
-		size_t size;
-		uint8_t buffer [1024];
+	fprintf (stderr, "byte code:\n");
 
-		size = fread (buffer, sizeof (uint8_t), sizeof (buffer), file);
+	for (BKUSize i = 0; i < ctx -> tracks.len; i ++) {
+		track = *(BKTKTrack **) BKArrayItemAt (&ctx -> tracks, i);
 
-		// will also be called with `chunkSize` = 0 to terminate tokenizer
-		if (BKTKTokenizerPutChars (&tok, buffer, size, (BKTKPutTokenFunc) put_token, &parser) != 0) {
-			break;
+		if (track) {
+			print_stats_track (track);
 		}
 	}
-	while (!BKTKTokenizerIsFinished (&tok));
+}
 
-	if (BKTKTokenizerHasError (&tok)) {
-		print_error ("%s\n", tok.buffer);
-		res = -1;
-	}
+static BKInt should_overwrite_output (char const * filename)
+{
+	char line [8];
 
-	if (BKTKParserHasError (&parser)) {
-		print_error ("%s\n", parser.buffer);
-		res = -1;
-	}
+	print_notice ("Output file already exists. Overwrite? [Y/n] ");
 
-	if (res) {
-		return res;
+	strcpy (line, "");
+	fgets (line, sizeof (line), stdin);
+
+	if (line [0] == 'Y') {
+		return 1;
 	}
 
-	BKDispose (&tok);
+	return 0;
+}
 
-	nodeTree = BKTKParserGetNodeTree (&parser);
+static BKInt context_init (BKTKContext * ctx, BKContext * renderContext, BKInt numChannels, BKInt sampleRate, BKUInt flags)
+{
+	BKInt res = 0;
 
-	if ((res = BKTKCompilerInit (&compiler)) != 0) {
-		print_error ("BKTKCompilerInit failed (%s)\n", BKStatusGetName (res));
+	if ((res = BKTKContextInit (ctx, flags)) != 0) {
 		return res;
 	}
 
-	if ((res = BKTKCompilerCompile (&compiler, nodeTree)) != 0) {
-		print_error ((char *) compiler.error.str);
+	if ((res = BKContextInit (renderContext, numChannels, sampleRate)) != 0) {
+		print_error ("Context init failed (%s)\n", BKStatusGetName (res));
 		return res;
 	}
 
-	BKDispose (&parser);
+	return res;
+}
 
-	if ((res = BKStringReplaceInRange (&ctx -> loadPath, loadPath, 0, ctx -> loadPath.len)) != 0) {
-		print_error ("Allocation error\n");
-		return res;
-	}
+#if BK_USE_WATCH
+/**
+ * Hash bytes with FNV-1a
+ */
+static uint64_t hash_bytes (uint64_t hash, void const * data, BKUSize size)
+{
+	uint8_t const * bytes = data;
 
-	if ((res = BKTKContextCreate (ctx, &compiler)) != 0) {
-		print_error ("Creating context failed (%s)\n", BKStatusGetName (res));
-		print_error ((char *) ctx -> error.str);
-		return res;
+	for (BKUSize i = 0; i < size; i ++) {
+		hash = (hash ^ bytes [i]) * 0x100000001B3;
 	}
 
-	BKDispose (&compiler);
+	return hash;
+}
 
-	if ((res = BKTKContextAttach (ctx, &renderCtx)) != 0) {
-		print_error ("Attaching context failed (%s)\n", BKStatusGetName (res));
-		return res;
+static BKInt append_source (uint8_t const * data, BKUSize size)
+{
+	uint8_t * source;
+	BKUSize capacity;
+
+	if (watchSourceLen + size > watchSourceCap) {
+		capacity = BKMax (watchSourceCap * 2, watchSourceLen + size);
+		source = realloc (watchSource, capacity);
+
+		if (!source) {
+			return BK_ALLOCATION_ERROR;
+		}
+
+		watchSource = source;
+		watchSourceCap = capacity;
 	}
 
+	memcpy (&watchSource [watchSourceLen], data, size);
+	watchSourceLen += size;
+
 	return 0;
 }
 
-static BKInt handle_options (BKTKContext * ctx, int argc, char * argv [])
+/**
+ * Get position of node offset in watched source
+ *
+ * Lines start after each '\n' or '\r' like in the tokenizer.
+ */
+static BKUSize source_offset (BKTKOffset offset, BKUSize const lineStarts [], BKUSize numLines)
 {
-	int    opt;
-	int    longoptind = 1;
-	BKUInt speed      = 0;
-	FILE * inputFile;
-	struct stat st;
-	BKString path = BK_STRING_INIT;
-	BKString loadPath = BK_STRING_INIT;
-	BKEnum opts = 0;
+	BKUSize pos;
 
-	opterr = 0;
+	if (offset.lineno < 1 || (BKUSize) offset.lineno > numLines) {
+		return watchSourceLen;
+	}
 
-#if BK_USE_SDL
-	flags = FLAG_INFO;
-#endif
+	pos = lineStarts [offset.lineno - 1] + BKMax (offset.colno - 1, 0);
 
-	while ((opt = getopt_long (argc, (void *) argv, "d:f:hil:no:pr:t:vy", options, &longoptind)) != -1) {
-		switch (opt) {
-			case 'd': {
-				BKStringEmpty (&loadPath);
+	return BKMin (pos, watchSourceLen);
+}
 
-				if (BKStringAppend (&loadPath, optarg) != 0) {
-					print_error ("Allocation error\n");
-					return -1;
-				}
-				break;
-			}
-			case 'f': {
-				flags |= FLAG_HAS_SEEK_TIME;
-				strncpy (seekTimeString, optarg, 64);
-				break;
-			}
-			case 'h':
-			case 'v': {
-				print_help ();
-				exit (1);
-				break;
-			}
-			case 'i': {
-				flags |= FLAG_INFO_EXPLICITE;
-				break;
+/**
+ * Get type of top-level group node
+ */
+static BKEnum definition_type (BKTKParserNode const * node)
+{
+	if (BKStringCompare (&node -> name, "track") == 0) {
+		return DEFINITION_TRACK;
+	}
+	else if (BKStringCompare (&node -> name, "grp") == 0) {
+		return DEFINITION_GROUP;
+	}
+	else if (BKStringCompare (&node -> name, "instr") == 0) {
+		return DEFINITION_INSTRUMENT;
+	}
+
+	return DEFINITION_OTHER;
+}
+
+/**
+ * Split top-level nodes of watched source into definitions
+ *
+ * Groups are identified by their command, first argument and occurrence.
+ * All other top-level commands are combined into a single definition. The
+ * hash covers the source text up to the next top-level node without trailing
+ * whitespace.
+ */
+static BKInt collect_definitions (BKTKParserNode const * tree, BKArray * outDefinitions)
+{
+	BKInt res = 0;
+	BKUSize numLines = 1;
+	BKUSize * lineStarts;
+	BKUSize start, end;
+	BKString const * arg;
+	BKTKParserNode const * node;
+	struct definition * definition, * other;
+	struct definition global;
+	uint64_t const basis = 0xCBF29CE484222325;
+
+	for (BKUSize i = 0; i < watchSourceLen; i ++) {
+		numLines += (watchSource [i] == '\n' || watchSource [i] == '\r');
+	}
+
+	lineStarts = malloc (numLines * sizeof (*lineStarts));
+
+	if (!lineStarts) {
+		return BK_ALLOCATION_ERROR;
+	}
+
+	numLines = 0;
+	lineStarts [numLines ++] = 0;
+
+	for (BKUSize i = 0; i < watchSourceLen; i ++) {
+		if (watchSource [i] == '\n' || watchSource [i] == '\r') {
+			lineStarts [numLines ++] = i + 1;
+		}
+	}
+
+	memset (&global, 0, sizeof (global));
+	global.key  = hash_bytes (basis, "", 1);
+	global.hash = basis;
+	snprintf (global.name, sizeof (global.name), "global commands");
+
+	for (node = tree; node; node = node -> nextNode) {
+		if (node -> type == BKTKTypeComment) {
+			continue;
+		}
+
+		start = source_offset (node -> offset, lineStarts, numLines);
+		end   = watchSourceLen;
+
+		if (node -> nextNode) {
+			end = BKMax (start, source_offset (node -> nextNode -> offset, lineStarts, numLines));
+		}
+
+		// ignore blank lines between definitions
+		while (end > start && isspace (watchSource [end - 1])) {
+			end --;
+		}
+
+		if (!(node -> flags & BKTKParserFlagIsGroup)) {
+			if (!global.offset.lineno) {
+				global.offset = node -> offset;
 			}
-			case 'l': {
-				flags |= FLAG_HAS_END_TIME;
-				strncpy (endTimeString, optarg, 64);
-				break;
+
+			global.hash = hash_bytes (global.hash, &watchSource [start], end - start);
+			continue;
+		}
+
+		definition = BKArrayPushPtr (outDefinitions);
+
+		if (!definition) {
+			res = BK_ALLOCATION_ERROR;
+			goto cleanup;
+		}
+
+		arg = node -> argCount ? &node -> args [0] : NULL;
+
+		definition -> key = hash_bytes (basis, node -> name.str, node -> name.len + 1);
+
+		if (arg) {
+			definition -> key = hash_bytes (definition -> key, arg -> str, arg -> len);
+		}
+
+		definition -> occurrence = 0;
+		definition -> hash = hash_bytes (basis, &watchSource [start], end - start);
+		definition -> offset = node -> offset;
+		definition -> type = definition_type (node);
+		definition -> changed = 0;
+		snprintf (definition -> name, sizeof (definition -> name), "[%s:%s]",
+			node -> name.str, arg ? (char const *) arg -> str : "");
+
+		for (BKUSize i = 0; i < outDefinitions -> len - 1; i ++) {
+			other = BKArrayItemAt (outDefinitions, i);
+
+			if (other -> key == definition -> key) {
+				definition -> occurrence ++;
 			}
-			case 'n': {
-				flags |= FLAG_PRINT_NO_TIME;
-				break;
+		}
+	}
+
+	if (global.offset.lineno) {
+		if (BKArrayPush (outDefinitions, &global) != 0) {
+			res = BK_ALLOCATION_ERROR;
+			goto cleanup;
+		}
+	}
+
+cleanup:
+	free (lineStarts);
+
+	return res;
+}
+
+static struct definition const * find_definition (BKArray const * definitions, struct definition const * definition)
+{
+	struct definition const * other;
+
+	for (BKUSize i = 0; i < definitions -> len; i ++) {
+		other = BKArrayItemAt (definitions, i);
+
+		if (other -> key == definition -> key && other -> occurrence == definition -> occurrence) {
+			return other;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Replace definitions with the ones of the reloaded source
+ *
+ * Returns the number of added, changed and removed definitions and prints
+ * them when reloading. `outUpdate` is set if the same definitions are in the
+ * same order and only tracks, groups and instruments have changed, so they
+ * can be replaced in the playing song.
+ */
+static BKInt update_definitions (BKTKParserNode const * tree, BKInt * outUpdate)
+{
+	BKInt numChanged = 0;
+	BKInt update = liveCtx && definitions.len;
+	BKArray newDefinitions = BK_ARRAY_INIT (sizeof (struct definition));
+	struct definition * definition;
+	struct definition const * other;
+
+	if (collect_definitions (tree, &newDefinitions) != 0) {
+		BKArrayDispose (&newDefinitions);
+		return -1;
+	}
+
+	if (newDefinitions.len != definitions.len) {
+		update = 0;
+	}
+
+	for (BKUSize i = 0; i < newDefinitions.len; i ++) {
+		definition = BKArrayItemAt (&newDefinitions, i);
+		other = find_definition (&definitions, definition);
+
+		if (other != BKArrayItemAt (&definitions, i)) {
+			update = 0;
+		}
+
+		if (!other || other -> hash != definition -> hash) {
+			definition -> changed = 1;
+			update &= definition -> type != DEFINITION_OTHER;
+			numChanged ++;
+
+			if (liveCtx) {
+				print_message ("  %s %s (line %d)\n", other ? "changed" : "added",
+					definition -> name, definition -> offset.lineno);
 			}
-			case 'o': {
-				outputFilename = optarg;
-				flags |= FLAG_INFO | FLAG_NO_SOUND;
-				break;
+		}
+	}
+
+	for (BKUSize i = 0; i < definitions.len; i ++) {
+		definition = BKArrayItemAt (&definitions, i);
+
+		if (!find_definition (&newDefinitions, definition)) {
+			numChanged ++;
+
+			if (liveCtx) {
+				print_message ("  removed %s\n", definition -> name);
 			}
-			case 'r': {
-				sampleRate = atoi (optarg);
-				break;
+		}
+	}
+
+	BKArrayDispose (&definitions);
+	definitions = newDefinitions;
+
+	*outUpdate = update && numChanged;
+
+	return numChanged;
+}
+
+/**
+ * Compile changed definitions into context replacing them in the playing song
+ *
+ * Unchanged definitions are only declared, so all objects get the indices
+ * they have in the playing song. Global commands are compiled again if a
+ * global group has changed, as they are part of the global track.
+ */
+static BKInt compile_update (BKTKContext * ctx, BKTKParserNode const * tree)
+{
+	BKInt res;
+	BKInt changed;
+	BKInt groupChanged = 0;
+	BKUSize index = 0;
+	BKTKParserNode const * node;
+	struct definition const * definition;
+
+	for (BKUSize i = 0; i < definitions.len; i ++) {
+		definition = BKArrayItemAt (&definitions, i);
+
+		if (definition -> changed && definition -> type == DEFINITION_GROUP) {
+			groupChanged = 1;
+		}
+	}
+
+	// tracks are copied into context
+	compiler.numWorkers = 1;
+
+	if ((res = BKTKCompilerBegin (&compiler)) != 0) {
+		return res;
+	}
+
+	for (node = tree; node; node = node -> nextNode) {
+		if (node -> type == BKTKTypeComment) {
+			continue;
+		}
+
+		changed = groupChanged;
+
+		// group nodes are collected in order
+		if (node -> flags & BKTKParserFlagIsGroup) {
+			definition = BKArrayItemAt (&definitions, index ++);
+			changed = definition -> changed;
+		}
+
+		if (changed) {
+			res = BKTKCompilerPutNode (&compiler, node, NULL);
+		}
+		else {
+			res = BKTKCompilerDeclareNode (&compiler, node);
+		}
+
+		if (res != 0) {
+			return res;
+		}
+	}
+
+	return BKTKContextCreateUpdate (ctx, liveCtx, &compiler);
+}
+#endif /* BK_USE_WATCH */
+
+/**
+ * Read remaining contents of file
+ */
+static BKInt read_file (FILE * file, uint8_t ** outData, BKUSize * outSize)
+{
+	size_t size;
+	BKUSize capacity = 0;
+	uint8_t * data = NULL;
+	uint8_t * newData;
+
+	*outSize = 0;
+
+	do {
+		if (*outSize == capacity) {
+			capacity = BKMax (capacity * 2, 16 * 1024);
+			newData = realloc (data, capacity);
+
+			if (!newData) {
+				free (data);
+				return BK_ALLOCATION_ERROR;
 			}
-			case 't': {
-				if (strcmp (optarg, "s") == 0) {
-					flags |= FLAG_TIMING_UNIT_SECS;
-				}
-				else if (strcmp (optarg, "t") == 0) {
-					flags |= FLAG_TIMING_UNIT_TICKS;
-				}
-				else {
-					print_error ("Unknown timing unit '%s'; use 's' or 't'\n", optarg);
-					return -1;
-				}
 
-				break;
-			}
-			case 'y': {
-				flags |= FLAG_YES;
-				break;
-			}
-			default: {
-				print_help ();
+			data = newData;
+		}
+
+		size = fread (&data [*outSize], sizeof (uint8_t), capacity - *outSize, file);
+		*outSize += size;
+	}
+	while (size);
+
+	if (ferror (file)) {
+		free (data);
+		return BK_FILE_ERROR;
+	}
+
+	*outData = data;
+
+	return 0;
+}
+
+#if BK_USE_SDL
+/**
+ * Dispose context created with `BKTKContextCreatePreview`
+ *
+ * Tracks of other contexts and objects of the compiler are kept.
+ */
+static void preview_dispose (BKTKContext * preview)
+{
+	BKTKTrack ** track;
+
+	for (BKUSize i = 0; i < preview -> tracks.len; i ++) {
+		track = BKArrayItemAt (&preview -> tracks, i);
+
+		if (*track && (*track) -> ctx != preview) {
+			*track = NULL;
+		}
+	}
+
+	BKArrayEmpty (&preview -> instruments);
+	BKArrayEmpty (&preview -> waveforms);
+	BKArrayEmpty (&preview -> samples);
+	BKDispose (preview);
+	free (preview);
+}
+
+/**
+ * Start playing tracks compiled so far
+ */
+static void preview_start (void)
+{
+	BKTKContext * preview = calloc (1, sizeof (*preview));
+
+	if (!preview) {
+		return;
+	}
+
+	if (BKTKContextInit (preview, 0) != 0) {
+		free (preview);
+		return;
+	}
+
+	if (BKStringAppendString (&preview -> loadPath, &loadDir) != 0 ||
+		BKTKContextCreatePreview (preview, NULL, &compiler) != 0 ||
+		BKTKContextAttach (preview, &renderCtx) != 0) {
+		preview_dispose (preview);
+		previewState = PREVIEW_NONE;
+		return;
+	}
+
+	previewCtx = preview;
+	liveCtx = preview;
+	previewState = PREVIEW_STARTED;
+	atomic_store (&loadState, LOAD_PREVIEW);
+}
+
+/**
+ * Hand tracks compiled since the last batch to audio callback
+ *
+ * The tracks are run up to the playing beat without rendering; the audio
+ * callback appends them to the preview. No batch is made while the last one
+ * has not been taken, so tracks may be appended in larger batches.
+ */
+static void preview_append (void)
+{
+	BKTKContext * batch;
+
+	if (atomic_load (&pendingCtx) || atomic_load (&retiredCtx)) {
+		return;
+	}
+
+	batch = calloc (1, sizeof (*batch));
+
+	if (!batch) {
+		return;
+	}
+
+	if (BKTKContextInit (batch, 0) != 0) {
+		free (batch);
+		return;
+	}
+
+	if (BKStringAppendString (&batch -> loadPath, &loadDir) != 0 ||
+		BKTKContextCreatePreview (batch, previewCtx, &compiler) != 0 ||
+		batch -> sequence.len == 0 ||
+		BKTKContextFastForward (batch, atomic_load (&playTicks)) != 0) {
+		preview_dispose (batch);
+		return;
+	}
+
+	atomic_store (&pendingCtx, batch);
+}
+
+/**
+ * Play tracks as soon as they are compiled
+ *
+ * The preview is replaced by the complete song when it is loaded.
+ */
+static void preview_update (void)
+{
+	switch (previewState) {
+		case PREVIEW_COMPILING: {
+			preview_start ();
+			break;
+		}
+		case PREVIEW_STARTED: {
+			preview_append ();
+			break;
+		}
+	}
+}
+#endif /* BK_USE_SDL */
+
+/**
+ * Pass file to parser while reading it
+ *
+ * Nodes are compiled as soon as they are complete.
+ */
+static BKInt put_file_chunks (FILE * file)
+{
+	size_t size;
+	uint8_t chars [4096];
+	BKTKPutTokensFunc putTokens = (BKTKPutTokensFunc) BKTKParserPutTokens;
+
+	do {
+		size = fread (chars, sizeof (uint8_t), sizeof (chars), file);
+
+		if (ferror (file)) {
+			return BK_FILE_ERROR;
+		}
+
+		// size = 0 terminates tokenizer
+		BKTKTokenizerPutCharsBatched (&tok, chars, size, putTokens, &parser);
+	}
+	while (!BKTKTokenizerIsFinished (&tok));
+
+	return 0;
+}
+
+/**
+ * Compile node passed from parser
+ *
+ * Keeps the result to tell compiler errors from parser errors. Compiled
+ * tracks are played at once when loading progressively.
+ */
+static BKInt compile_node (BKTKCompiler * compiler, BKTKParserNode const * node, BKTKArena * nodes)
+{
+	BKEnum phase = stats_switch (STATS_PHASE_COMPILE);
+
+#if BK_USE_SDL
+	// node may be freed by compiler
+	BKInt isTrack = (node -> flags & BKTKParserFlagIsGroup) && BKStringCompare (&node -> name, "track") == 0;
+#endif
+
+	compileRes = BKTKCompilerPutNode (compiler, node, nodes);
+
+#if BK_USE_SDL
+	if (compileRes == 0 && isTrack) {
+		preview_update ();
+	}
+#endif
+
+	stats_switch (phase);
+
+	return compileRes;
+}
+
+/**
+ * Parse tokens passed from tokenizer
+ *
+ * Tokens are passed on the calling thread, so the time not spent here is
+ * spent tokenizing.
+ */
+static BKInt put_tokens (BKTKParser * parser, BKTKToken const * tokens, BKUSize count)
+{
+	BKInt res;
+	BKEnum phase = stats_switch (STATS_PHASE_PARSE);
+
+	res = BKTKParserPutTokens (parser, tokens, count);
+	stats_switch (phase);
+
+	return res;
+}
+
+/**
+ * Load file into context and attach it to render context
+ *
+ * The context is not attached if `renderContext` is NULL. When watching,
+ * returns `RELOAD_UNCHANGED` if the file was reloaded without changes and
+ * `RELOAD_UPDATE` if only the changed definitions have been compiled into
+ * `ctx` to be appended to the playing song.
+ */
+static BKInt make_context (BKTKContext * ctx, BKContext * renderContext, FILE * file, BKString * const loadPath)
+{
+	BKInt res = 0;
+	BKTKParserNode * nodeTree;
+	BKTKParserFlatTree flatTree;
+	uint8_t * source = NULL;
+	BKUSize sourceLen = 0;
+	BKInt streaming = !(flags & FLAG_WATCH);
+	BKEnum phase = statsPhase;
+#if BK_USE_WATCH
+	BKInt update = 0;
+#endif
+
+	if ((res = BKTKParserInit (&parser)) != 0) {
+		print_error ("BKTKParserInit failed (%s)\n", BKStatusGetName (res));
+		return res;
+	}
+
+	if ((res = BKTKTokenizerInit (&tok)) != 0) {
+		print_error ("BKTKTokenizerInit failed (%s)\n", BKStatusGetName (res));
+		BKDispose (&parser);
+		return res;
+	}
+
+	if ((res = BKTKCompilerInit (&compiler)) != 0) {
+		print_error ("BKTKCompilerInit failed (%s)\n", BKStatusGetName (res));
+		BKDispose (&tok);
+		BKDispose (&parser);
+		return res;
+	}
+
+#if BK_USE_WATCH
+	watchSourceLen = 0;
+#endif
+
+	compiler.symbols = &parser.symbols;
+
+#if BK_USE_WATCH
+	// objects are replaced by index when updating
+	compiler.keepObjects = (flags & FLAG_WATCH) != 0;
+#endif
+
+	// definitions are compared using the complete tree when watching
+	if (streaming) {
+		compileRes = 0;
+
+		if ((res = BKTKCompilerBegin (&compiler)) != 0) {
+			print_error ((char *) compiler.error.str);
+			goto cleanup;
+		}
+
+		BKTKParserSetPutNodeFunc (&parser, (BKTKParserPutNodeFunc) compile_node, &compiler);
+	}
+
+#if BK_USE_SDL
+	if (flags & FLAG_PROGRESSIVE) {
+		// tracks are copied as soon as they are compiled
+		compiler.numWorkers = 1;
+		previewState = PREVIEW_COMPILING;
+
+		if ((res = put_file_chunks (file)) != 0) {
+			print_error ("Failed to read file\n");
+			goto cleanup;
+		}
+	}
+	else
+#endif
+	{
+		stats_switch (STATS_PHASE_READ);
+
+		// complete source is needed to tokenize in parallel
+		if ((res = read_file (file, &source, &sourceLen)) != 0) {
+			print_error ("Failed to read file\n");
+			goto cleanup;
+		}
+
+#if BK_USE_WATCH
+		if (flags & FLAG_WATCH) {
+			if ((res = append_source (source, sourceLen)) != 0) {
+				print_error ("Allocation error\n");
+				goto cleanup;
+			}
+		}
+#endif
+
+		// also terminates tokenizer
+		stats_switch (STATS_PHASE_TOKENIZE);
+		BKTKTokenizerPutCharsParallel (&tok, source, sourceLen, (BKTKPutTokensFunc) put_tokens, &parser, 0);
+	}
+
+	stats_switch (STATS_PHASE_COMPILE);
+
+	if (compileRes) {
+		print_error ((char *) compiler.error.str);
+		res = compileRes;
+		goto cleanup;
+	}
+
+	if (BKTKTokenizerHasError (&tok)) {
+		print_error ("%s\n", tok.buffer);
+		res = -1;
+	}
+
+	if (BKTKParserHasError (&parser)) {
+		print_error ("%s\n", parser.buffer);
+		res = -1;
+	}
+
+	if (res) {
+		goto cleanup;
+	}
+
+	if (streaming) {
+		if ((res = BKTKCompilerEnd (&compiler)) != 0) {
+			print_error ((char *) compiler.error.str);
+			goto cleanup;
+		}
+	}
+	else {
+		// tree is walked for comparing definitions and by the compiler
+		if ((res = BKTKParserFlatTreeInit (&flatTree, BKTKParserGetNodeTree (&parser))) != 0) {
+			print_error ("Allocation error\n");
+			goto cleanup;
+		}
+
+		nodeTree = BKTKParserFlatTreeGetNodes (&flatTree);
+
+#if BK_USE_WATCH
+		// keep playing if nothing has changed
+		if (flags & FLAG_WATCH) {
+			if (update_definitions (nodeTree, &update) == 0 && liveCtx) {
+				res = RELOAD_UNCHANGED;
+			}
+			// audio callback takes one context at a time
+			else if (update && !atomic_load (&pendingCtx) && !atomic_load (&updateBatch)) {
+				if (compile_update (ctx, nodeTree) == 0) {
+					res = RELOAD_UPDATE;
+				}
+				else {
+					// compile complete song instead
+					BKTKCompilerReset (&compiler);
+					compiler.numWorkers = 0;
+					BKStringEmpty (&ctx -> error);
+				}
+			}
+		}
+#endif
+
+		if (res == 0 && (res = BKTKCompilerCompile (&compiler, nodeTree)) != 0) {
+			print_error ((char *) compiler.error.str);
+		}
+
+		// compiled objects do not reference nodes
+		BKDispose (&flatTree);
+
+		if (res) {
+			goto cleanup;
+		}
+	}
+
+	if ((res = BKStringReplaceInRange (&ctx -> loadPath, loadPath, 0, ctx -> loadPath.len)) != 0) {
+		print_error ("Allocation error\n");
+		goto cleanup;
+	}
+
+	stats_switch (STATS_PHASE_CREATE);
+
+	if ((res = BKTKContextCreate (ctx, &compiler)) != 0) {
+		print_error ("Creating context failed (%s)\n", BKStatusGetName (res));
+		print_error ((char *) ctx -> error.str);
+		goto cleanup;
+	}
+
+	if (renderContext && (res = BKTKContextAttach (ctx, renderContext)) != 0) {
+		print_error ("Attaching context failed (%s)\n", BKStatusGetName (res));
+		goto cleanup;
+	}
+
+cleanup:
+	stats_switch (phase);
+
+	compiler.symbols = NULL;
+
+#if BK_USE_SDL
+	// objects may still be played by the preview; compiler is disposed at exit
+	if (previewState != PREVIEW_STARTED) {
+		BKDispose (&compiler);
+	}
+#else
+	BKDispose (&compiler);
+#endif
+	BKDispose (&tok);
+	BKDispose (&parser);
+	free (source);
+
+	return res;
+}
+
+#if BK_USE_WATCH
+/**
+ * Watch directory of input file
+ *
+ * Editors often replace the file when saving, so the directory is watched
+ * and events are filtered by file name.
+ */
+static BKInt watch_init (BKString const * path, BKString const * loadPath)
+{
+	char const * dir;
+	BKString dirname = BK_STRING_INIT;
+
+	if (BKStringAppendString (&watchPath, path) != 0 || BKStringAppendString (&watchLoadPath, loadPath) != 0) {
+		print_error ("Allocation error\n");
+		return -1;
+	}
+
+	if (BKStringDirname (&watchPath, &dirname) != 0) {
+		print_error ("Allocation error\n");
+		return -1;
+	}
+
+	dir = dirname.len ? (char const *) dirname.str : ".";
+	watchName = strrchr ((char const *) watchPath.str, '/');
+	watchName = watchName ? watchName + 1 : (char const *) watchPath.str;
+
+	watchFd = inotify_init ();
+
+	if (watchFd < 0 || inotify_add_watch (watchFd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+		print_error ("Could not watch directory: %s\n", dir);
+		BKStringDispose (&dirname);
+		return -1;
+	}
+
+	BKStringDispose (&dirname);
+
+	return 0;
+}
+
+/**
+ * Read pending events and check if the input file was written
+ */
+static BKInt watch_read_events (void)
+{
+	ssize_t size;
+	BKInt changed = 0;
+	struct inotify_event const * event;
+	_Alignas (struct inotify_event) char buffer [4096];
+
+	size = read (watchFd, buffer, sizeof (buffer));
+
+	for (char const * ptr = buffer; ptr < buffer + size; ptr += sizeof (*event) + event -> len) {
+		event = (struct inotify_event const *) ptr;
+
+		if (event -> len && strcmp (event -> name, watchName) == 0) {
+			changed = 1;
+		}
+	}
+
+	return changed;
+}
+#endif /* BK_USE_WATCH */
+
+#if BK_USE_SDL
+static BKEnum count_tick (BKCallbackInfo * info, void * userInfo)
+{
+	atomic_fetch_add (&playTicks, 1);
+	info -> divider = 1;
+
+	return 0;
+}
+
+/**
+ * Count beat ticks of render context
+ *
+ * Reloaded contexts and preview tracks are resumed at this tick.
+ */
+static BKInt count_ticks (BKContext * renderContext)
+{
+	BKCallback callback;
+
+	callback.func = (BKCallbackFunc) count_tick;
+	callback.userInfo = NULL;
+
+	if (BKDividerInit (&tickDivider, 0, &callback) != 0) {
+		return -1;
+	}
+
+	if (BKContextAttachDivider (renderContext, &tickDivider, BK_CLOCK_TYPE_BEAT) != 0) {
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Dispose context and its render context
+ *
+ * Reloaded contexts share the static render context, which is kept.
+ */
+static void dispose_context (BKTKContext * ctx, BKContext * renderContext)
+{
+	BKDispose (ctx);
+	free (ctx);
+
+	if (renderContext && renderContext != &renderCtx) {
+		BKDispose (renderContext);
+		free (renderContext);
+	}
+}
+
+/**
+ * Dispose context handed back by audio callback
+ */
+static void collect_retired_context (void)
+{
+	BKTKContext * oldCtx = atomic_exchange (&retiredCtx, NULL);
+
+	// static context is disposed at exit
+	if (oldCtx && oldCtx != &ctx) {
+#if BK_USE_WATCH
+		// next update may be appended
+		if (oldCtx == atomic_load (&updateBatch)) {
+			atomic_store (&updateBatch, NULL);
+		}
+#endif
+
+		dispose_context (oldCtx, oldCtx -> renderContext);
+	}
+}
+
+static void sleep_usecs (long usecs);
+
+/**
+ * Load song progressively on separate thread
+ *
+ * The complete song replaces the preview when it is loaded.
+ */
+static void * load_song (void * arg)
+{
+	BKInt res;
+	BKTKContext * batch;
+
+	res = make_context (&ctx, NULL, loadFile, &loadDir);
+
+	if (loadFile != stdin) {
+		fclose (loadFile);
+	}
+
+	loadFile = NULL;
+
+	// last tracks are played by the song or not at all
+	if (previewState == PREVIEW_STARTED && (batch = atomic_exchange (&pendingCtx, NULL))) {
+		preview_dispose (batch);
+	}
+
+	if (res != 0) {
+		print_error ("Failed to load file: %s\n", filename);
+		atomic_store (&loadState, LOAD_FAILED);
+		return NULL;
+	}
+
+	if (previewState == PREVIEW_STARTED) {
+		if ((res = BKTKContextFastForward (&ctx, atomic_load (&playTicks))) != 0) {
+			print_error ("Fast-forwarding failed (%s)\n", BKStatusGetName (res));
+			print_error ((char *) ctx.error.str);
+			atomic_store (&loadState, LOAD_FAILED);
+			return NULL;
+		}
+
+		// audio callback hands back one context at a time
+		while (atomic_load (&retiredCtx)) {
+			sleep_usecs (1000);
+		}
+
+		atomic_store (&pendingCtx, &ctx);
+
+		while (atomic_load (&pendingCtx)) {
+			sleep_usecs (1000);
+		}
+	}
+	else if ((res = BKTKContextAttach (&ctx, &renderCtx)) != 0) {
+		print_error ("Attaching context failed (%s)\n", BKStatusGetName (res));
+		atomic_store (&loadState, LOAD_FAILED);
+		return NULL;
+	}
+
+	atomic_store (&loadState, LOAD_DONE);
+
+	return NULL;
+}
+
+/**
+ * Start loading song from file
+ *
+ * Returns when a preview is playable or the song is loaded.
+ */
+static BKInt start_loading (FILE * file, BKString const * loadPath)
+{
+	BKInt state;
+
+	loadFile = file;
+	atomic_init (&loadState, LOAD_RUNNING);
+
+	if (BKStringAppendString (&loadDir, loadPath) != 0) {
+		return -1;
+	}
+
+	if (pthread_create (&loadThread, NULL, load_song, NULL) != 0) {
+		print_error ("Could not create loader thread\n");
+		return -1;
+	}
+
+	while ((state = atomic_load (&loadState)) == LOAD_RUNNING) {
+		sleep_usecs (1000);
+	}
+
+	return state == LOAD_FAILED ? -1 : 0;
+}
+
+/**
+ * Get context to play after loading progressively
+ *
+ * Returns `playing` while the preview is still playing.
+ */
+static BKTKContext * loaded_context (BKTKContext * playing)
+{
+	if (atomic_load (&loadState) != LOAD_DONE) {
+		return playing;
+	}
+
+	liveCtx = &ctx;
+
+	return &ctx;
+}
+#endif /* BK_USE_SDL */
+
+#if BK_USE_WATCH
+/**
+ * Load changed input file into a new context
+ *
+ * The interpreters of the new context are run up to the playing beat without
+ * rendering. The audio callback applies the attributes they have set and
+ * continues playing on the same render context. If only tracks, groups or
+ * instruments have changed, the new context holds only the tracks containing
+ * changed code, which the audio callback appends to the playing context. The
+ * previous version keeps playing if the file has errors or nothing has
+ * changed.
+ */
+static void reload_song (void)
+{
+	BKInt res;
+	FILE * file;
+	BKTKContext * newCtx;
+	BKTKContext * oldCtx;
+
+	// audio callback hands back at most one context per reload
+	collect_retired_context ();
+
+	file = fopen ((char *) watchPath.str, "rb");
+
+	if (!file) {
+		print_error ("Could not open file: %s\n", watchPath.str);
+		return;
+	}
+
+	newCtx = calloc (1, sizeof (*newCtx));
+
+	if (!newCtx) {
+		print_error ("Allocation error\n");
+		goto cleanup;
+	}
+
+	if ((res = BKTKContextInit (newCtx, 0)) != 0) {
+		print_error ("Allocation error\n");
+		free (newCtx);
+		newCtx = NULL;
+		goto cleanup;
+	}
+
+	if ((res = make_context (newCtx, NULL, file, &watchLoadPath)) != 0 && res != RELOAD_UPDATE) {
+		if (res != RELOAD_UNCHANGED) {
+			print_notice ("Keeping previous version\n");
+		}
+
+		goto cleanup;
+	}
+
+	if ((res = BKTKContextFastForward (newCtx, atomic_load (&playTicks))) != 0) {
+		print_error ("Fast-forwarding failed (%s)\n", BKStatusGetName (res));
+		print_error ((char *) newCtx -> error.str);
+		print_notice ("Keeping previous version\n");
+		goto cleanup;
+	}
+
+	// playing context is kept
+	if (res == RELOAD_UPDATE) {
+		atomic_store (&updateBatch, newCtx);
+		atomic_store (&pendingCtx, newCtx);
+		print_notice ("Updated %s\n", filename);
+
+		fclose (file);
+
+		return;
+	}
+
+	// replace context if audio callback did not take the last one yet
+	oldCtx = atomic_exchange (&pendingCtx, newCtx);
+
+	if (oldCtx == atomic_load (&updateBatch)) {
+		atomic_store (&updateBatch, NULL);
+	}
+
+	if (oldCtx && oldCtx != &ctx) {
+		dispose_context (oldCtx, oldCtx -> renderContext);
+	}
+
+	liveCtx = newCtx;
+	print_notice ("Reloaded %s\n", filename);
+
+	fclose (file);
+
+	return;
+
+cleanup:
+	if (newCtx) {
+		dispose_context (newCtx, NULL);
+	}
+
+	fclose (file);
+}
+#endif /* BK_USE_WATCH */
+
+/**
+ * Read events captured with --capture and play them instead of the song
+ */
+static BKInt read_replay_log (BKTKContext * ctx)
+{
+	BKInt res;
+	FILE * file;
+
+	if ((res = BKTKEventLogInit (&replayLog)) != 0) {
+		print_error ("Allocation error\n");
+		return -1;
+	}
+
+	file = fopen (replayFilename, "rb");
+
+	if (!file) {
+		print_error ("No such file: %s\n", replayFilename);
+		return -1;
+	}
+
+	res = BKTKEventLogRead (&replayLog, file);
+	fclose (file);
+
+	if (res != 0) {
+		print_error ("Failed to read event log: %s (%s)\n", replayFilename, BKStatusGetName (res));
+		return -1;
+	}
+
+	BKTKContextSetReplayLog (ctx, &replayLog);
+
+	return 0;
+}
+
+static BKInt handle_options (BKTKContext * ctx, int argc, char * argv [])
+{
+	int    opt;
+	int    longoptind = 1;
+	BKUInt speed      = 0;
+	FILE * inputFile;
+	struct stat st;
+	BKString path = BK_STRING_INIT;
+	BKString loadPath = BK_STRING_INIT;
+	BKEnum opts = 0;
+
+	opterr = 0;
+
+#if BK_USE_SDL
+	flags = FLAG_INFO;
+#endif
+
+	while ((opt = getopt_long (argc, (void *) argv, "b:B:c:d:e:E:f:hil:no:pPr:st:vwy", options, &longoptind)) != -1) {
+		switch (opt) {
+			case 'b': {
+				benchFilename = optarg;
+				break;
+			}
+			case 'B': {
+				benchCompareFilename = optarg;
+				break;
+			}
+			case 'd': {
+				BKStringEmpty (&loadPath);
+
+				if (BKStringAppend (&loadPath, optarg) != 0) {
+					print_error ("Allocation error\n");
+					return -1;
+				}
+				break;
+			}
+			case 'e': {
+				captureFilename = optarg;
+				flags |= FLAG_NO_SOUND;
+				break;
+			}
+			case 'E': {
+				replayFilename = optarg;
+				break;
+			}
+			case 'f': {
+				flags |= FLAG_HAS_SEEK_TIME;
+				strncpy (seekTimeString, optarg, 64);
+				break;
+			}
+			case 'h':
+			case 'v': {
+				print_help ();
+				exit (1);
+				break;
+			}
+			case 'i': {
+				flags |= FLAG_INFO_EXPLICITE;
+				break;
+			}
+			case 'l': {
+				flags |= FLAG_HAS_END_TIME;
+				strncpy (endTimeString, optarg, 64);
+				break;
+			}
+			case 'n': {
+				flags |= FLAG_PRINT_NO_TIME;
+				break;
+			}
+			case 'c': {
+				nativeFilename = optarg;
+				flags |= FLAG_NO_SOUND;
+				break;
+			}
+			case 'o': {
+				outputFilename = optarg;
+				flags |= FLAG_INFO | FLAG_NO_SOUND;
+				break;
+			}
+			case 'p': {
+#if BK_TK_PROFILE
+				flags |= FLAG_PROFILE;
+#else
+				print_error ("Profiling support disabled. Configure with --enable-profile\n");
+				return -1;
+#endif
+				break;
+			}
+			case 'r': {
+				sampleRate = atoi (optarg);
+				break;
+			}
+			case 's': {
+				flags |= FLAG_STATS;
+				BKTKStatsSetEnabled (1);
+				BKTKStatsGetTime (&statsMark);
+				break;
+			}
+			case 't': {
+				if (strcmp (optarg, "s") == 0) {
+					flags |= FLAG_TIMING_UNIT_SECS;
+				}
+				else if (strcmp (optarg, "t") == 0) {
+					flags |= FLAG_TIMING_UNIT_TICKS;
+				}
+				else if (strcmp (optarg, "b") == 0) {
+					flags |= FLAG_TIMING_UNIT_TICKS | FLAG_TIMING_BINARY;
+				}
+				else {
+					print_error ("Unknown timing unit '%s'; use 's', 't' or 'b'\n", optarg);
+					return -1;
+				}
+
+				break;
+			}
+			case 'P': {
+#if BK_USE_SDL
+				flags |= FLAG_PROGRESSIVE;
+#else
+				print_error ("Progressive loading needs SDL support\n");
+				return -1;
+#endif
+				break;
+			}
+			case 'w': {
+#if BK_USE_WATCH
+				flags |= FLAG_WATCH;
+#else
+				print_error ("Watching input file is not supported on this system\n");
+				return -1;
+#endif
+				break;
+			}
+			case 'y': {
+				flags |= FLAG_YES;
+				break;
+			}
+			default: {
+				print_help ();
+
+				if (optind < argc) {
+					print_error ("Unknown option '%c' before %s\n", optopt, argv [optind]);
+				}
+				else {
+					print_error ("Unknown option '%c'\n", optopt);
+				}
+
+				exit (1);
+				break;
+			}
+		}
+	}
+
+	if (flags & FLAG_INFO_EXPLICITE) {
+		flags |= FLAG_INFO;
+	}
+
+	// all arguments are songs or results
+	if (benchFilename || benchCompareFilename) {
+		benchFiles    = &argv [optind];
+		numBenchFiles = argc - optind;
+
+		if (!benchFilename && numBenchFiles != 1) {
+			print_error ("--bench-compare needs a results file\n");
+			return -1;
+		}
+
+		// tracks end when repeating
+		flags = FLAG_NO_SOUND;
+
+		return 0;
+	}
+
+	if (optind <= argc) {
+		filename = argv [optind];
+	}
+	else {
+		print_help ();
+		return -1;
+	}
+
+	if (filename == NULL) {
+		print_help ();
+		print_error ("No input file given\n");
+		return -1;
+	}
+
+	if (outputFilename) {
+		// output file already exists
+		if (stat (outputFilename, &st) == 0) {
+			if (!S_ISREG (st.st_mode)) {
+				print_error ("Output file already exists and is not a file: %s\n", outputFilename);
+				return -1;
+			}
+
+			// ask if file should be overwritten
+			if (!(flags & FLAG_YES)) {
+				if (!should_overwrite_output (outputFilename)) {
+					print_error ("Not overwriting\n");
+					return -1;
+				}
+			}
+		}
+
+		if (string_ends_with (outputFilename, ".wav")) {
+			outputType = OUTPUT_TYPE_WAVE;
+		}
+		else if (string_ends_with (outputFilename, ".raw")) {
+			outputType = OUTPUT_TYPE_RAW;
+		}
+		else {
+			print_error ("Only .wav and .raw is supported for output\n");
+			return -1;
+		}
+
+		if (string_begins_with (outputFilename, "-")) {
+			outputFile = stdout;
+		}
+		else {
+			outputFile = fopen (outputFilename, "wb+");
+
+			if (outputFile == NULL) {
+				print_error ("Could not open output file: %s\n", outputFilename);
+				return -1;
+			}
+		}
+
+		if (outputType == OUTPUT_TYPE_WAVE) {
+			int res = BKWaveFileWriterInit (&waveWriter, outputFile, numChannels, sampleRate, 0);
+
+			if (res != 0) {
+				print_error ("Could not initialize WAVE writer: %s\n", BKStatusGetName (res));
+				return -1;
+			}
+		}
+	}
+#if !BK_USE_SDL
+	else if ((flags & FLAG_INFO) == 0 && !nativeFilename && !captureFilename) {
+		print_error ("SDL support disabled. Output file must be given\n");
+		return -1;
+	}
+#endif
+
+	if (outputFilename) {
+		opts = ((flags & FLAG_TIMING_UNIT_MASK) >> FLAG_TIMING_UNIT_SHIFT) << BKTKContextOptionTimingShift;
+	}
+
+	if (context_init (ctx, &renderCtx, numChannels, sampleRate, opts) != 0) {
+		return 1;
+	}
+
+	BKStringEmpty (&path);
+
+	if (BKStringAppend (&path, filename) != 0) {
+		return -1;
+	}
+
+	// use stdin
+	if (BKStringCompare (&path, "-") == 0) {
+		inputFile = stdin;
+	}
+	// use path
+	else {
+		if (stat ((char *) path.str, &st) < 0) {
+			print_error ("No such file: %s\n", path.str);
+			return -1;
+		}
+
+		if (S_ISDIR (st.st_mode)) {
+			if (BKStringAppend (&path, "/DATA.blip") < 0) {
+				return -1;
+			}
+		}
+
+		inputFile = fopen ((char *) path.str, "rb");
+
+		if (inputFile == NULL) {
+			print_error ("No such file: %s\n", path.str);
+			return -1;
+		}
+	}
+
+	// path set by option
+	if (loadPath.len) {
+		if (stat ((char *) loadPath.str, &st) < 0) {
+			print_error ("No such path for loading: %s\n", loadPath.str);
+			return -1;
+		}
+
+		if (!S_ISDIR (st.st_mode)) {
+			print_error ("Load path is not a directory: %s\n", loadPath.str);
+			return -1;
+		}
+
+		BKStringReplaceInRange (&ctx -> loadPath, &loadPath, 0, ctx -> loadPath.len);
+		BKStringDispose (&loadPath);
+
+		BKStringEmpty (&loadPath);
+		BKStringAppendString (&loadPath, &ctx -> loadPath);
+	}
+	// parent directory from input file
+	else {
+		if (BKStringDirname (&path, &loadPath) != 0) {
+			return -1;
+		}
+	}
+
+	if ((flags & FLAG_TIMING_UNIT_MASK) && outputFilename) {
+		BKString path = BK_STRING_INIT;
+
+		if (BKStringAppend (&path, outputFilename) != 0) {
+			print_error ("Allocation error\n");
+			return -1;
+		}
+
+		if (BKStringAppend (&path, (flags & FLAG_TIMING_BINARY) ? ".timing" : ".txt") != 0) {
+			print_error ("Allocation error\n");
+			return -1;
+		}
+
+		timingFile = fopen ((char *) path.str, (flags & FLAG_TIMING_BINARY) ? "wb" : "w");
+
+		if (!timingFile) {
+			print_error ("Could not open timing file: %s\n", path.str);
+			return -1;
+		}
+
+		BKStringDispose (&path);
+
+		// text needs all records of a track at once; collect them in a temporary file
+		timingSpool = tmpfile ();
+
+		if (!timingSpool) {
+			print_error ("Could not create temporary timing file\n");
+			return -1;
+		}
+
+		if (BKTKTimingQueueAlloc (&timingQueue, TIMING_QUEUE_CAPACITY) != 0) {
+			print_error ("Allocation error\n");
+			return -1;
+		}
+
+		ctx -> timingQueue = timingQueue;
+	}
+
+	if (flags & FLAG_WATCH) {
+		if (outputFilename) {
+			print_error ("--watch cannot be used with --output\n");
+			return -1;
+		}
+
+		if (inputFile == stdin) {
+			print_error ("--watch needs an input file\n");
+			return -1;
+		}
+	}
+
+	if (nativeFilename) {
+		if (outputFilename) {
+			print_error ("--emit-c cannot be used with --output\n");
+			return -1;
+		}
+
+		if (flags & (FLAG_WATCH | FLAG_PROGRESSIVE)) {
+			print_error ("--emit-c cannot be used with --watch or --progressive\n");
+			return -1;
+		}
+	}
+
+	if (captureFilename) {
+		if (outputFilename || nativeFilename || replayFilename) {
+			print_error ("--capture cannot be used with --output, --emit-c or --replay\n");
+			return -1;
+		}
+
+		if (flags & (FLAG_WATCH | FLAG_PROGRESSIVE)) {
+			print_error ("--capture cannot be used with --watch or --progressive\n");
+			return -1;
+		}
+	}
+
+	if (replayFilename) {
+		if (nativeFilename) {
+			print_error ("--replay cannot be used with --emit-c\n");
+			return -1;
+		}
+
+		if (flags & (FLAG_WATCH | FLAG_PROGRESSIVE)) {
+			print_error ("--replay cannot be used with --watch or --progressive\n");
+			return -1;
+		}
+	}
+
+#if BK_USE_SDL
+	if (flags & FLAG_PROGRESSIVE) {
+		if (outputFilename) {
+			print_error ("--progressive cannot be used with --output\n");
+			return -1;
+		}
+
+		if (flags & FLAG_WATCH) {
+			print_error ("--progressive cannot be used with --watch\n");
+			return -1;
+		}
+
+		// phases of loader thread are not measured
+		if (flags & FLAG_STATS) {
+			print_error ("--stats cannot be used with --progressive\n");
+			return -1;
+		}
+
+		// preview tracks are resumed at the playing beat
+		if (flags & FLAG_NO_SOUND) {
+			print_error ("--progressive cannot be used without sound\n");
+			return -1;
+		}
+
+		if (count_ticks (&renderCtx) != 0) {
+			return -1;
+		}
+
+		// loader thread closes input file
+		if (start_loading (inputFile, &loadPath) != 0) {
+			return 1;
+		}
+
+		if (liveCtx) {
+			ctx = liveCtx;
+		}
+	}
+	else
+#endif
+	if (make_context (ctx, &renderCtx, inputFile, &loadPath) != 0) {
+		print_error ("Failed to load file: %s\n", filename);
+		fclose (inputFile);
+		return 1;
+	}
+
+	if (replayFilename) {
+		if (read_replay_log (ctx) != 0) {
+			return -1;
+		}
+	}
+
+#if BK_USE_WATCH
+	if (flags & FLAG_WATCH) {
+		if (watch_init (&path, &loadPath) != 0 || count_ticks (ctx -> renderContext) != 0) {
+			return -1;
+		}
+
+		liveCtx = ctx;
+	}
+#endif
+
+#if BK_USE_SDL
+	if ((flags & FLAG_NO_SOUND) == 0) {
+		char const * error = NULL;
+
+		if (init_sdl (ctx, &error) < 0) {
+			print_error ("Could not initialize SDL: %s\n", error);
+			return -1;
+		}
+	}
+#endif
+
+	if (inputFile == stdin) {
+		flags |= FLAG_FROM_STDIN;
+	}
+	else if ((flags & FLAG_PROGRESSIVE) == 0) {
+		fclose (inputFile);
+	}
+
+	if (flags & FLAG_HAS_SEEK_TIME) {
+		speed = ctx -> info.stepTicks;
+
+		if (parse_seek_time (seekTimeString, &seekTime, speed) != 0) {
+			return -1;
+		}
+	}
+
+	if (flags & FLAG_HAS_END_TIME) {
+		speed = ctx -> info.stepTicks;
+
+		if (parse_seek_time (endTimeString, &endTime, speed) != 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void sleep_usecs (long usecs)
+{
+	struct timeval timeout;
+
+	timeout.tv_sec  = usecs / 1000000;
+	timeout.tv_usec = usecs % 1000000;
+
+	select (0, NULL, NULL, NULL, &timeout);
+}
+
+/**
+ * Write records from timing queue to spool file while rendering
+ */
+static void * timing_thread (void * arg)
+{
+	BKInt done;
+	BKUSize count;
+	BKTKTimingRecord records [TIMING_BATCH_SIZE];
+
+	do {
+		// check before draining to not miss the last records
+		done = atomic_load (&timingDone);
+
+		while ((count = BKTKTimingQueuePop (timingQueue, records, TIMING_BATCH_SIZE))) {
+			fwrite (records, sizeof (*records), count, timingSpool);
+		}
+
+		if (!done) {
+			sleep_usecs (1000);
+		}
+	}
+	while (!done);
+
+	return NULL;
+}
+
+static BKInt start_timing_thread (void)
+{
+	if (!timingFile) {
+		return 0;
+	}
+
+	atomic_init (&timingDone, 0);
+
+	if (pthread_create (&timingThread, NULL, timing_thread, NULL) != 0) {
+		print_error ("Could not create timing thread\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Wait if timing thread is behind to not drop records
+ */
+static void wait_timing_queue (void)
+{
+	if (!timingFile) {
+		return;
+	}
+
+	while (BKTKTimingQueueSize (timingQueue) > TIMING_QUEUE_CAPACITY / 2) {
+		sleep_usecs (100);
+	}
+}
+
+static void write_timing_line (struct timing_line const * line, BKUInt * lineno)
+{
+	if (line -> lineno != *lineno + 1) {
+		fprintf (timingFile, "l:%.5g:%u\n", line -> time, line -> lineno);
+	}
+	else {
+		fprintf (timingFile, "l:%.5g\n", line -> time);
+	}
+
+	*lineno = line -> lineno;
+}
+
+/**
+ * Read line records from spool file sorted by track
+ *
+ * Tick rate changes apply to all tracks, so times are converted while
+ * reading. The lines of track `i` are at `starts [i]` up to `starts [i + 1]`.
+ */
+static BKInt read_timing_lines (struct timing_line ** outLines, BKUSize starts [], BKUSize numTracks)
+{
+	BKUSize count;
+	BKUInt factor = 1;
+	BKUInt divisor = BK_DEFAULT_CLOCK_RATE;
+	struct timing_line * lines;
+	struct timing_line * line;
+	BKTKTimingRecord const * record;
+	BKTKTimingRecord records [TIMING_BATCH_SIZE];
+
+	memset (starts, 0, (numTracks + 1) * sizeof (*starts));
+	rewind (timingSpool);
+
+	// count lines of each track
+	while ((count = fread (records, sizeof (*records), TIMING_BATCH_SIZE, timingSpool)) > 0) {
+		for (BKUSize i = 0; i < count; i ++) {
+			record = &records [i];
+
+			if (record -> type == BKTKTimingRecordTypeLine && record -> track < numTracks) {
+				starts [record -> track + 1] ++;
+			}
+		}
+	}
+
+	for (BKUSize i = 1; i <= numTracks; i ++) {
+		starts [i] += starts [i - 1];
+	}
+
+	lines = malloc ((starts [numTracks] + 1) * sizeof (*lines));
+
+	if (!lines) {
+		return -1;
+	}
+
+	rewind (timingSpool);
+
+	// `starts [i]` is used as write position of track `i - 1`
+	while ((count = fread (records, sizeof (*records), TIMING_BATCH_SIZE, timingSpool)) > 0) {
+		for (BKUSize i = 0; i < count; i ++) {
+			record = &records [i];
+
+			if (record -> type == BKTKTimingRecordTypeTickRate) {
+				factor  = record -> lineno >> 16;
+				divisor = record -> lineno & 0xFFFF;
+			}
+			else if (record -> track < numTracks) {
+				line = &lines [starts [record -> track] ++];
+				line -> time   = record -> tick;
+				line -> lineno = record -> lineno;
+
+				if (flags & FLAG_TIMING_UNIT_SECS) {
+					line -> time = line -> time * factor / divisor;
+				}
+			}
+		}
+	}
+
+	// restore start positions
+	for (BKUSize i = numTracks; i > 0; i --) {
+		starts [i] = starts [i - 1];
+	}
+
+	starts [0] = 0;
+	*outLines = lines;
+
+	return 0;
+}
+
+static void write_timing_text (void)
+{
+	BKEnum waveform;
+	BKTKTrack * track;
+	BKUInt lineno;
+	BKUSize index;
+	BKUSize numTracks = ctx.tracks.len;
+	BKUSize * starts;
+	struct timing_line * lines = NULL;
+	char name [64];
+	char const * unit = "";
+
+	starts = malloc ((numTracks + 1) * sizeof (*starts));
+
+	if (!starts || read_timing_lines (&lines, starts, numTracks) != 0) {
+		print_error ("Allocation error\n");
+		free (starts);
+		return;
+	}
+
+	if (flags & FLAG_TIMING_UNIT_SECS) {
+		unit = "seconds";
+	}
+
+	if (flags & FLAG_TIMING_UNIT_TICKS) {
+		unit = "ticks";
+	}
+
+	fprintf (
+		timingFile,
+		"%% Timing data for tracks contained in '%s'\n"
+		"%%\n"
+		"%% [track:{waveformtype}:{tracknumber}\n"
+		"%% l:{tick}:{lineno}\n"
+		"%% ...\n"
+		"%% ]\n"
+		"%%\n"
+		"%% If 'lineno' is ommited, the line follows the previous one\n"
+		"%%\n"
+		"%% Using unit '%s'\n"
+		"\n",
+		outputFilename, unit
+	);
+
+	for (BKUSize i = 0; i < ctx.tracks.len; i ++) {
+		track = *(BKTKTrack **) BKArrayItemAt (&ctx.tracks, i);
+
+		if (!track) {
+			continue;
+		}
+
+		waveform = track -> waveform;
+
+		if (i > 0) {
+			fprintf (timingFile, "\n");
+		}
+
+		waveform_get_name (track, name, sizeof (name), waveform, NULL);
+		fprintf (timingFile, "[track:%s:%d\n", name, track -> object.index);
+
+		lineno = 0;
+		index = track -> object.index;
+
+		if (index < numTracks) {
+			for (BKUSize j = starts [index]; j < starts [index + 1]; j ++) {
+				write_timing_line (&lines [j], &lineno);
+			}
+		}
+
+		fprintf (timingFile, "]\n");
+	}
+
+	free (starts);
+	free (lines);
+}
+
+static void write_timing_data (void)
+{
+	BKUSize numDropped;
+
+	if (!timingFile) {
+		return;
+	}
+
+	atomic_store (&timingDone, 1);
+	pthread_join (timingThread, NULL);
+
+	numDropped = BKTKTimingQueueNumDropped (timingQueue);
+
+	if (numDropped) {
+		print_notice ("Timing data incomplete: %zu records dropped\n", numDropped);
+	}
+
+	if (flags & FLAG_TIMING_BINARY) {
+		if (BKTKTimingIndexWrite (timingFile, timingSpool) != 0) {
+			print_error ("Could not write timing index\n");
+		}
+	}
+	else {
+		write_timing_text ();
+	}
+
+	fclose (timingSpool);
+	fclose (timingFile);
+
+	ctx.timingQueue = NULL;
+	BKDispose (timingQueue);
+}
+
+static void cleanup (void)
+{
+#if BK_USE_SDL
+	if ((flags & FLAG_NO_SOUND) == 0) {
+		SDL_CloseAudio ();
+	}
+#endif
+
+	if (outputFile) {
+		if (outputType == OUTPUT_TYPE_WAVE) {
+			BKWaveFileWriterTerminate (&waveWriter);
+			BKDispose (&waveWriter);
+		}
+
+		if (outputFile != stdout) {
+			fclose (outputFile);
+		}
+	}
+
+#if BK_USE_SDL
+	if (flags & FLAG_PROGRESSIVE) {
+		// loader may still be reading; contexts are released at exit
+		if (atomic_load (&loadState) == LOAD_PREVIEW) {
+			return;
+		}
+
+		pthread_join (loadThread, NULL);
+		BKStringDispose (&loadDir);
+	}
+
+	if (flags & (FLAG_WATCH | FLAG_PROGRESSIVE)) {
+		BKTKContext * oldCtx;
+
+		collect_retired_context ();
+
+		if ((oldCtx = atomic_exchange (&pendingCtx, NULL)) && oldCtx != &ctx) {
+			dispose_context (oldCtx, oldCtx -> renderContext);
+		}
+
+		if (playCtx && playCtx != &ctx) {
+			dispose_context (playCtx, playCtx -> renderContext);
+		}
+	}
+
+	// objects were shared with the preview
+	if (previewState == PREVIEW_STARTED) {
+		BKDispose (&compiler);
+	}
+#endif
+
+#if BK_USE_WATCH
+	if (flags & FLAG_WATCH) {
+		close (watchFd);
+		free (watchSource);
+		BKArrayDispose (&definitions);
+		BKStringDispose (&watchPath);
+		BKStringDispose (&watchLoadPath);
+	}
+#endif
+
+	BKDispose (&ctx);
+
+	if (replayFilename) {
+		BKDispose (&replayLog);
+	}
+}
+
+static BKInt write_native_chunk (FILE * file, uint8_t const * data, BKUSize size)
+{
+	return fwrite (data, sizeof (uint8_t), size, file) == size ? 0 : BK_FILE_ERROR;
+}
+
+/**
+ * Write song as C source
+ *
+ * The song is named after the output file.
+ */
+static BKInt write_native (BKTKContext * ctx)
+{
+	BKInt res;
+	FILE * file = stdout;
+	char name [64];
+	char const * base;
+	BKUSize len = 0;
+
+	base = strrchr (nativeFilename, '/');
+	base = base ? base + 1 : nativeFilename;
+
+	// must be a valid identifier
+	if (isdigit ((unsigned char) base [0])) {
+		name [len ++] = '_';
+	}
+
+	for (; *base && *base != '.' && len < sizeof (name) - 1; base ++) {
+		name [len ++] = isalnum ((unsigned char) *base) ? *base : '_';
+	}
+
+	if (len == 0) {
+		strcpy (name, "song");
+	}
+	else {
+		name [len] = '\0';
+	}
+
+	if (strcmp (nativeFilename, "-") != 0) {
+		file = fopen (nativeFilename, "w");
+
+		if (!file) {
+			print_error ("Could not open output file: %s\n", nativeFilename);
+			return -1;
+		}
+	}
+
+	res = BKTKNativeWrite (ctx, name, (BKTKWriterWriteFunc) write_native_chunk, file);
+
+	if (res != 0) {
+		print_error ("Failed to write C source (%s)\n", BKStatusGetName (res));
+	}
+
+	if (file != stdout) {
+		fclose (file);
+	}
+
+	return res;
+}
+
+/**
+ * Run song without rendering and write attribute events
+ *
+ * The song is run in chunks of one step so it stops at the same position as
+ * when writing to an output file. `--end-time` is converted to ticks at the
+ * default tick rate.
+ */
+static BKInt write_capture (BKTKContext * ctx)
+{
+	BKInt res = 0;
+	FILE * file = stdout;
+	BKTKEventLog log;
+	uint64_t endTick = UINT64_MAX;
+	uint64_t chunkTicks = BKMax (ctx -> info.stepTicks, 1);
+
+	if (flags & FLAG_HAS_END_TIME) {
+		endTick = (uint64_t) BKTimeGetTime (endTime) * 240 / sampleRate;
+	}
+
+	if (BKTKEventLogInit (&log) != 0) {
+		print_error ("Allocation error\n");
+		return -1;
+	}
+
+	while (check_tracks_running (ctx) && ctx -> beatTime < endTick) {
+		wait_timing_queue ();
+
+		if ((res = BKTKContextCapture (ctx, &log, BKMin (ctx -> beatTime + chunkTicks, endTick))) != 0) {
+			print_error ("Failed to capture song (%s)\n", BKStatusGetName (res));
+			goto cleanup;
+		}
+	}
+
+	if (strcmp (captureFilename, "-") != 0) {
+		file = fopen (captureFilename, "wb");
+
+		if (!file) {
+			print_error ("Could not open output file: %s\n", captureFilename);
+			res = -1;
+			goto cleanup;
+		}
+	}
+
+	if ((res = BKTKEventLogWrite (&log, file)) != 0) {
+		print_error ("Failed to write event log (%s)\n", BKStatusGetName (res));
+	}
+
+	if (file != stdout) {
+		fclose (file);
+	}
+
+cleanup:
+	BKDispose (&log);
+
+	return res;
+}
 
-				if (optind < argc) {
-					print_error ("Unknown option '%c' before %s\n", optopt, argv [optind]);
-				}
-				else {
-					print_error ("Unknown option '%c'\n", optopt);
-				}
+static BKInt write_output (BKTKContext * ctx)
+{
+	BKInt numFrames = 512;
+	BKInt numChannels = ctx -> renderContext -> numChannels;
+	BKFrame * frames = malloc (numFrames * numChannels * sizeof (BKFrame));
+	BKEnum phase;
 
-				exit (1);
+	if (frames == NULL) {
+		return -1;
+	}
+
+	phase = stats_switch (STATS_PHASE_RENDER);
+
+	while (check_tracks_running (ctx)) {
+		wait_timing_queue ();
+		BKContextGenerate (ctx -> renderContext, frames, numFrames);
+		output_chunk (frames, numFrames * numChannels);
+
+		if (flags & FLAG_HAS_END_TIME) {
+			if (BKTimeIsGreaterEqual (ctx -> renderContext -> currentTime, endTime)) {
 				break;
 			}
 		}
 	}
 
-	if (flags & FLAG_INFO_EXPLICITE) {
-		flags |= FLAG_INFO;
+	stats_switch (phase);
+	free (frames);
+
+	return 0;
+}
+
+/**
+ * Get monotonic time in seconds
+ */
+static double bench_seconds (void)
+{
+	struct timespec time;
+
+	clock_gettime (CLOCK_MONOTONIC, &time);
+
+	return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+static BKInt bench_discard_tokens (void * arg, BKTKToken const * tokens, BKUSize count)
+{
+	return 0;
+}
+
+/**
+ * Tokenize source
+ *
+ * Returns the elapsed seconds or -1 on error.
+ */
+static double bench_tokenize (uint8_t const * source, BKUSize size)
+{
+	double time;
+
+	if (BKTKTokenizerInit (&tok) != 0) {
+		print_error ("Allocation error\n");
+		return -1;
 	}
 
-	if (optind <= argc) {
-		filename = argv [optind];
+	time = bench_seconds ();
+	BKTKTokenizerPutCharsParallel (&tok, source, size, bench_discard_tokens, NULL, 0);
+	time = bench_seconds () - time;
+
+	if (BKTKTokenizerHasError (&tok)) {
+		print_error ("%s\n", tok.buffer);
+		time = -1;
 	}
-	else {
-		print_help ();
+
+	BKDispose (&tok);
+
+	return time;
+}
+
+/**
+ * Tokenize and parse source into node tree
+ *
+ * Returns the elapsed seconds or -1 on error.
+ */
+static double bench_parse (uint8_t const * source, BKUSize size)
+{
+	double time;
+
+	if (BKTKParserInit (&parser) != 0 || BKTKTokenizerInit (&tok) != 0) {
+		print_error ("Allocation error\n");
 		return -1;
 	}
 
-	if (filename == NULL) {
-		print_help ();
-		print_error ("No input file given\n");
+	time = bench_seconds ();
+	BKTKParserPutChars (&parser, &tok, source, size);
+	time = bench_seconds () - time;
+
+	if (BKTKTokenizerHasError (&tok) || BKTKParserHasError (&parser)) {
+		print_error ("%s\n", BKTKTokenizerHasError (&tok) ? tok.buffer : parser.buffer);
+		time = -1;
+	}
+
+	BKDispose (&tok);
+	BKDispose (&parser);
+
+	return time;
+}
+
+/**
+ * Compile source as when playing and create context from it
+ *
+ * `ctx` has to be initialized.
+ */
+static BKInt bench_load (BKTKContext * ctx, BKContext * renderContext, uint8_t const * source, BKUSize size, BKString const * loadPath, double * outCompileTime, double * outCreateTime)
+{
+	BKInt res;
+	double time;
+
+	if ((res = BKTKParserInit (&parser)) != 0 || (res = BKTKTokenizerInit (&tok)) != 0 || (res = BKTKCompilerInit (&compiler)) != 0) {
+		print_error ("Allocation error\n");
+		return res;
+	}
+
+	compiler.symbols = &parser.symbols;
+	compileRes = 0;
+
+	time = bench_seconds ();
+
+	if ((res = BKTKCompilerBegin (&compiler)) != 0) {
+		print_error ((char *) compiler.error.str);
+		goto cleanup;
+	}
+
+	BKTKParserSetPutNodeFunc (&parser, (BKTKParserPutNodeFunc) compile_node, &compiler);
+	BKTKParserPutChars (&parser, &tok, source, size);
+
+	if (compileRes) {
+		print_error ((char *) compiler.error.str);
+		res = compileRes;
+		goto cleanup;
+	}
+
+	if (BKTKTokenizerHasError (&tok) || BKTKParserHasError (&parser)) {
+		print_error ("%s\n", BKTKTokenizerHasError (&tok) ? tok.buffer : parser.buffer);
+		res = -1;
+		goto cleanup;
+	}
+
+	if ((res = BKTKCompilerEnd (&compiler)) != 0) {
+		print_error ((char *) compiler.error.str);
+		goto cleanup;
+	}
+
+	*outCompileTime = bench_seconds () - time;
+
+	if ((res = BKStringReplaceInRange (&ctx -> loadPath, loadPath, 0, ctx -> loadPath.len)) != 0) {
+		print_error ("Allocation error\n");
+		goto cleanup;
+	}
+
+	time = bench_seconds ();
+
+	if ((res = BKTKContextCreate (ctx, &compiler)) != 0) {
+		print_error ("Creating context failed (%s)\n", BKStatusGetName (res));
+		print_error ((char *) ctx -> error.str);
+		goto cleanup;
+	}
+
+	*outCreateTime = bench_seconds () - time;
+
+	if ((res = BKTKContextAttach (ctx, renderContext)) != 0) {
+		print_error ("Attaching context failed (%s)\n", BKStatusGetName (res));
+		goto cleanup;
+	}
+
+cleanup:
+	compiler.symbols = NULL;
+	BKDispose (&compiler);
+	BKDispose (&tok);
+	BKDispose (&parser);
+
+	return res;
+}
+
+/**
+ * Render song until all tracks have stopped or repeated
+ *
+ * Returns the elapsed seconds or -1 on error.
+ */
+static double bench_render (BKTKContext * ctx, double * outSongTime)
+{
+	double time;
+	BKInt numFrames = 512;
+	BKInt numChannels = ctx -> renderContext -> numChannels;
+	BKUSize maxFrames = (BKUSize) BENCH_MAX_SECONDS * sampleRate;
+	BKUSize totalFrames = 0;
+	BKFrame * frames = malloc (numFrames * numChannels * sizeof (BKFrame));
+
+	if (frames == NULL) {
+		print_error ("Allocation error\n");
 		return -1;
 	}
 
-	if (outputFilename) {
-		// output file already exists
-		if (stat (outputFilename, &st) == 0) {
-			if (!S_ISREG (st.st_mode)) {
-				print_error ("Output file already exists and is not a file: %s\n", outputFilename);
-				return -1;
+	time = bench_seconds ();
+
+	while (check_tracks_running (ctx) && totalFrames < maxFrames) {
+		BKContextGenerate (ctx -> renderContext, frames, numFrames);
+		totalFrames += numFrames;
+	}
+
+	time = bench_seconds () - time;
+	*outSongTime = (double) totalFrames / sampleRate;
+
+	free (frames);
+
+	return time;
+}
+
+/**
+ * Measure song
+ *
+ * Front end stages and context creation are run `BENCH_RUNS` times and the
+ * fastest run is reported. The song is rendered once.
+ */
+static BKInt bench_song (uint8_t const * source, BKUSize size, BKString const * loadPath, struct bench_result * result)
+{
+	BKInt res = 0;
+	double time;
+	double compileTime = 0.0, createTime = 0.0;
+	double renderTime = 0.0, songTime = 0.0;
+	double best [BENCH_VALUE_COUNT];
+	double megabytes = size * 1e-6;
+
+	for (BKInt i = 0; i < BENCH_VALUE_COUNT; i ++) {
+		best [i] = INFINITY;
+	}
+
+	for (BKInt run = 0; run < BENCH_RUNS; run ++) {
+		if ((time = bench_tokenize (source, size)) < 0) {
+			return -1;
+		}
+
+		best [BENCH_VALUE_TOKENIZE] = fmin (best [BENCH_VALUE_TOKENIZE], time);
+
+		if ((time = bench_parse (source, size)) < 0) {
+			return -1;
+		}
+
+		best [BENCH_VALUE_PARSE] = fmin (best [BENCH_VALUE_PARSE], time);
+
+		if ((res = context_init (&ctx, &renderCtx, numChannels, sampleRate, 0)) != 0) {
+			return res;
+		}
+
+		res = bench_load (&ctx, &renderCtx, source, size, loadPath, &compileTime, &createTime);
+
+		if (res == 0) {
+			best [BENCH_VALUE_COMPILE] = fmin (best [BENCH_VALUE_COMPILE], compileTime);
+			best [BENCH_VALUE_CREATE]  = fmin (best [BENCH_VALUE_CREATE], createTime);
+
+			if (run == BENCH_RUNS - 1) {
+				if ((renderTime = bench_render (&ctx, &songTime)) < 0) {
+					res = -1;
+				}
 			}
+		}
 
-			// ask if file should be overwritten
-			if (!(flags & FLAG_YES)) {
-				if (!should_overwrite_output (outputFilename)) {
-					print_error ("Not overwriting\n");
-					return -1;
+		BKDispose (&ctx);
+		BKDispose (&renderCtx);
+
+		if (res != 0) {
+			return res;
+		}
+	}
+
+	// timer may not resolve tiny songs
+	result -> values [BENCH_VALUE_BYTES]        = size;
+	result -> values [BENCH_VALUE_TOKENIZE]     = megabytes / fmax (best [BENCH_VALUE_TOKENIZE], 1e-9);
+	result -> values [BENCH_VALUE_PARSE]        = megabytes / fmax (best [BENCH_VALUE_PARSE], 1e-9);
+	result -> values [BENCH_VALUE_COMPILE]      = megabytes / fmax (best [BENCH_VALUE_COMPILE], 1e-9);
+	result -> values [BENCH_VALUE_CREATE]       = best [BENCH_VALUE_CREATE] * 1e3;
+	result -> values [BENCH_VALUE_SONG_SECONDS] = songTime;
+	result -> values [BENCH_VALUE_REALTIME]     = songTime / fmax (renderTime, 1e-9);
+
+	return 0;
+}
+
+/**
+ * Append base64 encoded sawtooth as 16 bit samples
+ */
+static BKInt bench_append_data (BKString * source, BKUSize size)
+{
+	static char const chars [] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	BKInt res;
+	uint8_t bytes [3];
+	char line [4096 + 1];
+	BKUSize len = 0;
+	uint32_t value;
+
+	for (BKUSize i = 0; i < size; i += 3) {
+		for (BKUSize j = 0; j < 3; j ++) {
+			// little endian; high byte is the ramp
+			bytes [j] = ((i + j) & 1) ? (uint8_t) ((i + j) >> 1) : 0;
+		}
+
+		value = (bytes [0] << 16) | (bytes [1] << 8) | bytes [2];
+
+		line [len ++] = chars [(value >> 18) & 63];
+		line [len ++] = chars [(value >> 12) & 63];
+		line [len ++] = chars [(value >> 6) & 63];
+		line [len ++] = chars [value & 63];
+
+		if (len == sizeof (line) - 1) {
+			line [len] = '\0';
+
+			if ((res = BKStringAppend (source, line)) != 0) {
+				return res;
+			}
+
+			len = 0;
+		}
+	}
+
+	line [len] = '\0';
+
+	return BKStringAppend (source, line);
+}
+
+/**
+ * Write synthetic stress song with `index` to `source`
+ *
+ * Returns the name of the song or NULL if there is no such song.
+ */
+static char const * bench_make_song (BKInt index, BKString * source, BKInt * outRes)
+{
+	static char const * notes [] = {"c", "d#", "g", "a#", "f", "g#"};
+	BKInt res = 0;
+	char const * name = NULL;
+
+	BKStringEmpty (source);
+
+	switch (index) {
+		// sequencer and renderer with many tracks
+		case 0: {
+			name = "synthetic:many-tracks";
+			res |= BKStringAppend (source, "stepticks:6\n");
+
+			for (BKInt i = 0; i < BENCH_MANY_TRACKS; i ++) {
+				res |= BKStringAppendFormat (source, "[track:%s\n\tv:16\n", (i & 1) ? "triangle" : "square");
+
+				for (BKInt j = 0; j < 128; j ++) {
+					res |= BKStringAppendFormat (source, "\ta:%s%d;s:1;r;s:1\n", notes [(i + j) % 6], 2 + (i + j / 6) % 5);
 				}
+
+				res |= BKStringAppend (source, "]\n");
 			}
+
+			break;
 		}
+		// groups calling each other up to the interpreter stack size
+		case 1: {
+			name = "synthetic:deep-groups";
+			res |= BKStringAppend (source, "stepticks:2\n");
 
-		if (string_ends_with (outputFilename, ".wav")) {
-			outputType = OUTPUT_TYPE_WAVE;
+			for (BKInt i = 0; i < 8; i ++) {
+				res |= BKStringAppend (source, "[track:square\n\tv:32\n");
+
+				for (BKInt j = 0; j < BENCH_GROUP_DEPTH; j ++) {
+					res |= BKStringAppendFormat (source, "\t[grp:%d\n\t\ta:%s%d;s:1;r\n", j, notes [(i + j) % 6], 2 + j % 5);
+
+					if (j < BENCH_GROUP_DEPTH - 1) {
+						res |= BKStringAppendFormat (source, "\t\tg:%d\n", j + 1);
+					}
+
+					res |= BKStringAppend (source, "\t]\n");
+				}
+
+				for (BKInt j = 0; j < 64; j ++) {
+					res |= BKStringAppend (source, "\tg:0\n");
+				}
+
+				res |= BKStringAppend (source, "]\n");
+			}
+
+			break;
+		}
+		// tokenizer with a large base64 sample
+		case 2: {
+			name = "synthetic:large-data";
+			res |= BKStringAppend (source, "[samp:ramp\n\tdata:1:16sl:!\"");
+			res |= bench_append_data (source, BENCH_DATA_SIZE);
+			res |= BKStringAppend (source, "\"\n]\n[track:sample\n\td:ramp\n\tv:128\n\ta:c4;s:64;r\n]\n");
+			break;
+		}
+		// compiler with many named commands and arguments
+		case 3: {
+			static char const * effects [] = {"pr", "vb", "tr", "ps", "vs"};
+
+			name = "synthetic:large-song";
+			res |= BKStringAppend (source, "stepticks:12\n");
+
+			for (BKInt i = 0; i < 64; i ++) {
+				res |= BKStringAppendFormat (source, "[instr:%d\n\tv:255:192:%d:96:48:0\n\ta:0:%d:0:-%d:0\n]\n", i, 128 + i, i * 10, i * 5);
+			}
+
+			for (BKInt i = 0; i < BENCH_COMPILE_TRACKS; i ++) {
+				res |= BKStringAppendFormat (source, "[track:%s\n\tv:%d;pw:%d;dc:%d\n", (i & 1) ? "sawtooth" : "square", 64 + i % 128, 1 + i % 8, 4 + i % 8);
+
+				for (BKInt j = 0; j < 16; j ++) {
+					res |= BKStringAppendFormat (source, "\t[grp:%d\n", j);
+
+					for (BKInt k = 0; k < 64; k ++) {
+						BKInt n = i + j + k;
+
+						res |= BKStringAppendFormat (source, "\ti:%d;e:%s:%d:%d;a:%s%d;s:1/%d;at:%d;r;e:%s;s:3/%d\n",
+							n % 64, effects [n % 5], 2 + n % 24, 20 + n % 100, notes [n % 6], 1 + n % 6, 2 + n % 3, n % 4,
+							effects [n % 5], 2 + n % 3);
+					}
+
+					res |= BKStringAppend (source, "\t]\n");
+				}
+
+				for (BKInt j = 0; j < 16; j ++) {
+					res |= BKStringAppendFormat (source, "\tg:%d;pt:%d\n", j, j % 3 - 1);
+				}
+
+				res |= BKStringAppend (source, "]\n");
+			}
+
+			break;
+		}
+	}
+
+	*outRes = res ? BK_ALLOCATION_ERROR : 0;
+
+	return name;
+}
+
+/**
+ * Write string as JSON string
+ */
+static void bench_write_string (FILE * file, char const * str)
+{
+	fputc ('"', file);
+
+	for (; *str; str ++) {
+		if (*str == '"' || *str == '\\') {
+			fprintf (file, "\\%c", *str);
 		}
-		else if (string_ends_with (outputFilename, ".raw")) {
-			outputType = OUTPUT_TYPE_RAW;
+		else if ((unsigned char) *str < 0x20) {
+			fprintf (file, "\\u%04x", *str);
 		}
 		else {
-			print_error ("Only .wav and .raw is supported for output\n");
-			return -1;
+			fputc (*str, file);
 		}
+	}
 
-		if (string_begins_with (outputFilename, "-")) {
-			outputFile = stdout;
-		}
-		else {
-			outputFile = fopen (outputFilename, "wb+");
+	fputc ('"', file);
+}
 
-			if (outputFile == NULL) {
-				print_error ("Could not open output file: %s\n", outputFilename);
-				return -1;
-			}
-		}
+/**
+ * Write results as JSON
+ *
+ * Each song is written on a single line to be read by --bench-compare.
+ */
+static BKInt bench_write_results (char const * path, BKArray const * results)
+{
+	FILE * file;
+	struct bench_result const * result;
 
-		if (outputType == OUTPUT_TYPE_WAVE) {
-			int res = BKWaveFileWriterInit (&waveWriter, outputFile, numChannels, sampleRate, 0);
+	file = fopen (path, "w");
 
-			if (res != 0) {
-				print_error ("Could not initialize WAVE writer: %s\n", BKStatusGetName (res));
-				return -1;
-			}
-		}
-	}
-#if !BK_USE_SDL
-	else if ((flags & FLAG_INFO) == 0) {
-		print_error ("SDL support disabled. Output file must be given\n");
+	if (!file) {
+		print_error ("Could not open output file: %s\n", path);
 		return -1;
 	}
-#endif
 
-	if (outputFilename) {
-		opts = ((flags & FLAG_TIMING_UNIT_MASK) >> FLAG_TIMING_UNIT_SHIFT) << BKTKContextOptionTimingShift;
-	}
+	fprintf (file, "{\n\t\"version\": \"%s\",\n\t\"blipkit\": \"%s\",\n\t\"runs\": %d,\n\t\"songs\": [\n", BK_BLIPLAY_VERSION, BK_VERSION, BENCH_RUNS);
 
-	if (context_init (ctx, numChannels, sampleRate, opts) != 0) {
-		return 1;
+	for (BKUSize i = 0; i < results -> len; i ++) {
+		result = BKArrayItemAt (results, i);
+
+		fprintf (file, "\t\t{\"name\": ");
+		bench_write_string (file, result -> name);
+
+		for (BKInt j = 0; j < BENCH_VALUE_COUNT; j ++) {
+			fprintf (file, ", \"%s\": %.10g", benchValues [j].key, result -> values [j]);
+		}
+
+		fprintf (file, "}%s\n", i < results -> len - 1 ? "," : "");
 	}
 
-	BKStringEmpty (&path);
+	fprintf (file, "\t]\n}\n");
+	fclose (file);
 
-	if (BKStringAppend (&path, filename) != 0) {
+	return 0;
+}
+
+/**
+ * Read results written by `bench_write_results`
+ *
+ * Lines without a song are ignored.
+ */
+static BKInt bench_read_results (char const * path, BKArray * results)
+{
+	FILE * file;
+	char line [4096];
+	char const * str;
+	char * end;
+	BKUSize len;
+	struct bench_result result;
+
+	file = fopen (path, "r");
+
+	if (!file) {
+		print_error ("No such file: %s\n", path);
 		return -1;
 	}
 
-	// use stdin
-	if (BKStringCompare (&path, "-") == 0) {
-		inputFile = stdin;
-	}
-	// use path
-	else {
-		if (stat ((char *) path.str, &st) < 0) {
-			print_error ("No such file: %s\n", path.str);
-			return -1;
+	while (fgets (line, sizeof (line), file)) {
+		str = strstr (line, "{\"name\": \"");
+
+		if (!str) {
+			continue;
 		}
 
-		if (S_ISDIR (st.st_mode)) {
-			if (BKStringAppend (&path, "/DATA.blip") < 0) {
-				return -1;
+		memset (&result, 0, sizeof (result));
+		str += strlen ("{\"name\": \"");
+
+		for (len = 0; *str && *str != '"' && len < sizeof (result.name) - 1; str ++) {
+			if (*str == '\\' && str [1]) {
+				str ++;
 			}
+
+			result.name [len ++] = *str;
 		}
 
-		inputFile = fopen ((char *) path.str, "rb");
+		for (BKInt i = 0; i < BENCH_VALUE_COUNT; i ++) {
+			char key [64];
 
-		if (inputFile == NULL) {
-			print_error ("No such file: %s\n", path.str);
+			snprintf (key, sizeof (key), "\"%s\": ", benchValues [i].key);
+
+			if ((str = strstr (line, key))) {
+				result.values [i] = strtod (str + strlen (key), &end);
+			}
+		}
+
+		if (BKArrayPush (results, &result) != 0) {
+			print_error ("Allocation error\n");
+			fclose (file);
 			return -1;
 		}
 	}
 
-	// path set by option
-	if (loadPath.len) {
-		if (stat ((char *) loadPath.str, &st) < 0) {
-			print_error ("No such path for loading: %s\n", loadPath.str);
-			return -1;
+	fclose (file);
+
+	return 0;
+}
+
+/**
+ * Print changes of compared values of songs contained in both results
+ *
+ * Returns 1 if a value got worse than `BENCH_MAX_REGRESSION` percent.
+ */
+static BKInt bench_compare (BKArray const * oldResults, BKArray const * results)
+{
+	BKInt regressed = 0;
+	double change;
+	struct bench_result const * result;
+	struct bench_result const * oldResult;
+
+	for (BKUSize i = 0; i < results -> len; i ++) {
+		result = BKArrayItemAt (results, i);
+		oldResult = NULL;
+
+		for (BKUSize j = 0; j < oldResults -> len; j ++) {
+			if (strcmp (((struct bench_result const *) BKArrayItemAt (oldResults, j)) -> name, result -> name) == 0) {
+				oldResult = BKArrayItemAt (oldResults, j);
+				break;
+			}
 		}
 
-		if (!S_ISDIR (st.st_mode)) {
-			print_error ("Load path is not a directory: %s\n", loadPath.str);
-			return -1;
+		if (!oldResult) {
+			print_notice ("%s: not in old results\n", result -> name);
+			continue;
 		}
 
-		BKStringReplaceInRange (&ctx -> loadPath, &loadPath, 0, ctx -> loadPath.len);
-		BKStringDispose (&loadPath);
+		print_message ("%s:", result -> name);
 
-		BKStringEmpty (&loadPath);
-		BKStringAppendString (&loadPath, &ctx -> loadPath);
-	}
-	// parent directory from input file
-	else {
-		if (BKStringDirname (&path, &loadPath) != 0) {
-			return -1;
-		}
-	}
+		for (BKInt j = 0; j < BENCH_VALUE_COUNT; j ++) {
+			if (!benchValues [j].better || oldResult -> values [j] <= 0.0) {
+				continue;
+			}
 
-	if ((flags & FLAG_TIMING_UNIT_MASK) && outputFilename) {
-		BKString path = BK_STRING_INIT;
+			// positive if better
+			change = (result -> values [j] / oldResult -> values [j] - 1.0) * 100.0 * benchValues [j].better;
 
-		if (BKStringAppend (&path, outputFilename) != 0) {
-			print_error ("Allocation error\n");
-			return -1;
+			if (change < -BENCH_MAX_REGRESSION) {
+				print_message (" %s%s %+.1f%%%s", colorRed, benchValues [j].key, change, colorNormal);
+				regressed = 1;
+			}
+			else {
+				print_message (" %s %+.1f%%", benchValues [j].key, change);
+			}
 		}
 
-		if (BKStringAppend (&path, ".txt") != 0) {
-			print_error ("Allocation error\n");
-			return -1;
-		}
+		print_message ("\n");
+	}
 
-		timingFile = fopen ((char *) path.str, "w");
+	return regressed;
+}
 
-		BKStringDispose (&path);
-	}
+/**
+ * Read song file
+ *
+ * Directories are read as in the player.
+ */
+static BKInt bench_read_song (char const * name, uint8_t ** outSource, BKUSize * outSize, BKString * loadPath)
+{
+	BKInt res;
+	FILE * file;
+	struct stat st;
+	BKString path = BK_STRING_INIT;
 
-	if (make_context (ctx, inputFile, &loadPath) != 0) {
-		print_error ("Failed to load file: %s\n", filename);
-		fclose (inputFile);
-		return 1;
+	if ((res = BKStringAppend (&path, name)) != 0) {
+		print_error ("Allocation error\n");
+		return res;
 	}
 
-#if BK_USE_SDL
-	if ((flags & FLAG_NO_SOUND) == 0) {
-		char const * error = NULL;
-
-		if (init_sdl (ctx, &error) < 0) {
-			print_error ("Could not initialize SDL: %s\n", error);
-			return -1;
+	if (stat ((char *) path.str, &st) == 0 && S_ISDIR (st.st_mode)) {
+		if ((res = BKStringAppend (&path, "/DATA.blip")) != 0) {
+			print_error ("Allocation error\n");
+			goto cleanup;
 		}
 	}
-#endif
 
-	if (inputFile == stdin) {
-		flags |= FLAG_FROM_STDIN;
-	}
-	else {
-		fclose (inputFile);
+	file = fopen ((char *) path.str, "rb");
+
+	if (!file) {
+		print_error ("No such file: %s\n", path.str);
+		res = -1;
+		goto cleanup;
 	}
 
-	if (flags & FLAG_HAS_SEEK_TIME) {
-		speed = ctx -> info.stepTicks;
+	res = read_file (file, outSource, outSize);
+	fclose (file);
 
-		if (parse_seek_time (seekTimeString, &seekTime, speed) != 0) {
-			return -1;
-		}
+	if (res != 0) {
+		print_error ("Failed to read file: %s\n", path.str);
+		goto cleanup;
 	}
 
-	if (flags & FLAG_HAS_END_TIME) {
-		speed = ctx -> info.stepTicks;
+	BKStringEmpty (loadPath);
 
-		if (parse_seek_time (endTimeString, &endTime, speed) != 0) {
-			return -1;
-		}
+	if ((res = BKStringDirname (&path, loadPath)) != 0) {
+		free (*outSource);
+		goto cleanup;
 	}
 
-	return 0;
+cleanup:
+	BKStringDispose (&path);
+
+	return res;
 }
 
-static void write_timing_data (void)
+/**
+ * Measure songs given as arguments and synthetic stress songs
+ *
+ * Returns 2 if a song failed and 4 if values got worse compared to the
+ * results given with --bench-compare.
+ */
+static BKInt run_bench (void)
 {
-	BKEnum waveform;
-	BKTKTrack * track;
-	BKByteBufferSegment * seg;
-
-	if (timingFile) {
-		char name [64];
-		BKSize size;
-		char const * unit = "";
+	BKInt res;
+	BKInt status = 0;
+	uint8_t * source;
+	BKUSize size;
+	char const * name;
+	BKString synthetic = BK_STRING_INIT;
+	BKString loadPath = BK_STRING_INIT;
+	BKArray results = BK_ARRAY_INIT (sizeof (struct bench_result));
+	BKArray oldResults = BK_ARRAY_INIT (sizeof (struct bench_result));
+	struct bench_result result;
+
+	if (benchCompareFilename) {
+		if (bench_read_results (benchCompareFilename, &oldResults) != 0) {
+			status = 2;
+			goto cleanup;
+		}
+	}
 
-		if (flags & FLAG_TIMING_UNIT_SECS) {
-			unit = "seconds";
+	// compare results files only
+	if (!benchFilename) {
+		if (bench_read_results (benchFiles [0], &results) != 0) {
+			status = 2;
+			goto cleanup;
 		}
 
-		if (flags & FLAG_TIMING_UNIT_TICKS) {
-			unit = "ticks";
+		if (bench_compare (&oldResults, &results)) {
+			status = 4;
 		}
 
-		fprintf (
-			timingFile,
-			"%% Timing data for tracks contained in '%s'\n"
-			"%%\n"
-			"%% [track:{waveformtype}:{tracknumber}\n"
-			"%% l:{tick}:{lineno}\n"
-			"%% ...\n"
-			"%% ]\n"
-			"%%\n"
-			"%% If 'lineno' is ommited, the line follows the previous one\n"
-			"%%\n"
-			"%% Using unit '%s'\n"
-			"\n",
-			outputFilename, unit
-		);
+		goto cleanup;
+	}
+
+	for (BKInt i = 0; ; i ++) {
+		memset (&result, 0, sizeof (result));
 
-		for (BKUSize i = 0; i < ctx.tracks.len; i ++) {
-			track = *(BKTKTrack **) BKArrayItemAt (&ctx.tracks, i);
+		if (i < numBenchFiles) {
+			name = benchFiles [i];
 
-			if (!track) {
+			if (bench_read_song (name, &source, &size, &loadPath) != 0) {
+				status = 2;
 				continue;
 			}
-
-			waveform = track -> waveform;
-
-			if (i > 0) {
-				fprintf (timingFile, "\n");
+		}
+		else {
+			if (!(name = bench_make_song (i - numBenchFiles, &synthetic, &res))) {
+				break;
 			}
 
-			waveform_get_name (track, name, sizeof (name), waveform, NULL);
-			fprintf (timingFile, "[track:%s:%d\n", name, track -> object.index);
-
-			for (seg = track -> timingData.first; seg != track -> timingData.cur; seg = seg -> next) {
-				fwrite (seg -> data, sizeof (char), seg -> size, timingFile);
+			if (res != 0) {
+				print_error ("Allocation error\n");
+				status = 2;
+				break;
 			}
 
-			seg = track -> timingData.cur;
+			source = NULL;
+			size = synthetic.len;
+			BKStringEmpty (&loadPath);
 
-			if (seg) {
-				size = track -> timingData.ptr - seg -> data;
-				fwrite (seg -> data, sizeof (char), size, timingFile);
+			if (BKStringAppend (&loadPath, ".") != 0) {
+				print_error ("Allocation error\n");
+				status = 2;
+				break;
 			}
-
-			fprintf (timingFile, "]\n");
 		}
 
-		fclose (timingFile);
-	}
-}
+		snprintf (result.name, sizeof (result.name), "%s", name);
+		print_message ("%s\n", name);
 
-static void cleanup (void)
-{
-#if BK_USE_SDL
-	if ((flags & FLAG_NO_SOUND) == 0) {
-		SDL_CloseAudio ();
-	}
-#endif
+		res = bench_song (source ? source : synthetic.str, size, &loadPath, &result);
+		free (source);
 
-	if (outputFile) {
-		if (outputType == OUTPUT_TYPE_WAVE) {
-			BKWaveFileWriterTerminate (&waveWriter);
-			BKDispose (&waveWriter);
+		if (res != 0) {
+			print_error ("Failed to measure song: %s\n", name);
+			status = 2;
+			continue;
 		}
 
-		if (outputFile != stdout) {
-			fclose (outputFile);
+		print_message ("  tokenize %.1f MB/s, parse %.1f MB/s, compile %.1f MB/s, create %.3f ms, render %.1fx realtime\n",
+			result.values [BENCH_VALUE_TOKENIZE], result.values [BENCH_VALUE_PARSE], result.values [BENCH_VALUE_COMPILE],
+			result.values [BENCH_VALUE_CREATE], result.values [BENCH_VALUE_REALTIME]);
+
+		if (BKArrayPush (&results, &result) != 0) {
+			print_error ("Allocation error\n");
+			status = 2;
+			goto cleanup;
 		}
 	}
 
-	BKDispose (&ctx);
-}
-
-static BKInt write_output (BKTKContext * ctx)
-{
-	BKInt numFrames = 512;
-	BKInt numChannels = ctx -> renderContext -> numChannels;
-	BKFrame * frames = malloc (numFrames * numChannels * sizeof (BKFrame));
-
-	if (frames == NULL) {
-		return -1;
+	if (bench_write_results (benchFilename, &results) != 0) {
+		status = 2;
+		goto cleanup;
 	}
 
-	while (check_tracks_running (ctx)) {
-		BKContextGenerate (ctx -> renderContext, frames, numFrames);
-		output_chunk (frames, numFrames * numChannels);
-
-		if (flags & FLAG_HAS_END_TIME) {
-			if (BKTimeIsGreaterEqual (ctx -> renderContext -> currentTime, endTime)) {
-				break;
-			}
+	if (benchCompareFilename) {
+		if (bench_compare (&oldResults, &results)) {
+			status = 4;
 		}
 	}
 
-	free (frames);
+cleanup:
+	BKStringDispose (&synthetic);
+	BKStringDispose (&loadPath);
+	BKArrayDispose (&results);
+	BKArrayDispose (&oldResults);
 
-	return 0;
+	return status;
 }
 
 static BKInt runloop (BKTKContext * ctx)
@@ -1178,6 +4066,14 @@ static BKInt runloop (BKTKContext * ctx)
 		print_notice ("Press [q] to quit\n");
 	}
 
+#if BK_USE_WATCH
+	if (watchFd >= 0) {
+		FD_SET (watchFd, &fds);
+		nfds = BKMax (nfds, watchFd + 1);
+		print_notice ("Watching %s\n", watchPath.str);
+	}
+#endif
+
 	set_noecho (1);
 
 	SDL_PauseAudio (0);
@@ -1193,22 +4089,47 @@ static BKInt runloop (BKTKContext * ctx)
 			return -1;
 		}
 		else if (res > 0) {
-			c = getchar_nocanon (0);
+#if BK_USE_WATCH
+			if (watchFd >= 0 && FD_ISSET (watchFd, &fdsc)) {
+				if (watch_read_events ()) {
+					if (!(flags & FLAG_PRINT_NO_TIME)) {
+						printf ("\n");
+					}
+
+					reload_song ();
+					ctx = liveCtx;
+				}
+			}
+#endif
+
+			if (FD_ISSET (STDIN_FILENO, &fdsc)) {
+				c = getchar_nocanon (0);
 
-			switch (c) {
-				case 'q': {
-					flag = 0;
-					break;
+				switch (c) {
+					case 'q': {
+						flag = 0;
+						break;
+					}
 				}
 			}
 		}
 
+		collect_retired_context ();
+
+		if (flags & FLAG_PROGRESSIVE) {
+			ctx = loaded_context (ctx);
+		}
+
 		if (!(flags & FLAG_PRINT_NO_TIME)) {
 			print_time (ctx);
 		}
 
-		if (check_tracks_running (ctx) == 0) {
-			break;
+		// keep waiting for changes when watching or loading; tracks of the
+		// preview are exchanged by the audio callback
+		if (!(flags & FLAG_WATCH) && atomic_load (&loadState) != LOAD_PREVIEW) {
+			if (check_tracks_running (ctx) == 0) {
+				break;
+			}
 		}
 	}
 	while (flag);
@@ -1239,6 +4160,8 @@ static BKInt runloop (BKTKContext * ctx)
 
 int main (int argc, char * argv [])
 {
+	BKTKContext * song = &ctx;
+
 	istty = isatty (STDOUT_FILENO);
 
 	if (istty) {
@@ -1252,8 +4175,27 @@ int main (int argc, char * argv [])
 		return 1;
 	}
 
+	if (benchFilename || benchCompareFilename) {
+		return run_bench ();
+	}
+
+	if (nativeFilename) {
+		return write_native (&ctx) != 0 ? 2 : 0;
+	}
+
+	if (captureFilename) {
+		return write_capture (&ctx) != 0 ? 2 : 0;
+	}
+
+#if BK_USE_SDL
+	// preview while loading progressively
+	if (liveCtx) {
+		song = liveCtx;
+	}
+#endif
+
 	if (flags & FLAG_INFO && outputFile != stdout) {
-		print_info (&ctx);
+		print_info (song);
 		printf ("\n");
 	}
 
@@ -1261,9 +4203,13 @@ int main (int argc, char * argv [])
 		return 0;
 	}
 
+	if (start_timing_thread () != 0) {
+		return 1;
+	}
+
 	if (flags & FLAG_HAS_SEEK_TIME) {
 		print_notice ("Fast forward to %s\n", seekTimeString);
-		seek_context (&ctx, seekTime);
+		seek_context (song, seekTime);
 	}
 
 	if (!istty) {
@@ -1271,18 +4217,40 @@ int main (int argc, char * argv [])
 	}
 
 	if (flags & FLAG_NO_SOUND) {
-		if (write_output (&ctx) < 0) {
+		if (write_output (song) < 0) {
 			return 2;
 		}
 	}
 	else {
-		if (runloop (&ctx) < 0) {
+		if (runloop (song) < 0) {
 			return 3;
 		}
 	}
 
 	write_timing_data ();
 
+#if BK_TK_PROFILE
+	if (flags & FLAG_PROFILE) {
+#if BK_USE_SDL
+		if (liveCtx) {
+			song = liveCtx;
+		}
+#endif
+
+		print_profile (song);
+	}
+#endif
+
+	if (flags & FLAG_STATS) {
+#if BK_USE_SDL
+		if (liveCtx) {
+			song = liveCtx;
+		}
+#endif
+
+		print_stats (song);
+	}
+
 	cleanup ();
 
 	return 0;
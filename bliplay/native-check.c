@@ -0,0 +1,239 @@
+/*
+ * Copyright (c) 2012-2016 Simon Schoenenberger
+ * http://blipkit.audio
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/**
+ * Render a song with the interpreter and with the native code generated by
+ * `bliplay --emit-c` and compare the frames
+ *
+ * Compiled by `make check-native` together with the generated source, which has to
+ * define the song `NATIVE_SONG`.
+ *
+ * Usage: native-check file.blip
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <sys/stat.h>
+#include "BKTK.h"
+#include "BlipKit.h"
+
+#ifndef NATIVE_SONG
+#define NATIVE_SONG native_song
+#endif
+
+#define CHECK_SAMPLE_RATE 44100
+#define CHECK_NUM_CHANNELS 2
+#define CHECK_SECONDS 60
+#define CHECK_CHUNK_FRAMES 512
+
+extern BKTKNativeSong const NATIVE_SONG;
+
+static BKInt load_source (char const * filename, uint8_t ** outData, BKUSize * outSize)
+{
+	FILE * file;
+	long size;
+	uint8_t * data;
+
+	file = fopen (filename, "rb");
+
+	if (!file) {
+		return BK_FILE_ERROR;
+	}
+
+	if (fseek (file, 0, SEEK_END) != 0 || (size = ftell (file)) < 0 || fseek (file, 0, SEEK_SET) != 0) {
+		fclose (file);
+		return BK_FILE_ERROR;
+	}
+
+	data = malloc (size + 1);
+
+	if (!data) {
+		fclose (file);
+		return BK_ALLOCATION_ERROR;
+	}
+
+	if (fread (data, sizeof (uint8_t), size, file) != (size_t) size) {
+		free (data);
+		fclose (file);
+		return BK_FILE_ERROR;
+	}
+
+	fclose (file);
+
+	*outData = data;
+	*outSize = size;
+
+	return 0;
+}
+
+/**
+ * Compile source into context attached to `renderContext`
+ */
+static BKInt make_context (BKTKContext * ctx, BKContext * renderContext, uint8_t const * source, BKUSize size, BKString const * loadPath)
+{
+	BKInt res;
+	BKTKParser parser;
+	BKTKTokenizer tok;
+	BKTKCompiler compiler;
+
+	if ((res = BKTKParserInit (&parser)) != 0) {
+		return res;
+	}
+
+	if ((res = BKTKTokenizerInit (&tok)) != 0) {
+		BKDispose (&parser);
+		return res;
+	}
+
+	if ((res = BKTKCompilerInit (&compiler)) != 0) {
+		BKDispose (&tok);
+		BKDispose (&parser);
+		return res;
+	}
+
+	compiler.symbols = &parser.symbols;
+
+	if (BKTKParserPutChars (&parser, &tok, source, size) != 0) {
+		fprintf (stderr, "%s\n", BKTKTokenizerHasError (&tok) ? tok.buffer : parser.buffer);
+		res = -1;
+		goto cleanup;
+	}
+
+	if ((res = BKTKCompilerCompile (&compiler, BKTKParserGetNodeTree (&parser))) != 0) {
+		fprintf (stderr, "%s", compiler.error.str);
+		goto cleanup;
+	}
+
+	if ((res = BKStringReplaceInRange (&ctx -> loadPath, loadPath, 0, ctx -> loadPath.len)) != 0) {
+		goto cleanup;
+	}
+
+	if ((res = BKTKContextCreate (ctx, &compiler)) != 0) {
+		fprintf (stderr, "Creating context failed (%s)\n%s", BKStatusGetName (res), ctx -> error.str);
+		goto cleanup;
+	}
+
+	if ((res = BKTKContextAttach (ctx, renderContext)) != 0) {
+		fprintf (stderr, "Attaching context failed (%s)\n", BKStatusGetName (res));
+		goto cleanup;
+	}
+
+cleanup:
+	compiler.symbols = NULL;
+	BKDispose (&compiler);
+	BKDispose (&tok);
+	BKDispose (&parser);
+
+	return res;
+}
+
+int main (int argc, char * argv [])
+{
+	BKInt res = 0;
+	uint8_t * source = NULL;
+	BKUSize size = 0;
+	BKString path = BK_STRING_INIT;
+	BKString loadPath = BK_STRING_INIT;
+	BKTKContext ctx [2];
+	BKContext renderContext [2];
+	struct stat st;
+	BKFrame frames [2][CHECK_CHUNK_FRAMES * CHECK_NUM_CHANNELS];
+	BKUSize numFrames = (BKUSize) CHECK_SECONDS * CHECK_SAMPLE_RATE;
+
+	if (argc != 2) {
+		fprintf (stderr, "Usage: %s file.blip\n", argv [0]);
+		return 2;
+	}
+
+	if (BKStringAppend (&path, argv [1]) != 0) {
+		fprintf (stderr, "Allocation error\n");
+		return 2;
+	}
+
+	// files are loaded relative to song directory as by bliplay
+	if (stat ((char *) path.str, &st) == 0 && S_ISDIR (st.st_mode)) {
+		if ((res = BKStringAppendString (&loadPath, &path)) == 0) {
+			res = BKStringAppend (&path, "/DATA.blip");
+		}
+	}
+	else {
+		res = BKStringDirname (&path, &loadPath);
+	}
+
+	if (res != 0) {
+		fprintf (stderr, "Allocation error\n");
+		return 2;
+	}
+
+	if ((res = load_source ((char *) path.str, &source, &size)) != 0) {
+		fprintf (stderr, "Failed to read file: %s\n", path.str);
+		return 2;
+	}
+
+	for (BKInt i = 0; i < 2; i ++) {
+		if ((res = BKTKContextInit (&ctx [i], 0)) != 0 || (res = BKContextInit (&renderContext [i], CHECK_NUM_CHANNELS, CHECK_SAMPLE_RATE)) != 0) {
+			fprintf (stderr, "Context init failed (%s)\n", BKStatusGetName (res));
+			return 2;
+		}
+
+		if ((res = make_context (&ctx [i], &renderContext [i], source, size, &loadPath)) != 0) {
+			return 2;
+		}
+	}
+
+	// second context is run by native code
+	if ((res = BKTKContextSetNativeSong (&ctx [1], &NATIVE_SONG)) != 0) {
+		fprintf (stderr, "%s: native code does not match byte code (%s)\n", argv [1], BKStatusGetName (res));
+		return 1;
+	}
+
+	for (BKUSize frame = 0; frame < numFrames; frame += CHECK_CHUNK_FRAMES) {
+		BKContextGenerate (&renderContext [0], frames [0], CHECK_CHUNK_FRAMES);
+		BKContextGenerate (&renderContext [1], frames [1], CHECK_CHUNK_FRAMES);
+
+		if (memcmp (frames [0], frames [1], sizeof (frames [0])) != 0) {
+			for (BKUSize i = 0; i < CHECK_CHUNK_FRAMES * CHECK_NUM_CHANNELS; i ++) {
+				if (frames [0][i] != frames [1][i]) {
+					frame += i / CHECK_NUM_CHANNELS;
+					break;
+				}
+			}
+
+			fprintf (stderr, "%s: native code differs from interpreter at frame %zu (%.3f s)\n",
+				argv [1], (size_t) frame, (double) frame / CHECK_SAMPLE_RATE);
+			res = 1;
+			break;
+		}
+	}
+
+	for (BKInt i = 0; i < 2; i ++) {
+		BKDispose (&ctx [i]);
+		BKDispose (&renderContext [i]);
+	}
+
+	BKStringDispose (&path);
+	BKStringDispose (&loadPath);
+	free (source);
+
+	return res;
+}
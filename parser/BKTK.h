@@ -28,11 +28,17 @@
 extern "C" {
 #endif
 
+#include "BKTKArena.h"
 #include "BKTKBase.h"
 #include "BKTKCompiler.h"
 #include "BKTKContext.h"
+#include "BKTKEventLog.h"
 #include "BKTKInterpreter.h"
+#include "BKTKNative.h"
 #include "BKTKParser.h"
+#include "BKTKSymbols.h"
+#include "BKTKStats.h"
+#include "BKTKTiming.h"
 #include "BKTKTokenizer.h"
 #include "BKTKWriter.h"
 
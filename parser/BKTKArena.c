@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) 2012-2016 Simon Schoenenberger
+ * http://blipkit.audio
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <stddef.h>
+#include "BKTKArena.h"
+#include "BKTKStats.h"
+
+#define ARENA_CHUNK_SIZE (16 * 1024)
+#define ARENA_ALIGN      (_Alignof (max_align_t))
+
+struct BKTKArenaChunk
+{
+	BKTKArenaChunk * next;
+	BKUSize          size;
+	BKUSize          used;
+	_Alignas (max_align_t) uint8_t data [];
+};
+
+struct BKTKArenaObject
+{
+	BKTKArenaObject * next;
+	void            * object;
+};
+
+/**
+ * Add chunk with at least `size` free bytes
+ *
+ * Chunks for large allocations are inserted after the first one so its free
+ * space can still be used.
+ */
+static BKTKArenaChunk * BKTKArenaAddChunk (BKTKArena * arena, BKUSize size)
+{
+	BKTKArenaChunk * chunk;
+	BKTKArenaChunk * first = arena -> chunks;
+	BKUSize chunkSize = BKMax (ARENA_CHUNK_SIZE - sizeof (*chunk), size);
+
+	chunk = malloc (sizeof (*chunk) + chunkSize);
+
+	if (!chunk) {
+		return NULL;
+	}
+
+	BKTKStatsCountAlloc (arena -> statsType, sizeof (*chunk) + chunkSize);
+
+	chunk -> size = chunkSize;
+	chunk -> used = 0;
+
+	if (first && chunkSize == size) {
+		chunk -> next = first -> next;
+		first -> next = chunk;
+	}
+	else {
+		chunk -> next = first;
+		arena -> chunks = chunk;
+	}
+
+	return chunk;
+}
+
+BK_INLINE BKUSize BKTKArenaAlignSize (BKUSize size)
+{
+	return (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+BKInt BKTKArenaReserve (BKTKArena * arena, BKUSize size)
+{
+	BKTKArenaChunk * chunk = arena -> chunks;
+
+	size = BKTKArenaAlignSize (size);
+
+	if (!chunk || chunk -> size - chunk -> used < size) {
+		if (!BKTKArenaAddChunk (arena, size)) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+void * BKTKArenaAlloc (BKTKArena * arena, BKUSize size)
+{
+	void * ptr;
+	BKTKArenaChunk * chunk = arena -> chunks;
+
+	size = BKTKArenaAlignSize (size);
+
+	if (!chunk || chunk -> size - chunk -> used < size) {
+		chunk = BKTKArenaAddChunk (arena, size);
+
+		if (!chunk) {
+			return NULL;
+		}
+	}
+
+	ptr = &chunk -> data [chunk -> used];
+	chunk -> used += size;
+	memset (ptr, 0, size);
+
+	return ptr;
+}
+
+char * BKTKArenaCopyString (BKTKArena * arena, char const * str, BKUSize len)
+{
+	char * copy = BKTKArenaAlloc (arena, len + 1);
+
+	if (!copy) {
+		return NULL;
+	}
+
+	memcpy (copy, str, len);
+
+	return copy;
+}
+
+BKInt BKTKArenaAddObject (BKTKArena * arena, void * object)
+{
+	BKTKArenaObject * item = BKTKArenaAlloc (arena, sizeof (*item));
+
+	if (!item) {
+		return -1;
+	}
+
+	item -> object = object;
+	item -> next = arena -> objects;
+	arena -> objects = item;
+
+	return 0;
+}
+
+void BKTKArenaMove (BKTKArena * arena, BKTKArena * other)
+{
+	BKTKArenaChunk * last;
+	BKTKArenaObject * lastObject;
+
+	if (other -> objects) {
+		lastObject = other -> objects;
+
+		while (lastObject -> next) {
+			lastObject = lastObject -> next;
+		}
+
+		lastObject -> next = arena -> objects;
+		arena -> objects = other -> objects;
+		other -> objects = NULL;
+	}
+
+	if (!other -> chunks) {
+		return;
+	}
+
+	if (!arena -> chunks) {
+		arena -> chunks = other -> chunks;
+	}
+	else {
+		// keep first chunk of `arena` in front
+		last = other -> chunks;
+
+		while (last -> next) {
+			last = last -> next;
+		}
+
+		last -> next = arena -> chunks -> next;
+		arena -> chunks -> next = other -> chunks;
+	}
+
+	other -> chunks = NULL;
+}
+
+/**
+ * Dispose objects before their memory is released
+ */
+static void BKTKArenaDisposeObjects (BKTKArena * arena)
+{
+	for (BKTKArenaObject * item = arena -> objects; item; item = item -> next) {
+		BKDispose (item -> object);
+	}
+
+	arena -> objects = NULL;
+}
+
+void BKTKArenaDispose (BKTKArena * arena)
+{
+	BKTKArenaChunk * chunk, * next;
+
+	BKTKArenaDisposeObjects (arena);
+
+	for (chunk = arena -> chunks; chunk; chunk = next) {
+		next = chunk -> next;
+		free (chunk);
+	}
+
+	arena -> chunks = NULL;
+}
+
+void BKTKArenaClear (BKTKArena * arena)
+{
+	BKTKArenaChunk * first = arena -> chunks;
+
+	BKTKArenaDisposeObjects (arena);
+
+	// large chunks are not kept
+	if (!first || first -> size > ARENA_CHUNK_SIZE - sizeof (*first)) {
+		BKTKArenaDispose (arena);
+		return;
+	}
+
+	arena -> chunks = first -> next;
+	BKTKArenaDispose (arena);
+
+	first -> next = NULL;
+	first -> used = 0;
+	arena -> chunks = first;
+}
+
+BKInt BKTKArenaArrayReserve (BKTKArenaArray * array, BKUSize count, BKTKArena * arena)
+{
+	void * items;
+	BKUSize capacity = BKMax (array -> capacity, 16);
+
+	if (array -> len + count <= array -> capacity) {
+		return 0;
+	}
+
+	while (capacity < array -> len + count) {
+		capacity *= 2;
+	}
+
+	items = BKTKArenaAlloc (arena, capacity * array -> itemSize);
+
+	if (!items) {
+		return -1;
+	}
+
+	if (array -> len) {
+		memcpy (items, array -> items, array -> len * array -> itemSize);
+	}
+
+	array -> items = items;
+	array -> capacity = capacity;
+
+	return 0;
+}
+
+BKInt BKTKArenaArrayResize (BKTKArenaArray * array, BKUSize len, BKTKArena * arena)
+{
+	if (len > array -> len) {
+		if (BKTKArenaArrayReserve (array, len - array -> len, arena) != 0) {
+			return -1;
+		}
+
+		memset ((uint8_t *) array -> items + array -> len * array -> itemSize, 0, (len - array -> len) * array -> itemSize);
+	}
+
+	array -> len = len;
+
+	return 0;
+}
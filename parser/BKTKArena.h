@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2012-2016 Simon Schoenenberger
+ * http://blipkit.audio
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _BK_TK_ARENA_H_
+#define _BK_TK_ARENA_H_
+
+#include "BKTKStats.h"
+
+typedef struct BKTKArena BKTKArena;
+typedef struct BKTKArenaChunk BKTKArenaChunk;
+typedef struct BKTKArenaObject BKTKArenaObject;
+typedef struct BKTKArenaArray BKTKArenaArray;
+
+/**
+ * Owns memory of objects which live as long as a song
+ *
+ * Allocations are only released all at once when the arena is disposed.
+ * The chunk with free space is always the first one. Chunks are counted for
+ * the subsystem given when initializing the arena. Objects added with
+ * `BKTKArenaAddObject` are disposed before.
+ */
+struct BKTKArena
+{
+	BKTKArenaChunk  * chunks;
+	BKTKArenaObject * objects; // last added first
+	BKTKStatsType     statsType;
+};
+
+/**
+ * Array with items in an arena
+ *
+ * Items are continuous. Growing copies them to a larger block; the old one is
+ * released with the arena.
+ */
+struct BKTKArenaArray
+{
+	void  * items;
+	BKUSize len;
+	BKUSize capacity;
+	BKUSize itemSize;
+};
+
+#define BK_TK_ARENA_INIT(statsType) ((BKTKArena) {NULL, NULL, (statsType)})
+#define BK_TK_ARENA_ARRAY_INIT(itemSize) ((BKTKArenaArray) {NULL, 0, 0, (itemSize)})
+
+/**
+ * Allocate zeroed memory
+ *
+ * Returns NULL if allocation failed
+ */
+extern void * BKTKArenaAlloc (BKTKArena * arena, BKUSize size);
+
+/**
+ * Copy string of length `len` and terminate it
+ *
+ * Returns NULL if allocation failed
+ */
+extern char * BKTKArenaCopyString (BKTKArena * arena, char const * str, BKUSize len);
+
+/**
+ * Dispose `object` with `BKDispose` when the arena is disposed or cleared
+ *
+ * The object has to be allocated in the arena. Returns -1 if allocation
+ * failed
+ */
+extern BKInt BKTKArenaAddObject (BKTKArena * arena, void * object);
+
+/**
+ * Ensure that `size` bytes can be allocated
+ *
+ * `size` has to be smaller than a chunk. Returns -1 if allocation failed
+ */
+extern BKInt BKTKArenaReserve (BKTKArena * arena, BKUSize size);
+
+/**
+ * Move allocations of `other` to `arena`
+ *
+ * `other` is empty afterwards
+ */
+extern void BKTKArenaMove (BKTKArena * arena, BKTKArena * other);
+
+/**
+ * Dispose objects and release all allocations
+ *
+ * The arena can be used again afterwards
+ */
+extern void BKTKArenaDispose (BKTKArena * arena);
+
+/**
+ * Dispose objects and release all allocations but keep the first chunk to
+ * be reused
+ */
+extern void BKTKArenaClear (BKTKArena * arena);
+
+/**
+ * Set number of items of `array`
+ *
+ * Added items are zeroed. Returns -1 if allocation failed
+ */
+extern BKInt BKTKArenaArrayResize (BKTKArenaArray * array, BKUSize len, BKTKArena * arena);
+
+/**
+ * Ensure that `count` items can be pushed without growing
+ *
+ * Returns -1 if allocation failed
+ */
+extern BKInt BKTKArenaArrayReserve (BKTKArenaArray * array, BKUSize count, BKTKArena * arena);
+
+/**
+ * Append item to `array`
+ *
+ * Returns -1 if allocation failed
+ */
+BK_INLINE BKInt BKTKArenaArrayPush (BKTKArenaArray * array, void const * item, BKTKArena * arena);
+
+/**
+ * Get item at `index` or NULL if it is out of range
+ */
+BK_INLINE void * BKTKArenaArrayItemAt (BKTKArenaArray const * array, BKUSize index);
+
+
+// --- Inline implementations
+
+BK_INLINE BKInt BKTKArenaArrayPush (BKTKArenaArray * array, void const * item, BKTKArena * arena)
+{
+	if (array -> len >= array -> capacity && BKTKArenaArrayReserve (array, 1, arena) != 0) {
+		return -1;
+	}
+
+	memcpy ((uint8_t *) array -> items + array -> len * array -> itemSize, item, array -> itemSize);
+	array -> len ++;
+
+	return 0;
+}
+
+BK_INLINE void * BKTKArenaArrayItemAt (BKTKArenaArray const * array, BKUSize index)
+{
+	if (index >= array -> len) {
+		return NULL;
+	}
+
+	return (uint8_t *) array -> items + index * array -> itemSize;
+}
+
+#endif /* ! _BK_TK_ARENA_H_ */
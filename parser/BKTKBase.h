@@ -34,11 +34,34 @@
 #include "BKString.h"
 #include "BKTrack.h"
 
+/**
+ * Set to 1 to collect interpreter statistics
+ *
+ * Has no effect on the interpreter when not enabled
+ */
+#ifndef BK_TK_PROFILE
+#define BK_TK_PROFILE 0
+#endif
+
+/**
+ * Inline function even if it is large
+ *
+ * Used for functions which are called with constant flags, so each call
+ * gets a copy without the branches of the other flags.
+ */
+#if defined (__GNUC__)
+#define BK_TK_FORCE_INLINE BK_INLINE __attribute__ ((always_inline))
+#else
+#define BK_TK_FORCE_INLINE BK_INLINE
+#endif
+
 typedef struct BKString BKString;
 typedef struct BKTKOffset BKTKOffset;
 typedef struct BKTKTrack BKTKTrack;
 typedef struct BKTKCompiler BKTKCompiler;
 typedef struct BKTKFileInfo BKTKFileInfo;
+typedef struct BKTKGroup BKTKGroup;
+typedef struct BKTKProfileCounter BKTKProfileCounter;
 
 /**
  * Defines an offset in the given string
@@ -61,6 +84,16 @@ struct BKTKFileInfo
 	} tickRate;
 };
 
+/**
+ * Profiling counters of a track or group
+ */
+struct BKTKProfileCounter
+{
+	uint64_t calls;      // number of calls or divider callbacks
+	uint64_t dispatches; // number of executed instructions
+	uint64_t nanos;      // time spent in divider callbacks
+};
+
 /**
  * Get the next power of 2
  */
@@ -21,15 +21,38 @@
  * IN THE SOFTWARE.
  */
 
+#define _POSIX_C_SOURCE 200112L
+
+#include <pthread.h>
+#include <unistd.h>
 #include "BKTone.h"
 #include "BKWaveFileReader.h"
 #include "BKTKCompiler.h"
 #include "BKTKTokenizer.h"
 #include "BKTKContext.h"
+#include "BKTKStats.h"
 
-#define MAX_TRACKS     256
-#define MAX_GROUPS     256
+#define MAX_TRACKS     (1 << 16)
+#define MAX_GROUPS     (1 << 16)
 #define MAX_SEQ_LENGTH 256
+#define MAX_WORKERS    32
+
+#define MIN_PARALLEL_JOBS 8
+
+#define CONTENT_HASH_BASIS 0xCBF29CE484222325
+
+#define OUTLINE_MIN_UNITS 4
+#define OUTLINE_MAX_UNITS 64
+#define OUTLINE_SORT_BITS 8
+#define OUTLINE_NO_UNIT   ((BKUSize) -1)
+#define MAX_OUTLINE_GROUP 2047 // `idx1` of narrow call instruction
+
+#define NARROW_ARG2_MAX ((1 << 12) - 1) // `arg2` fields
+#define NARROW_GRP_MAX  ((1 << 11) - 1) // `grp` indices
+
+#define VERIFY_NEW    0
+#define VERIFY_ACTIVE 1 // on current call path
+#define VERIFY_DONE   2
 
 #define VOLUME_UNIT (BK_MAX_VOLUME / 255)
 #define PITCH_UNIT (BK_FINT20_UNIT / 100)
@@ -230,39 +253,212 @@ static struct keyval const pulseNames [] =
 #define NUM_REPEAT_NAMES (sizeof (repeatNames) / sizeof (struct keyval))
 #define NUM_PULSE_NAMES (sizeof (pulseNames) / sizeof (struct keyval))
 
+#define KEYVAL_MAX_SLOTS 256
+
 /**
- * Convert string to signed integer like `atoi`
+ * Perfect hash table generated from a lookup table
  *
- * Returns alternative value if string is NULL
+ * `slots` contains the item index + 1 or 0 if empty
  */
-static int strtolx (uint8_t const * str, int alt)
+struct keyvalTable
+{
+	struct keyval const * items;
+	BKUSize               size;
+	uint32_t              seed;
+	uint32_t              mask;
+	uint8_t               slots [KEYVAL_MAX_SLOTS];
+};
+
+BK_INLINE uint32_t keyvalHash (uint8_t const * str, BKUSize len, uint32_t seed)
+{
+	uint32_t hash = 2166136261u ^ seed;
+
+	for (BKUSize i = 0; i < len; i ++) {
+		hash = (hash ^ str [i]) * 16777619u;
+	}
+
+	return hash ^ (hash >> 15);
+}
+
+/**
+ * Perfect hash tables of lookup tables
+ *
+ * `seed` is the lowest seed for which `keyvalHash` maps all names to
+ * different slots. The number of slots is the next power of 2 of 4 times the
+ * number of names but at most `KEYVAL_MAX_SLOTS`. Tables have to be
+ * generated again when names are changed.
+ */
+static struct keyvalTable const noteTable =
+{
+	noteNames, NUM_NOTE_NAMES, 1, 0x3F,
+	{
+		 0, 11,  0,  0,  0,  0,  0,  0,  0,  0,  3, 12,  7,  0,  0,  0,
+		 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  2,  0, 13,  0,  9,  0,
+		 0,  0,  0,  0,  0,  0,  0,  1,  0,  0,  5,  8,  0,  0,  0,  0,
+		 0,  0,  0,  0,  0,  0,  0,  0,  6,  0,  0,  0,  0,  4,  0, 10,
+	},
+};
+
+static struct keyvalTable const cmdTable =
+{
+	cmdNames, NUM_CMD_NAMES, 23, 0xFF,
+	{
+		11,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  9,  0,  0,
+		 0,  0,  0,  0,  3,  0,  0, 19,  0,  0, 35,  0, 24,  0, 16,  0,
+		 6,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 13,  0,  0,
+		 0,  0, 31,  0, 34,  0,  0, 18,  0,  0,  0,  0, 26,  0,  0,  0,
+		 0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 29,  0,  0,  0,  0,  0,
+		 0,  0,  0,  0, 15,  0,  0,  0,  0,  0,  0, 25,  0,  2,  0,  0,
+		40,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 23,  0,  0,  0,  0,
+		 0,  0,  0,  0,  7,  0,  0,  0,  0, 12,  0,  0,  0,  0,  0,  0,
+		 0,  0,  0,  0,  0,  0, 38,  0, 32,  0, 28,  0,  0,  0,  0,  0,
+		 0,  0,  0,  0,  0,  0,  0,  5,  0,  0,  4,  0,  0,  0,  0,  0,
+		 0,  0, 20,  0,  0, 33,  0, 36, 30,  0,  0,  0, 27,  0,  0,  0,
+		 0,  0,  0,  0,  0, 14,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+		 0,  0,  0,  0,  0,  0,  0,  8, 22,  0, 37,  0,  0,  0,  0,  0,
+		 0,  1,  0,  0,  0,  0,  0, 17,  0,  0,  0,  0, 39,  0,  0,  0,
+		 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+		 0,  0,  0,  0,  0,  0,  0, 10, 21,  0,  0,  0,  0,  0,  0,  0,
+	},
+};
+
+static struct keyvalTable const effectTable =
+{
+	effectNames, NUM_EFFECT_NAMES, 0, 0x1F,
+	{
+		 0,  0,  4,  0,  0,  0,  0,  0,  2,  3,  0,  0,  0,  0,  0,  0,
+		 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  0,  5,  0,  0,
+	},
+};
+
+static struct keyvalTable const waveformTable =
+{
+	waveformNames, NUM_WAVEFORM_NAMES, 5, 0x7F,
+	{
+		 0,  0,  0,  0,  0,  0,  0,  5,  0, 15,  0,  0,  0,  0,  0,  0,
+		 0,  0,  0,  0, 14,  0,  0,  0,  0,  0,  3,  0,  0,  0,  0,  0,
+		 0,  0,  0,  0,  0,  0,  1,  0,  0,  0,  0,  0,  0,  0,  9,  0,
+		 0,  0,  0, 13,  0,  0,  0,  0,  0,  0,  0, 12,  0,  0,  0, 11,
+		 0,  0,  0,  0,  4, 10,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+		 0,  0,  0,  0,  0,  0,  6,  0,  0,  0,  0,  0,  0,  0,  0, 18,
+		 0, 17,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+		 7,  0, 16,  8,  0,  0,  0,  0,  0,  0,  2,  0,  0,  0,  0,  0,
+	},
+};
+
+static struct keyvalTable const envelopeTable =
+{
+	envelopeNames, NUM_ENVELOPE_NAMES, 0, 0x3F,
+	{
+		 0,  0,  0,  0,  0,  0,  0,  0,  0,  4,  5,  0,  0,  0,  0,  0,
+		 0,  8,  0,  0,  7,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+		 0,  0,  0,  3,  0,  2,  0,  0,  0,  0,  0,  0,  0,  0,  9,  0,
+		 0,  0,  0,  0,  1,  0,  0,  6,  0,  0,  0,  0,  0,  0,  0,  0,
+	},
+};
+
+static struct keyvalTable const miscTable =
+{
+	miscNames, NUM_MISC_NAMES, 0, 0x1F,
+	{
+		 1,  0,  0,  0,  0,  0,  0,  4,  0,  0,  2,  0,  0,  0,  0,  0,
+		 0,  0,  0,  0,  0,  0,  0,  0,  0,  3,  6,  0,  0,  5,  0,  0,
+	},
+};
+
+static struct keyvalTable const repeatTable =
+{
+	repeatNames, NUM_REPEAT_NAMES, 0, 0x0F,
+	{
+		 0,  0,  0,  0,  0,  0,  1,  0,  3,  2,  0,  0,  0,  0,  0,  0,
+	},
+};
+
+static struct keyvalTable const pulseTable =
+{
+	pulseNames, NUM_PULSE_NAMES, 0, 0x07,
+	{
+		 0,  1,  0,  0,  0,  0,  2,  0,
+	},
+};
+
+_Static_assert (NUM_NOTE_NAMES == 13, "noteTable has to be generated again");
+_Static_assert (NUM_CMD_NAMES == 40, "cmdTable has to be generated again");
+_Static_assert (NUM_EFFECT_NAMES == 5, "effectTable has to be generated again");
+_Static_assert (NUM_WAVEFORM_NAMES == 18, "waveformTable has to be generated again");
+_Static_assert (NUM_ENVELOPE_NAMES == 9, "envelopeTable has to be generated again");
+_Static_assert (NUM_MISC_NAMES == 6, "miscTable has to be generated again");
+_Static_assert (NUM_REPEAT_NAMES == 3, "repeatTable has to be generated again");
+_Static_assert (NUM_PULSE_NAMES == 2, "pulseTable has to be generated again");
+
+/**
+ * Scan signed integer like `strtol`
+ *
+ * Leading whitespace is skipped and value is clamped to `BKInt`
+ * Advances `*str` and returns 1 if a number was found
+ */
+static BKInt scanInt (uint8_t const ** str, BKInt * outValue)
 {
-	uint8_t * end;
-	long i = strtol ((char *) str, (char **) &end, 10);
+	uint8_t const * s = *str;
+	int64_t value = 0;
+	BKInt sign = 1;
+
+	while (*s == ' ' || (*s >= '\t' && *s <= '\r')) {
+		s ++;
+	}
+
+	if (*s == '-' || *s == '+') {
+		sign = (*s == '-') ? -1 : 1;
+		s ++;
+	}
+
+	if (*s < '0' || *s > '9') {
+		return 0;
+	}
+
+	do {
+		if (value <= INT32_MAX) {
+			value = value * 10 + (*s - '0');
+		}
+
+		s ++;
+	}
+	while (*s >= '0' && *s <= '9');
+
+	value = BKClamp (value * sign, INT32_MIN, INT32_MAX);
 
-	return end > str ? (int) i : alt;
+	*outValue = (BKInt) value;
+	*str = s;
+
+	return 1;
 }
 
 /**
- * Compare name of command with string
- * Used as callback for `bsearch`
+ * Convert string to signed integer like `atoi`
+ *
+ * Returns alternative value if string is NULL
  */
-static int keyvalcmp (BKString const * name, struct keyval const * item)
+static int strtolx (uint8_t const * str, int alt)
 {
-	return strcmp ((void *) name -> str, item -> name);
+	BKInt value;
+
+	return scanInt (&str, &value) ? value : alt;
 }
 
-static BKInt keyvalLookup (struct keyval const table [], BKSize size, BKString const * name, BKInt * outValue, BKUInt * outFlags)
+static BKInt keyvalLookupChars (struct keyvalTable const * table, uint8_t const * str, BKUSize len, BKInt * outValue, BKUInt * outFlags)
 {
-	struct keyval * item;
+	struct keyval const * item;
+	BKUInt slot;
 
-	if (name == NULL) {
+	slot = table -> slots [keyvalHash (str, len, table -> seed) & table -> mask];
+
+	if (!slot) {
 		return 0;
 	}
 
-	item = bsearch (name, table, size, sizeof (struct keyval), (void *) keyvalcmp);
+	item = &table -> items [slot - 1];
 
-	if (item == NULL) {
+	if (strncmp ((char *) str, item -> name, len) != 0 || item -> name [len] != '\0') {
 		return 0;
 	}
 
@@ -275,6 +471,15 @@ static BKInt keyvalLookup (struct keyval const table [], BKSize size, BKString c
 	return 1;
 }
 
+static BKInt keyvalLookup (struct keyvalTable const * table, BKString const * name, BKInt * outValue, BKUInt * outFlags)
+{
+	if (name == NULL) {
+		return 0;
+	}
+
+	return keyvalLookupChars (table, name -> str, name -> len, outValue, outFlags);
+}
+
 /**
  * Escape string and limit output
  */
@@ -326,6 +531,119 @@ BK_INLINE BKInstrMask BKReadIntrMask (void ** opcode)
 	return mask;
 }
 
+BK_INLINE BKInt fitsArg2 (BKInt value)
+{
+	return value >= -NARROW_ARG2_MAX - 1 && value <= NARROW_ARG2_MAX;
+}
+
+/**
+ * Append `word` to `byteCode`
+ */
+BK_INLINE BKInt appendWord (BKTKArenaArray * byteCode, uint32_t word, BKTKArena * arena)
+{
+	return BKTKArenaArrayPush (byteCode, &word, arena);
+}
+
+/**
+ * Append instruction `cmd` with operands which do not fit into its fields
+ */
+static void appendWide (BKTKArenaArray * byteCode, uint32_t cmd, BKInt const args [], BKUInt count, BKTKArena * arena)
+{
+	appendWord (byteCode, BKInstrMaskArg1Make (BKIntrWide, count), arena);
+	appendWord (byteCode, cmd, arena);
+
+	for (BKUInt i = 0; i < count; i ++) {
+		appendWord (byteCode, BKInstrMaskArg1Make (0, BKClamp (args [i], -BK_INTR_WIDE_MAX, BK_INTR_WIDE_MAX)), arena);
+	}
+}
+
+/**
+ * Get number of words of instruction in linked byte code
+ *
+ * Calls include the line and column words following them.
+ */
+static BKUInt instrSize (uint32_t const * words, BKUSize numWords)
+{
+	BKInstrMask mask = (BKInstrMask) {.value = words [0]};
+	BKUSize size = 1;
+
+	switch (mask.arg1.cmd) {
+		case BKIntrCall:
+		case BKIntrSampleRange:
+		case BKIntrSampleSustainRange: {
+			size = 3;
+			break;
+		}
+		case BKIntrEffect: {
+			size = 4;
+			break;
+		}
+		case BKIntrWide: {
+			size = 2 + BKMax (mask.arg1.arg1, 0);
+
+			if (numWords > 1 && ((BKInstrMask) {.value = words [1]}).arg1.cmd == BKIntrCall) {
+				size += 2;
+			}
+			break;
+		}
+	}
+
+	return (BKUInt) BKMin (size, numWords);
+}
+
+/**
+ * Operands of call instruction
+ */
+struct callOperands
+{
+	BKInt type;
+	BKInt group;
+	BKInt track;
+	BKInt lineno;
+	BKInt colno;
+};
+
+/**
+ * Read call instruction which may be prefixed with `BKIntrWide`
+ *
+ * Returns 0 if the instruction at `words` is not a call.
+ */
+static BKInt readCall (uint32_t const * words, BKUSize numWords, struct callOperands * outCall)
+{
+	BKInstrMask mask = (BKInstrMask) {.value = words [0]};
+	BKInstrMask call = mask;
+	BKUSize size = instrSize (words, numWords);
+
+	*outCall = (struct callOperands) {0};
+
+	if (mask.arg1.cmd == BKIntrWide) {
+		if (size < 6 || mask.arg1.arg1 < 2) {
+			return 0;
+		}
+
+		call = (BKInstrMask) {.value = words [1]};
+		outCall -> group = ((BKInstrMask) {.value = words [2]}).arg1.arg1;
+		outCall -> track = ((BKInstrMask) {.value = words [3]}).arg1.arg1;
+	}
+	else if (mask.arg1.cmd == BKIntrCall) {
+		outCall -> group = mask.grp.idx1;
+		outCall -> track = mask.grp.idx2;
+	}
+
+	if (call.arg1.cmd != BKIntrCall) {
+		return 0;
+	}
+
+	outCall -> type = call.grp.type;
+
+	if (size >= 3) {
+		outCall -> lineno = ((BKInstrMask) {.value = words [size - 2]}).arg1.arg1;
+		outCall -> colno = ((BKInstrMask) {.value = words [size - 1]}).arg1.arg1;
+	}
+
+	return 1;
+}
+
 static void printErrorUnexpectedCommand (BKTKCompiler * compiler, BKTKParserNode const * node)
 {
 	char const * type = (node -> flags & BKTKParserFlagIsGroup) ? "group" : "command";
@@ -357,21 +675,34 @@ static void printError (BKTKCompiler * compiler, BKTKParserNode const * node, ch
  */
 static BKInt parseNote (BKString const * string, BKInt * outNote, BKInt * outPitch)
 {
-	char noteStr [4];
+	uint8_t const * str = string -> str;
+	BKUSize len = 0;
 	BKInt value  = 0;
 	BKInt octave = 0;
 	BKInt pitch  = 0;
 	BKInt res;
-	BKString note = (BKString) {
-		.str = (uint8_t *) noteStr,
-		.len = 0,
-		.cap = 4,
-	};
 
-	BKStringEmpty (&note);
-	res = sscanf ((char *) string -> str, "%2[a-z#]%zn%d%d", note.str, &note.len, &octave, &pitch); // d#3[+-p] => "d#", 3, p
+	// d#3[+-p] => "d#", 3, p
+	while (len < 2 && ((str [len] >= 'a' && str [len] <= 'z') || str [len] == '#')) {
+		len ++;
+	}
+
+	if (!len) {
+		return 0;
+	}
+
+	res = 1;
+	str += len;
+
+	if (scanInt (&str, &octave)) {
+		res ++;
+
+		if (scanInt (&str, &pitch)) {
+			res ++;
+		}
+	}
 
-	if (keyvalLookup (noteNames, NUM_NOTE_NAMES, &note, & value, NULL)) {
+	if (keyvalLookupChars (&noteTable, string -> str, len, &value, NULL)) {
 		value += octave * 12;
 		*outNote = BKClamp (value, BK_MIN_NOTE, BK_MAX_NOTE);
 		*outPitch = pitch;
@@ -390,11 +721,24 @@ static BKInt parseNote (BKString const * string, BKInt * outNote, BKInt * outPit
  */
 static BKInt parseGroupIndex (BKString const * string, BKInt * outIdx, BKInt * outIdx2, BKInt * outType)
 {
-	BKInt res;
+	uint8_t const * str = string -> str;
+	BKInt res = 0;
 	BKInt idx = 0, idx2 = 0;
 	uint8_t type = BKGroupIndexTypeLocal;
 
-	res = sscanf ((char *) string -> str, "%d%c%d", &idx, &type, &idx2); // 12t17 => 12, 't', 17
+	// 12t17 => 12, 't', 17
+	if (scanInt (&str, &idx)) {
+		res ++;
+
+		if (*str) {
+			type = *str ++;
+			res ++;
+
+			if (scanInt (&str, &idx2)) {
+				res ++;
+			}
+		}
+	}
 
 	switch (type) {
 		case 'g': {
@@ -416,24 +760,32 @@ static BKInt parseGroupIndex (BKString const * string, BKInt * outIdx, BKInt * o
 
 static void parseTicksFormat (BKString const * format, BKInt args [2])
 {
+	uint8_t const * str = format -> str;
+
 	args [0] = 0;
 	args [1] = 0;
 
-	if (sscanf ((char *) format -> str, "%d/%d", &args [0], &args [1]) >= 2) {
-		args [0] = BKClamp (args [0], 1, 1 << 12);
-		args [1] = BKClamp (args [1], 1, 1 << 12);
+	// 3/4 => 3, 4
+	if (scanInt (&str, &args [0]) && *str ++ == '/' && scanInt (&str, &args [1])) {
+		args [0] = BKClamp (args [0], 1, BK_INTR_WIDE_MAX);
+		args [1] = BKClamp (args [1], 1, BK_INTR_WIDE_MAX);
 	}
 }
 
 static BKInt parseDataParams (BKString const * arg)
 {
+	uint8_t const * str = arg -> str;
 	BKUInt params = 0;
 	BKInt endian = 0;
 	BKInt bits = 16;
 	uint8_t sign = 's';
 	uint8_t endianChar = 0;
 
-	sscanf ((char *) arg -> str, "%d%c%c", &bits, &sign, &endianChar);
+	// 8ub => 8, 'u', 'b'
+	if (scanInt (&str, &bits) && *str) {
+		sign = *str ++;
+		endianChar = *str;
+	}
 
 	switch (bits) {
 		case 1:  params |= BK_1_BIT_UNSIGNED; break;
@@ -490,113 +842,398 @@ static BKInt nodeArgInt (BKTKParserNode const * node, BKUSize offset, BKInt alt)
 	return strtolx ((uint8_t *) nodeArgString (node, offset) -> str, alt);
 }
 
-static BKInt firstUnusedSlot (BKArray * list)
+/**
+ * Get symbol table names are interned into
+ */
+BK_INLINE BKTKSymbolTable * BKTKCompilerSymbols (BKTKCompiler const * compiler)
+{
+	return compiler -> symbols ? compiler -> symbols : (BKTKSymbolTable *) &compiler -> localSymbols;
+}
+
+/**
+ * Get symbol of node argument at `offset`
+ *
+ * Symbols interned by the parser are only used if its table is shared with
+ * the compiler; the table is not read then, as the parser may be interning
+ * symbols while workers are compiling. Otherwise, the argument is looked up
+ * by name.
+ * Returns 0 if no argument exists at given offset or its name is not interned
+ */
+static BKUInt BKTKCompilerArgSymbol (BKTKCompiler const * compiler, BKTKParserNode const * node, BKUSize offset)
 {
-	BKInt i;
-	BKTKObject const * object;
+	BKString const * arg;
 
-	for (i = 0; i < list -> len; i ++) {
-		object = *(BKTKObject **) BKArrayItemAt (list, i);
+	if (offset >= node -> argCount) {
+		return 0;
+	}
 
-		if (!object || !(object -> object.flags & BKTKFlagUsed)) {
-			break;
-		}
+	if (compiler -> symbols && node -> argSymbols) {
+		return node -> argSymbols [offset];
 	}
 
-	return i;
+	arg = &node -> args [offset];
+
+	return BKTKSymbolTableLookup (BKTKCompilerSymbols (compiler), arg -> str, arg -> len);
 }
 
-static BKTKTrack * BKTKCompilerTrackAtOffset (BKTKCompiler * compiler, BKUSize offset, BKInt create)
+/**
+ * Get objects defined with `symbol`
+ *
+ * Returns NULL if `symbol` is 0 or if nothing is defined and `create` is 0
+ */
+static BKTKCompilerSymbol * BKTKCompilerSymbolAt (BKTKCompiler * compiler, BKUInt symbol, BKInt create)
 {
-	BKTKTrack * track;
-	BKTKTrack ** trackRef;
+	BKUSize len = compiler -> symbolObjects.len;
 
-	if (BKArrayResize (&compiler -> tracks, offset + 1) != 0) {
+	if (!symbol) {
 		return NULL;
 	}
 
-	trackRef = BKArrayItemAt (&compiler -> tracks, offset);
-	track = *trackRef;
-
-	if (!track && create) {
-		track = calloc (1, sizeof (BKTKTrack));
-
-		if (!track) {
+	if (symbol >= len) {
+		if (!create) {
 			return NULL;
 		}
 
-		*trackRef = track;
+		if (BKArrayResize (&compiler -> symbolObjects, symbol + 1) != 0) {
+			return NULL;
+		}
 
-		track -> byteCode = BK_BYTE_BUFFER_INIT;
-		track -> groups = BK_ARRAY_INIT (sizeof (BKTKGroup *));
+		memset (BKArrayItemAt (&compiler -> symbolObjects, len), 0, (symbol + 1 - len) * sizeof (BKTKCompilerSymbol));
 	}
 
-	return track;
+	return BKArrayItemAt (&compiler -> symbolObjects, symbol);
 }
 
-static BKTKGroup * BKTKCompilerTrackGroupAtOffset (BKTKTrack * track, BKUSize offset, BKInt create)
+BK_INLINE BKInt offsetIsBefore (BKTKOffset a, BKTKOffset b)
 {
-	BKTKGroup * group;
-	BKTKGroup ** groupRef;
-
-	if (BKArrayResize (&track -> groups, offset + 1) != 0) {
-		return NULL;
-	}
-
-	groupRef = BKArrayItemAt (&track -> groups, offset);
-	group = *groupRef;
+	return a.lineno < b.lineno || (a.lineno == b.lineno && a.colno < b.colno);
+}
 
-	if (!group && create) {
-		group = calloc (1, sizeof (BKTKGroup));
+/**
+ * Get `ref` if object at index `ref` - 1 is defined before the horizon
+ *
+ * Returns 0 otherwise. Track bodies are compiled after all definitions are
+ * collected; later objects are hidden to get the same result as compiling
+ * in file order.
+ */
+static BKUInt BKTKCompilerVisibleRef (BKTKCompiler const * compiler, BKArray const * objects, BKUInt ref)
+{
+	BKTKObject const * object;
 
-		if (!group) {
-			return NULL;
-		}
+	if (!ref) {
+		return 0;
+	}
 
-		*groupRef = group;
+	object = *(BKTKObject **) BKArrayItemAt (objects, ref - 1);
 
-		group -> byteCode = BK_BYTE_BUFFER_INIT;
+	if (!object || !offsetIsBefore (object -> offset, compiler -> horizon)) {
+		return 0;
 	}
 
-	return group;
+	return ref;
 }
 
-BKInt BKTKCompilerInit (BKTKCompiler * compiler)
+/**
+ * Track body to be compiled by a worker
+ *
+ * Messages of other top-level nodes are kept in jobs without `track` to
+ * merge all messages in file order.
+ */
+struct trackJob
 {
-	BKInt res;
+	BKTKParserNode const * tree;
+	BKTKTrack            * track;
+	BKTKArena              nodes; // owns `tree` if moved from the parser
+	BKInt                  res;
+	BKString               error;
+};
 
-	if ((res = BKObjectInit (compiler, &BKTKCompilerClass, sizeof (*compiler))) != 0) {
-		return res;
-	}
+/**
+ * Groups are allocated in the arena of the worker and moved to the compiler
+ * when all jobs are done
+ */
+struct jobWorker
+{
+	BKTKCompiler * compiler;
+	BKTKArena      arena;
+};
 
-	compiler -> tracks      = BK_ARRAY_INIT (sizeof (BKTKTrack *));
-	compiler -> instruments = BK_HASH_TABLE_INIT;
-	compiler -> waveforms   = BK_HASH_TABLE_INIT;
-	compiler -> samples     = BK_HASH_TABLE_INIT;
-	compiler -> auxString   = BK_STRING_INIT;
-	compiler -> error       = BK_STRING_INIT;
+/**
+ * Jobs are pushed by the thread putting the nodes and taken by the workers
+ * in file order
+ *
+ * Definitions are added with `objectsLock` held for writing, as workers may
+ * look up objects at the same time.
+ */
+struct BKTKCompilerPool
+{
+	BKArray          jobs; // struct trackJob
+	BKUSize          nextJob;
+	BKUSize          numTracks;
+	BKInt            ending;
+	BKUInt           numThreads;
+	pthread_mutex_t  lock;
+	pthread_cond_t   cond;
+	pthread_rwlock_t objectsLock;
+	pthread_t        threads [MAX_WORKERS];
+	struct jobWorker workers [MAX_WORKERS];
+};
 
-	if ((res = BKTKCompilerReset (compiler)) != 0) {
-		return -1;
+/**
+ * Get compiler owning the object tables and lock them for reading
+ *
+ * Workers look up objects in the compiler which put the node.
+ */
+static BKTKCompiler * BKTKCompilerLockObjects (BKTKCompiler * compiler)
+{
+	if (!compiler -> owner) {
+		return compiler;
 	}
 
-	return 0;
+	pthread_rwlock_rdlock (&compiler -> owner -> pool -> objectsLock);
+
+	return compiler -> owner;
 }
 
-static BKInt BKTKCompilerCompileCommand (BKTKCompiler * compiler, BKTKParserNode const * node, BKByteBuffer * byteCode, BKInt cmd, BKInt level)
+static void BKTKCompilerUnlockObjects (BKTKCompiler * compiler)
 {
-	BKInt arg;
-	BKInt args [8];
-	BKString const * name;
-	BKInt note, note2;
-
-	if (BKByteBufferReserve (byteCode, 64 * sizeof (uint32_t)) != 0) {
-		goto allocationError;
+	if (compiler -> owner) {
+		pthread_rwlock_unlock (&compiler -> owner -> pool -> objectsLock);
 	}
+}
 
-	if (compiler -> lineno != node -> offset.lineno) {
-		compiler -> lineno = node -> offset.lineno;
-		BKByteBufferAppendInt32 (byteCode, BKInstrMaskArg1Make (BKIntrLineNo, (BKInt) compiler -> lineno));
+/**
+ * Lock object tables for adding definitions while workers may be running
+ */
+static void BKTKCompilerLockDefinitions (BKTKCompiler * compiler)
+{
+	if (compiler -> pool) {
+		pthread_rwlock_wrlock (&compiler -> pool -> objectsLock);
+	}
+}
+
+static void BKTKCompilerUnlockDefinitions (BKTKCompiler * compiler)
+{
+	if (compiler -> pool) {
+		pthread_rwlock_unlock (&compiler -> pool -> objectsLock);
+	}
+}
+
+/**
+ * Get name and symbol of object defined by `tree`
+ *
+ * Autoindexed objects are named by `index`. The name is interned, as the
+ * references may not be parsed yet when streaming nodes.
+ * Returns 0 if the name could not be interned
+ */
+static BKUInt BKTKCompilerObjectName (BKTKCompiler * compiler, BKTKParserNode const * tree, BKUSize index, BKString * outName, BKInt * outAutoindex)
+{
+	BKUInt symbol;
+	char indexStr [24];
+	BKString const * name = nodeArgString (tree, 0);
+
+	*outAutoindex = name -> len == 0;
+
+	if (!*outAutoindex) {
+		BKStringAppendString (outName, name);
+
+		if ((symbol = BKTKCompilerArgSymbol (compiler, tree, 0)) != 0) {
+			return symbol;
+		}
+	}
+	else {
+		snprintf (indexStr, sizeof (indexStr), "%zu", (size_t) index);
+		BKStringAppend (outName, indexStr);
+	}
+
+	if (BKTKSymbolTableIntern (BKTKCompilerSymbols (compiler), outName -> str, outName -> len, &symbol) != 0) {
+		return 0;
+	}
+
+	return symbol;
+}
+
+static BKTKCompilerContent * BKTKCompilerPushContent (BKArray * contents)
+{
+	BKTKCompilerContent * content = BKArrayPushPtr (contents);
+
+	if (content) {
+		*content = (BKTKCompilerContent) {.hash = CONTENT_HASH_BASIS};
+	}
+
+	return content;
+}
+
+/**
+ * Append compiled data to contents and update hash
+ */
+static BKInt contentAppend (BKTKCompilerContent * content, void const * data, BKUSize size)
+{
+	BKUSize capacity;
+	uint8_t * newData;
+	uint8_t const * bytes = data;
+
+	if (content -> size + size > content -> capacity) {
+		capacity = BKMax (content -> capacity * 2, BKNextPow2 (content -> size + size));
+		newData = realloc (content -> data, capacity);
+
+		if (!newData) {
+			return BK_ALLOCATION_ERROR;
+		}
+
+		BKTKStatsCountAlloc (BKTKStatsTypeCompiler, capacity);
+
+		content -> data = newData;
+		content -> capacity = capacity;
+	}
+
+	for (BKUSize i = 0; i < size; i ++) {
+		content -> hash = (content -> hash ^ bytes [i]) * 0x100000001B3;
+	}
+
+	memcpy (&content -> data [content -> size], data, size);
+	content -> size += size;
+
+	return 0;
+}
+
+static void contentsFreeData (BKArray * contents)
+{
+	BKTKCompilerContent * content;
+
+	for (BKUSize i = 0; i < contents -> len; i ++) {
+		content = BKArrayItemAt (contents, i);
+		free (content -> data);
+		content -> data = NULL;
+		content -> size = 0;
+		content -> capacity = 0;
+	}
+}
+
+/**
+ * Get index of object which `index` was merged into
+ */
+static BKInt mergedIndex (BKArray const * contents, BKInt index)
+{
+	BKTKCompilerContent const * content;
+
+	if (index < 0 || (BKUSize) index >= contents -> len) {
+		return index;
+	}
+
+	content = BKArrayItemAt (contents, index);
+
+	return content -> index;
+}
+
+static BKInt firstUnusedSlot (void * const * objects, BKUSize count)
+{
+	BKInt i;
+	BKTKObject const * object;
+
+	for (i = 0; i < count; i ++) {
+		object = objects [i];
+
+		if (!object || !(object -> object.flags & BKTKFlagUsed)) {
+			break;
+		}
+	}
+
+	return i;
+}
+
+static BKTKTrack * BKTKCompilerTrackAtOffset (BKTKCompiler * compiler, BKUSize offset, BKInt create)
+{
+	BKTKTrack * track;
+	BKTKTrack ** trackRef;
+
+	if (BKArrayResize (&compiler -> tracks, offset + 1) != 0) {
+		return NULL;
+	}
+
+	trackRef = BKArrayItemAt (&compiler -> tracks, offset);
+	track = *trackRef;
+
+	if (!track && create) {
+		if (BKTKTrackAlloc (&track, &compiler -> arena) != 0) {
+			return NULL;
+		}
+
+		*trackRef = track;
+	}
+
+	return track;
+}
+
+static BKTKGroup * BKTKCompilerTrackGroupAtOffset (BKTKCompiler * compiler, BKTKTrack * track, BKUSize offset, BKInt create)
+{
+	BKTKGroup * group;
+	BKTKGroup ** groupRef;
+
+	if (offset >= track -> code -> groups.len && BKTKArenaArrayResize (&track -> code -> groups, offset + 1, &compiler -> arena) != 0) {
+		return NULL;
+	}
+
+	groupRef = BKTKArenaArrayItemAt (&track -> code -> groups, offset);
+	group = *groupRef;
+
+	if (!group && create) {
+		if (BKTKGroupAlloc (&group, &compiler -> arena) != 0) {
+			return NULL;
+		}
+
+		*groupRef = group;
+	}
+
+	return group;
+}
+
+BKInt BKTKCompilerInit (BKTKCompiler * compiler)
+{
+	BKInt res;
+
+	if ((res = BKObjectInit (compiler, &BKTKCompilerClass, sizeof (*compiler))) != 0) {
+		return res;
+	}
+
+	compiler -> tracks      = BK_ARRAY_INIT (sizeof (BKTKTrack *));
+	compiler -> instruments   = BK_ARRAY_INIT (sizeof (BKTKInstrument *));
+	compiler -> waveforms     = BK_ARRAY_INIT (sizeof (BKTKWaveform *));
+	compiler -> samples       = BK_ARRAY_INIT (sizeof (BKTKSample *));
+	compiler -> symbolObjects = BK_ARRAY_INIT (sizeof (BKTKCompilerSymbol));
+	compiler -> instrumentContents = BK_ARRAY_INIT (sizeof (BKTKCompilerContent));
+	compiler -> waveformContents   = BK_ARRAY_INIT (sizeof (BKTKCompilerContent));
+	compiler -> arpeggios   = BK_ARRAY_INIT (sizeof (BKTKArpeggio));
+	compiler -> auxString   = BK_STRING_INIT;
+	compiler -> error       = BK_STRING_INIT;
+	compiler -> arena       = BK_TK_ARENA_INIT (BKTKStatsTypeCompiler);
+
+	if ((res = BKTKSymbolTableInit (&compiler -> localSymbols)) != 0) {
+		return res;
+	}
+
+	if ((res = BKTKCompilerReset (compiler)) != 0) {
+		return -1;
+	}
+
+	return 0;
+}
+
+static BKInt BKTKCompilerCompileCommand (BKTKCompiler * compiler, BKTKParserNode const * node, BKTKArenaArray * byteCode, BKInt cmd, BKInt level)
+{
+	BKInt arg;
+	BKInt args [8];
+	BKString const * name;
+	BKInt note, note2;
+
+	if (BKTKArenaArrayReserve (byteCode, 64, &compiler -> arena) != 0) {
+		goto allocationError;
+	}
+
+	if (compiler -> lineno != node -> offset.lineno) {
+		compiler -> lineno = node -> offset.lineno;
+		// larger lines would be read as relative to the call of an outlined group
+		appendWord (byteCode, BKInstrMaskArg1Make (BKIntrLineNo, BKMin (compiler -> lineno, BK_INTR_MAX_LINENO)), &compiler -> arena);
 	}
 
 	switch (cmd) {
@@ -621,10 +1258,10 @@ static BKInt BKTKCompilerCompileCommand (BKTKCompiler * compiler, BKTKParserNode
 			}
 
 			note = args [0] * 100 + args [1];
-			BKByteBufferAppendInt32 (byteCode, BKInstrMaskArg1Make (cmd, note));
+			appendWord (byteCode, BKInstrMaskArg1Make (cmd, note), &compiler -> arena);
 
 			if (node -> argCount > 1) {
-				BKByteBufferAppendInt32 (byteCode, BKInstrMaskArg1Make (BKIntrArpeggio, (BKInt) node -> argCount - 1));
+				appendWord (byteCode, BKInstrMaskArg1Make (BKIntrArpeggio, (BKInt) node -> argCount - 1), &compiler -> arena);
 
 				for (i = 1; i < node -> argCount; i ++) {
 					name = nodeArgString (node, i);
@@ -636,7 +1273,7 @@ static BKInt BKTKCompilerCompileCommand (BKTKCompiler * compiler, BKTKParserNode
 					}
 
 					note2 = args [0] * 100 + args [1] - note;
-					BKByteBufferAppendInt32 (byteCode, BKInstrMaskArg1Make (0, note2));
+					appendWord (byteCode, BKInstrMaskArg1Make (0, note2), &compiler -> arena);
 				}
 			}
 
@@ -644,7 +1281,7 @@ static BKInt BKTKCompilerCompileCommand (BKTKCompiler * compiler, BKTKParserNode
 		}
 		case BKIntrStepTicks: {
 			parseTicksFormat (nodeArgString (node, 0), args);
-			BKByteBufferAppendInt32 (byteCode, BKInstrMaskArg2Make (cmd, args [0], args [1]));
+			appendWord (byteCode, BKInstrMaskArg2Make (cmd, args [0], args [1]), &compiler -> arena);
 
 			if (level == 0 && !compiler -> info.stepTicks) {
 				compiler -> info.stepTicks = args [0];
@@ -658,12 +1295,18 @@ static BKInt BKTKCompilerCompileCommand (BKTKCompiler * compiler, BKTKParserNode
 		case BKIntrMuteTicks:
 		case BKIntrAttackTicks: {
 			parseTicksFormat (nodeArgString (node, 0), args);
-			BKByteBufferAppendInt32 (byteCode, BKInstrMaskArg2Make (cmd, args [0], args [1]));
+
+			if (fitsArg2 (args [0]) && fitsArg2 (args [1])) {
+				appendWord (byteCode, BKInstrMaskArg2Make (cmd, args [0], args [1]), &compiler -> arena);
+			}
+			else {
+				appendWide (byteCode, BKInstrMaskArg1Make (cmd, 0), args, 2, &compiler -> arena);
+			}
 			break;
 		}
 		case BKIntrDutyCycle: {
 			args [0] = BKClamp (nodeArgInt (node, 0, 0), 1, BK_MAX_DUTY_CYCLE);
-			BKByteBufferAppendInt32 (byteCode, BKInstrMaskArg1Make (cmd, args [0]));
+			appendWord (byteCode, BKInstrMaskArg1Make (cmd, args [0]), &compiler -> arena);
 			break;
 		}
 			// range commands
@@ -671,26 +1314,26 @@ static BKInt BKTKCompilerCompileCommand (BKTKCompiler * compiler, BKTKParserNode
 		case BKIntrSampleSustainRange: {
 			args [0] = nodeArgInt (node, 0, 0);
 			args [1] = nodeArgInt (node, 1, 0);
-			BKByteBufferAppendInt32 (byteCode, BKInstrMaskArg1Make (cmd, 0));
-			BKByteBufferAppendInt32 (byteCode, BKInstrMaskArg1Make (0, args [0]));
-			BKByteBufferAppendInt32 (byteCode, BKInstrMaskArg1Make (0, args [1]));
+			appendWord (byteCode, BKInstrMaskArg1Make (cmd, 0), &compiler -> arena);
+			appendWord (byteCode, BKInstrMaskArg1Make (0, args [0]), &compiler -> arena);
+			appendWord (byteCode, BKInstrMaskArg1Make (0, args [1]), &compiler -> arena);
 			break;
 		}
 		case BKIntrSampleRepeat: {
 			name = nodeArgString (node, 0);
 
-			if (!keyvalLookup (repeatNames, NUM_REPEAT_NAMES, name, &arg, NULL)) {
+			if (!keyvalLookup (&repeatTable, name, &arg, NULL)) {
 				printError (compiler, node, "Warning: expected repeat mode: 'no', 'rep', 'pal'");
 				return 0;
 			}
 
-			BKByteBufferAppendInt32 (byteCode, BKInstrMaskArg1Make (cmd, arg));
+			appendWord (byteCode, BKInstrMaskArg1Make (cmd, arg), &compiler -> arena);
 			break;
 		}
 		case BKIntrEffect: {
 			name = nodeArgString (node, 0);
 
-			if (!keyvalLookup (effectNames, NUM_EFFECT_NAMES, name, &args [0], NULL)) {
+			if (!keyvalLookup (&effectTable, name, &args [0], NULL)) {
 				printError (compiler, node, "Warning: expected effect name: 'pr', 'ps', 'tr', 'vb', 'vs'");
 				return 0;
 			}
@@ -712,10 +1355,15 @@ static BKInt BKTKCompilerCompileCommand (BKTKCompiler * compiler, BKTKParserNode
 				}
 			}
 
-			BKByteBufferAppendInt32 (byteCode, BKInstrMaskArg1Make (cmd, args [0]));
-			BKByteBufferAppendInt32 (byteCode, BKInstrMaskArg2Make (0, args [1], args [2]));
-			BKByteBufferAppendInt32 (byteCode, BKInstrMaskArg1Make (0, args [3]));
-			BKByteBufferAppendInt32 (byteCode, BKInstrMaskArg2Make (0, args [4], args [5]));
+			if (fitsArg2 (args [1]) && fitsArg2 (args [2]) && fitsArg2 (args [4]) && fitsArg2 (args [5])) {
+				appendWord (byteCode, BKInstrMaskArg1Make (cmd, args [0]), &compiler -> arena);
+				appendWord (byteCode, BKInstrMaskArg2Make (0, args [1], args [2]), &compiler -> arena);
+				appendWord (byteCode, BKInstrMaskArg1Make (0, args [3]), &compiler -> arena);
+				appendWord (byteCode, BKInstrMaskArg2Make (0, args [4], args [5]), &compiler -> arena);
+			}
+			else {
+				appendWide (byteCode, BKInstrMaskArg1Make (cmd, args [0]), &args [1], 5, &compiler -> arena);
+			}
 
 			break;
 		}
@@ -723,38 +1371,45 @@ static BKInt BKTKCompilerCompileCommand (BKTKCompiler * compiler, BKTKParserNode
 			name = nodeArgString (node, 0);
 			parseGroupIndex (name, &args [0], &args [1], &args [2]);
 			args [1] ++; // 1 based index (0 is root)
-			BKByteBufferAppendInt32 (byteCode, BKInstrMaskGrpMake (BKIntrCall, args [0], args [1], args [2]));
+
+			if (args [0] <= NARROW_GRP_MAX && args [1] <= NARROW_GRP_MAX) {
+				appendWord (byteCode, BKInstrMaskGrpMake (BKIntrCall, args [0], args [1], args [2]), &compiler -> arena);
+			}
+			else {
+				appendWide (byteCode, BKInstrMaskGrpMake (BKIntrCall, 0, 0, args [2]), args, 2, &compiler -> arena);
+			}
+
 			// save file offset for error output
-			BKByteBufferAppendInt32 (byteCode, BKInstrMaskArg1Make (0, node -> offset.lineno));
-			BKByteBufferAppendInt32 (byteCode, BKInstrMaskArg1Make (0, node -> offset.colno));
+			appendWord (byteCode, BKInstrMaskArg1Make (0, node -> offset.lineno), &compiler -> arena);
+			appendWord (byteCode, BKInstrMaskArg1Make (0, node -> offset.colno), &compiler -> arena);
 			break;
 		}
 		case BKIntrPanning: {
 			args [0] = nodeArgInt (node, 0, 0);
 			args [0] = BKClamp (args [0], -255, 255) * VOLUME_UNIT;
-			BKByteBufferAppendInt32 (byteCode, BKInstrMaskArg1Make (cmd, args [0]));
+			appendWord (byteCode, BKInstrMaskArg1Make (cmd, args [0]), &compiler -> arena);
 			break;
 		}
 		case BKIntrPitch: {
 			args [0] = nodeArgInt (node, 0, 0);
-			BKByteBufferAppendInt32 (byteCode, BKInstrMaskArg1Make (cmd, args [0]));
+			appendWord (byteCode, BKInstrMaskArg1Make (cmd, args [0]), &compiler -> arena);
 			break;
 		}
 		case BKIntrPhaseWrap: {
 			args [0] = nodeArgInt (node, 0, 0);
 			args [0] = BKClamp (args [0], 0, 1 << 20);
-			BKByteBufferAppendInt32 (byteCode, BKInstrMaskArg1Make (cmd, args [0]));
+			appendWord (byteCode, BKInstrMaskArg1Make (cmd, args [0]), &compiler -> arena);
 			break;
 		}
 		case BKIntrPulseKernel: {
 			name = nodeArgString (node, 0);
 
-			if (!keyvalLookup (pulseNames, NUM_PULSE_NAMES, name, &args [0], NULL)) {
+			if (!keyvalLookup (&pulseTable, name, &args [0], NULL)) {
 				printError (compiler, node, "Warning: expected pulse kernel name: 'harm', 'sinc'");
 				return -1;
 			}
 
-			BKByteBufferAppendInt32 (byteCode, BKInstrMaskArg1Make (cmd, args [0]));
+			appendWord (byteCode, BKInstrMaskArg1Make (cmd, args [0]), &compiler -> arena);
 			break;
 		}
 		// commands without arguments
@@ -762,20 +1417,33 @@ static BKInt BKTKCompilerCompileCommand (BKTKCompiler * compiler, BKTKParserNode
 		case BKIntrMute:
 		case BKIntrRepeatStart:
 		case BKIntrEnd: {
-			BKByteBufferAppendInt32 (byteCode, BKInstrMaskArg1Make (cmd, 0));
+			appendWord (byteCode, BKInstrMaskArg1Make (cmd, 0), &compiler -> arena);
 			break;
 		}
 		case BKIntrRepeat: {
-			BKByteBufferAppendInt32 (byteCode, BKInstrMaskArg1Make (BKIntrJump, -1));
+			appendWord (byteCode, BKInstrMaskArg1Make (BKIntrJump, -1), &compiler -> arena);
 			break;
 		}
 			// step commands
-		case BKIntrTicks:
+		case BKIntrTicks: {
+			args [0] = nodeArgInt (node, 0, 0);
+			args [1] = 0;
+
+			if (args [0] > 0) {
+				if (fitsArg2 (args [0])) {
+					appendWord (byteCode, BKInstrMaskArg2Make (cmd, args [0], 0), &compiler -> arena);
+				}
+				else {
+					appendWide (byteCode, BKInstrMaskArg1Make (cmd, 0), args, 2, &compiler -> arena);
+				}
+			}
+			break;
+		}
 		case BKIntrStep: {
 			args [0] = nodeArgInt (node, 0, 0);
 
 			if (args [0] > 0) {
-				BKByteBufferAppendInt32 (byteCode, BKInstrMaskArg1Make (cmd, args [0]));
+				appendWord (byteCode, BKInstrMaskArg1Make (cmd, args [0]), &compiler -> arena);
 			}
 			break;
 		}
@@ -784,7 +1452,7 @@ static BKInt BKTKCompilerCompileCommand (BKTKCompiler * compiler, BKTKParserNode
 		case BKIntrMasterVolume: {
 			args [0] = nodeArgInt (node, 0, 0);
 			args [0] = BKClamp (args [0], 0, 255) * VOLUME_UNIT;
-			BKByteBufferAppendInt32 (byteCode, BKInstrMaskArg1Make (cmd, args [0]));
+			appendWord (byteCode, BKInstrMaskArg1Make (cmd, args [0]), &compiler -> arena);
 			break;
 		}
 		case BKIntrTickRate: {
@@ -797,7 +1465,7 @@ static BKInt BKTKCompilerCompileCommand (BKTKCompiler * compiler, BKTKParserNode
 				args [0] = 1;
 			}
 
-			BKByteBufferAppendInt32 (byteCode, BKInstrMaskArg2Make (cmd, args [0], args [1]));
+			appendWord (byteCode, BKInstrMaskArg2Make (cmd, args [0], args [1]), &compiler -> arena);
 
 			if (level == 0 && !compiler -> info.tickRate.factor) {
 				compiler -> info.tickRate.factor = args [0];
@@ -806,40 +1474,61 @@ static BKInt BKTKCompilerCompileCommand (BKTKCompiler * compiler, BKTKParserNode
 			break;
 		}
 		case BKIntrInstrument: {
-			BKTKInstrument * instrument;
+			BKUInt ref = 0;
+			BKTKCompiler * owner;
+			BKTKCompilerSymbol const * objects;
 
 			name = nodeArgString (node, 0);
 
 			if (name -> len) {
-				if (!BKHashTableLookup (&compiler -> instruments, (char *) name -> str, (void **) &instrument)) {
+				owner = BKTKCompilerLockObjects (compiler);
+				objects = BKTKCompilerSymbolAt (owner, BKTKCompilerArgSymbol (owner, node, 0), 0);
+
+				if (objects) {
+					ref = BKTKCompilerVisibleRef (compiler, &owner -> instruments, objects -> instrument);
+				}
+
+				BKTKCompilerUnlockObjects (compiler);
+
+				if (!ref) {
 					printError (compiler, node, "Error: undefined instrument '%s'",
 						BKTKCompilerEscapeString (compiler, name));
 					goto error;
 				}
 
-				BKByteBufferAppendInt32 (byteCode, BKInstrMaskArg1Make (cmd, instrument -> object.index));
+				appendWord (byteCode, BKInstrMaskArg1Make (cmd, ref - 1), &compiler -> arena);
 			}
 			else {
-				BKByteBufferAppendInt32 (byteCode, BKInstrMaskArg1Make (cmd, -1));
+				appendWord (byteCode, BKInstrMaskArg1Make (cmd, -1), &compiler -> arena);
 			}
 
 			break;
 		}
 		case BKIntrWaveform: {
 			BKInt value = -1;
-			BKTKWaveform * waveform = NULL;
+			BKUInt ref = 0;
+			BKTKCompiler * owner;
+			BKTKCompilerSymbol const * objects;
 
 			name = nodeArgString (node, 0);
+			owner = BKTKCompilerLockObjects (compiler);
+			objects = BKTKCompilerSymbolAt (owner, BKTKCompilerArgSymbol (owner, node, 0), 0);
+
+			if (objects) {
+				ref = BKTKCompilerVisibleRef (compiler, &owner -> waveforms, objects -> waveform);
+			}
+
+			BKTKCompilerUnlockObjects (compiler);
 
-			if (!BKHashTableLookup (&compiler -> waveforms, (char *) name -> str, (void **) &waveform)) {
-				keyvalLookup (waveformNames, NUM_WAVEFORM_NAMES, name, &value, NULL);
+			if (!ref) {
+				keyvalLookup (&waveformTable, name, &value, NULL);
 			}
 
-			if (waveform) {
-				BKByteBufferAppendInt32 (byteCode, BKInstrMaskArg1Make (cmd, waveform -> object.index | BK_INTR_CUSTOM_WAVEFORM_FLAG));
+			if (ref) {
+				appendWord (byteCode, BKInstrMaskArg1Make (cmd, (ref - 1) | BK_INTR_CUSTOM_WAVEFORM_FLAG), &compiler -> arena);
 			}
 			else if (value > 0) {
-				BKByteBufferAppendInt32 (byteCode, BKInstrMaskArg1Make (cmd, value));
+				appendWord (byteCode, BKInstrMaskArg1Make (cmd, value), &compiler -> arena);
 			}
 			else {
 				printError (compiler, node, "Error: undefined waveform '%s'",
@@ -850,17 +1539,27 @@ static BKInt BKTKCompilerCompileCommand (BKTKCompiler * compiler, BKTKParserNode
 			break;
 		}
 		case BKIntrSample: {
-			BKTKSample * sample;
+			BKUInt ref = 0;
+			BKTKCompiler * owner;
+			BKTKCompilerSymbol const * objects;
 
 			name = nodeArgString (node, 0);
+			owner = BKTKCompilerLockObjects (compiler);
+			objects = BKTKCompilerSymbolAt (owner, BKTKCompilerArgSymbol (owner, node, 0), 0);
+
+			if (objects) {
+				ref = BKTKCompilerVisibleRef (compiler, &owner -> samples, objects -> sample);
+			}
 
-			if (!BKHashTableLookup (&compiler -> samples, (char *) name -> str, (void **) &sample)) {
+			BKTKCompilerUnlockObjects (compiler);
+
+			if (!ref) {
 				printError (compiler, node, "Error: undefined sample '%s'",
 					BKTKCompilerEscapeString (compiler, name));
 				goto error;
 			}
 
-			BKByteBufferAppendInt32 (byteCode, BKInstrMaskArg1Make (cmd, sample -> object.index));
+			appendWord (byteCode, BKInstrMaskArg1Make (cmd, ref - 1), &compiler -> arena);
 
 			break;
 		}
@@ -980,30 +1679,27 @@ static BKInt BKTKCompilerCompileInstrument (BKTKCompiler * compiler, BKTKParserN
 	BKUInt flags;
 	BKTKParserNode const * node;
 	BKTKInstrument ** instrument;
-	BKString const * name;
 	BKString auxString = BK_STRING_INIT;
 	BKInt seqType, type, isEnv;
 	BKInt length = 0, repeatBegin = 0, repeatLength = 0;
 	BKSequencePhase sequence [MAX_SEQ_LENGTH];
 	BKInt autoindex = 0;
+	BKUInt symbol;
+	BKTKCompilerSymbol * objects;
+	BKTKCompilerContent * content;
 
-	name = nodeArgString (tree, 0);
-
-	if (name -> len) {
-		BKStringAppendString (&auxString, name);
-	}
-	else {
-		BKStringAppendFormat (&auxString, "%ld", BKHashTableSize (&compiler -> instruments));
-		autoindex = 1;
-	}
+	symbol = BKTKCompilerObjectName (compiler, tree, compiler -> instruments.len, &auxString, &autoindex);
+	objects = BKTKCompilerSymbolAt (compiler, symbol, 1);
 
-	if (BKHashTableLookupOrInsert (&compiler -> instruments, (char *) auxString.str, (void ***) &instrument) < 0) {
+	if (!objects) {
 		printError (compiler, tree, "Error: allocation failed");
-		res = -1;
+		res = BK_ALLOCATION_ERROR;
 		goto cleanup;
 	}
 
-	if (*instrument) {
+	if (objects && objects -> instrument) {
+		instrument = BKArrayItemAt (&compiler -> instruments, objects -> instrument - 1);
+
 		if (autoindex) {
 			printError (compiler, tree, "Error: instrument '%s' already defined with autoindex on line %u:%u but redefined",
 				BKTKCompilerEscapeString (compiler, &auxString),
@@ -1019,14 +1715,39 @@ static BKInt BKTKCompilerCompileInstrument (BKTKCompiler * compiler, BKTKParserN
 		goto cleanup;
 	}
 
-	if ((res = BKTKInstrumentAlloc (instrument)) != 0) {
+	if (!(instrument = BKArrayPushPtr (&compiler -> instruments))) {
+		printError (compiler, tree, "Error: allocation failed");
+		res = BK_ALLOCATION_ERROR;
+		goto cleanup;
+	}
+
+	*instrument = NULL;
+
+	if (!(content = BKTKCompilerPushContent (&compiler -> instrumentContents))) {
+		printError (compiler, tree, "Error: allocation failed");
+		res = BK_ALLOCATION_ERROR;
+		goto cleanup;
+	}
+
+	if ((res = BKTKInstrumentAlloc (instrument, &compiler -> arena)) != 0) {
 		printError (compiler, tree, "Error: allocation failed");
 		goto cleanup;
 	}
 
-	(*instrument) -> object.index = (BKUInt) BKHashTableSize (&compiler -> instruments) - 1;
+	(*instrument) -> object.index = (BKUInt) compiler -> instruments.len - 1;
+
+	if (objects) {
+		objects -> instrument = (*instrument) -> object.index + 1;
+	}
+
 	(*instrument) -> object.offset = tree -> offset;
-	BKStringAppendString (&(*instrument) -> name, &auxString);
+	(*instrument) -> name = BKTKArenaCopyString (&compiler -> arena, (char const *) auxString.str, auxString.len);
+
+	if (!(*instrument) -> name) {
+		printError (compiler, tree, "Error: allocation failed");
+		res = BK_ALLOCATION_ERROR;
+		goto cleanup;
+	}
 
 	for (node = tree -> subNode; node; node = node -> nextNode) {
 		if (node -> type == BKTKTypeComment) {
@@ -1038,7 +1759,7 @@ static BKInt BKTKCompilerCompileInstrument (BKTKCompiler * compiler, BKTKParserN
 			continue;
 		}
 
-		if (!keyvalLookup (envelopeNames, NUM_ENVELOPE_NAMES, &node -> name, &seqType, &flags)) {
+		if (!keyvalLookup (&envelopeTable, &node -> name, &seqType, &flags)) {
 			printErrorUnexpectedCommand (compiler, node);
 			continue;
 		}
@@ -1062,6 +1783,10 @@ static BKInt BKTKCompilerCompileInstrument (BKTKCompiler * compiler, BKTKParserN
 				adsr [3] = nodeArgInt (node, 3, 0);
 
 				res = BKInstrumentSetEnvelopeADSR (&(*instrument) -> instr, adsr [0], adsr [1], adsr [2], adsr [3]);
+
+				if (contentAppend (content, &seqType, sizeof (seqType)) != 0 || contentAppend (content, adsr, sizeof (adsr)) != 0) {
+					goto allocationError;
+				}
 				break;
 			}
 			case BKTKEnvelopeTypePitchEnv: {
@@ -1115,12 +1840,19 @@ static BKInt BKTKCompilerCompileInstrument (BKTKCompiler * compiler, BKTKParserN
 		}
 
 		if (type >= 0) {
+			BKInt header [] = {seqType, length, repeatBegin, repeatLength};
+
 			if (isEnv) {
 				res = BKInstrumentSetEnvelope (&(*instrument) -> instr, type, sequence, length, repeatBegin, repeatLength);
 			}
 			else {
 				res = BKInstrumentSetSequence (&(*instrument) -> instr, type, (BKInt *) sequence, length, repeatBegin, repeatLength);
 			}
+
+			if (contentAppend (content, header, sizeof (header)) != 0 ||
+				contentAppend (content, sequence, length * (isEnv ? sizeof (BKSequencePhase) : sizeof (BKInt))) != 0) {
+				goto allocationError;
+			}
 		}
 
 		if (res < 0) {
@@ -1135,6 +1867,12 @@ static BKInt BKTKCompilerCompileInstrument (BKTKCompiler * compiler, BKTKParserN
 
 		return res;
 	}
+
+	allocationError: {
+		printError (compiler, tree, "Error: allocation failed");
+		res = BK_ALLOCATION_ERROR;
+		goto cleanup;
+	}
 }
 
 static BKInt BKTKCompilerCompileWaveform (BKTKCompiler * compiler, BKTKParserNode const * tree)
@@ -1147,31 +1885,31 @@ static BKInt BKTKCompilerCompileWaveform (BKTKCompiler * compiler, BKTKParserNod
 	BKString const * name;
 	BKString auxString = BK_STRING_INIT;
 	BKInt autoindex = 0;
+	BKUInt symbol;
+	BKTKCompilerSymbol * objects;
+	BKTKCompilerContent * content;
 
 	name = nodeArgString (tree, 0);
+	symbol = BKTKCompilerObjectName (compiler, tree, compiler -> waveforms.len, &auxString, &autoindex);
 
-	if (name -> len) {
-		BKStringAppendString (&auxString, name);
-	}
-	else {
-		BKStringAppendFormat (&auxString, "%ld", BKHashTableSize (&compiler -> waveforms));
-		autoindex = 1;
-	}
-
-	if (keyvalLookup (waveformNames, NUM_WAVEFORM_NAMES, name, &value, NULL)) {
+	if (keyvalLookup (&waveformTable, name, &value, NULL)) {
 		printError (compiler, tree, "Error: waveform '%s' overwrites default waveform",
 			BKTKCompilerEscapeString (compiler, name));
 		res = -1;
 		goto cleanup;
 	}
 
-	if (BKHashTableLookupOrInsert (&compiler -> waveforms, (char *) auxString.str, (void ***) &waveform) < 0) {
+	objects = BKTKCompilerSymbolAt (compiler, symbol, 1);
+
+	if (!objects) {
 		printError (compiler, tree, "Error: allocation failed");
 		res = BK_ALLOCATION_ERROR;
 		goto cleanup;
 	}
 
-	if (*waveform) {
+	if (objects && objects -> waveform) {
+		waveform = BKArrayItemAt (&compiler -> waveforms, objects -> waveform - 1);
+
 		if (autoindex) {
 			printError (compiler, tree, "Error: waveform '%s' already defined with autoindex on line %u:%u but redefined",
 				BKTKCompilerEscapeString (compiler, name),
@@ -1187,14 +1925,39 @@ static BKInt BKTKCompilerCompileWaveform (BKTKCompiler * compiler, BKTKParserNod
 		goto cleanup;
 	}
 
-	if ((res = BKTKWaveformAlloc (waveform)) != 0) {
+	if (!(waveform = BKArrayPushPtr (&compiler -> waveforms))) {
+		printError (compiler, tree, "Error: allocation failed");
+		res = BK_ALLOCATION_ERROR;
+		goto cleanup;
+	}
+
+	*waveform = NULL;
+
+	if (!(content = BKTKCompilerPushContent (&compiler -> waveformContents))) {
+		printError (compiler, tree, "Error: allocation failed");
+		res = BK_ALLOCATION_ERROR;
+		goto cleanup;
+	}
+
+	if ((res = BKTKWaveformAlloc (waveform, &compiler -> arena)) != 0) {
 		printError (compiler, tree, "Error: allocation failed");
 		goto cleanup;
 	}
 
-	(*waveform) -> object.index = (BKUInt) BKHashTableSize (&compiler -> waveforms) - 1;
+	(*waveform) -> object.index = (BKUInt) compiler -> waveforms.len - 1;
+
+	if (objects) {
+		objects -> waveform = (*waveform) -> object.index + 1;
+	}
+
 	(*waveform) -> object.offset = tree -> offset;
-	BKStringAppendString (&(*waveform) -> name, &auxString);
+	(*waveform) -> name = BKTKArenaCopyString (&compiler -> arena, (char const *) auxString.str, auxString.len);
+
+	if (!(*waveform) -> name) {
+		printError (compiler, tree, "Error: allocation failed");
+		res = BK_ALLOCATION_ERROR;
+		goto cleanup;
+	}
 
 	for (node = tree -> subNode; node; node = node -> nextNode) {
 		BKInt arg;
@@ -1205,7 +1968,7 @@ static BKInt BKTKCompilerCompileWaveform (BKTKCompiler * compiler, BKTKParserNod
 			continue;
 		}
 
-		if (!keyvalLookup (miscNames, NUM_MISC_NAMES, &node -> name, &value, &flags)) {
+		if (!keyvalLookup (&miscTable, &node -> name, &value, &flags)) {
 			printErrorUnexpectedCommand (compiler, node);
 			continue;
 		}
@@ -1235,6 +1998,12 @@ static BKInt BKTKCompilerCompileWaveform (BKTKCompiler * compiler, BKTKParserNod
 
 				}
 
+				if (contentAppend (content, &length, sizeof (length)) != 0 || contentAppend (content, sequence, length * sizeof (BKFrame)) != 0) {
+					printError (compiler, tree, "Error: allocation failed");
+					res = BK_ALLOCATION_ERROR;
+					goto cleanup;
+				}
+
 				break;
 			}
 			default: {
@@ -1260,24 +2029,22 @@ static BKInt BKTKCompilerCompileSample (BKTKCompiler * compiler, BKTKParserNode
 	BKString const * name;
 	BKString auxString = BK_STRING_INIT;
 	BKInt autoindex = 0;
+	BKUInt symbol;
+	BKTKCompilerSymbol * objects;
 
 	name = nodeArgString (tree, 0);
+	symbol = BKTKCompilerObjectName (compiler, tree, compiler -> samples.len, &auxString, &autoindex);
+	objects = BKTKCompilerSymbolAt (compiler, symbol, 1);
 
-	if (name -> len) {
-		BKStringAppendString (&auxString, name);
-	}
-	else {
-		BKStringAppendFormat (&auxString, "%ld", BKHashTableSize (&compiler -> samples));
-		autoindex = 1;
-	}
-
-	if (BKHashTableLookupOrInsert (&compiler -> samples, (char *) auxString.str, (void ***) &sample) < 0) {
+	if (!objects) {
 		printError (compiler, tree, "Error: allocation failed");
 		res = BK_ALLOCATION_ERROR;
 		goto cleanup;
 	}
 
-	if (*sample) {
+	if (objects && objects -> sample) {
+		sample = BKArrayItemAt (&compiler -> samples, objects -> sample - 1);
+
 		if (autoindex) {
 			printError (compiler, tree, "Error: sample '%s' already defined with autoindex on line %u:%u but redefined",
 				BKTKCompilerEscapeString (compiler, name),
@@ -1292,18 +2059,36 @@ static BKInt BKTKCompilerCompileSample (BKTKCompiler * compiler, BKTKParserNode
 		goto cleanup;
 	}
 
-	if ((res = BKTKSampleAlloc (sample)) != 0) {
+	if (!(sample = BKArrayPushPtr (&compiler -> samples))) {
 		printError (compiler, tree, "Error: allocation failed");
+		res = BK_ALLOCATION_ERROR;
 		goto cleanup;
 	}
 
-	(*sample) -> object.index = (BKUInt) BKHashTableSize (&compiler -> samples) - 1;
-	(*sample) -> object.offset = tree -> offset;
-	(*sample) -> path = BK_STRING_INIT;
-	BKStringAppendString (&(*sample) -> name, &auxString);
+	*sample = NULL;
 
-	for (node = tree -> subNode; node; node = node -> nextNode) {
-		BKInt arg1, arg2;
+	if ((res = BKTKSampleAlloc (sample, &compiler -> arena)) != 0) {
+		printError (compiler, tree, "Error: allocation failed");
+		goto cleanup;
+	}
+
+	(*sample) -> object.index = (BKUInt) compiler -> samples.len - 1;
+
+	if (objects) {
+		objects -> sample = (*sample) -> object.index + 1;
+	}
+
+	(*sample) -> object.offset = tree -> offset;
+	(*sample) -> name = BKTKArenaCopyString (&compiler -> arena, (char const *) auxString.str, auxString.len);
+
+	if (!(*sample) -> name) {
+		printError (compiler, tree, "Error: allocation failed");
+		res = BK_ALLOCATION_ERROR;
+		goto cleanup;
+	}
+
+	for (node = tree -> subNode; node; node = node -> nextNode) {
+		BKInt arg1, arg2;
 		BKString const * str;
 		BKString const * data;
 
@@ -1311,7 +2096,7 @@ static BKInt BKTKCompilerCompileSample (BKTKCompiler * compiler, BKTKParserNode
 			continue;
 		}
 
-		if (!keyvalLookup (miscNames, NUM_MISC_NAMES, &node -> name, &value, &flags)) {
+		if (!keyvalLookup (&miscTable, &node -> name, &value, &flags)) {
 			printErrorUnexpectedCommand (compiler, node);
 			continue;
 		}
@@ -1335,6 +2120,8 @@ static BKInt BKTKCompilerCompileSample (BKTKCompiler * compiler, BKTKParserNode
 					goto cleanup;
 				}
 
+				BKTKStatsCountAlloc (BKTKStatsTypeSamples, data -> len);
+
 				break;
 			}
 			case BKTKMiscLoad: {
@@ -1347,8 +2134,13 @@ static BKInt BKTKCompilerCompileSample (BKTKCompiler * compiler, BKTKParserNode
 				}
 
 				str = nodeArgString (node, 1);
-				BKStringEmpty (&(*sample) -> path);
-				BKStringAppendString (&(*sample) -> path, str);
+				(*sample) -> path = BKTKArenaCopyString (&compiler -> arena, (char const *) str -> str, str -> len);
+
+				if (!(*sample) -> path) {
+					printError (compiler, node, "Error: allocation failed");
+					res = BK_ALLOCATION_ERROR;
+					goto cleanup;
+				}
 				break;
 			}
 			case BKTKMiscPitch: {
@@ -1359,7 +2151,7 @@ static BKInt BKTKCompilerCompileSample (BKTKCompiler * compiler, BKTKParserNode
 			case BKTKMiscSampleRepeat: {
 				name = nodeArgString (node, 0);
 
-				if (!keyvalLookup (repeatNames, NUM_REPEAT_NAMES, name, &arg1, NULL)) {
+				if (!keyvalLookup (&repeatTable, name, &arg1, NULL)) {
 					printError (compiler, node, "Warning: expected repeat mode: 'no', 'rep', 'pal'");
 					res = -1;
 					goto cleanup;
@@ -1389,7 +2181,12 @@ static BKInt BKTKCompilerCompileSample (BKTKCompiler * compiler, BKTKParserNode
 	}
 }
 
-static BKInt BKTKCompilerCompileGroup (BKTKCompiler * compiler, BKTKParserNode const * tree, BKTKTrack * track, BKInt level)
+/**
+ * Compile group defined by `tree` into `track`
+ *
+ * Sets `outGroup` to the group if not NULL.
+ */
+static BKInt BKTKCompilerCompileGroup (BKTKCompiler * compiler, BKTKParserNode const * tree, BKTKTrack * track, BKInt level, BKTKGroup ** outGroup)
 {
 	BKInt res;
 	BKInt value;
@@ -1409,11 +2206,11 @@ static BKInt BKTKCompilerCompileGroup (BKTKCompiler * compiler, BKTKParserNode c
 		}
 	}
 	else {
-		offset = firstUnusedSlot (&track -> groups);
+		offset = firstUnusedSlot (track -> code -> groups.items, track -> code -> groups.len);
 		autoindex = 1;
 	}
 
-	group = BKTKCompilerTrackGroupAtOffset (track, offset, 1);
+	group = BKTKCompilerTrackGroupAtOffset (compiler, track, offset, 1);
 
 	if (!group) {
 		printError (compiler, tree, "Error: allocation failed");
@@ -1437,12 +2234,16 @@ static BKInt BKTKCompilerCompileGroup (BKTKCompiler * compiler, BKTKParserNode c
 	group -> object.index  = offset;
 	group -> object.offset = tree -> offset;
 
+	if (outGroup) {
+		*outGroup = group;
+	}
+
 	for (node = tree -> subNode; node; node = node -> nextNode) {
 		if (node -> type == BKTKTypeComment) {
 			continue;
 		}
 
-		if (!keyvalLookup (cmdNames, NUM_CMD_NAMES, &node -> name, &value, &flags)) {
+		if (!keyvalLookup (&cmdTable, &node -> name, &value, &flags)) {
 			printErrorUnexpectedCommand (compiler, node);
 			continue;
 		}
@@ -1459,7 +2260,7 @@ static BKInt BKTKCompilerCompileGroup (BKTKCompiler * compiler, BKTKParserNode c
 
 	cmd = BKInstrMaskArg1Make (BKIntrReturn, 0);
 
-	if (BKByteBufferAppendInt32 (&group -> byteCode, cmd) != 0) {
+	if (appendWord (&group -> byteCode, cmd, &compiler -> arena) != 0) {
 		printError (compiler, node, "Error: allocation failed");
 		return -1;
 	}
@@ -1467,28 +2268,31 @@ static BKInt BKTKCompilerCompileGroup (BKTKCompiler * compiler, BKTKParserNode c
 	return 0;
 }
 
-static BKInt BKTKCompilerCompileTrack (BKTKCompiler * compiler, BKTKParserNode const * tree, BKInt level)
+/**
+ * Reserve track defined by `tree`
+ *
+ * The body is compiled later with `BKTKCompilerCompileTrackBody`.
+ */
+static BKInt BKTKCompilerDeclareTrack (BKTKCompiler * compiler, BKTKParserNode const * tree, BKTKTrack ** outTrack)
 {
-	BKInt res;
 	BKInt value = -1;
-	BKUInt flags;
-	BKTKParserNode const * node;
 	BKTKTrack * track;
 	BKString const * wavename;
 	BKInt offset;
-	uint32_t cmd;
 	BKInt autoindex = 0;
-	BKTKWaveform * waveform = NULL;
+	BKTKCompilerSymbol const * objects;
 	BKInt waveformIdx;
 
 	wavename = nodeArgString (tree, 0);
+	objects = BKTKCompilerSymbolAt (compiler, BKTKCompilerArgSymbol (compiler, tree, 0), 0);
 
-	if (!BKHashTableLookup (&compiler -> waveforms, (char *) wavename -> str, (void **) &waveform)) {
-		keyvalLookup (waveformNames, NUM_WAVEFORM_NAMES, wavename, &value, NULL);
+	if (!objects || !objects -> waveform) {
+		objects = NULL;
+		keyvalLookup (&waveformTable, wavename, &value, NULL);
 	}
 
-	if (waveform) {
-		waveformIdx = waveform -> object.index | BK_INTR_CUSTOM_WAVEFORM_FLAG;
+	if (objects) {
+		waveformIdx = (objects -> waveform - 1) | BK_INTR_CUSTOM_WAVEFORM_FLAG;
 	}
 	else if (value > 0) {
 		waveformIdx = value;
@@ -1509,7 +2313,7 @@ static BKInt BKTKCompilerCompileTrack (BKTKCompiler * compiler, BKTKParserNode c
 		}
 	}
 	else {
-		offset = firstUnusedSlot (&compiler -> tracks);
+		offset = firstUnusedSlot (compiler -> tracks.items, compiler -> tracks.len);
 		autoindex = 1;
 	}
 
@@ -1539,16 +2343,34 @@ static BKInt BKTKCompilerCompileTrack (BKTKCompiler * compiler, BKTKParserNode c
 	track -> object.offset = tree -> offset;
 	track -> waveform      = waveformIdx;
 
-	cmd = BKInstrMaskArg1Make (BKIntrWaveform, waveformIdx);
+	*outTrack = track;
 
-	if (BKByteBufferAppendInt32 (&track -> byteCode, cmd) != 0) {
+	return 0;
+}
+
+/**
+ * Compile commands and groups of track declared with `BKTKCompilerDeclareTrack`
+ *
+ * Only writes to `track` and to the message state of `compiler`.
+ */
+static BKInt BKTKCompilerCompileTrackBody (BKTKCompiler * compiler, BKTKParserNode const * tree, BKTKTrack * track, BKInt level)
+{
+	BKInt res;
+	BKInt value = -1;
+	BKUInt flags;
+	BKTKParserNode const * node;
+	uint32_t cmd;
+
+	cmd = BKInstrMaskArg1Make (BKIntrWaveform, track -> waveform);
+
+	if (appendWord (&track -> code -> byteCode, cmd, &compiler -> arena) != 0) {
 		printError (compiler, tree, "Error: allocation failed");
 		return -1;
 	}
 
 	cmd = BKInstrMaskArg1Make (BKIntrRepeatStart, 0);
 
-	if (BKByteBufferAppendInt32 (&track -> byteCode, cmd) != 0) {
+	if (appendWord (&track -> code -> byteCode, cmd, &compiler -> arena) != 0) {
 		printError (compiler, tree, "Error: allocation failed");
 		return -1;
 	}
@@ -1558,10 +2380,10 @@ static BKInt BKTKCompilerCompileTrack (BKTKCompiler * compiler, BKTKParserNode c
 			continue;
 		}
 
-		if (keyvalLookup (cmdNames, NUM_CMD_NAMES, &node -> name, &value, &flags)) {
+		if (keyvalLookup (&cmdTable, &node -> name, &value, &flags)) {
 			switch (value) {
 				case BKIntrGroupDef: {
-					if ((res = BKTKCompilerCompileGroup (compiler, node, track, level)) != 0) {
+					if ((res = BKTKCompilerCompileGroup (compiler, node, track, level, NULL)) != 0) {
 						return res;
 					}
 					break;
@@ -1571,7 +2393,7 @@ static BKInt BKTKCompilerCompileTrack (BKTKCompiler * compiler, BKTKParserNode c
 						printErrorUnexpectedCommand (compiler, node);
 					}
 					else {
-						if ((res = BKTKCompilerCompileCommand (compiler, node, &track -> byteCode, value, level)) != 0) {
+						if ((res = BKTKCompilerCompileCommand (compiler, node, &track -> code -> byteCode, value, level)) != 0) {
 							return res;
 						}
 					}
@@ -1585,7 +2407,7 @@ static BKInt BKTKCompilerCompileTrack (BKTKCompiler * compiler, BKTKParserNode c
 
 	cmd = BKInstrMaskArg1Make (BKIntrEnd, 0);
 
-	if (BKByteBufferAppendInt32 (&track -> byteCode, cmd) != 0) {
+	if (appendWord (&track -> code -> byteCode, cmd, &compiler -> arena) != 0) {
 		printError (compiler, node, "Error: allocation failed");
 		return -1;
 	}
@@ -1593,7 +2415,69 @@ static BKInt BKTKCompilerCompileTrack (BKTKCompiler * compiler, BKTKParserNode c
 	return 0;
 }
 
-static BKInt BKTKCompilerLinkByteCode (BKTKCompiler * compiler, BKByteBuffer * byteCode, BKTKTrack * track)
+/**
+ * Merge objects with identical contents into the first one
+ *
+ * Sets `index` of each content to the object which is kept and disposes the
+ * others. References in byte code are replaced when linking. If `merge` is 0,
+ * each content only gets the index of its object.
+ */
+static BKInt BKTKCompilerMergeObjects (BKArray * objects, BKArray * contents, BKInt merge)
+{
+	BKUSize mask, slot;
+	BKUInt * slots;
+	BKTKObject ** object;
+	BKTKCompilerContent * content, * other;
+	BKUSize count = BKMin (objects -> len, contents -> len);
+
+	mask = BKNextPow2 (count * 2) - 1;
+	slots = calloc (mask + 1, sizeof (*slots));
+
+	if (!slots) {
+		return BK_ALLOCATION_ERROR;
+	}
+
+	BKTKStatsCountAlloc (BKTKStatsTypeCompiler, (mask + 1) * sizeof (*slots));
+
+	for (BKUSize i = 0; i < count; i ++) {
+		content = BKArrayItemAt (contents, i);
+		object = BKArrayItemAt (objects, i);
+		content -> index = (BKUInt) i;
+
+		if (!*object || !merge) {
+			continue;
+		}
+
+		for (slot = content -> hash & mask; slots [slot]; slot = (slot + 1) & mask) {
+			other = BKArrayItemAt (contents, slots [slot] - 1);
+
+			if (other -> hash == content -> hash && other -> size == content -> size &&
+				memcmp (other -> data, content -> data, content -> size) == 0) {
+				content -> index = other -> index;
+				break;
+			}
+		}
+
+		if (content -> index == i) {
+			slots [slot] = (BKUInt) i + 1;
+		}
+		// still referenced by its index
+		else if ((*object) -> object.flags & BKTKFlagShared) {
+			content -> index = (BKUInt) i;
+		}
+		// disposed with the arena
+		else {
+			*object = NULL;
+		}
+	}
+
+	free (slots);
+	contentsFreeData (contents);
+
+	return 0;
+}
+
+static BKInt BKTKCompilerLinkByteCode (BKTKCompiler * compiler, BKTKArenaArray * byteCode, BKTKTrack * track)
 {
 	void * opcode;
 	void * opcodeEnd;
@@ -1602,27 +2486,43 @@ static BKInt BKTKCompilerLinkByteCode (BKTKCompiler * compiler, BKByteBuffer * b
 	BKInt index, index2;
 	BKTKGroup * group;
 	BKTKTrack * groupTrack;
+	struct callOperands call;
+	uint32_t const * words;
 
-	// make continous byte array for interpreter
-	if (BKByteBufferMakeContinuous (byteCode) != 0) {
-		return -1;
-	}
+	BKTKStatsCountAlloc (BKTKStatsTypeByteCode, byteCode -> len * sizeof (uint32_t));
 
-	opcode = byteCode -> first->data;
-	opcodeEnd = opcode + BKByteBufferSize (byteCode);
+	opcode = byteCode -> items;
+	opcodeEnd = opcode + byteCode -> len * sizeof (uint32_t);
 
 	while (opcode < opcodeEnd) {
 		mask = BKReadIntrMask (&opcode);
 
-		if (mask.arg1.cmd == BKIntrCall) {
-			offset.lineno = BKReadIntrMask (&opcode).arg1.arg1;
-			offset.colno = BKReadIntrMask (&opcode).arg1.arg1;
-			index = mask.grp.idx1;
-			index2 = mask.grp.idx2;
+		// use merged objects
+		if (mask.arg1.cmd == BKIntrInstrument) {
+			index = mergedIndex (&compiler -> instrumentContents, mask.arg1.arg1);
+			((uint32_t *) opcode) [-1] = BKInstrMaskArg1Make (BKIntrInstrument, index);
+		}
+		else if (mask.arg1.cmd == BKIntrWaveform && (mask.arg1.arg1 & BK_INTR_CUSTOM_WAVEFORM_FLAG)) {
+			index = mergedIndex (&compiler -> waveformContents, mask.arg1.arg1 & ~BK_INTR_CUSTOM_WAVEFORM_FLAG);
+			((uint32_t *) opcode) [-1] = BKInstrMaskArg1Make (BKIntrWaveform, index | BK_INTR_CUSTOM_WAVEFORM_FLAG);
+		}
+		else if (mask.arg1.cmd == BKIntrCall || mask.arg1.cmd == BKIntrWide) {
+			words = (uint32_t const *) opcode - 1;
+			opcode = (void *) (words + instrSize (words, (uint32_t const *) opcodeEnd - words));
+
+			// other wide instructions have no references
+			if (!readCall (words, (uint32_t const *) opcodeEnd - words, &call)) {
+				continue;
+			}
+
+			offset.lineno = call.lineno;
+			offset.colno = call.colno;
+			index = call.group;
+			index2 = call.track;
 
-			switch (mask.grp.type) {
+			switch (call.type) {
 				case BKGroupIndexTypeLocal: {
-					group = BKTKCompilerTrackGroupAtOffset (track, index, 0);
+					group = BKTKCompilerTrackGroupAtOffset (compiler, track, index, 0);
 
 					if (!group || !(group -> object.object.flags & BKTKFlagUsed)) {
 						BKStringAppendFormat (&compiler -> error, "Local group '%d' not defined on line %d:%d\n", index, offset.lineno, offset.colno);
@@ -1632,7 +2532,7 @@ static BKInt BKTKCompilerLinkByteCode (BKTKCompiler * compiler, BKByteBuffer * b
 				}
 				case BKGroupIndexTypeGlobal: {
 					groupTrack = BKTKCompilerTrackAtOffset (compiler, 0, 0);
-					group = BKTKCompilerTrackGroupAtOffset (groupTrack, index, 0);
+					group = BKTKCompilerTrackGroupAtOffset (compiler, groupTrack, index, 0);
 
 					if (!group || !(group -> object.object.flags & BKTKFlagUsed)) {
 						BKStringAppendFormat (&compiler -> error, "Global group '%d' not defined on line %d:%d\n", index, offset.lineno, offset.colno);
@@ -1648,7 +2548,7 @@ static BKInt BKTKCompilerLinkByteCode (BKTKCompiler * compiler, BKByteBuffer * b
 						return -1;
 					}
 
-					group = BKTKCompilerTrackGroupAtOffset (groupTrack, index, 0);
+					group = BKTKCompilerTrackGroupAtOffset (compiler, groupTrack, index, 0);
 
 					if (!group|| !(group -> object.object.flags & BKTKFlagUsed)) {
 						BKStringAppendFormat (&compiler -> error, "Group '%d' of track '%d' not defined on line %d:%d\n", index, index2 - 1, offset.lineno, offset.colno);
@@ -1672,12 +2572,17 @@ static BKInt BKTKCompilerTrackLink (BKTKCompiler * compiler, BKTKTrack * track)
 {
 	BKTKGroup * group;
 
-	if (BKTKCompilerLinkByteCode (compiler, &track -> byteCode, track) != 0) {
+	if (track -> waveform & BK_INTR_CUSTOM_WAVEFORM_FLAG) {
+		track -> waveform = mergedIndex (&compiler -> waveformContents, track -> waveform & ~BK_INTR_CUSTOM_WAVEFORM_FLAG);
+		track -> waveform |= BK_INTR_CUSTOM_WAVEFORM_FLAG;
+	}
+
+	if (BKTKCompilerLinkByteCode (compiler, &track -> code -> byteCode, track) != 0) {
 		return -1;
 	}
 
-	for (BKUSize i = 0; i < track -> groups.len; i ++) {
-		group = *(BKTKGroup **) BKArrayItemAt (&track -> groups, i);
+	for (BKUSize i = 0; i < track -> code -> groups.len; i ++) {
+		group = ((BKTKGroup **) track -> code -> groups.items) [i];
 
 		if (group) {
 			if (BKTKCompilerGroupLink (compiler, group, track) != 0) {
@@ -1689,183 +2594,2210 @@ static BKInt BKTKCompilerTrackLink (BKTKCompiler * compiler, BKTKTrack * track)
 	return 0;
 }
 
-static BKInt BKTKCompilerLink (BKTKCompiler * compiler)
+/**
+ * Constant pool of arpeggios while linking
+ *
+ * `slots` is a hash table of arpeggio indices + 1.
+ */
+struct arpeggioPool
 {
-	BKTKTrack * track;
+	BKArray * arpeggios; // BKTKArpeggio
+	BKUInt  * slots;
+	BKUSize   mask;
+};
 
-	for (BKUSize i = 0; i < compiler -> tracks.len; i ++) {
-		track = *(BKTKTrack **) BKArrayItemAt (&compiler -> tracks, i);
+BK_INLINE uint32_t arpeggioHash (BKTKArpeggio const * arpeggio)
+{
+	return keyvalHash ((uint8_t const *) arpeggio -> values, sizeof (arpeggio -> values), 0);
+}
 
-		if (track) {
-			if (BKTKCompilerTrackLink (compiler, track) != 0) {
-				return -1;
-			}
+/**
+ * Double number of hash slots
+ */
+static BKInt arpeggioPoolGrow (struct arpeggioPool * pool)
+{
+	BKUSize slot;
+	BKUSize mask = pool -> mask ? pool -> mask * 2 + 1 : 63;
+	BKUInt * slots = calloc (mask + 1, sizeof (*slots));
+
+	if (!slots) {
+		return BK_ALLOCATION_ERROR;
+	}
+
+	BKTKStatsCountAlloc (BKTKStatsTypeCompiler, (mask + 1) * sizeof (*slots));
+
+	for (BKUSize i = 0; i < pool -> arpeggios -> len; i ++) {
+		slot = arpeggioHash (BKArrayItemAt (pool -> arpeggios, i)) & mask;
+
+		while (slots [slot]) {
+			slot = (slot + 1) & mask;
 		}
+
+		slots [slot] = (BKUInt) i + 1;
 	}
 
+	free (pool -> slots);
+	pool -> slots = slots;
+	pool -> mask = mask;
+
 	return 0;
 }
 
-BKInt BKTKCompilerCompile (BKTKCompiler * compiler, BKTKParserNode const * tree)
+/**
+ * Get index of arpeggio in pool
+ *
+ * Equal arpeggios share an index. Returns -1 on allocation error.
+ */
+static BKInt arpeggioPoolIndex (struct arpeggioPool * pool, BKTKArpeggio const * arpeggio)
 {
-	BKInt res = 0;
-	BKInt value;
-	BKUInt flags;
-	BKTKParserNode const * node;
-	BKTKTrack * globalTrack;
-	uint32_t cmd;
-
-	cmd = BKInstrMaskArg1Make (BKIntrWaveform, BK_SQUARE);
-	globalTrack = BKTKCompilerTrackAtOffset (compiler, 0, 1);
+	BKUSize slot;
+	BKTKArpeggio const * other;
 
-	if (BKByteBufferAppendInt32 (&globalTrack -> byteCode, cmd) != 0) {
-		printError (compiler, tree, "Error: allocation failed");
-		res = BK_ALLOCATION_ERROR;
-		goto cleanup;
+	if ((pool -> arpeggios -> len + 1) * 2 > pool -> mask) {
+		if (arpeggioPoolGrow (pool) != 0) {
+			return -1;
+		}
 	}
 
-	cmd = BKInstrMaskArg1Make (BKIntrRepeatStart, 0);
+	for (slot = arpeggioHash (arpeggio) & pool -> mask; pool -> slots [slot]; slot = (slot + 1) & pool -> mask) {
+		other = BKArrayItemAt (pool -> arpeggios, pool -> slots [slot] - 1);
 
-	if (BKByteBufferAppendInt32 (&globalTrack -> byteCode, cmd) != 0) {
-		printError (compiler, tree, "Error: allocation failed");
+		if (memcmp (other -> values, arpeggio -> values, sizeof (arpeggio -> values)) == 0) {
+			return pool -> slots [slot] - 1;
+		}
+	}
+
+	if (BKArrayPush (pool -> arpeggios, arpeggio) != 0) {
 		return -1;
 	}
 
-	for (node = tree; node; node = node -> nextNode) {
-		if (node -> type == BKTKTypeComment) {
-			continue;
-		}
+	pool -> slots [slot] = (BKUInt) pool -> arpeggios -> len;
 
-		if (!keyvalLookup (cmdNames, NUM_CMD_NAMES, &node -> name, &value, &flags)) {
-			printErrorUnexpectedCommand (compiler, node);
-			continue;
-		}
+	return (BKInt) pool -> arpeggios -> len - 1;
+}
 
-		switch (value) {
-			case BKIntrGroupDef: {
-				if ((res = BKTKCompilerCompileGroup (compiler, node, globalTrack, 0)) != 0) {
-					goto cleanup;
-				}
-				break;
-			}
-			case BKIntrInstrumentDef: {
-				if ((res = BKTKCompilerCompileInstrument (compiler, node)) != 0) {
-					goto cleanup;
-				}
-				break;
-			}
-			case BKIntrSampleDef: {
-				if ((res = BKTKCompilerCompileSample (compiler, node)) != 0) {
-					goto cleanup;
-				}
-				break;
-			}
-			case BKIntrTrackDef: {
-				if ((res = BKTKCompilerCompileTrack (compiler, node, 1)) != 0) {
-					goto cleanup;
-				}
-				break;
+/**
+ * Replace notes following arpeggio instructions by index in constant pool
+ *
+ * Pitches are scaled when linking, so the interpreter passes the pooled
+ * arpeggio to the track without converting or copying it.
+ */
+static BKInt arpeggioPoolRewrite (struct arpeggioPool * pool, BKTKArenaArray * byteCode, BKTKArena * arena)
+{
+	BKInt res = 0;
+	BKInt index, count;
+	BKUSize size;
+	BKInstrMask mask;
+	BKTKArpeggio arpeggio;
+	BKTKArenaArray linked = BK_TK_ARENA_ARRAY_INIT (sizeof (uint32_t));
+	BKUSize numWords = byteCode -> len;
+	uint32_t const * words = byteCode -> items;
+	BKInt changed = 0;
+
+	for (BKUSize i = 0; i < numWords && !changed; i ++) {
+		changed = ((BKInstrMask) {.value = words [i]}).arg1.cmd == BKIntrArpeggio;
+	}
+
+	if (!changed) {
+		return 0;
+	}
+
+	for (BKUSize i = 0; i < numWords; i += size) {
+		mask = (BKInstrMask) {.value = words [i]};
+
+		if (mask.arg1.cmd == BKIntrArpeggio) {
+			count = (BKInt) BKMin ((BKUSize) BKMax (mask.arg1.arg1, 0), numWords - i - 1);
+			size = 1 + count;
+
+			// notes exceeding the maximum are ignored
+			count = BKMin (count, BK_MAX_ARPEGGIO - 1);
+			arpeggio = (BKTKArpeggio) {.values = {count + 1, 0}};
+
+			for (BKInt j = 0; j < count; j ++) {
+				arpeggio.values [j + 2] = value2Pitch (((BKInstrMask) {.value = words [i + 1 + j]}).arg1.arg1);
 			}
-			case BKIntrWaveformDef: {
-				if ((res = BKTKCompilerCompileWaveform (compiler, node)) != 0) {
-					goto cleanup;
-				}
+
+			if ((index = arpeggioPoolIndex (pool, &arpeggio)) < 0) {
+				res = BK_ALLOCATION_ERROR;
 				break;
 			}
-			default: {
-				if (node -> flags & BKTKParserFlagIsGroup) {
-					printErrorUnexpectedCommand (compiler, node);
-				}
-				else if ((res = BKTKCompilerCompileCommand (compiler, node, &globalTrack -> byteCode, value, 0)) != 0) {
-					goto cleanup;
-				}
-				break;
+
+			res |= appendWord (&linked, BKInstrMaskArg1Make (BKIntrArpeggio, index), arena);
+		}
+		else {
+			size = instrSize (&words [i], numWords - i);
+
+			for (BKUSize j = 0; j < size; j ++) {
+				res |= appendWord (&linked, words [i + j], arena);
 			}
 		}
 	}
 
-	cmd = BKInstrMaskArg1Make (BKIntrEnd, 0);
-
-	if (BKByteBufferAppendInt32 (&globalTrack -> byteCode, cmd) != 0) {
-		printError (compiler, node, "Error: allocation failed");
-		res = BK_ALLOCATION_ERROR;
-		goto cleanup;
+	if (res != 0) {
+		return BK_ALLOCATION_ERROR;
 	}
 
-	if (BKTKCompilerLink (compiler) != 0) {
-		res = -1;
-		goto cleanup;
-	}
+	BKTKStatsCountAlloc (BKTKStatsTypeByteCode, linked.len * sizeof (uint32_t));
 
-	cleanup: {
-		return res;
-	}
+	*byteCode = linked;
+
+	return 0;
 }
 
-BKInt BKTKCompilerReset (BKTKCompiler * compiler)
+/**
+ * Move arpeggios of all tracks and groups to constant pool
+ */
+static BKInt BKTKCompilerPoolArpeggios (BKTKCompiler * compiler)
 {
-	char const * key;
+	BKInt res = 0;
 	BKTKTrack * track;
-	BKTKInstrument * instr;
-	BKTKWaveform * waveform;
-	BKTKSample * sample;
-	BKHashTableIterator itor;
+	BKTKGroup * group;
+	struct arpeggioPool pool = {.arpeggios = &compiler -> arpeggios};
 
-	for (BKUSize i = 0; i < compiler -> tracks.len; i ++) {
+	BKArrayEmpty (&compiler -> arpeggios);
+
+	for (BKUSize i = 0; i < compiler -> tracks.len && res == 0; i ++) {
 		track = *(BKTKTrack **) BKArrayItemAt (&compiler -> tracks, i);
-		BKDispose (track);
-	}
 
-	BKHashTableIteratorInit (&itor, &compiler -> instruments);
+		if (!track) {
+			continue;
+		}
 
-	while (BKHashTableIteratorNext (&itor, &key, (void **) &instr)) {
-		BKDispose (instr);
-	}
+		res = arpeggioPoolRewrite (&pool, &track -> code -> byteCode, &compiler -> arena);
 
-	BKHashTableIteratorInit (&itor, &compiler -> waveforms);
+		for (BKUSize j = 0; j < track -> code -> groups.len && res == 0; j ++) {
+			group = ((BKTKGroup **) track -> code -> groups.items) [j];
 
-	while (BKHashTableIteratorNext (&itor, &key, (void **) &waveform)) {
-		BKDispose (waveform);
+			if (group) {
+				res = arpeggioPoolRewrite (&pool, &group -> byteCode, &compiler -> arena);
+			}
+		}
 	}
 
-	BKHashTableIteratorInit (&itor, &compiler -> samples);
+	free (pool.slots);
 
-	while (BKHashTableIteratorNext (&itor, &key, (void **) &sample)) {
-		BKDispose (sample);
-	}
-
-	BKArrayEmpty (&compiler -> tracks);
-	BKHashTableEmpty (&compiler -> instruments);
-	BKHashTableEmpty (&compiler -> waveforms);
-	BKHashTableEmpty (&compiler -> samples);
-	BKStringEmpty (&compiler -> auxString);
-	BKStringEmpty (&compiler -> error);
+	return res;
+}
 
-	compiler -> lineno = 0;
-	compiler -> info = (BKTKFileInfo) {0};
+static BKInt BKTKCompilerLink (BKTKCompiler * compiler)
+{
+	BKTKTrack * track;
 
-	// reserve global track
-	track = BKTKCompilerTrackAtOffset (compiler, 0, 1);
+	if (BKTKCompilerMergeObjects (&compiler -> instruments, &compiler -> instrumentContents, !compiler -> keepObjects) != 0) {
+		return -1;
+	}
 
-	if (!track) {
+	if (BKTKCompilerMergeObjects (&compiler -> waveforms, &compiler -> waveformContents, !compiler -> keepObjects) != 0) {
 		return -1;
 	}
 
-	track -> object.object.flags |= BKTKFlagUsed;
+	for (BKUSize i = 0; i < compiler -> tracks.len; i ++) {
+		track = *(BKTKTrack **) BKArrayItemAt (&compiler -> tracks, i);
+
+		if (track) {
+			if (BKTKCompilerTrackLink (compiler, track) != 0) {
+				return -1;
+			}
+		}
+	}
+
+	if (BKTKCompilerPoolArpeggios (compiler) != 0) {
+		printError (compiler, NULL, "Error: allocation failed");
+		return BK_ALLOCATION_ERROR;
+	}
 
 	return 0;
 }
 
-static void BKTKCompilerDispose (BKTKCompiler * compiler)
+/**
+ * Instruction of a byte code buffer seen by the outliner
+ */
+struct outlineUnit
 {
-	BKTKCompilerReset (compiler);
-	
+	uint32_t const * words;
+	uint64_t         hash;
+	BKUInt           size;     // number of words
+	BKInt            line;     // line instructions: difference to previous line
+	BKInt            run;      // run which is called here or -1
+	uint8_t          eligible;
+	uint8_t          anchor;   // runs may start here
+	uint8_t          covered;
+};
+
+/**
+ * Byte code buffer and its units
+ */
+struct outlineBuffer
+{
+	BKTKArenaArray * byteCode;
+	BKTKTrack    * track;
+	BKInt          depth;   // maximum call depth or -1 if never called
+	BKUSize        first;   // first unit
+	BKUSize        count;
+};
+
+/**
+ * Instruction sequence which occurs multiple times
+ */
+struct outlineRun
+{
+	BKUSize first;  // unit of first occurrence
+	BKUInt  size;   // number of units
+	BKUInt  words;
+	BKUInt  uses;   // occurrences replaced by a call
+	BKInt   group;  // index of global group or -1
+};
+
+/**
+ * Hash of unit sequence
+ */
+struct outlineWindow
+{
+	uint64_t hash;
+	BKUSize  index;
+};
+
+struct outliner
+{
+	BKArray                buffers;   // struct outlineBuffer
+	BKArray                units;     // struct outlineUnit
+	BKArray                runs;      // struct outlineRun
+	uint64_t               lineHash;  // hash of first line instruction of run
+	uint64_t             * prefix;    // hashes of unit prefixes
+	BKUSize              * nextLine;  // next line instruction in buffer
+	BKUInt               * avail;     // number of free units following
+	BKInt                * windows;   // run starting at unit or -1
+	struct outlineWindow * sorted;
+	struct outlineWindow * sortBuffer;
+};
+
+static BKInt outlineUnitIsEligible (uint32_t const * words)
+{
+	BKInstrMask mask = (BKInstrMask) {.value = words [0]};
+
+	// wide operands are not moved apart from their instruction
+	if (mask.arg1.cmd == BKIntrWide) {
+		mask = (BKInstrMask) {.value = words [1]};
+	}
+
+	// instructions which depend on their address or the call stack
+	switch (mask.arg1.cmd) {
+		case BKIntrCall:
+		case BKIntrReturn:
+		case BKIntrEnd:
+		case BKIntrJump:
+		case BKIntrRepeatStart: {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static BKInt outlinerAddBuffer (struct outliner * outliner, BKTKArenaArray * byteCode, BKTKTrack * track)
+{
+	struct outlineBuffer * buffer;
+	struct outlineUnit * unit;
+	uint32_t const * words = NULL;
+	BKUSize numWords = 0;
+	BKInt line = 0;
+	BKInt anchor = 1;
+	BKInstrMask mask;
+
+	buffer = BKArrayPushPtr (&outliner -> buffers);
+
+	if (!buffer) {
+		return BK_ALLOCATION_ERROR;
+	}
+
+	if (byteCode) {
+		words = byteCode -> items;
+		numWords = byteCode -> len;
+	}
+
+	*buffer = (struct outlineBuffer) {
+		.byteCode = byteCode,
+		.track    = track,
+		.depth    = -1,
+		.first    = outliner -> units.len,
+	};
+
+	for (BKUSize i = 0; i < numWords; i += unit -> size) {
+		unit = BKArrayPushPtr (&outliner -> units);
+
+		if (!unit) {
+			return BK_ALLOCATION_ERROR;
+		}
+
+		*unit = (struct outlineUnit) {
+			.words    = &words [i],
+			.hash     = CONTENT_HASH_BASIS,
+			.size     = instrSize (&words [i], numWords - i),
+			.run      = -1,
+			.eligible = outlineUnitIsEligible (&words [i]),
+		};
+
+		mask = (BKInstrMask) {.value = words [i]};
+
+		// runs start at lines or after steps
+		unit -> anchor = anchor || mask.arg1.cmd == BKIntrLineNo;
+		anchor = mask.arg1.cmd == BKIntrStep || mask.arg1.cmd == BKIntrTicks;
+
+		// line numbers are compared relative to the first one of a run; they
+		// have to increase to be encoded relatively
+		if (mask.arg1.cmd == BKIntrLineNo) {
+			unit -> line = mask.arg1.arg1 - line;
+			unit -> eligible = unit -> line >= 0 && mask.arg1.arg1 < BK_INTR_RELATIVE_LINE_FLAG;
+			unit -> hash = ((outliner -> lineHash ^ unit -> line) * 0x100000001B3);
+			line = mask.arg1.arg1;
+			continue;
+		}
+
+		for (BKUInt j = 0; j < unit -> size * sizeof (uint32_t); j ++) {
+			unit -> hash = (unit -> hash ^ ((uint8_t const *) unit -> words) [j]) * 0x100000001B3;
+		}
+	}
+
+	buffer -> count = outliner -> units.len - buffer -> first;
+
+	return 0;
+}
+
+/**
+ * Get buffer of group called by `unit`
+ *
+ * Returns NULL if `unit` is not a call.
+ */
+static struct outlineBuffer * outlinerCallTarget (struct outliner * outliner, BKUSize const * trackBuffers, struct outlineBuffer const * buffer, struct outlineUnit const * unit)
+{
+	struct callOperands call;
+	BKUSize trackIndex = 0;
+	BKUSize first;
+
+	if (!readCall (unit -> words, unit -> size, &call)) {
+		return NULL;
+	}
+
+	switch (call.type) {
+		case BKGroupIndexTypeLocal: {
+			trackIndex = buffer -> track -> object.index;
+			break;
+		}
+		case BKGroupIndexTypeTrack: {
+			trackIndex = call.track;
+			break;
+		}
+	}
+
+	// body is followed by all group slots
+	first = trackBuffers [trackIndex];
+
+	if (call.group < 0 || first + 1 + call.group >= trackBuffers [trackIndex + 1]) {
+		return NULL;
+	}
+
+	return BKArrayItemAt (&outliner -> buffers, first + 1 + call.group);
+}
+
+/**
+ * Set maximum call depth of all buffers
+ *
+ * Depths are limited to the interpreter's stack size. Recursive groups reach
+ * the limit.
+ */
+static void outlinerSetDepths (struct outliner * outliner, BKUSize const * trackBuffers)
+{
+	BKInt changed = 1;
+	struct outlineBuffer * buffer, * target;
+	struct outlineUnit * unit;
+
+	for (BKUSize i = 0; i < outliner -> buffers.len; i ++) {
+		buffer = BKArrayItemAt (&outliner -> buffers, i);
+
+		if (buffer -> byteCode == &buffer -> track -> code -> byteCode) {
+			buffer -> depth = 0;
+		}
+	}
+
+	// depths only increase up to the limit
+	while (changed) {
+		changed = 0;
+
+		for (BKUSize i = 0; i < outliner -> buffers.len; i ++) {
+			buffer = BKArrayItemAt (&outliner -> buffers, i);
+
+			if (buffer -> depth < 0 || buffer -> depth >= BK_INTR_STACK_SIZE) {
+				continue;
+			}
+
+			for (BKUSize j = 0; j < buffer -> count; j ++) {
+				unit = BKArrayItemAt (&outliner -> units, buffer -> first + j);
+				target = outlinerCallTarget (outliner, trackBuffers, buffer, unit);
+
+				if (target && target -> depth < buffer -> depth + 1) {
+					target -> depth = buffer -> depth + 1;
+					changed = 1;
+				}
+			}
+		}
+	}
+
+	// calls are ignored when the stack is full
+	for (BKUSize i = 0; i < outliner -> buffers.len; i ++) {
+		buffer = BKArrayItemAt (&outliner -> buffers, i);
+
+		if (buffer -> depth >= BK_INTR_STACK_SIZE) {
+			for (BKUSize j = 0; j < buffer -> count; j ++) {
+				unit = BKArrayItemAt (&outliner -> units, buffer -> first + j);
+				unit -> eligible = 0;
+			}
+		}
+	}
+}
+
+/**
+ * Get line number of first line instruction of `size` units at `index`
+ *
+ * Returns 0 if there is no line instruction.
+ */
+static BKInt outlinerBaseLine (struct outliner const * outliner, BKUSize index, BKUInt size)
+{
+	BKInstrMask mask;
+	struct outlineUnit const * units = outliner -> units.items;
+
+	for (BKUSize i = index; i < index + size; i ++) {
+		mask = (BKInstrMask) {.value = units [i].words [0]};
+
+		if (mask.arg1.cmd == BKIntrLineNo) {
+			return mask.arg1.arg1;
+		}
+	}
+
+	return 0;
+}
+
+static BKInt outlinerUnitsEqual (struct outliner const * outliner, BKUSize a, BKUSize b, BKUInt size)
+{
+	BKInt hasLine = 0;
+	BKInstrMask maskA, maskB;
+	struct outlineUnit const * unitA = (struct outlineUnit const *) outliner -> units.items + a;
+	struct outlineUnit const * unitB = (struct outlineUnit const *) outliner -> units.items + b;
+
+	for (BKUInt i = 0; i < size; i ++, unitA ++, unitB ++) {
+		maskA = (BKInstrMask) {.value = unitA -> words [0]};
+		maskB = (BKInstrMask) {.value = unitB -> words [0]};
+
+		if (maskA.arg1.cmd != maskB.arg1.cmd || unitA -> size != unitB -> size) {
+			return 0;
+		}
+
+		// first line is passed by call
+		if (maskA.arg1.cmd == BKIntrLineNo) {
+			if (hasLine && unitA -> line != unitB -> line) {
+				return 0;
+			}
+
+			hasLine = 1;
+		}
+		else if (maskA.value != maskB.value || (unitA -> size > 1 && memcmp (&unitA -> words [1], &unitB -> words [1], (unitA -> size - 1) * sizeof (uint32_t)) != 0)) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * Check if replacing `uses` occurrences with calls makes byte code smaller
+ */
+static BKInt outlineRunIsUseful (struct outlineRun const * run, BKUInt uses)
+{
+	// call is 3 words and group needs a return
+	return uses >= 2 && uses * run -> words > uses * 3 + run -> words + 1;
+}
+
+/**
+ * Get hash of `size` units starting at `index`
+ *
+ * The first line instruction is hashed without its line.
+ */
+static uint64_t outlinerWindowHash (struct outliner const * outliner, BKUSize index, BKUInt size, uint64_t const * powers)
+{
+	uint64_t hash;
+	BKUSize line = outliner -> nextLine [index];
+	struct outlineUnit const * units = outliner -> units.items;
+
+	hash = outliner -> prefix [index + size] - outliner -> prefix [index] * powers [size];
+
+	if (line < index + size) {
+		hash += (outliner -> lineHash - units [line].hash) * powers [index + size - 1 - line];
+	}
+
+	return hash;
+}
+
+/**
+ * Sort windows by the lower 32 bits of their hash
+ *
+ * Windows with the same hash keep their order.
+ */
+static void outlineSortWindows (struct outlineWindow * windows, struct outlineWindow * buffer, BKUSize count)
+{
+	BKUSize offsets [1 << OUTLINE_SORT_BITS];
+	BKUSize offset, digit;
+	struct outlineWindow * tmp;
+
+	// even number of passes leaves result in `windows`
+	for (BKUInt shift = 0; shift < 32; shift += OUTLINE_SORT_BITS) {
+		memset (offsets, 0, sizeof (offsets));
+
+		for (BKUSize i = 0; i < count; i ++) {
+			offsets [(windows [i].hash >> shift) & ((1 << OUTLINE_SORT_BITS) - 1)] ++;
+		}
+
+		offset = 0;
+
+		for (BKUSize i = 0; i < (1 << OUTLINE_SORT_BITS); i ++) {
+			digit = offsets [i];
+			offsets [i] = offset;
+			offset += digit;
+		}
+
+		for (BKUSize i = 0; i < count; i ++) {
+			buffer [offsets [(windows [i].hash >> shift) & ((1 << OUTLINE_SORT_BITS) - 1)] ++] = windows [i];
+		}
+
+		tmp = windows;
+		windows = buffer;
+		buffer = tmp;
+	}
+}
+
+/**
+ * Create runs for windows of `size` units starting at `sorted [first]` up to
+ * `sorted [end]` which have the same sort key
+ */
+static BKInt outlinerAddRun (struct outliner * outliner, BKUSize first, BKUSize end, BKUInt size)
+{
+	BKUInt count = 1;
+	BKUSize index, lastEnd;
+	BKUSize leader = outliner -> sorted [first].index;
+	struct outlineUnit const * units = outliner -> units.items;
+	struct outlineRun * run;
+	struct outlineRun newRun = {
+		.first = leader,
+		.size  = size,
+		.group = -1,
+	};
+
+	lastEnd = leader + size;
+
+	// count non-overlapping occurrences; windows not equal to the first one
+	// are ignored
+	for (BKUSize i = first + 1; i < end; i ++) {
+		index = outliner -> sorted [i].index;
+
+		if (outliner -> sorted [i].hash != outliner -> sorted [first].hash || !outlinerUnitsEqual (outliner, leader, index, size)) {
+			outliner -> sorted [i].index = OUTLINE_NO_UNIT;
+			continue;
+		}
+
+		if (index >= lastEnd) {
+			lastEnd = index + size;
+			count ++;
+		}
+	}
+
+	for (BKUSize i = leader; i < leader + size; i ++) {
+		newRun.words += units [i].size;
+	}
+
+	if (!outlineRunIsUseful (&newRun, count)) {
+		return 0;
+	}
+
+	if (!(run = BKArrayPushPtr (&outliner -> runs))) {
+		return BK_ALLOCATION_ERROR;
+	}
+
+	*run = newRun;
+
+	for (BKUSize i = first; i < end; i ++) {
+		index = outliner -> sorted [i].index;
+
+		if (index != OUTLINE_NO_UNIT) {
+			outliner -> windows [index] = (BKInt) outliner -> runs.len - 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Replace non-overlapping runs of `size` units occurring more than once
+ */
+static BKInt outlinerFindRuns (struct outliner * outliner, BKUInt size, uint64_t const * powers)
+{
+	BKInt res;
+	BKUSize end;
+	BKUSize numWindows = 0;
+	BKUSize numUnits = outliner -> units.len;
+	BKUSize firstRun = outliner -> runs.len;
+	struct outlineBuffer const * buffer;
+	struct outlineUnit * units = outliner -> units.items;
+	struct outlineRun * run;
+
+	// count free units following each unit in the same buffer
+	for (BKUSize i = 0; i < outliner -> buffers.len; i ++) {
+		buffer = BKArrayItemAt (&outliner -> buffers, i);
+
+		for (BKUSize j = buffer -> count; j > 0; j --) {
+			BKUSize index = buffer -> first + j - 1;
+
+			outliner -> avail [index] = 0;
+
+			if (units [index].eligible && !units [index].covered) {
+				outliner -> avail [index] = 1 + (j < buffer -> count ? outliner -> avail [index + 1] : 0);
+			}
+		}
+	}
+
+	for (BKUSize i = 0; i < numUnits; i ++) {
+		outliner -> windows [i] = -1;
+
+		if (units [i].anchor && outliner -> avail [i] >= size) {
+			outliner -> sorted [numWindows ++] = (struct outlineWindow) {
+				.hash  = outlinerWindowHash (outliner, i, size, powers),
+				.index = i,
+			};
+		}
+	}
+
+	outlineSortWindows (outliner -> sorted, outliner -> sortBuffer, numWindows);
+
+	for (BKUSize i = 0; i < numWindows; i = end) {
+		for (end = i + 1; end < numWindows && (uint32_t) outliner -> sorted [end].hash == (uint32_t) outliner -> sorted [i].hash; end ++) {
+			;
+		}
+
+		if (end - i >= 2) {
+			if ((res = outlinerAddRun (outliner, i, end, size)) != 0) {
+				return res;
+			}
+		}
+	}
+
+	// take runs from the start; overlapping occurrences are skipped
+	for (BKUSize i = 0; i < numUnits; ) {
+		if (outliner -> windows [i] < 0) {
+			i ++;
+			continue;
+		}
+
+		for (BKUInt j = 0; j < size; j ++) {
+			units [i + j].covered = 1;
+		}
+
+		run = BKArrayItemAt (&outliner -> runs, outliner -> windows [i]);
+		units [i].run = outliner -> windows [i];
+		run -> uses ++;
+		i += size;
+	}
+
+	// release runs which lost occurrences to overlapping runs
+	for (BKUSize i = 0; i < numUnits; i ++) {
+		if (units [i].run < (BKInt) firstRun) {
+			continue;
+		}
+
+		run = BKArrayItemAt (&outliner -> runs, units [i].run);
+
+		if (!outlineRunIsUseful (run, run -> uses)) {
+			units [i].run = -1;
+
+			for (BKUInt j = 0; j < size; j ++) {
+				units [i + j].covered = 0;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Create global group containing the instructions of `run`
+ */
+static BKInt outlinerMakeGroup (BKTKCompiler * compiler, struct outliner * outliner, BKTKTrack * globalTrack, struct outlineRun * run)
+{
+	BKTKGroup * group;
+	BKInt baseLine;
+	struct outlineUnit const * unit;
+	uint32_t word;
+
+	group = BKTKCompilerTrackGroupAtOffset (compiler, globalTrack, run -> group, 1);
+
+	if (!group) {
+		return BK_ALLOCATION_ERROR;
+	}
+
+	group -> object.object.flags |= BKTKFlagUsed | BKTKFlagOutlined;
+	group -> object.index = run -> group;
+
+	baseLine = outlinerBaseLine (outliner, run -> first, run -> size);
+
+	for (BKUInt i = 0; i < run -> size; i ++) {
+		unit = BKArrayItemAt (&outliner -> units, run -> first + i);
+
+		// line is added to the one passed by the call
+		if (((BKInstrMask) {.value = unit -> words [0]}).arg1.cmd == BKIntrLineNo) {
+			word = ((BKInstrMask) {.value = unit -> words [0]}).arg1.arg1 - baseLine;
+			word = BKInstrMaskArg1Make (BKIntrLineNo, word | BK_INTR_RELATIVE_LINE_FLAG);
+
+			if (appendWord (&group -> byteCode, word, &compiler -> arena) != 0) {
+				return BK_ALLOCATION_ERROR;
+			}
+
+			continue;
+		}
+
+		for (BKUInt j = 0; j < unit -> size; j ++) {
+			if (appendWord (&group -> byteCode, unit -> words [j], &compiler -> arena) != 0) {
+				return BK_ALLOCATION_ERROR;
+			}
+		}
+	}
+
+	if (appendWord (&group -> byteCode, BKInstrMaskArg1Make (BKIntrReturn, 0), &compiler -> arena) != 0) {
+		return BK_ALLOCATION_ERROR;
+	}
+
+	BKTKStatsCountAlloc (BKTKStatsTypeByteCode, group -> byteCode.len * sizeof (uint32_t));
+
+	return 0;
+}
+
+/**
+ * Replace outlined runs in `buffer` with calls
+ */
+static BKInt outlinerRewriteBuffer (struct outliner * outliner, struct outlineBuffer * buffer, BKTKArena * arena)
+{
+	BKInt res = 0;
+	BKTKArenaArray byteCode = BK_TK_ARENA_ARRAY_INIT (sizeof (uint32_t));
+	struct outlineUnit const * unit;
+	struct outlineRun const * run;
+	BKInt changed = 0;
+
+	for (BKUSize i = 0; i < buffer -> count && !changed; i ++) {
+		unit = BKArrayItemAt (&outliner -> units, buffer -> first + i);
+
+		if (unit -> run >= 0) {
+			run = BKArrayItemAt (&outliner -> runs, unit -> run);
+			changed = run -> group >= 0;
+		}
+	}
+
+	if (!changed) {
+		return 0;
+	}
+
+	for (BKUSize i = 0; i < buffer -> count; ) {
+		unit = BKArrayItemAt (&outliner -> units, buffer -> first + i);
+		run = unit -> run >= 0 ? BKArrayItemAt (&outliner -> runs, unit -> run) : NULL;
+
+		if (run && run -> group >= 0) {
+			// line is base of relative lines in group
+			res |= appendWord (&byteCode, BKInstrMaskGrpMake (BKIntrCall, run -> group, 0, BKGroupIndexTypeGlobal), arena);
+			res |= appendWord (&byteCode, BKInstrMaskArg1Make (0, outlinerBaseLine (outliner, buffer -> first + i, run -> size)), arena);
+			res |= appendWord (&byteCode, BKInstrMaskArg1Make (0, 0), arena);
+			i += run -> size;
+		}
+		else {
+			for (BKUInt j = 0; j < unit -> size; j ++) {
+				res |= appendWord (&byteCode, unit -> words [j], arena);
+			}
+
+			i ++;
+		}
+	}
+
+	if (res != 0) {
+		return BK_ALLOCATION_ERROR;
+	}
+
+	BKTKStatsCountAlloc (BKTKStatsTypeByteCode, byteCode.len * sizeof (uint32_t));
+
+	*buffer -> byteCode = byteCode;
+
+	return 0;
+}
+
+static void outlinerDispose (struct outliner * outliner)
+{
+	BKArrayDispose (&outliner -> buffers);
+	BKArrayDispose (&outliner -> units);
+	BKArrayDispose (&outliner -> runs);
+	free (outliner -> prefix);
+	free (outliner -> avail);
+	free (outliner -> nextLine);
+	free (outliner -> windows);
+	free (outliner -> sorted);
+	free (outliner -> sortBuffer);
+}
+
+/**
+ * Move instruction runs repeated in track and group byte code into global
+ * groups
+ *
+ * Runs are searched from the longest to the shortest length. Longer repeated
+ * runs are split into multiple calls. Calls and instructions depending on
+ * their address are never moved. Buffers whose callers could already fill the
+ * interpreter's stack are left unchanged.
+ *
+ * Line numbers in groups are relative to the line passed by the call, so runs
+ * on different lines can be shared.
+ */
+static BKInt BKTKCompilerOutline (BKTKCompiler * compiler)
+{
+	BKInt res = 0;
+	BKTKTrack * track;
+	BKTKTrack * globalTrack;
+	BKTKGroup * group;
+	BKUSize * trackBuffers = NULL;
+	BKUSize numUnits;
+	BKInt nextGroup;
+	uint64_t powers [OUTLINE_MAX_UNITS + 1];
+	struct outlineUnit const * unit;
+	struct outlineRun * run;
+	struct outliner outliner = {
+		.buffers  = BK_ARRAY_INIT (sizeof (struct outlineBuffer)),
+		.units    = BK_ARRAY_INIT (sizeof (struct outlineUnit)),
+		.runs     = BK_ARRAY_INIT (sizeof (struct outlineRun)),
+		.lineHash = (CONTENT_HASH_BASIS ^ BKIntrLineNo) * 0x100000001B3,
+	};
+
+	globalTrack = BKTKCompilerTrackAtOffset (compiler, 0, 0);
+
+	if (!globalTrack) {
+		return 0;
+	}
+
+	trackBuffers = malloc ((compiler -> tracks.len + 1) * sizeof (*trackBuffers));
+
+	if (!trackBuffers) {
+		res = BK_ALLOCATION_ERROR;
+		goto cleanup;
+	}
+
+	BKTKStatsCountAlloc (BKTKStatsTypeCompiler, (compiler -> tracks.len + 1) * sizeof (*trackBuffers));
+
+	// track body followed by one buffer per group slot
+	for (BKUSize i = 0; i < compiler -> tracks.len; i ++) {
+		track = *(BKTKTrack **) BKArrayItemAt (&compiler -> tracks, i);
+		trackBuffers [i] = outliner.buffers.len;
+
+		if (!track) {
+			continue;
+		}
+
+		if ((res = outlinerAddBuffer (&outliner, &track -> code -> byteCode, track)) != 0) {
+			goto cleanup;
+		}
+
+		for (BKUSize j = 0; j < track -> code -> groups.len; j ++) {
+			group = ((BKTKGroup **) track -> code -> groups.items) [j];
+
+			if ((res = outlinerAddBuffer (&outliner, group ? &group -> byteCode : NULL, track)) != 0) {
+				goto cleanup;
+			}
+		}
+	}
+
+	trackBuffers [compiler -> tracks.len] = outliner.buffers.len;
+	numUnits = outliner.units.len;
+
+	outlinerSetDepths (&outliner, trackBuffers);
+
+	outliner.prefix     = malloc ((numUnits + 1) * sizeof (*outliner.prefix));
+	outliner.nextLine   = malloc ((numUnits + 1) * sizeof (*outliner.nextLine));
+	outliner.avail      = malloc ((numUnits + 1) * sizeof (*outliner.avail));
+	outliner.windows    = malloc ((numUnits + 1) * sizeof (*outliner.windows));
+	outliner.sorted     = malloc ((numUnits + 1) * sizeof (*outliner.sorted));
+	outliner.sortBuffer = malloc ((numUnits + 1) * sizeof (*outliner.sortBuffer));
+
+	if (!outliner.prefix || !outliner.nextLine || !outliner.avail || !outliner.windows || !outliner.sorted || !outliner.sortBuffer) {
+		res = BK_ALLOCATION_ERROR;
+		goto cleanup;
+	}
+
+	BKTKStatsCountAlloc (BKTKStatsTypeCompiler, (numUnits + 1) * sizeof (*outliner.prefix));
+	BKTKStatsCountAlloc (BKTKStatsTypeCompiler, (numUnits + 1) * sizeof (*outliner.nextLine));
+	BKTKStatsCountAlloc (BKTKStatsTypeCompiler, (numUnits + 1) * sizeof (*outliner.avail));
+	BKTKStatsCountAlloc (BKTKStatsTypeCompiler, (numUnits + 1) * sizeof (*outliner.windows));
+	BKTKStatsCountAlloc (BKTKStatsTypeCompiler, (numUnits + 1) * sizeof (*outliner.sorted));
+	BKTKStatsCountAlloc (BKTKStatsTypeCompiler, (numUnits + 1) * sizeof (*outliner.sortBuffer));
+
+	powers [0] = 1;
+
+	for (BKUInt i = 1; i <= OUTLINE_MAX_UNITS; i ++) {
+		powers [i] = powers [i - 1] * 0x100000001B3;
+	}
+
+	outliner.prefix [0] = 0;
+
+	for (BKUSize i = 0; i < numUnits; i ++) {
+		unit = BKArrayItemAt (&outliner.units, i);
+		outliner.prefix [i + 1] = outliner.prefix [i] * 0x100000001B3 + unit -> hash;
+	}
+
+	outliner.nextLine [numUnits] = OUTLINE_NO_UNIT;
+
+	for (BKUSize i = numUnits; i > 0; i --) {
+		unit = BKArrayItemAt (&outliner.units, i - 1);
+		outliner.nextLine [i - 1] = outliner.nextLine [i];
+
+		if (((BKInstrMask) {.value = unit -> words [0]}).arg1.cmd == BKIntrLineNo) {
+			outliner.nextLine [i - 1] = i - 1;
+		}
+	}
+
+	for (BKUInt size = OUTLINE_MAX_UNITS; size >= OUTLINE_MIN_UNITS; size /= 4) {
+		if ((res = outlinerFindRuns (&outliner, size, powers)) != 0) {
+			goto cleanup;
+		}
+	}
+
+	// runs exceeding the group index range stay inline
+	nextGroup = (BKInt) globalTrack -> code -> groups.len;
+
+	for (BKUSize i = 0; i < outliner.runs.len; i ++) {
+		run = BKArrayItemAt (&outliner.runs, i);
+
+		if (!outlineRunIsUseful (run, run -> uses) || nextGroup > MAX_OUTLINE_GROUP) {
+			continue;
+		}
+
+		run -> group = nextGroup ++;
+
+		if ((res = outlinerMakeGroup (compiler, &outliner, globalTrack, run)) != 0) {
+			goto cleanup;
+		}
+	}
+
+	for (BKUSize i = 0; i < outliner.buffers.len; i ++) {
+		if ((res = outlinerRewriteBuffer (&outliner, BKArrayItemAt (&outliner.buffers, i), &compiler -> arena)) != 0) {
+			goto cleanup;
+		}
+	}
+
+	cleanup: {
+		outlinerDispose (&outliner);
+		free (trackBuffers);
+
+		return res;
+	}
+}
+
+/**
+ * Byte code buffer seen by the verifier
+ */
+struct verifyBlock
+{
+	uint32_t const * words;
+	BKUSize          numWords;
+	BKTKTrack      * track;  // owner of local groups
+	BKInt            index;  // group slot or -1 for track body
+	BKInt            state;
+	BKInt            depth;  // maximum number of stack items pushed
+	BKInt            steps;  // advances time before returning
+};
+
+struct verifier
+{
+	BKTKCompiler * compiler;
+	BKArray        blocks;       // struct verifyBlock
+	BKUSize      * trackBlocks;  // body is followed by all group slots
+};
+
+static BKInt verifierAddBlock (struct verifier * verifier, BKTKArenaArray * byteCode, BKTKTrack * track, BKInt index)
+{
+	struct verifyBlock * block;
+
+	block = BKArrayPushPtr (&verifier -> blocks);
+
+	if (!block) {
+		return BK_ALLOCATION_ERROR;
+	}
+
+	*block = (struct verifyBlock) {
+		.track = track,
+		.index = index,
+		.state = VERIFY_NEW,
+	};
+
+	if (byteCode) {
+		block -> words = byteCode -> items;
+		block -> numWords = byteCode -> len;
+	}
+
+	return 0;
+}
+
+/**
+ * Get block of group called by instruction `mask` in `block`
+ *
+ * Returns NULL if the group does not exist.
+ */
+static struct verifyBlock * verifierCallTarget (struct verifier * verifier, struct verifyBlock const * block, struct callOperands const * call)
+{
+	struct verifyBlock * target;
+	BKUSize trackIndex = 0;
+	BKUSize first;
+
+	switch (call -> type) {
+		case BKGroupIndexTypeLocal: {
+			trackIndex = block -> track -> object.index;
+			break;
+		}
+		case BKGroupIndexTypeTrack: {
+			trackIndex = call -> track;
+			break;
+		}
+	}
+
+	if (trackIndex >= verifier -> compiler -> tracks.len) {
+		return NULL;
+	}
+
+	first = verifier -> trackBlocks [trackIndex];
+
+	if (call -> group < 0 || first + 1 + call -> group >= verifier -> trackBlocks [trackIndex + 1]) {
+		return NULL;
+	}
+
+	target = BKArrayItemAt (&verifier -> blocks, first + 1 + call -> group);
+
+	return target -> words ? target : NULL;
+}
+
+/**
+ * Verify block and all groups called by it
+ *
+ * `level` is the number of stack items when the block is executed.
+ * Instructions following a jump or end instruction are never executed and
+ * are not checked.
+ */
+static BKInt verifierCheckBlock (struct verifier * verifier, struct verifyBlock * block, BKInt level)
+{
+	BKTKCompiler * compiler = verifier -> compiler;
+	struct verifyBlock * target;
+	struct callOperands call;
+	BKInstrMask mask;
+	BKUInt cmd;
+	BKInt lineno = 0, colno = 0;
+	BKInt repeatLine = 0;
+	BKInt loopSteps = -1; // time advanced since repeat mark or -1 if not set
+	BKInt done = 0;
+	BKUInt size;
+
+	block -> state = VERIFY_ACTIVE;
+
+	// tracks set the repeat mark before the first instruction
+	if (block -> index < 0) {
+		loopSteps = 0;
+	}
+
+	for (BKUSize i = 0; i < block -> numWords && !done; i += size) {
+		mask = (BKInstrMask) {.value = block -> words [i]};
+		size = instrSize (&block -> words [i], block -> numWords - i);
+		cmd = mask.arg1.cmd;
+
+		if (cmd == BKIntrWide && size > 1) {
+			cmd = ((BKInstrMask) {.value = block -> words [i + 1]}).arg1.cmd;
+		}
+
+		switch (cmd) {
+			case BKIntrLineNo: {
+				// relative lines are only used in outlined groups
+				if (!(mask.arg1.arg1 & BK_INTR_RELATIVE_LINE_FLAG)) {
+					lineno = mask.arg1.arg1;
+				}
+				break;
+			}
+			case BKIntrStep:
+			case BKIntrTicks: {
+				block -> steps = 1;
+				loopSteps = loopSteps >= 0 ? 1 : loopSteps;
+				break;
+			}
+			case BKIntrCall: {
+				readCall (&block -> words [i], size, &call);
+				lineno = call.lineno;
+				colno = call.colno;
+				target = verifierCallTarget (verifier, block, &call);
+
+				if (!target) {
+					BKStringAppendFormat (&compiler -> error, "Group '%d' not defined on line %d:%d\n", call.group, lineno, colno);
+					return -1;
+				}
+
+				if (target -> state == VERIFY_ACTIVE) {
+					BKStringAppendFormat (&compiler -> error, "Recursive call of group '%d' on line %d:%d\n", call.group, lineno, colno);
+					return -1;
+				}
+
+				if (target -> state == VERIFY_NEW && level < BK_INTR_STACK_SIZE) {
+					if (verifierCheckBlock (verifier, target, level + 1) != 0) {
+						return -1;
+					}
+				}
+
+				if (level + 1 + target -> depth > BK_INTR_STACK_SIZE) {
+					BKStringAppendFormat (&compiler -> error, "Groups nested deeper than %d levels on line %d:%d\n", BK_INTR_STACK_SIZE, lineno, colno);
+					return -1;
+				}
+
+				block -> depth = BKMax (block -> depth, target -> depth + 1);
+
+				if (target -> steps) {
+					block -> steps = 1;
+					loopSteps = loopSteps >= 0 ? 1 : loopSteps;
+				}
+				break;
+			}
+			case BKIntrRepeatStart: {
+				loopSteps = 0;
+				repeatLine = lineno;
+				break;
+			}
+			case BKIntrJump: {
+				// unused
+				if (mask.arg1.arg1 != -1) {
+					break;
+				}
+
+				// the mark of the caller would be left with a filled stack
+				if (loopSteps < 0) {
+					BKStringAppendFormat (&compiler -> error, "Repeat without start in group '%d' on line %d\n", block -> index, lineno);
+					return -1;
+				}
+
+				if (loopSteps == 0) {
+					BKStringAppendFormat (&compiler -> error, "Repeat without steps on line %d\n", lineno);
+					return -1;
+				}
+
+				done = 1;
+				break;
+			}
+			case BKIntrEnd: {
+				block -> steps = 1;
+				done = 1;
+				break;
+			}
+			case BKIntrReturn: {
+				if (block -> index < 0) {
+					BKStringAppendFormat (&compiler -> error, "Error: return in body of track '%d'\n", block -> track -> object.index);
+					return -1;
+				}
+
+				// the mark would be used by the caller
+				if (loopSteps >= 0) {
+					BKStringAppendFormat (&compiler -> error, "Repeat start without repeat in group '%d' on line %d\n", block -> index, repeatLine);
+					return -1;
+				}
+
+				done = 1;
+				break;
+			}
+		}
+	}
+
+	if (!done) {
+		BKStringAppendFormat (&compiler -> error, "Error: byte code of track '%d' has no end\n", block -> track -> object.index);
+		return -1;
+	}
+
+	block -> state = VERIFY_DONE;
+
+	return 0;
+}
+
+/**
+ * Check linked byte code of all tracks and groups
+ *
+ * The maximum call depth has to fit into the interpreter's stack, groups must
+ * not be called recursively, repeats have to jump to a mark in the same track
+ * body or group and must advance time. Tracks are flagged with
+ * `BKTKFlagVerified` so the interpreter can skip its runtime checks.
+ */
+static BKInt BKTKCompilerVerify (BKTKCompiler * compiler)
+{
+	BKInt res = 0;
+	BKTKTrack * track;
+	BKTKGroup * group;
+	struct verifyBlock * block;
+	struct verifier verifier = {
+		.compiler = compiler,
+		.blocks   = BK_ARRAY_INIT (sizeof (struct verifyBlock)),
+	};
+
+	verifier.trackBlocks = malloc ((compiler -> tracks.len + 1) * sizeof (*verifier.trackBlocks));
+
+	if (!verifier.trackBlocks) {
+		goto allocationError;
+	}
+
+	BKTKStatsCountAlloc (BKTKStatsTypeCompiler, (compiler -> tracks.len + 1) * sizeof (*verifier.trackBlocks));
+
+	for (BKUSize i = 0; i < compiler -> tracks.len; i ++) {
+		track = *(BKTKTrack **) BKArrayItemAt (&compiler -> tracks, i);
+		verifier.trackBlocks [i] = verifier.blocks.len;
+
+		if (!track) {
+			continue;
+		}
+
+		if (verifierAddBlock (&verifier, &track -> code -> byteCode, track, -1) != 0) {
+			goto allocationError;
+		}
+
+		for (BKUSize j = 0; j < track -> code -> groups.len; j ++) {
+			group = ((BKTKGroup **) track -> code -> groups.items) [j];
+
+			if (verifierAddBlock (&verifier, group ? &group -> byteCode : NULL, track, (BKInt) j) != 0) {
+				goto allocationError;
+			}
+		}
+	}
+
+	verifier.trackBlocks [compiler -> tracks.len] = verifier.blocks.len;
+
+	// uncalled groups are never executed
+	for (BKUSize i = 0; i < compiler -> tracks.len; i ++) {
+		if (verifier.trackBlocks [i] == verifier.trackBlocks [i + 1]) {
+			continue;
+		}
+
+		block = BKArrayItemAt (&verifier.blocks, verifier.trackBlocks [i]);
+
+		if ((res = verifierCheckBlock (&verifier, block, 0)) != 0) {
+			goto cleanup;
+		}
+	}
+
+	for (BKUSize i = 0; i < compiler -> tracks.len; i ++) {
+		track = *(BKTKTrack **) BKArrayItemAt (&compiler -> tracks, i);
+
+		if (track) {
+			track -> object.object.flags |= BKTKFlagVerified;
+		}
+	}
+
+	cleanup: {
+		BKArrayDispose (&verifier.blocks);
+		free (verifier.trackBlocks);
+
+		return res;
+	}
+
+	allocationError: {
+		printError (compiler, NULL, "Error: allocation failed");
+		res = BK_ALLOCATION_ERROR;
+		goto cleanup;
+	}
+}
+
+static void BKTKCompilerRunJob (BKTKCompiler * compiler, struct trackJob * job, BKTKArena * arena)
+{
+	// workers use their own line number and message state
+	BKTKCompiler worker = {
+		.owner     = compiler,
+		.auxString = BK_STRING_INIT,
+		.error     = BK_STRING_INIT,
+		.horizon   = job -> tree -> offset,
+		.arena     = *arena,
+	};
+
+	job -> res   = BKTKCompilerCompileTrackBody (&worker, job -> tree, job -> track, 1);
+	job -> error = worker.error;
+	*arena       = worker.arena;
+
+	BKStringDispose (&worker.auxString);
+}
+
+/**
+ * Compile jobs until the pool is ending and no job is left
+ */
+static void * BKTKCompilerWorker (struct jobWorker * worker)
+{
+	BKUSize index;
+	struct trackJob job;
+	struct trackJob * item;
+	BKTKCompilerPool * pool = worker -> compiler -> pool;
+
+	pthread_mutex_lock (&pool -> lock);
+
+	for (;;) {
+		while (pool -> nextJob >= pool -> jobs.len && !pool -> ending) {
+			pthread_cond_wait (&pool -> cond, &pool -> lock);
+		}
+
+		if (pool -> nextJob >= pool -> jobs.len) {
+			break;
+		}
+
+		index = pool -> nextJob ++;
+		job = *(struct trackJob *) BKArrayItemAt (&pool -> jobs, index);
+
+		if (!job.track) {
+			continue;
+		}
+
+		// jobs may be reallocated while compiling
+		pthread_mutex_unlock (&pool -> lock);
+
+		BKTKCompilerRunJob (worker -> compiler, &job, &worker -> arena);
+		BKTKArenaDispose (&job.nodes);
+
+		pthread_mutex_lock (&pool -> lock);
+
+		item = BKArrayItemAt (&pool -> jobs, index);
+		item -> tree  = NULL;
+		item -> nodes = job.nodes;
+		item -> res   = job.res;
+		item -> error = job.error;
+	}
+
+	pthread_mutex_unlock (&pool -> lock);
+
+	return NULL;
+}
+
+static BKUInt BKTKCompilerNumWorkers (BKTKCompiler const * compiler)
+{
+	long numCPUs;
+	BKUSize numWorkers = compiler -> numWorkers;
+
+	if (!numWorkers) {
+		numCPUs = sysconf (_SC_NPROCESSORS_ONLN);
+		numWorkers = numCPUs > 0 ? numCPUs : 1;
+	}
+
+	return (BKUInt) BKMin (numWorkers, MAX_WORKERS);
+}
+
+/**
+ * Create pool when the first job is pushed
+ */
+static BKInt BKTKCompilerPoolInit (BKTKCompiler * compiler)
+{
+	BKTKCompilerPool * pool;
+
+	if (compiler -> pool) {
+		return 0;
+	}
+
+	pool = calloc (1, sizeof (*pool));
+
+	if (!pool) {
+		return BK_ALLOCATION_ERROR;
+	}
+
+	BKTKStatsCountAlloc (BKTKStatsTypeCompiler, sizeof (*pool));
+
+	pool -> jobs = BK_ARRAY_INIT (sizeof (struct trackJob));
+
+	for (BKUInt i = 0; i < MAX_WORKERS; i ++) {
+		pool -> workers [i].arena = BK_TK_ARENA_INIT (BKTKStatsTypeCompiler);
+	}
+
+	if (pthread_mutex_init (&pool -> lock, NULL) != 0) {
+		free (pool);
+		return BK_ALLOCATION_ERROR;
+	}
+
+	if (pthread_cond_init (&pool -> cond, NULL) != 0) {
+		pthread_mutex_destroy (&pool -> lock);
+		free (pool);
+		return BK_ALLOCATION_ERROR;
+	}
+
+	if (pthread_rwlock_init (&pool -> objectsLock, NULL) != 0) {
+		pthread_cond_destroy (&pool -> cond);
+		pthread_mutex_destroy (&pool -> lock);
+		free (pool);
+		return BK_ALLOCATION_ERROR;
+	}
+
+	compiler -> pool = pool;
+
+	return 0;
+}
+
+/**
+ * Start worker threads
+ *
+ * The thread putting the nodes becomes a worker when finishing.
+ */
+static void BKTKCompilerStartWorkers (BKTKCompiler * compiler)
+{
+	struct jobWorker * worker;
+	BKTKCompilerPool * pool = compiler -> pool;
+	BKUInt numWorkers = BKTKCompilerNumWorkers (compiler);
+
+	for (; pool -> numThreads < numWorkers - 1; pool -> numThreads ++) {
+		worker = &pool -> workers [pool -> numThreads];
+		worker -> compiler = compiler;
+
+		if (pthread_create (&pool -> threads [pool -> numThreads], NULL, (void *) BKTKCompilerWorker, worker) != 0) {
+			break;
+		}
+	}
+}
+
+/**
+ * Push job to pool
+ *
+ * Allocations of `nodes` are moved to the job if given. Threads are not
+ * started for a few tracks; these are compiled when finishing.
+ */
+static BKInt BKTKCompilerPushJob (BKTKCompiler * compiler, struct trackJob const * job, BKTKArena * nodes)
+{
+	BKInt res;
+	struct trackJob * item;
+	BKTKCompilerPool * pool;
+
+	if ((res = BKTKCompilerPoolInit (compiler)) != 0) {
+		return res;
+	}
+
+	pool = compiler -> pool;
+	pthread_mutex_lock (&pool -> lock);
+
+	item = BKArrayPushPtr (&pool -> jobs);
+
+	if (!item) {
+		pthread_mutex_unlock (&pool -> lock);
+		return BK_ALLOCATION_ERROR;
+	}
+
+	*item = *job;
+
+	if (nodes) {
+		BKTKArenaMove (&item -> nodes, nodes);
+	}
+
+	if (job -> track && ++ pool -> numTracks == MIN_PARALLEL_JOBS) {
+		BKTKCompilerStartWorkers (compiler);
+	}
+
+	pthread_cond_signal (&pool -> cond);
+	pthread_mutex_unlock (&pool -> lock);
+
+	return 0;
+}
+
+/**
+ * Wait for running workers
+ *
+ * Pending jobs are taken by the workers until none is left.
+ */
+static void BKTKCompilerJoinWorkers (BKTKCompiler * compiler)
+{
+	BKTKCompilerPool * pool = compiler -> pool;
+
+	pthread_mutex_lock (&pool -> lock);
+	pool -> ending = 1;
+	pthread_cond_broadcast (&pool -> cond);
+	pthread_mutex_unlock (&pool -> lock);
+
+	for (BKUInt i = 0; i < pool -> numThreads; i ++) {
+		pthread_join (pool -> threads [i], NULL);
+	}
+
+	for (BKUInt i = 0; i <= pool -> numThreads; i ++) {
+		BKTKArenaMove (&compiler -> arena, &pool -> workers [i].arena);
+	}
+
+	pool -> numThreads = 0;
+}
+
+/**
+ * Stop workers and dispose pool
+ *
+ * Pending jobs are dropped.
+ */
+static void BKTKCompilerPoolDispose (BKTKCompiler * compiler)
+{
+	struct trackJob * job;
+	BKTKCompilerPool * pool = compiler -> pool;
+
+	if (!pool) {
+		return;
+	}
+
+	pthread_mutex_lock (&pool -> lock);
+	pool -> nextJob = pool -> jobs.len;
+	pthread_mutex_unlock (&pool -> lock);
+
+	BKTKCompilerJoinWorkers (compiler);
+
+	for (BKUSize i = 0; i < pool -> jobs.len; i ++) {
+		job = BKArrayItemAt (&pool -> jobs, i);
+		BKTKArenaDispose (&job -> nodes);
+		BKStringDispose (&job -> error);
+	}
+
+	BKArrayDispose (&pool -> jobs);
+	pthread_rwlock_destroy (&pool -> objectsLock);
+	pthread_cond_destroy (&pool -> cond);
+	pthread_mutex_destroy (&pool -> lock);
+	free (pool);
+
+	compiler -> pool = NULL;
+}
+
+/**
+ * Compile pending track bodies
+ *
+ * Messages of all jobs are appended in file order up to the first failed
+ * node, whose result is returned. The pool is disposed afterwards.
+ */
+static BKInt BKTKCompilerFinishJobs (BKTKCompiler * compiler)
+{
+	BKInt res = 0;
+	struct trackJob * job;
+	struct jobWorker * worker;
+	BKTKCompilerPool * pool = compiler -> pool;
+
+	if (!pool) {
+		return 0;
+	}
+
+	pthread_mutex_lock (&pool -> lock);
+	pool -> ending = 1;
+	pthread_cond_broadcast (&pool -> cond);
+	pthread_mutex_unlock (&pool -> lock);
+
+	// calling thread is a worker too
+	worker = &pool -> workers [pool -> numThreads];
+	worker -> compiler = compiler;
+	BKTKCompilerWorker (worker);
+
+	BKTKCompilerJoinWorkers (compiler);
+
+	for (BKUSize i = 0; i < pool -> jobs.len && !res; i ++) {
+		job = BKArrayItemAt (&pool -> jobs, i);
+		BKStringAppendString (&compiler -> error, &job -> error);
+		res = job -> res;
+	}
+
+	BKTKCompilerPoolDispose (compiler);
+
+	return res;
+}
+
+BKInt BKTKCompilerBegin (BKTKCompiler * compiler)
+{
+	BKTKTrack * globalTrack;
+	uint32_t cmd;
+
+	compiler -> horizon = (BKTKOffset) {BK_INT_MAX, BK_INT_MAX};
+
+	cmd = BKInstrMaskArg1Make (BKIntrWaveform, BK_SQUARE);
+	globalTrack = BKTKCompilerTrackAtOffset (compiler, 0, 1);
+
+	if (!globalTrack || appendWord (&globalTrack -> code -> byteCode, cmd, &compiler -> arena) != 0) {
+		printError (compiler, NULL, "Error: allocation failed");
+		return BK_ALLOCATION_ERROR;
+	}
+
+	cmd = BKInstrMaskArg1Make (BKIntrRepeatStart, 0);
+
+	if (appendWord (&globalTrack -> code -> byteCode, cmd, &compiler -> arena) != 0) {
+		printError (compiler, NULL, "Error: allocation failed");
+		return BK_ALLOCATION_ERROR;
+	}
+
+	return 0;
+}
+
+/**
+ * Compile track body in file order
+ *
+ * Uses the same line number and horizon as a worker would.
+ */
+static BKInt BKTKCompilerCompileTrack (BKTKCompiler * compiler, BKTKParserNode const * tree, BKTKTrack * track)
+{
+	BKInt res;
+	BKInt lineno = compiler -> lineno;
+	BKTKOffset horizon = compiler -> horizon;
+
+	compiler -> lineno  = 0;
+	compiler -> horizon = tree -> offset;
+
+	res = BKTKCompilerCompileTrackBody (compiler, tree, track, 1);
+
+	compiler -> lineno  = lineno;
+	compiler -> horizon = horizon;
+
+	return res;
+}
+
+/**
+ * Compile top-level node
+ *
+ * Track bodies are pushed to the pool unless they are compiled immediately.
+ */
+static BKInt BKTKCompilerCompileNode (BKTKCompiler * compiler, BKTKParserNode const * node, BKTKArena * nodes)
+{
+	BKInt res = 0;
+	BKInt value;
+	BKUInt flags;
+	BKTKTrack * globalTrack;
+	BKTKTrack * track;
+	struct trackJob job;
+
+	if (node -> type == BKTKTypeComment) {
+		return 0;
+	}
+
+	if (!keyvalLookup (&cmdTable, &node -> name, &value, &flags)) {
+		printErrorUnexpectedCommand (compiler, node);
+		return 0;
+	}
+
+	globalTrack = BKTKCompilerTrackAtOffset (compiler, 0, 0);
+
+	switch (value) {
+		case BKIntrGroupDef: {
+			res = BKTKCompilerCompileGroup (compiler, node, globalTrack, 0, NULL);
+			break;
+		}
+		case BKIntrInstrumentDef: {
+			BKTKCompilerLockDefinitions (compiler);
+			res = BKTKCompilerCompileInstrument (compiler, node);
+			BKTKCompilerUnlockDefinitions (compiler);
+			break;
+		}
+		case BKIntrSampleDef: {
+			BKTKCompilerLockDefinitions (compiler);
+			res = BKTKCompilerCompileSample (compiler, node);
+			BKTKCompilerUnlockDefinitions (compiler);
+			break;
+		}
+		case BKIntrTrackDef: {
+			if ((res = BKTKCompilerDeclareTrack (compiler, node, &track)) != 0) {
+				break;
+			}
+
+			if (compiler -> numWorkers == 1) {
+				res = BKTKCompilerCompileTrack (compiler, node, track);
+				break;
+			}
+
+			job = (struct trackJob) {
+				.tree  = node,
+				.track = track,
+				.error = BK_STRING_INIT,
+			};
+
+			if ((res = BKTKCompilerPushJob (compiler, &job, nodes)) != 0) {
+				printError (compiler, node, "Error: allocation failed");
+			}
+			break;
+		}
+		case BKIntrWaveformDef: {
+			BKTKCompilerLockDefinitions (compiler);
+			res = BKTKCompilerCompileWaveform (compiler, node);
+			BKTKCompilerUnlockDefinitions (compiler);
+			break;
+		}
+		default: {
+			if (node -> flags & BKTKParserFlagIsGroup) {
+				printErrorUnexpectedCommand (compiler, node);
+			}
+			else {
+				res = BKTKCompilerCompileCommand (compiler, node, &globalTrack -> code -> byteCode, value, 0);
+			}
+			break;
+		}
+	}
+
+	return res;
+}
+
+/**
+ * Compile top-level node and keep its messages
+ *
+ * While track bodies are compiled by workers, the messages are pushed as job
+ * to merge them in file order.
+ */
+static BKInt BKTKCompilerCollectNode (BKTKCompiler * compiler, BKTKParserNode const * node, BKTKArena * nodes)
+{
+	BKInt res;
+	struct trackJob job;
+	BKString error = compiler -> error;
+
+	if (!compiler -> pool) {
+		return BKTKCompilerCompileNode (compiler, node, nodes);
+	}
+
+	compiler -> error = BK_STRING_INIT;
+	res = BKTKCompilerCompileNode (compiler, node, nodes);
+
+	if (!res && !compiler -> error.len) {
+		BKStringDispose (&compiler -> error);
+		compiler -> error = error;
+
+		return 0;
+	}
+
+	job = (struct trackJob) {
+		.tree  = node,
+		.res   = res,
+		.error = compiler -> error,
+	};
+
+	compiler -> error = error;
+
+	if (BKTKCompilerPushJob (compiler, &job, NULL) != 0) {
+		BKStringAppendString (&compiler -> error, &job.error);
+		BKStringDispose (&job.error);
+		printError (compiler, node, "Error: allocation failed");
+
+		return BK_ALLOCATION_ERROR;
+	}
+
+	return res;
+}
+
+BKInt BKTKCompilerPutNode (BKTKCompiler * compiler, BKTKParserNode const * node, BKTKArena * nodes)
+{
+	BKInt res;
+	BKInt jobsRes;
+
+	if ((res = BKTKCompilerCollectNode (compiler, node, nodes)) != 0) {
+		// report messages of tracks before the failed node
+		if ((jobsRes = BKTKCompilerFinishJobs (compiler)) != 0) {
+			res = jobsRes;
+		}
+	}
+
+	return res;
+}
+
+/**
+ * Get last object of array
+ */
+static BKTKObject * lastObject (BKArray const * objects)
+{
+	return *(BKTKObject **) BKArrayItemAt (objects, objects -> len - 1);
+}
+
+BKInt BKTKCompilerDeclareNode (BKTKCompiler * compiler, BKTKParserNode const * node)
+{
+	BKInt res = 0;
+	BKInt value;
+	BKTKTrack * track;
+	BKTKGroup * group;
+	BKTKObject * object = NULL;
+	BKTKParserNode head;
+
+	if (!(node -> flags & BKTKParserFlagIsGroup)) {
+		return 0;
+	}
+
+	if (!keyvalLookup (&cmdTable, &node -> name, &value, NULL)) {
+		printErrorUnexpectedCommand (compiler, node);
+		return 0;
+	}
+
+	// definition without body
+	head = *node;
+	head.subNode = NULL;
+
+	BKTKCompilerLockDefinitions (compiler);
+
+	switch (value) {
+		case BKIntrGroupDef: {
+			if ((res = BKTKCompilerCompileGroup (compiler, &head, BKTKCompilerTrackAtOffset (compiler, 0, 0), 0, &group)) == 0) {
+				object = &group -> object;
+			}
+			break;
+		}
+		case BKIntrInstrumentDef: {
+			if ((res = BKTKCompilerCompileInstrument (compiler, &head)) == 0) {
+				object = lastObject (&compiler -> instruments);
+			}
+			break;
+		}
+		case BKIntrSampleDef: {
+			if ((res = BKTKCompilerCompileSample (compiler, &head)) == 0) {
+				object = lastObject (&compiler -> samples);
+			}
+			break;
+		}
+		case BKIntrTrackDef: {
+			if ((res = BKTKCompilerDeclareTrack (compiler, &head, &track)) == 0) {
+				object = &track -> object;
+			}
+			break;
+		}
+		case BKIntrWaveformDef: {
+			if ((res = BKTKCompilerCompileWaveform (compiler, &head)) == 0) {
+				object = lastObject (&compiler -> waveforms);
+			}
+			break;
+		}
+		default: {
+			printErrorUnexpectedCommand (compiler, node);
+			break;
+		}
+	}
+
+	if (object) {
+		object -> object.flags |= BKTKFlagDeclared;
+	}
+
+	BKTKCompilerUnlockDefinitions (compiler);
+
+	return res;
+}
+
+BKInt BKTKCompilerEnd (BKTKCompiler * compiler)
+{
+	BKInt res;
+	BKTKTrack * globalTrack;
+	uint32_t cmd;
+
+	if ((res = BKTKCompilerFinishJobs (compiler)) != 0) {
+		return res;
+	}
+
+	cmd = BKInstrMaskArg1Make (BKIntrEnd, 0);
+	globalTrack = BKTKCompilerTrackAtOffset (compiler, 0, 0);
+
+	if (appendWord (&globalTrack -> code -> byteCode, cmd, &compiler -> arena) != 0) {
+		printError (compiler, NULL, "Error: allocation failed");
+		return BK_ALLOCATION_ERROR;
+	}
+
+	if (BKTKCompilerLink (compiler) != 0) {
+		return -1;
+	}
+
+	if (BKTKCompilerOutline (compiler) != 0) {
+		printError (compiler, NULL, "Error: allocation failed");
+		return BK_ALLOCATION_ERROR;
+	}
+
+	if ((res = BKTKCompilerVerify (compiler)) != 0) {
+		return res;
+	}
+
+	return 0;
+}
+
+/**
+ * Get track which a call of a copied track resolves to
+ *
+ * Tracks in `tracks` are used as they are; otherwise the compiled track if it
+ * is copied as well.
+ */
+static BKTKTrack const * copyCallTarget (BKTKCompiler const * compiler, BKArray const * tracks, uint8_t const copying [], BKUSize index)
+{
+	BKTKTrack * const * ref = BKArrayItemAt (tracks, index);
+
+	if (ref && *ref) {
+		return *ref;
+	}
+
+	if (index < compiler -> tracks.len && copying [index]) {
+		return *(BKTKTrack * const *) BKArrayItemAt (&compiler -> tracks, index);
+	}
+
+	return NULL;
+}
+
+/**
+ * Check if all groups called by byte code of track at `owner` are defined
+ */
+static BKInt copyCallsDefined (BKTKCompiler const * compiler, BKTKArenaArray const * byteCode, BKUSize owner, BKArray const * tracks, uint8_t const copying [])
+{
+	BKUSize index;
+	BKTKTrack const * track;
+	BKTKGroup * const * group;
+	struct callOperands call;
+	BKUSize numWords = byteCode -> len;
+	uint32_t const * words = byteCode -> items;
+
+	for (BKUSize i = 0; i < numWords; i += instrSize (&words [i], numWords - i)) {
+		if (!readCall (&words [i], numWords - i, &call)) {
+			continue;
+		}
+
+		switch (call.type) {
+			case BKGroupIndexTypeLocal: {
+				index = owner;
+				break;
+			}
+			case BKGroupIndexTypeGlobal: {
+				index = 0;
+				break;
+			}
+			default: {
+				index = (BKUSize) call.track;
+				break;
+			}
+		}
+
+		track = copyCallTarget (compiler, tracks, copying, index);
+		group = track ? BKTKArenaArrayItemAt (&track -> code -> groups, (BKUSize) call.group) : NULL;
+
+		if (!group || !*group || !((*group) -> object.object.flags & BKTKFlagUsed)) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * Copy byte code and move its arpeggios to `pool`
+ *
+ * `end` appends an end instruction, which the global track only gets when
+ * compiling ends.
+ */
+static BKInt copyByteCode (struct arpeggioPool * pool, BKTKArenaArray * copy, BKTKArenaArray const * byteCode, BKInt end, BKTKArena * arena)
+{
+	BKInt res = 0;
+	BKUSize numWords = byteCode -> len;
+	uint32_t const * words = byteCode -> items;
+
+	for (BKUSize i = 0; i < numWords; i ++) {
+		res |= appendWord (copy, words [i], arena);
+	}
+
+	if (end) {
+		res |= appendWord (copy, BKInstrMaskArg1Make (BKIntrEnd, 0), arena);
+	}
+
+	if (res == 0) {
+		res = arpeggioPoolRewrite (pool, copy, arena);
+	}
+
+	return res ? BK_ALLOCATION_ERROR : 0;
+}
+
+BKInt BKTKCompilerCopyTracks (BKTKCompiler * compiler, BKArray * tracks, BKArray * arpeggios, BKTKArena * arena)
+{
+	BKInt res = 0;
+	BKInt defined, changed;
+	BKInt numCopied = 0;
+	BKTKTrack * track, * trackCopy;
+	BKTKGroup * group, * groupCopy;
+	uint8_t * copying = NULL;
+	BKUSize numTracks = compiler -> tracks.len;
+	struct arpeggioPool pool = {.arpeggios = arpeggios};
+
+	// track bodies may still be compiled by workers
+	if (compiler -> numWorkers != 1) {
+		return BK_INVALID_STATE;
+	}
+
+	if (BKArrayResize (tracks, numTracks) != 0) {
+		goto allocationError;
+	}
+
+	copying = calloc (numTracks + 1, sizeof (*copying));
+
+	if (!copying) {
+		goto allocationError;
+	}
+
+	// bodies are compiled with their node; the global track is copied as it is
+	for (BKUSize i = 0; i < numTracks; i ++) {
+		track = *(BKTKTrack **) BKArrayItemAt (&compiler -> tracks, i);
+
+		if (!track || *(BKTKTrack **) BKArrayItemAt (tracks, i)) {
+			continue;
+		}
+
+		if (i && !(track -> object.object.flags & BKTKFlagUsed)) {
+			continue;
+		}
+
+		copying [i] = 1;
+	}
+
+	// leave out tracks calling groups which are not copied
+	do {
+		changed = 0;
+
+		for (BKUSize i = 0; i < numTracks; i ++) {
+			if (!copying [i]) {
+				continue;
+			}
+
+			track = *(BKTKTrack **) BKArrayItemAt (&compiler -> tracks, i);
+			defined = copyCallsDefined (compiler, &track -> code -> byteCode, i, tracks, copying);
+
+			for (BKUSize j = 0; j < track -> code -> groups.len && defined; j ++) {
+				group = ((BKTKGroup **) track -> code -> groups.items) [j];
+
+				if (group) {
+					defined = copyCallsDefined (compiler, &group -> byteCode, i, tracks, copying);
+				}
+			}
+
+			if (!defined) {
+				copying [i] = 0;
+				changed = 1;
+			}
+		}
+	}
+	while (changed);
+
+	for (BKUSize i = 0; i < numTracks; i ++) {
+		if (!copying [i]) {
+			continue;
+		}
+
+		track = *(BKTKTrack **) BKArrayItemAt (&compiler -> tracks, i);
+
+		if ((res = BKTKTrackAlloc (&trackCopy, arena)) != 0) {
+			goto cleanup;
+		}
+
+		trackCopy -> object.object.flags |= track -> object.object.flags & (BKTKFlagUsed | BKTKFlagAutoIndex);
+		trackCopy -> object.index  = track -> object.index;
+		trackCopy -> object.offset = track -> object.offset;
+		trackCopy -> waveform      = track -> waveform;
+
+		if ((res = copyByteCode (&pool, &trackCopy -> code -> byteCode, &track -> code -> byteCode, i == 0, arena)) != 0) {
+			goto cleanup;
+		}
+
+		if (BKTKArenaArrayResize (&trackCopy -> code -> groups, track -> code -> groups.len, arena) != 0) {
+			goto allocationError;
+		}
+
+		for (BKUSize j = 0; j < track -> code -> groups.len; j ++) {
+			group = ((BKTKGroup **) track -> code -> groups.items) [j];
+
+			if (!group) {
+				continue;
+			}
+
+			if ((res = BKTKGroupAlloc (&groupCopy, arena)) != 0) {
+				goto cleanup;
+			}
+
+			groupCopy -> object.object.flags |= group -> object.object.flags & BKTKFlagUsed;
+			groupCopy -> object.index  = group -> object.index;
+			groupCopy -> object.offset = group -> object.offset;
+
+			if ((res = copyByteCode (&pool, &groupCopy -> byteCode, &group -> byteCode, 0, arena)) != 0) {
+				goto cleanup;
+			}
+
+			((BKTKGroup **) trackCopy -> code -> groups.items) [j] = groupCopy;
+		}
+
+		*(BKTKTrack **) BKArrayItemAt (tracks, i) = trackCopy;
+		numCopied ++;
+	}
+
+	res = numCopied;
+
+	cleanup: {
+		free (pool.slots);
+		free (copying);
+
+		return res;
+	}
+
+	allocationError: {
+		res = BK_ALLOCATION_ERROR;
+		goto cleanup;
+	}
+}
+
+BKInt BKTKCompilerCompile (BKTKCompiler * compiler, BKTKParserNode const * tree)
+{
+	BKInt res = 0;
+	BKTKParserNode const * node;
+
+	if ((res = BKTKCompilerBegin (compiler)) != 0) {
+		return res;
+	}
+
+	for (node = tree; node; node = node -> nextNode) {
+		if ((res = BKTKCompilerPutNode (compiler, node, NULL)) != 0) {
+			return res;
+		}
+	}
+
+	return BKTKCompilerEnd (compiler);
+}
+
+BKInt BKTKCompilerReset (BKTKCompiler * compiler)
+{
+	BKTKTrack * track;
+
+	BKTKCompilerPoolDispose (compiler);
+
+	contentsFreeData (&compiler -> instrumentContents);
+	contentsFreeData (&compiler -> waveformContents);
+
+	// disposes all objects
+	BKTKArenaDispose (&compiler -> arena);
+
+	BKArrayEmpty (&compiler -> tracks);
+	BKArrayEmpty (&compiler -> instruments);
+	BKArrayEmpty (&compiler -> waveforms);
+	BKArrayEmpty (&compiler -> samples);
+	BKArrayEmpty (&compiler -> symbolObjects);
+	BKArrayEmpty (&compiler -> instrumentContents);
+	BKArrayEmpty (&compiler -> waveformContents);
+	BKArrayEmpty (&compiler -> arpeggios);
+	BKStringEmpty (&compiler -> auxString);
+	BKStringEmpty (&compiler -> error);
+	BKTKSymbolTableEmpty (&compiler -> localSymbols);
+
+	compiler -> lineno = 0;
+	compiler -> horizon = (BKTKOffset) {BK_INT_MAX, BK_INT_MAX};
+	compiler -> info = (BKTKFileInfo) {0};
+
+	// reserve global track
+	track = BKTKCompilerTrackAtOffset (compiler, 0, 1);
+
+	if (!track) {
+		return -1;
+	}
+
+	track -> object.object.flags |= BKTKFlagUsed;
+
+	return 0;
+}
+
+static void BKTKCompilerDispose (BKTKCompiler * compiler)
+{
+	BKTKCompilerReset (compiler);
+	BKTKArenaDispose (&compiler -> arena);
+
 	BKArrayDispose (&compiler -> tracks);
-	BKHashTableDispose (&compiler -> instruments);
-	BKHashTableDispose (&compiler -> waveforms);
-	BKHashTableDispose (&compiler -> samples);
+	BKArrayDispose (&compiler -> instruments);
+	BKArrayDispose (&compiler -> waveforms);
+	BKArrayDispose (&compiler -> samples);
+	BKArrayDispose (&compiler -> symbolObjects);
+	BKArrayDispose (&compiler -> instrumentContents);
+	BKArrayDispose (&compiler -> waveformContents);
+	BKArrayDispose (&compiler -> arpeggios);
 	BKStringDispose (&compiler -> auxString);
 	BKStringDispose (&compiler -> error);
+	BKDispose (&compiler -> localSymbols);
 }
 
 BKClass const BKTKCompilerClass =
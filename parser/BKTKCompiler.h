@@ -24,11 +24,16 @@
 #ifndef _BK_TK_COMPILER_H_
 #define _BK_TK_COMPILER_H_
 
+#include "BKTKArena.h"
 #include "BKTKBase.h"
 #include "BKInstrument.h"
 #include "BKTKInterpreter.h"
 #include "BKTKParser.h"
 
+typedef struct BKTKCompilerSymbol BKTKCompilerSymbol;
+typedef struct BKTKCompilerContent BKTKCompilerContent;
+typedef struct BKTKCompilerPool BKTKCompilerPool;
+
 /**
  * Globally used flags
  */
@@ -36,19 +41,80 @@ enum BKTKFlag
 {
 	BKTKFlagUsed      = 1 << 0,
 	BKTKFlagAutoIndex = 1 << 1,
+	BKTKFlagOutlined  = 1 << 2, // group created from repeated instructions
+	BKTKFlagVerified  = 1 << 3, // track byte code passed the verifier
+	BKTKFlagShared    = 1 << 4, // object used by a context created while compiling
+	BKTKFlagDeclared  = 1 << 5, // defined without compiling its body
 };
 
+/**
+ * Objects defined with a symbol as name
+ *
+ * Values are the object index + 1 or 0 if not defined
+ */
+struct BKTKCompilerSymbol
+{
+	BKUInt instrument;
+	BKUInt waveform;
+	BKUInt sample;
+};
+
+/**
+ * Compiled contents of an instrument or waveform
+ *
+ * Objects with the same contents are merged into the one at `index`
+ */
+struct BKTKCompilerContent
+{
+	uint64_t  hash;
+	BKUInt    index;
+	BKUSize   size;
+	BKUSize   capacity;
+	uint8_t * data;
+};
+
+/**
+ * `symbols` may be set to the symbol table of the parser which created the
+ * compiled nodes to use the symbols interned while parsing. Otherwise, names
+ * are interned into `localSymbols`. Names of autoindexed objects are interned
+ * into the used table.
+ *
+ * Track bodies are compiled in parallel by `pool` while further nodes are
+ * compiled. `numWorkers` limits the number of threads; 0 uses one per online
+ * CPU and 1 compiles track bodies immediately. `horizon` hides objects
+ * defined after the compiled track. Workers compile with a copy which looks
+ * up objects in `owner`.
+ *
+ * Objects with identical contents are merged when linking unless
+ * `keepObjects` is set; they then keep the index of their definition, so they
+ * can be replaced in a playing context.
+ *
+ * Tracks, groups and objects are allocated in `arena` which is handed over
+ * to the context created from the compiler.
+ */
 struct BKTKCompiler
 {
-	BKObject     object;
-	BKHashTable  instruments;
-	BKHashTable  waveforms;
-	BKHashTable  samples;
-	BKArray      tracks;
-	BKString     auxString;
-	BKString     error;
-	BKInt        lineno;
-	BKTKFileInfo info;
+	BKObject                object;
+	BKArray                 instruments;
+	BKArray                 waveforms;
+	BKArray                 samples;
+	BKArray                 symbolObjects;
+	BKArray                 instrumentContents;
+	BKArray                 waveformContents;
+	BKTKSymbolTable       * symbols;
+	BKTKSymbolTable         localSymbols;
+	BKArray                 tracks;
+	BKArray                 arpeggios; // BKTKArpeggio; constant pool filled when linking
+	BKString                auxString;
+	BKString                error;
+	BKInt                   lineno;
+	BKTKOffset              horizon;
+	BKUInt                  numWorkers;
+	BKInt                   keepObjects;
+	BKTKCompilerPool      * pool;
+	BKTKCompiler          * owner;
+	BKTKFileInfo            info;
+	BKTKArena               arena;
 };
 
 /**
@@ -58,9 +124,65 @@ extern BKInt BKTKCompilerInit (BKTKCompiler * compiler);
 
 /**
  * Parse tree from BKParser
+ *
+ * `tree` may also be the nodes of a `BKTKParserFlatTree`
  */
 extern BKInt BKTKCompilerCompile (BKTKCompiler * compiler, BKTKParserNode const * tree);
 
+/**
+ * Begin compiling nodes one by one
+ *
+ * Used instead of `BKTKCompilerCompile` if the complete tree is not kept.
+ */
+extern BKInt BKTKCompilerBegin (BKTKCompiler * compiler);
+
+/**
+ * Compile top-level node
+ *
+ * `nextNode` is ignored. Track bodies are compiled by workers while further
+ * nodes are put; the allocations of `nodes` are moved to the compiler to keep
+ * the node until then. If `nodes` is NULL, the node has to be kept until
+ * `BKTKCompilerEnd` returns. Other nodes are not referenced afterwards. Has
+ * the signature of `BKTKParserPutNodeFunc` to be called by the parser.
+ *
+ * If a node fails, pending track bodies are compiled to report their messages
+ * in file order.
+ */
+extern BKInt BKTKCompilerPutNode (BKTKCompiler * compiler, BKTKParserNode const * node, BKTKArena * nodes);
+
+/**
+ * Declare object defined by top-level node without compiling its body
+ *
+ * Objects, groups and tracks get the index and name they would get when
+ * compiled, so later definitions are numbered the same. They are flagged with
+ * `BKTKFlagDeclared` and left empty. Other commands are ignored. Used instead
+ * of `BKTKCompilerPutNode` for unchanged definitions when compiling only the
+ * changed ones for `BKTKContextCreateUpdate`.
+ */
+extern BKInt BKTKCompilerDeclareNode (BKTKCompiler * compiler, BKTKParserNode const * node);
+
+/**
+ * Finish compiling nodes
+ *
+ * Waits for the track bodies being compiled, resolves group references and
+ * links the byte code.
+ */
+extern BKInt BKTKCompilerEnd (BKTKCompiler * compiler);
+
+/**
+ * Copy compiled tracks for a context created while compiling
+ *
+ * Tracks which are compiled but not set in `tracks` are copied into `arena`.
+ * The byte code is copied before linking; objects are referenced by their
+ * index in the compiler and arpeggios are pooled into `arpeggios`. The global
+ * track is copied with the commands compiled so far. Tracks calling groups
+ * which are neither in `tracks` nor copied are left out until they can be
+ * resolved. Track bodies have to be compiled immediately (`numWorkers` is 1).
+ *
+ * Returns the number of copied tracks.
+ */
+extern BKInt BKTKCompilerCopyTracks (BKTKCompiler * compiler, BKArray * tracks, BKArray * arpeggios, BKTKArena * arena);
+
 /**
  * Reset compiler to compile another node
  */
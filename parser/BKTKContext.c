@@ -21,9 +21,16 @@
  * IN THE SOFTWARE.
  */
 
+#if BK_TK_PROFILE
+#define _POSIX_C_SOURCE 199309L
+#include <time.h>
+#endif
+
 #include "BKWaveFileReader.h"
 #include "BKTKContext.h"
 #include "BKTKInterpreter.h"
+#include "BKTKNative.h"
+#include "BKTKStats.h"
 
 extern BKClass const BKTKContextClass;
 extern BKClass const BKTKGroupClass;
@@ -42,39 +49,73 @@ static void printError (BKTKContext * ctx, char const * format, ...)
 	va_end (args);
 }
 
-BKInt BKTKTrackAlloc (BKTKTrack ** track)
+/**
+ * Allocate and initialize object in arena
+ */
+static BKInt arenaObjectAlloc (void ** object, BKClass const * isa, BKTKArena * arena)
+{
+	*object = BKTKArenaAlloc (arena, isa -> instanceSize);
+
+	if (!*object) {
+		return BK_ALLOCATION_ERROR;
+	}
+
+	return BKObjectInit (*object, isa, isa -> instanceSize);
+}
+
+/**
+ * Dispose initialized object when arena is disposed
+ */
+static BKInt arenaObjectAdd (void * object, BKTKArena * arena)
+{
+	if (BKTKArenaAddObject (arena, object) != 0) {
+		return BK_ALLOCATION_ERROR;
+	}
+
+	return 0;
+}
+
+BKInt BKTKTrackAlloc (BKTKTrack ** track, BKTKArena * arena)
 {
 	BKInt res;
 
-	if ((res = BKObjectInit (track, &BKTKTrackClass, sizeof (*track))) != 0) {
+	if ((res = arenaObjectAlloc ((void **) track, &BKTKTrackClass, arena)) != 0) {
 		return res;
 	}
 
-	(*track) -> byteCode = BK_BYTE_BUFFER_INIT;
-	(*track) -> groups = BK_ARRAY_INIT (sizeof (BKTKGroup *));
-	(*track) -> timingData = BK_BYTE_BUFFER_INIT;
+	// initialized when added to context
+	(*track) -> renderTrack = BKTKArenaAlloc (arena, sizeof (BKTrack));
+	(*track) -> interpreter.stack = BKTKArenaAlloc (arena, BK_INTR_STACK_SIZE * sizeof (BKTKStackItem));
+	(*track) -> code = BKTKArenaAlloc (arena, sizeof (BKTKTrackCode));
 
-	return res;
+	if (!(*track) -> renderTrack || !(*track) -> interpreter.stack || !(*track) -> code) {
+		return BK_ALLOCATION_ERROR;
+	}
+
+	(*track) -> code -> byteCode = BK_TK_ARENA_ARRAY_INIT (sizeof (uint32_t));
+	(*track) -> code -> groups = BK_TK_ARENA_ARRAY_INIT (sizeof (BKTKGroup *));
+
+	return arenaObjectAdd (*track, arena);
 }
 
-BKInt BKTKGroupAlloc (BKTKGroup ** group)
+BKInt BKTKGroupAlloc (BKTKGroup ** group, BKTKArena * arena)
 {
 	BKInt res;
 
-	if ((res = BKObjectAlloc ((void **) group, &BKTKGroupClass, sizeof (*group))) != 0) {
+	if ((res = arenaObjectAlloc ((void **) group, &BKTKGroupClass, arena)) != 0) {
 		return res;
 	}
 
-	(*group) -> byteCode = BK_BYTE_BUFFER_INIT;
+	(*group) -> byteCode = BK_TK_ARENA_ARRAY_INIT (sizeof (uint32_t));
 
 	return res;
 }
 
-BKInt BKTKInstrumentAlloc (BKTKInstrument ** instrument)
+BKInt BKTKInstrumentAlloc (BKTKInstrument ** instrument, BKTKArena * arena)
 {
 	BKInt res;
 
-	if ((res = BKObjectAlloc ((void **) instrument, &BKTKInstrumentClass, sizeof (*instrument))) != 0) {
+	if ((res = arenaObjectAlloc ((void **) instrument, &BKTKInstrumentClass, arena)) != 0) {
 		return res;
 	}
 
@@ -82,16 +123,16 @@ BKInt BKTKInstrumentAlloc (BKTKInstrument ** instrument)
 		return res;
 	}
 
-	(*instrument) -> name = BK_STRING_INIT;
+	(*instrument) -> name = "";
 
-	return res;
+	return arenaObjectAdd (*instrument, arena);
 }
 
-BKInt BKTKWaveformAlloc (BKTKWaveform ** waveform)
+BKInt BKTKWaveformAlloc (BKTKWaveform ** waveform, BKTKArena * arena)
 {
 	BKInt res;
 
-	if ((res = BKObjectAlloc ((void **) waveform, &BKTKWaveformClass, sizeof (*waveform))) != 0) {
+	if ((res = arenaObjectAlloc ((void **) waveform, &BKTKWaveformClass, arena)) != 0) {
 		return res;
 	}
 
@@ -99,16 +140,16 @@ BKInt BKTKWaveformAlloc (BKTKWaveform ** waveform)
 		return res;
 	}
 
-	(*waveform) -> name = BK_STRING_INIT;
+	(*waveform) -> name = "";
 
-	return res;
+	return arenaObjectAdd (*waveform, arena);
 }
 
-BKInt BKTKSampleAlloc (BKTKSample ** sample)
+BKInt BKTKSampleAlloc (BKTKSample ** sample, BKTKArena * arena)
 {
 	BKInt res;
 
-	if ((res = BKObjectAlloc ((void **) sample, &BKTKSampleClass, sizeof (*sample))) != 0) {
+	if ((res = arenaObjectAlloc ((void **) sample, &BKTKSampleClass, arena)) != 0) {
 		return res;
 	}
 
@@ -116,63 +157,34 @@ BKInt BKTKSampleAlloc (BKTKSample ** sample)
 		return res;
 	}
 
-	(*sample) -> name = BK_STRING_INIT;
-
-	return res;
-}
+	(*sample) -> path = "";
+	(*sample) -> name = "";
 
-static void BKTKGroupDispose (BKTKGroup * group)
-{
-	if (group) {
-		BKByteBufferDispose (&group -> byteCode);
-		free (group);
-	}
+	return arenaObjectAdd (*sample, arena);
 }
 
 static void BKTKTrackDispose (BKTKTrack * track)
 {
-	BKTKGroup * group;
-
-	if (track) {
-		for	(BKUSize i = 0; i < track -> groups.len; i ++) {
-			group = *(BKTKGroup **) BKArrayItemAt (&track -> groups, i);
-			BKTKGroupDispose (group);
-		}
-
-		BKByteBufferDispose (&track -> byteCode);
-		BKDispose (&track -> renderTrack);
-		BKDividerDetach (&track -> divider);
+	// tracks of the compiler are not played
+	if (track -> ctx) {
+		BKDispose (track -> renderTrack);
 		BKDispose (&track -> interpreter);
-		free (track);
 	}
 }
 
 static void BKTKInstrumentDispose (BKTKInstrument * instrument)
 {
-	if (instrument) {
-		BKDispose (&instrument -> instr);
-		BKStringDispose (&instrument -> name);
-		free (instrument);
-	}
+	BKDispose (&instrument -> instr);
 }
 
 static void BKTKWaveformDispose (BKTKWaveform * waveform)
 {
-	if (waveform) {
-		BKDispose (&waveform -> data);
-		BKStringDispose (&waveform -> name);
-		free (waveform);
-	}
+	BKDispose (&waveform -> data);
 }
 
 static void BKTKSampleDispose (BKTKSample * sample)
 {
-	if (sample) {
-		BKStringDispose (&sample -> path);
-		BKDispose (&sample -> data);
-		BKStringDispose (&sample -> name);
-		free (sample);
-	}
+	BKDispose (&sample -> data);
 }
 
 BKInt BKTKContextInit (BKTKContext * ctx, BKUInt flags)
@@ -188,8 +200,17 @@ BKInt BKTKContextInit (BKTKContext * ctx, BKUInt flags)
 	ctx -> waveforms = BK_ARRAY_INIT (sizeof (BKTKWaveform *));
 	ctx -> samples = BK_ARRAY_INIT (sizeof (BKTKSample *));
 	ctx -> tracks = BK_ARRAY_INIT (sizeof (BKTKTrack *));
+	ctx -> arpeggios = BK_ARRAY_INIT (sizeof (BKTKArpeggio));
+	ctx -> sequence = BK_ARRAY_INIT (sizeof (BKTKSequencerItem));
+	ctx -> trackOpcodes = BK_ARRAY_INIT (sizeof (void *));
+	ctx -> trackFlags = BK_ARRAY_INIT (sizeof (BKUInt));
 	ctx -> error = BK_STRING_INIT;
 	ctx -> loadPath = BK_STRING_INIT;
+	ctx -> arena = BK_TK_ARENA_INIT (BKTKStatsTypeContext);
+
+	if ((res = BKTKEventLogInit (&ctx -> resumeLog)) != 0) {
+		return res;
+	}
 
 	return 0;
 }
@@ -202,10 +223,9 @@ static BKInt BKTKContextLoadSamples (BKTKContext * ctx, BKTKCompiler * compiler)
 	BKFrame * frames = NULL;
 	BKTKSample * sample;
 	BKWaveFileReader reader;
-	BKHashTableIterator itor;
-	char const * key;
 	BKString dir = BK_STRING_INIT;
 	BKString path = BK_STRING_INIT;
+	BKString segment = BK_STRING_INIT;
 	BKArray * samples = &ctx -> samples;
 	BKHashTable sampleFiles = BK_HASH_TABLE_INIT;
 
@@ -214,23 +234,29 @@ static BKInt BKTKContextLoadSamples (BKTKContext * ctx, BKTKCompiler * compiler)
 
 	BKStringAppendString (&dir, &ctx -> loadPath);
 
-	BKHashTableIteratorInit (&itor, &compiler -> samples);
-
-	if (BKArrayResize (samples, BKHashTableSize (&compiler -> samples)) != 0) {
+	if (BKArrayResize (samples, compiler -> samples.len) != 0) {
 		printError (ctx, "Error: allocation error");
 		goto allocationError;
 	}
 
-	while (BKHashTableIteratorNext (&itor, &key, (void **) &sample)) {
-		*(BKTKSample **) BKArrayItemAt (samples, sample -> object.index) = sample;
+	for (BKUSize i = 0; i < compiler -> samples.len; i ++) {
+		sample = *(BKTKSample **) BKArrayItemAt (&compiler -> samples, i);
+		*(BKTKSample **) BKArrayItemAt (samples, i) = sample;
+
+		// already loaded and possibly playing
+		if (sample -> object.object.flags & BKTKFlagShared) {
+			continue;
+		}
 
-		if (sample -> path.len) {
+		if (sample -> path [0]) {
 			//BKInt result;
 			//BKData ** dataRef;
 
 			BKStringEmpty (&path);
 			BKStringAppendString (&path, &dir);
-			BKStringAppendPathSegment (&path, &sample -> path);
+			BKStringEmpty (&segment);
+			BKStringAppend (&segment, sample -> path);
+			BKStringAppendPathSegment (&path, &segment);
 
 			/*result = BKHashTableLookupOrInsert (&sampleFiles, (char const *) path.str, (void ***) &dataRef);
 
@@ -257,7 +283,7 @@ static BKInt BKTKContextLoadSamples (BKTKContext * ctx, BKTKCompiler * compiler)
 
 				if (!file) {
 					printError (ctx, "Error: opening file failed: '%s' on line %u:%u",
-						sample -> path.str, sample -> object.offset.lineno, sample -> object.offset.colno);
+						sample -> path, sample -> object.offset.lineno, sample -> object.offset.colno);
 					res = BK_FILE_ERROR;
 					goto cleanup;
 				}
@@ -279,6 +305,8 @@ static BKInt BKTKContextLoadSamples (BKTKContext * ctx, BKTKCompiler * compiler)
 					goto allocationError;
 				}
 
+				BKTKStatsCountAlloc (BKTKStatsTypeSamples, numFrames * numChannels * sizeof (BKFrame));
+
 				if (BKWaveFileReaderReadFrames (&reader, frames) != 0) {
 					printError (ctx, "Error: failed to read WAVE data");
 					goto allocationError;
@@ -289,6 +317,8 @@ static BKInt BKTKContextLoadSamples (BKTKContext * ctx, BKTKCompiler * compiler)
 					goto allocationError;
 				}
 
+				BKTKStatsCountAlloc (BKTKStatsTypeSamples, numFrames * numChannels * sizeof (BKFrame));
+
 				BKDispose (&reader);
 
 				free (frames);
@@ -317,6 +347,7 @@ static BKInt BKTKContextLoadSamples (BKTKContext * ctx, BKTKCompiler * compiler)
 		free (frames);
 		BKStringDispose (&dir);
 		BKStringDispose (&path);
+		BKStringDispose (&segment);
 		BKHashTableDispose (&sampleFiles);
 		BKDispose (&reader);
 
@@ -329,8 +360,114 @@ static BKInt BKTKContextLoadSamples (BKTKContext * ctx, BKTKCompiler * compiler)
 	}
 }
 
+/**
+ * Make sequencer item of track at `index` due at beat tick `due`
+ */
+BK_INLINE BKTKSequencerItem sequencerItemMake (uint64_t due, BKUInt index)
+{
+	return (due << BK_TK_SEQUENCER_INDEX_BITS) | index;
+}
+
+/**
+ * Get due beat tick of sequencer item
+ */
+BK_INLINE uint64_t sequencerItemDue (BKTKSequencerItem item)
+{
+	return item >> BK_TK_SEQUENCER_INDEX_BITS;
+}
+
+/**
+ * Get track index of sequencer item
+ */
+BK_INLINE BKUInt sequencerItemTrack (BKTKSequencerItem item)
+{
+	return (BKUInt) (item & (BK_TK_SEQUENCER_MAX_TRACKS - 1));
+}
+
+/**
+ * Allocate sequence for `numItems` tracks and stepping state for all tracks
+ */
+static BKInt sequencerResize (BKTKContext * ctx, BKUSize numItems)
+{
+	BKUSize numTracks = ctx -> tracks.len;
+
+	if (numTracks > BK_TK_SEQUENCER_MAX_TRACKS) {
+		return -1;
+	}
+
+	if (BKArrayResize (&ctx -> sequence, numItems) != 0 ||
+		BKArrayResize (&ctx -> trackOpcodes, numTracks) != 0 ||
+		BKArrayResize (&ctx -> trackFlags, numTracks) != 0) {
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Append track to sequence to be due at first beat at its first instruction
+ *
+ * Tracks begin at their native function if native code is set.
+ */
+static void sequencerPutTrack (BKTKContext * ctx, BKUInt index, BKTKTrack const * track)
+{
+	void * opcode = track -> code -> byteCode.items;
+
+	if (ctx -> nativeEntries) {
+		opcode = ctx -> nativeEntries [index];
+	}
+
+	((void **) ctx -> trackOpcodes.items) [index] = opcode;
+	((BKUInt *) ctx -> trackFlags.items) [index] = 0;
+	((BKTKSequencerItem *) ctx -> sequence.items) [ctx -> sequence.len ++] = sequencerItemMake (0, index);
+}
+
+/**
+ * Put all tracks in sequence to be due at first beat
+ *
+ * Tracks in index order with equal due ticks already form a valid heap.
+ */
+static void sequencerFill (BKTKContext * ctx)
+{
+	BKTKTrack * track;
+
+	ctx -> sequence.len = 0;
+
+	for (BKUSize i = 0; i < ctx -> tracks.len; i ++) {
+		track = *(BKTKTrack **) BKArrayItemAt (&ctx -> tracks, i);
+
+		if (track) {
+			sequencerPutTrack (ctx, (BKUInt) i, track);
+		}
+	}
+
+	ctx -> beatTime = 0;
+}
+
+static BKInt BKTKContextInitTrack (BKTKContext * ctx, BKTKTrack * track)
+{
+	BKInt res;
+
+	// stack is allocated with track
+	if ((res = BKTKInterpreterInit (&track -> interpreter, track -> interpreter.stack)) != 0) {
+		return res;
+	}
+
+	if ((res = BKTrackInit (track -> renderTrack, BK_SQUARE)) != 0) {
+		return res;
+	}
+
+	BKSetAttr (track -> renderTrack, BK_VOLUME, BK_MAX_VOLUME);
+
+	track -> object.object.flags |= ctx -> object.flags;
+	track -> ctx = ctx;
+
+	return 0;
+}
+
 static BKInt BKTKContextCreateTracks (BKTKContext * ctx, BKTKCompiler * compiler)
 {
+	BKUSize numTracks = 0;
 	BKInt res = 0;
 	BKTKTrack * track;
 	BKTKTrack ** trackRef;
@@ -348,24 +485,21 @@ static BKInt BKTKContextCreateTracks (BKTKContext * ctx, BKTKCompiler * compiler
 			continue;
 		}
 
-		if ((res = BKTKInterpreterInit (&track -> interpreter)) != 0) {
-			goto cleanup;
-		}
-
-		if ((res = BKTrackInit (&track -> renderTrack, BK_SQUARE)) != 0) {
+		if ((res = BKTKContextInitTrack (ctx, track)) != 0) {
 			goto cleanup;
 		}
 
-		BKSetAttr (&track -> renderTrack, BK_VOLUME, BK_MAX_VOLUME);
-
-		track -> object.object.flags |= ctx -> object.flags;
-		track -> interpreter.opcode = track -> byteCode.first -> data;
-		track -> interpreter.opcodePtr = track -> interpreter.opcode;
-		track -> ctx = ctx;
-
 		*(BKTKTrack **) BKArrayItemAt (&ctx -> tracks, i) = track;
+		numTracks ++;
+	}
+
+	if (sequencerResize (ctx, numTracks)) {
+		printError (ctx, "Error: allocation error");
+		goto allocationError;
 	}
 
+	sequencerFill (ctx);
+
 	cleanup: {
 		return res;
 	}
@@ -376,39 +510,54 @@ static BKInt BKTKContextCreateTracks (BKTKContext * ctx, BKTKCompiler * compiler
 	}
 }
 
+static void BKTKContextSetInfo (BKTKContext * ctx, BKTKCompiler const * compiler)
+{
+	ctx -> info = compiler -> info;
+
+	if (!ctx -> info.stepTicks) {
+		ctx -> info.stepTicks = BK_INTR_STEP_TICKS;
+	}
+
+	if (!ctx -> info.tickRate.factor) {
+		ctx -> info.tickRate.factor = 1;
+		ctx -> info.tickRate.divisor = BK_DEFAULT_CLOCK_RATE;
+	}
+}
+
 BKInt BKTKContextCreate (BKTKContext * ctx, BKTKCompiler * compiler)
 {
 	BKInt res = 0;
+	BKTKStatsTime startTime;
 	BKTKWaveform * waveform;
 	BKTKInstrument * instrument;
 	BKArray * waveforms = &ctx -> waveforms;
 	BKArray * instruments = &ctx -> instruments;
-	BKHashTableIterator itor;
-	char const * key;
 
-	BKHashTableIteratorInit (&itor, &compiler -> instruments);
-
-	if (BKArrayResize (instruments, BKHashTableSize (&compiler -> instruments)) != 0) {
+	if (BKArrayResize (instruments, compiler -> instruments.len) != 0) {
 		printError (ctx, "Error: allocation error");
 		goto allocationError;
 	}
 
-	while (BKHashTableIteratorNext (&itor, &key, (void **) &instrument)) {
-		*(BKTKInstrument **) BKArrayItemAt (instruments, instrument -> object.index) = instrument;
+	for (BKUSize i = 0; i < compiler -> instruments.len; i ++) {
+		instrument = *(BKTKInstrument **) BKArrayItemAt (&compiler -> instruments, i);
+		*(BKTKInstrument **) BKArrayItemAt (instruments, i) = instrument;
 	}
 
-	BKHashTableIteratorInit (&itor, &compiler -> waveforms);
-
-	if (BKArrayResize (waveforms, BKHashTableSize (&compiler -> waveforms)) != 0) {
+	if (BKArrayResize (waveforms, compiler -> waveforms.len) != 0) {
 		printError (ctx, "Error: allocation error");
 		goto allocationError;
 	}
 
-	while (BKHashTableIteratorNext (&itor, &key, (void **) &waveform)) {
-		*(BKTKWaveform **) BKArrayItemAt (waveforms, waveform -> object.index) = waveform;
+	for (BKUSize i = 0; i < compiler -> waveforms.len; i ++) {
+		waveform = *(BKTKWaveform **) BKArrayItemAt (&compiler -> waveforms, i);
+		*(BKTKWaveform **) BKArrayItemAt (waveforms, i) = waveform;
 	}
 
-	if ((res = BKTKContextLoadSamples (ctx, compiler)) != 0) {
+	BKTKStatsGetTime (&startTime);
+	res = BKTKContextLoadSamples (ctx, compiler);
+	BKTKStatsAddTime (BKTKStatsTypeSamples, &startTime);
+
+	if (res != 0) {
 		goto cleanup;
 	}
 
@@ -417,24 +566,28 @@ BKInt BKTKContextCreate (BKTKContext * ctx, BKTKCompiler * compiler)
 	}
 
 	BKArrayEmpty (&compiler -> tracks);
-	BKHashTableEmpty (&compiler -> instruments);
-	BKHashTableEmpty (&compiler -> waveforms);
-	BKHashTableEmpty (&compiler -> samples);
+	BKArrayEmpty (&compiler -> instruments);
+	BKArrayEmpty (&compiler -> waveforms);
+	BKArrayEmpty (&compiler -> samples);
+	BKArrayEmpty (&compiler -> symbolObjects);
+	BKTKArenaMove (&ctx -> arena, &compiler -> arena);
 
-	ctx -> info = compiler -> info;
-
-	if (!ctx -> info.stepTicks) {
-		ctx -> info.stepTicks = BK_INTR_STEP_TICKS;
-	}
-
-	if (!ctx -> info.tickRate.factor) {
-		ctx -> info.tickRate.factor = 1;
-		ctx -> info.tickRate.divisor = BK_DEFAULT_CLOCK_RATE;
-	}
+	BKArrayDispose (&ctx -> arpeggios);
+	ctx -> arpeggios = compiler -> arpeggios;
+	compiler -> arpeggios = BK_ARRAY_INIT (sizeof (BKTKArpeggio));
 
+	BKTKContextSetInfo (ctx, compiler);
 	BKTKCompilerReset (compiler);
 
 	cleanup: {
+		if (res) {
+			// objects are still owned by the compiler
+			BKArrayEmpty (&ctx -> instruments);
+			BKArrayEmpty (&ctx -> waveforms);
+			BKArrayEmpty (&ctx -> samples);
+			BKArrayEmpty (&ctx -> tracks);
+		}
+
 		return res;
 	}
 
@@ -444,175 +597,1055 @@ BKInt BKTKContextCreate (BKTKContext * ctx, BKTKCompiler * compiler)
 	}
 }
 
-static void writeTimingData (BKTKTrack * track, char const * data, ...)
+/**
+ * Initialize tracks copied from compiler and sequence only them
+ *
+ * Leaves room for the items of `playing` if given.
+ */
+static BKInt BKTKContextSequenceCopies (BKTKContext * ctx, BKTKContext const * playing)
 {
-	va_list args;
-	char buffer [1024];
-	BKInt size;
-
-	buffer [0] = '\0';
-
-	va_start (args, data);
-	size = vsnprintf (buffer, sizeof (buffer), data, args);
-	va_end (args);
+	BKInt res;
+	BKUSize numTracks = 0;
+	BKUSize numItems = playing ? playing -> sequence.len : 0;
+	BKTKTrack * track;
 
-	if (size >= 0) {
-		BKByteBufferAppendBytes (&track -> timingData, buffer, size);
-	}
-}
+	// copied tracks have no context yet
+	for (BKUSize i = 0; i < ctx -> tracks.len; i ++) {
+		track = *(BKTKTrack **) BKArrayItemAt (&ctx -> tracks, i);
 
-static void writeTimingLine (BKTKTrack * track)
-{
-	BKTKInterpreter * interpreter = & track -> interpreter;
-	BKEnum type = track -> object.object.flags & BKTKContextOptionTimingDataMask;
-	float tickTime = 0;
+		if (track && !track -> ctx) {
+			if ((res = BKTKContextInitTrack (ctx, track)) != 0) {
+				return res;
+			}
 
-	if (type == BKTKContextOptionTimingDataSecs) {
-		BKContext * ctx = track -> ctx -> renderContext;
-		BKTime masterTick;
-		BKInt sampleRate;
+			// global `stepticks` has already been run
+			if (playing) {
+				track -> interpreter.stepTickCount = ctx -> info.stepTicks;
+			}
 
-		BKGetPtr (ctx, BK_CLOCK_PERIOD, & masterTick, sizeof (masterTick));
-		BKGetAttr (ctx, BK_SAMPLE_RATE, & sampleRate);
-		tickTime = (float) BKTimeGetTime (masterTick);
-		tickTime += (float) BKTimeGetFrac (masterTick) / BK_FINT20_UNIT;
-		tickTime = tickTime / sampleRate * interpreter -> lineTime;
-	}
-	else if (type == BKTKContextOptionTimingDataTicks) {
-		tickTime = interpreter -> lineTime;
+			numTracks ++;
+		}
 	}
 
-	if (interpreter -> lineno != track -> lineno + 1) {
-		writeTimingData (track, "l:%.5g:%u\n", tickTime, interpreter -> lineno);
-	}
-	else {
-		writeTimingData (track, "l:%.5g\n", tickTime);
+	if (sequencerResize (ctx, numItems + numTracks) != 0) {
+		printError (ctx, "Error: allocation error");
+		return BK_ALLOCATION_ERROR;
 	}
-}
 
-static BKEnum dividerCallback (BKCallbackInfo * info, BKTKTrack * track)
-{
-	BKInt ticks;
-	BKTKInterpreter * interpreter = &track -> interpreter;
+	ctx -> sequence.len = 0;
 
-	BKTKInterpreterAdvance (&track -> interpreter, track, &ticks);
-	info -> divider = ticks;
+	for (BKUSize i = 0; i < ctx -> tracks.len; i ++) {
+		track = *(BKTKTrack **) BKArrayItemAt (&ctx -> tracks, i);
 
-	if (track -> object.object.flags & BKTKContextOptionTimingDataMask) {
-		if ((interpreter -> object.flags & BKTKInterpreterFlagHasRepeated) == 0) {
-			if (interpreter -> lineno != track -> lineno) {
-				writeTimingLine (track);
-				track -> lineno = interpreter -> lineno;
-			}
+		if (track && track -> ctx == ctx) {
+			sequencerPutTrack (ctx, (BKUInt) i, track);
 		}
 	}
 
+	ctx -> beatTime = 0;
+
 	return 0;
 }
 
-BKInt BKTKContextAttach (BKTKContext * ctx, BKContext * renderContext)
+BKInt BKTKContextCreatePreview (BKTKContext * ctx, BKTKContext const * playing, BKTKCompiler * compiler)
 {
-	BKInt res;
+	BKInt res = 0;
 	BKTKTrack * track;
-	BKCallback callback;
+	BKTKSample * sample;
+	BKTKWaveform * waveform;
+	BKTKInstrument * instrument;
 
-	if (ctx -> renderContext) {
-		return BK_INVALID_STATE;
+	if (BKArrayResize (&ctx -> instruments, compiler -> instruments.len) != 0) {
+		printError (ctx, "Error: allocation error");
+		goto allocationError;
 	}
 
-	ctx -> renderContext = renderContext;
-	callback.func = (BKCallbackFunc) dividerCallback;
-
-	for (BKUSize i = 0; i < ctx -> tracks.len; i ++) {
-		track = *(BKTKTrack **) BKArrayItemAt (&ctx -> tracks, i);
+	for (BKUSize i = 0; i < compiler -> instruments.len; i ++) {
+		instrument = *(BKTKInstrument **) BKArrayItemAt (&compiler -> instruments, i);
+		*(BKTKInstrument **) BKArrayItemAt (&ctx -> instruments, i) = instrument;
 
-		if (track) {
-			if ((res = BKTrackAttach (&track -> renderTrack, ctx -> renderContext)) != 0) {
-				return res;
-			}
+		if (instrument) {
+			instrument -> object.object.flags |= BKTKFlagShared;
+		}
+	}
 
-			callback.userInfo = track;
+	if (BKArrayResize (&ctx -> waveforms, compiler -> waveforms.len) != 0) {
+		printError (ctx, "Error: allocation error");
+		goto allocationError;
+	}
 
-			if ((res = BKDividerInit (&track -> divider, 0, &callback)) != 0) {
-				return res;
-			}
+	for (BKUSize i = 0; i < compiler -> waveforms.len; i ++) {
+		waveform = *(BKTKWaveform **) BKArrayItemAt (&compiler -> waveforms, i);
+		*(BKTKWaveform **) BKArrayItemAt (&ctx -> waveforms, i) = waveform;
 
-			if ((res = BKContextAttachDivider (ctx -> renderContext, &track -> divider, BK_CLOCK_TYPE_BEAT)) != 0) {
-				return res;
-			}
+		if (waveform) {
+			waveform -> object.object.flags |= BKTKFlagShared;
 		}
 	}
 
-	return 0;
-}
-
-void BKTKContextDetach (BKTKContext * ctx)
-{
-	BKTKTrack * track;
+	if ((res = BKTKContextLoadSamples (ctx, compiler)) != 0) {
+		goto cleanup;
+	}
 
-	if (!ctx -> renderContext) {
-		return;
+	for (BKUSize i = 0; i < ctx -> samples.len; i ++) {
+		sample = *(BKTKSample **) BKArrayItemAt (&ctx -> samples, i);
+		sample -> object.object.flags |= BKTKFlagShared;
 	}
 
-	for (BKUSize i = 0; i < ctx -> tracks.len; i ++) {
-		track = *(BKTKTrack **) BKArrayItemAt (&ctx -> tracks, i);
+	if (playing) {
+		if (BKArrayResize (&ctx -> tracks, playing -> tracks.len) != 0 ||
+			BKArrayResize (&ctx -> arpeggios, playing -> arpeggios.len) != 0) {
+			printError (ctx, "Error: allocation error");
+			goto allocationError;
+		}
 
-		if (track) {
-			BKDividerDetach (&track -> divider);
-			BKTrackDetach (&track -> renderTrack);
+		for (BKUSize i = 0; i < playing -> tracks.len; i ++) {
+			track = *(BKTKTrack **) BKArrayItemAt (&playing -> tracks, i);
+			*(BKTKTrack **) BKArrayItemAt (&ctx -> tracks, i) = track;
 		}
+
+		memcpy (ctx -> arpeggios.items, playing -> arpeggios.items, playing -> arpeggios.len * sizeof (BKTKArpeggio));
 	}
 
-	ctx -> renderContext = NULL;
-}
+	if ((res = BKTKCompilerCopyTracks (compiler, &ctx -> tracks, &ctx -> arpeggios, &ctx -> arena)) < 0) {
+		printError (ctx, "Error: copying tracks failed");
+		goto cleanup;
+	}
 
-static void BKTKTrackReset (BKTKTrack * track)
-{
-	BKDividerReset (&track -> divider);
-	BKTKInterpreterReset (&track -> interpreter);
-	BKTrackReset (&track -> renderTrack);
-	track -> lineno = 0;
+	BKTKContextSetInfo (ctx, compiler);
+	res = BKTKContextSequenceCopies (ctx, playing);
 
-	BKByteBufferDispose (&track -> timingData);
-	track -> timingData = BK_BYTE_BUFFER_INIT;
+	cleanup: {
+		if (res) {
+			// objects are still owned by the compiler
+			BKArrayEmpty (&ctx -> instruments);
+			BKArrayEmpty (&ctx -> waveforms);
+			BKArrayEmpty (&ctx -> samples);
+			BKArrayEmpty (&ctx -> tracks);
+		}
+
+		return res;
+	}
+
+	allocationError: {
+		res = BK_ALLOCATION_ERROR;
+		goto cleanup;
+	}
 }
 
-void BKTKContextReset (BKTKContext * ctx)
+/**
+ * Check if track of compiler at `index` is defined
+ *
+ * The global track is always defined.
+ */
+static BKInt compilerTrackIsDefined (BKTKCompiler const * compiler, BKUSize index)
 {
-	BKTKTrack * track;
+	BKTKTrack * const * ref = BKArrayItemAt (&compiler -> tracks, index);
 
-	for (BKUSize i = 0; i < ctx -> tracks.len; i ++) {
-		track = *(BKTKTrack **) BKArrayItemAt (&ctx -> tracks, i);
-		BKTKTrackReset (track);
+	if (!ref || !*ref) {
+		return 0;
 	}
 
-	BKStringEmpty (&ctx -> error);
+	return index == 0 || ((*ref) -> object.object.flags & BKTKFlagUsed);
 }
 
-static void BKTKContextDispose (BKTKContext * ctx)
+/**
+ * Check if track of compiler at `index` has been compiled and not only
+ * declared
+ *
+ * The global track is compiled if any of its groups is.
+ */
+static BKInt compilerTrackIsCompiled (BKTKCompiler const * compiler, BKUSize index)
 {
-	BKTKContextDetach (ctx);
+	BKTKGroup * group;
+	BKTKTrack * track = *(BKTKTrack **) BKArrayItemAt (&compiler -> tracks, index);
 
-	for (BKUSize i = 0; i < ctx -> instruments.len; i ++) {
-		BKTKInstrumentDispose (*(BKTKInstrument **) BKArrayItemAt (&ctx -> instruments, i));
+	if (index) {
+		return !(track -> object.object.flags & BKTKFlagDeclared);
 	}
 
-	for (BKUSize i = 0; i < ctx -> waveforms.len; i ++) {
-		BKTKWaveformDispose (*(BKTKWaveform **)BKArrayItemAt (&ctx -> waveforms, i));
-	}
+	for (BKUSize i = 0; i < track -> code -> groups.len; i ++) {
+		group = ((BKTKGroup **) track -> code -> groups.items) [i];
 
-	for (BKUSize i = 0; i < ctx -> samples.len; i ++) {
-		BKTKSampleDispose (*(BKTKSample **)BKArrayItemAt (&ctx -> samples, i));
+		if (group && (group -> object.object.flags & (BKTKFlagUsed | BKTKFlagDeclared)) == BKTKFlagUsed) {
+			return 1;
+		}
 	}
 
-	for (BKUSize i = 0; i < ctx -> tracks.len; i ++) {
-		BKTKTrackDispose (*(BKTKTrack **)BKArrayItemAt (&ctx -> tracks, i));
-	}
+	return 0;
+}
+
+/**
+ * Keep groups of replaced track which are still called by playing tracks
+ *
+ * Global groups which are only declared are taken from the playing global
+ * track, which also contains the outlined groups. Other tracks have to define
+ * all groups again.
+ */
+static BKInt BKTKContextKeepGroups (BKTKContext * ctx, BKTKTrack * track, BKTKTrack const * playingTrack, BKTKTrack const * compiled)
+{
+	BKTKGroup * group;
+	BKTKGroup * const * groups = playingTrack -> code -> groups.items;
+	BKUSize numGroups = playingTrack -> code -> groups.len;
+
+	if (track -> code -> groups.len < numGroups) {
+		if (BKTKArenaArrayResize (&track -> code -> groups, numGroups, &ctx -> arena) != 0) {
+			printError (ctx, "Error: allocation error");
+			return BK_ALLOCATION_ERROR;
+		}
+	}
+
+	for (BKUSize i = 0; i < numGroups; i ++) {
+		if (!groups [i] || !(groups [i] -> object.object.flags & BKTKFlagUsed)) {
+			continue;
+		}
+
+		group = NULL;
+
+		if (i < compiled -> code -> groups.len) {
+			group = ((BKTKGroup **) compiled -> code -> groups.items) [i];
+		}
+
+		if (group && (group -> object.object.flags & (BKTKFlagUsed | BKTKFlagDeclared)) == BKTKFlagUsed) {
+			continue;
+		}
+
+		if (track -> object.index) {
+			printError (ctx, "Error: group %zu of track %d has been removed", (size_t) i, track -> object.index - 1);
+			return BK_INVALID_STATE;
+		}
+
+		((BKTKGroup **) track -> code -> groups.items) [i] = groups [i];
+	}
+
+	return 0;
+}
+
+BKInt BKTKContextCreateUpdate (BKTKContext * ctx, BKTKContext const * playing, BKTKCompiler * compiler)
+{
+	BKInt res = 0;
+	BKTKTrack * track;
+	BKTKTrack * const * playingTracks = playing -> tracks.items;
+	BKTKInstrument * instrument;
+	BKUSize numTracks = BKMax (compiler -> tracks.len, playing -> tracks.len);
+
+	// tracks of `playing` are not advanced by the interpreter
+	if (playing -> nativeEntries || playing -> replayLog) {
+		printError (ctx, "Error: context does not run byte code");
+		return BK_INVALID_STATE;
+	}
+
+	if (compiler -> instruments.len != playing -> instruments.len ||
+		compiler -> waveforms.len != playing -> waveforms.len ||
+		compiler -> samples.len != playing -> samples.len) {
+		printError (ctx, "Error: objects have been added or removed");
+		return BK_INVALID_STATE;
+	}
+
+	for (BKUSize i = 0; i < numTracks; i ++) {
+		if (compilerTrackIsDefined (compiler, i) != (i < playing -> tracks.len && playingTracks [i])) {
+			printError (ctx, "Error: tracks have been added, removed or renumbered");
+			return BK_INVALID_STATE;
+		}
+	}
+
+	// compiler copies into `tracks` up to its number of tracks
+	if (BKArrayResize (&compiler -> tracks, numTracks) != 0 ||
+		BKArrayResize (&ctx -> instruments, playing -> instruments.len) != 0 ||
+		BKArrayResize (&ctx -> waveforms, playing -> waveforms.len) != 0 ||
+		BKArrayResize (&ctx -> samples, playing -> samples.len) != 0 ||
+		BKArrayResize (&ctx -> tracks, numTracks) != 0 ||
+		BKArrayResize (&ctx -> arpeggios, playing -> arpeggios.len) != 0) {
+		printError (ctx, "Error: allocation error");
+		goto allocationError;
+	}
+
+	memcpy (ctx -> instruments.items, playing -> instruments.items, playing -> instruments.len * sizeof (BKTKInstrument *));
+	memcpy (ctx -> waveforms.items, playing -> waveforms.items, playing -> waveforms.len * sizeof (BKTKWaveform *));
+	memcpy (ctx -> samples.items, playing -> samples.items, playing -> samples.len * sizeof (BKTKSample *));
+	memcpy (ctx -> tracks.items, playing -> tracks.items, playing -> tracks.len * sizeof (BKTKTrack *));
+	memcpy (ctx -> arpeggios.items, playing -> arpeggios.items, playing -> arpeggios.len * sizeof (BKTKArpeggio));
+
+	for (BKUSize i = 0; i < compiler -> instruments.len; i ++) {
+		instrument = *(BKTKInstrument **) BKArrayItemAt (&compiler -> instruments, i);
+
+		if (!(instrument -> object.object.flags & BKTKFlagDeclared)) {
+			*(BKTKInstrument **) BKArrayItemAt (&ctx -> instruments, i) = instrument;
+		}
+	}
+
+	// compiled tracks are copied in place of the playing ones
+	for (BKUSize i = 0; i < numTracks; i ++) {
+		if (compilerTrackIsDefined (compiler, i) && compilerTrackIsCompiled (compiler, i)) {
+			*(BKTKTrack **) BKArrayItemAt (&ctx -> tracks, i) = NULL;
+		}
+	}
+
+	if ((res = BKTKCompilerCopyTracks (compiler, &ctx -> tracks, &ctx -> arpeggios, &ctx -> arena)) < 0) {
+		printError (ctx, "Error: copying tracks failed");
+		goto cleanup;
+	}
+
+	res = 0;
+
+	for (BKUSize i = 0; i < numTracks; i ++) {
+		track = *(BKTKTrack **) BKArrayItemAt (&ctx -> tracks, i);
+
+		if (!playingTracks [i] || track == playingTracks [i]) {
+			continue;
+		}
+
+		// left out by compiler
+		if (!track) {
+			printError (ctx, "Error: track %d calls undefined groups", (BKInt) i - 1);
+			res = BK_INVALID_STATE;
+			goto cleanup;
+		}
+
+		if ((res = BKTKContextKeepGroups (ctx, track, playingTracks [i], *(BKTKTrack **) BKArrayItemAt (&compiler -> tracks, i))) != 0) {
+			goto cleanup;
+		}
+	}
+
+	ctx -> info = playing -> info;
+
+	if ((res = BKTKContextSequenceCopies (ctx, playing)) != 0) {
+		goto cleanup;
+	}
+
+	BKArrayEmpty (&compiler -> tracks);
+	BKArrayEmpty (&compiler -> instruments);
+	BKArrayEmpty (&compiler -> waveforms);
+	BKArrayEmpty (&compiler -> samples);
+	BKArrayEmpty (&compiler -> symbolObjects);
+	BKTKArenaMove (&ctx -> arena, &compiler -> arena);
+	BKTKCompilerReset (compiler);
+
+	cleanup: {
+		if (res) {
+			// objects are still owned by the compiler or by `playing`
+			BKArrayEmpty (&ctx -> instruments);
+			BKArrayEmpty (&ctx -> waveforms);
+			BKArrayEmpty (&ctx -> samples);
+			BKArrayEmpty (&ctx -> tracks);
+			BKArrayEmpty (&ctx -> arpeggios);
+			BKArrayEmpty (&ctx -> sequence);
+			BKArrayEmpty (&ctx -> trackOpcodes);
+			BKArrayEmpty (&ctx -> trackFlags);
+			BKTKArenaDispose (&ctx -> arena);
+		}
+
+		return res;
+	}
+
+	allocationError: {
+		res = BK_ALLOCATION_ERROR;
+		goto cleanup;
+	}
+}
+
+BKInt BKTKTrackPushEvent (BKTKTrack * track, BKEnum type, BKEnum attr, BKInt value, BKInt const data [], BKUInt size)
+{
+	BKInt res;
+	BKTKContext * ctx = track -> ctx;
+
+	if ((res = BKTKEventLogPush (ctx -> eventLog, ctx -> beatTime, track -> object.index, type, attr, value, data, size)) != 0) {
+		printError (ctx, "Error: failed to push event of track %d", track -> object.index);
+		return res;
+	}
+
+	return 0;
+}
+
+BKInt BKTKTrackSetObject (BKTKTrack * track, BKEnum attr, BKInt index, BKInt capture)
+{
+	void * object = NULL;
+	BKTKContext * ctx = track -> ctx;
+
+	if (capture) {
+		return BKTKTrackPushEvent (track, BKTKEventTypeObject, attr, index, NULL, 0);
+	}
+
+	switch (attr) {
+		case BK_INSTRUMENT: {
+			BKTKInstrument ** ref = BKArrayItemAt (&ctx -> instruments, index);
+
+			if (ref && *ref) {
+				object = &(*ref) -> instr;
+			}
+			break;
+		}
+		case BK_WAVEFORM: {
+			BKTKWaveform ** ref = BKArrayItemAt (&ctx -> waveforms, index);
+
+			if (ref && *ref) {
+				object = &(*ref) -> data;
+			}
+			break;
+		}
+		case BK_SAMPLE: {
+			BKTKSample ** ref = BKArrayItemAt (&ctx -> samples, index);
+
+			if (ref && *ref) {
+				object = &(*ref) -> data;
+			}
+			break;
+		}
+		default: {
+			return BK_INVALID_ATTRIBUTE;
+			break;
+		}
+	}
+
+	return BKSetPtr (track -> renderTrack, attr, object, sizeof (void *));
+}
+
+BKInt BKTKTrackSetTickRate (BKTKTrack * track, BKInt factor, BKInt divisor, BKInt capture)
+{
+	BKTime time;
+	BKContext * renderContext = track -> renderTrack -> unit.ctx;
+
+	if (capture) {
+		BKInt values [2] = {factor, divisor};
+
+		return BKTKTrackPushEvent (track, BKTKEventTypeTickRate, BK_CLOCK_PERIOD, 0, values, 2);
+	}
+
+	if (!divisor) {
+		return BK_INVALID_VALUE;
+	}
+
+	time = BKTimeFromSeconds (renderContext, (float) factor / (float) divisor);
+
+	return BKSetPtr (renderContext, BK_CLOCK_PERIOD, &time, sizeof (time));
+}
+
+BKInt BKTKTrackSetPulseKernel (BKTKTrack * track, BKInt kernel, BKInt capture)
+{
+	if (capture) {
+		return BKTKTrackPushEvent (track, BKTKEventTypePulseKernel, BK_PULSE_KERNEL, kernel, NULL, 0);
+	}
+
+	if (kernel < BK_PULSE_KERNEL_HARM || kernel > BK_PULSE_KERNEL_SINC) {
+		return BK_INVALID_VALUE;
+	}
+
+	return BKSetPtr (track -> renderTrack -> unit.ctx, BK_PULSE_KERNEL, (void *) BKBufferPulseKernels [kernel], sizeof (void *));
+}
+
+/**
+ * Push line record of track to timing queue
+ *
+ * Called from the audio thread
+ */
+static void pushTimingLine (BKTKTrack * track)
+{
+	BKTKTimingQueue * queue = track -> ctx -> timingQueue;
+	BKTKTimingRecord record;
+
+	if (!queue) {
+		return;
+	}
+
+	record.tick   = track -> interpreter.lineTime;
+	record.lineno = track -> interpreter.lineno;
+	record.track  = track -> object.index;
+	record.type   = BKTKTimingRecordTypeLine;
+
+	BKTKTimingQueuePush (queue, &record);
+}
+
+#if BK_TK_PROFILE
+/**
+ * Get monotonic time in nanoseconds
+ */
+static uint64_t profileNanos (void)
+{
+	struct timespec time;
+
+	clock_gettime (CLOCK_MONOTONIC, &time);
+
+	return (uint64_t) time.tv_sec * 1000000000 + time.tv_nsec;
+}
+#endif
+
+/**
+ * Advance track at `index` to its next event
+ *
+ * If `capture` is set, the interpreter pushes attributes to `ctx -> eventLog`
+ * instead; native code is not used then. Returns the number of ticks until
+ * the track is due again.
+ */
+BK_TK_FORCE_INLINE BKInt advanceTrack (BKTKContext * ctx, BKUInt index, BKInt capture)
+{
+	BKInt ticks;
+	BKTKTrack * track = ((BKTKTrack **) ctx -> tracks.items) [index];
+	BKTKInterpreter * interpreter = &track -> interpreter;
+	void ** opcodePtr = &((void **) ctx -> trackOpcodes.items) [index];
+	BKUInt * flags = &((BKUInt *) ctx -> trackFlags.items) [index];
+#if BK_TK_PROFILE
+	uint64_t startTime = profileNanos ();
+#endif
+
+	if (capture) {
+		BKTKInterpreterCapture (interpreter, track, opcodePtr, flags, &ticks);
+	}
+	else if (ctx -> nativeEntries) {
+		BKTKNativeAdvance (interpreter, track, opcodePtr, flags, &ticks);
+	}
+	else {
+		BKTKInterpreterAdvance (interpreter, track, opcodePtr, flags, &ticks);
+	}
+
+	if (track -> object.object.flags & BKTKContextOptionTimingDataMask) {
+		if ((*flags & BKTKInterpreterFlagHasRepeated) == 0) {
+			if (interpreter -> lineno != track -> lineno) {
+				pushTimingLine (track);
+				track -> lineno = interpreter -> lineno;
+			}
+		}
+	}
+
+#if BK_TK_PROFILE
+	track -> profile.calls ++;
+	track -> profile.nanos += profileNanos () - startTime;
+#endif
+
+	return BKMax (ticks, 1);
+}
+
+/**
+ * Move item at `i` down to its place in heap
+ */
+static void sequencerSiftDown (BKTKSequencerItem * items, BKUSize numItems, BKUSize i)
+{
+	BKUSize child;
+	BKTKSequencerItem item = items [i];
+
+	while ((child = 2 * i + 1) < numItems) {
+		if (child + 1 < numItems && items [child + 1] < items [child]) {
+			child ++;
+		}
+
+		if (items [child] >= item) {
+			break;
+		}
+
+		items [i] = items [child];
+		i = child;
+	}
+
+	items [i] = item;
+}
+
+/**
+ * Advance tracks which are due at current beat
+ *
+ * Only a single divider is attached to the beat clock. Its period is set to
+ * the distance to the next due track, so per-beat cost does not depend on
+ * the number of tracks. Tracks due at the same beat are advanced in index
+ * order, as they would be by one divider per track. Items contain only the
+ * due tick and track index, so track objects are only touched when they are
+ * advanced.
+ * `capture` is passed to `advanceTrack`.
+ *
+ * Returns the number of ticks until the next track is due.
+ */
+BK_TK_FORCE_INLINE BKInt sequencerAdvance (BKTKContext * ctx, BKInt capture)
+{
+	uint64_t ticks;
+	uint64_t time = ctx -> beatTime;
+	uint64_t due;
+	BKUInt index;
+	BKTKSequencerItem * items = ctx -> sequence.items;
+	BKUSize numItems = ctx -> sequence.len;
+
+	if (!numItems) {
+		ctx -> beatTime = time + BK_INT_MAX;
+		return BK_INT_MAX;
+	}
+
+	while ((due = sequencerItemDue (items [0])) <= time) {
+		index = sequencerItemTrack (items [0]);
+		items [0] = sequencerItemMake (time + advanceTrack (ctx, index, capture), index);
+		sequencerSiftDown (items, numItems, 0);
+	}
+
+	ticks = BKMin (due - time, BK_INT_MAX);
+	ctx -> beatTime = time + ticks;
+
+	return (BKInt) ticks;
+}
+
+/**
+ * Apply event of `log` to its track
+ */
+static void replayEvent (BKTKContext * ctx, BKTKEventLog const * log, BKTKEvent const * event)
+{
+	BKTKTrack ** ref = BKArrayItemAt (&ctx -> tracks, event -> track);
+	BKInt const * data = NULL;
+
+	if (!ref || !*ref) {
+		return;
+	}
+
+	if (event -> size) {
+		data = (BKInt const *) log -> data.items + event -> value;
+	}
+
+	switch (event -> type) {
+		case BKTKEventTypeAttr: {
+			BKTKTrackSetAttr (*ref, event -> attr, event -> value, 0);
+			break;
+		}
+		case BKTKEventTypeData: {
+			BKTKTrackSetData (*ref, event -> attr, data, event -> size, 0);
+			break;
+		}
+		case BKTKEventTypeObject: {
+			BKTKTrackSetObject (*ref, event -> attr, event -> value, 0);
+			break;
+		}
+		case BKTKEventTypeEffect: {
+			if (event -> size == 3) {
+				BKTKTrackSetEffect (*ref, event -> attr, data, 0);
+			}
+			break;
+		}
+		case BKTKEventTypeTickRate: {
+			if (event -> size == 2) {
+				BKTKTrackSetTickRate (*ref, data [0], data [1], 0);
+			}
+			break;
+		}
+		case BKTKEventTypePulseKernel: {
+			BKTKTrackSetPulseKernel (*ref, event -> value, 0);
+			break;
+		}
+	}
+}
+
+/**
+ * Apply events of replay log which are due at current beat
+ *
+ * Returns the number of ticks until the next event is due.
+ */
+static BKInt replayAdvance (BKTKContext * ctx)
+{
+	uint64_t ticks = BK_INT_MAX;
+	uint64_t time = ctx -> beatTime;
+	BKTKEventLog const * log = ctx -> replayLog;
+	BKTKEvent const * events = log -> events.items;
+
+	while (ctx -> replayIndex < log -> events.len && events [ctx -> replayIndex].tick <= time) {
+		replayEvent (ctx, log, &events [ctx -> replayIndex ++]);
+	}
+
+	if (ctx -> replayIndex < log -> events.len) {
+		ticks = BKMin (events [ctx -> replayIndex].tick - time, BK_INT_MAX);
+	}
+
+	ctx -> beatTime = time + ticks;
+
+	return (BKInt) ticks;
+}
+
+static BKEnum sequencerCallback (BKCallbackInfo * info, BKTKContext * ctx)
+{
+	// wait for beat of next sequencer call after resuming
+	if (ctx -> resumeTicks) {
+		info -> divider = ctx -> resumeTicks;
+		ctx -> resumeTicks = 0;
+	}
+	else if (ctx -> replayLog) {
+		info -> divider = replayAdvance (ctx);
+	}
+	else {
+		info -> divider = sequencerAdvance (ctx, 0);
+	}
+
+	return 0;
+}
+
+BKInt BKTKContextCapture (BKTKContext * ctx, BKTKEventLog * log, uint64_t endTick)
+{
+	BKUSize errorSize = ctx -> error.len;
+
+	if (ctx -> replayLog || ctx -> eventLog) {
+		return BK_INVALID_STATE;
+	}
+
+	ctx -> eventLog = log;
+
+	while (ctx -> beatTime < endTick) {
+		sequencerAdvance (ctx, 1);
+	}
+
+	ctx -> eventLog = NULL;
+
+	// errors of pushing events are appended by `BKTKTrackPushEvent`
+	if (ctx -> error.len != errorSize) {
+		return BK_INVALID_STATE;
+	}
+
+	return 0;
+}
+
+BKInt BKTKContextFastForward (BKTKContext * ctx, uint64_t tick)
+{
+	BKInt res;
+
+	if (ctx -> renderContext) {
+		return BK_INVALID_STATE;
+	}
+
+	BKTKEventLogEmpty (&ctx -> resumeLog);
+
+	if ((res = BKTKContextCapture (ctx, &ctx -> resumeLog, tick)) != 0) {
+		return res;
+	}
+
+	return BKTKEventLogCompact (&ctx -> resumeLog);
+}
+
+void BKTKContextResume (BKTKContext * ctx, uint64_t tick)
+{
+	BKTKEventLog const * log = &ctx -> resumeLog;
+	BKTKEvent const * events = log -> events.items;
+
+	for (BKUSize i = 0; i < log -> events.len; i ++) {
+		replayEvent (ctx, log, &events [i]);
+	}
+
+	while (ctx -> beatTime < tick) {
+		sequencerAdvance (ctx, 0);
+	}
+
+	ctx -> resumeTicks = (BKInt) BKMin (ctx -> beatTime - tick, BK_INT_MAX);
+}
+
+static void swapArrays (BKArray * array, BKArray * other)
+{
+	BKArray tmp = *array;
+
+	*array = *other;
+	*other = tmp;
+}
+
+/**
+ * Set instrument of render track to the one which replaced it
+ */
+static void trackReplaceInstrument (BKTKTrack * track, BKArray const * oldInstruments, BKArray const * instruments)
+{
+	BKInstrument * instr = NULL;
+	BKTKInstrument * old, * new;
+	BKUSize numInstruments = BKMin (oldInstruments -> len, instruments -> len);
+
+	BKGetPtr (track -> renderTrack, BK_INSTRUMENT, &instr, sizeof (instr));
+
+	if (!instr) {
+		return;
+	}
+
+	for (BKUSize i = 0; i < numInstruments; i ++) {
+		old = *(BKTKInstrument **) BKArrayItemAt (oldInstruments, i);
+		new = *(BKTKInstrument **) BKArrayItemAt (instruments, i);
+
+		if (old && instr == &old -> instr) {
+			if (new != old) {
+				BKSetPtr (track -> renderTrack, BK_INSTRUMENT, new ? &new -> instr : NULL, sizeof (void *));
+			}
+			break;
+		}
+	}
+}
+
+/**
+ * Check if track at `index` of `ctx` is kept by `preview`
+ */
+static BKInt isKeptTrack (BKTKContext const * ctx, BKTKContext const * preview, BKUSize index)
+{
+	BKTKTrack * const * track = BKArrayItemAt (&ctx -> tracks, index);
+
+	return track && *track && *track == *(BKTKTrack * const *) BKArrayItemAt (&preview -> tracks, index);
+}
+
+void BKTKContextAppend (BKTKContext * ctx, BKTKContext * preview, uint64_t tick)
+{
+	BKTKTrack * track, * old;
+	BKUInt index;
+	uint64_t due;
+	BKInt replaced = 0;
+	BKInt instrumentsReplaced = 0;
+	BKTKSequencerItem * items = preview -> sequence.items;
+	BKTKSequencerItem const * playingItems = ctx -> sequence.items;
+	BKUSize numItems = ctx -> sequence.len;
+	BKUSize numKept = 0;
+	BKUSize numTracks = preview -> sequence.len;
+	BKTKEventLog const * log = &preview -> resumeLog;
+	BKTKEvent const * events = log -> events.items;
+	char const * arpeggios = ctx -> arpeggios.items;
+
+	// room is left by `BKTKContextCreatePreview`
+	memmove (&items [numItems], items, numTracks * sizeof (*items));
+
+	// replaced tracks are not sequenced anymore
+	for (BKUSize i = 0; i < numItems; i ++) {
+		if (isKeptTrack (ctx, preview, sequencerItemTrack (playingItems [i]))) {
+			items [numKept ++] = playingItems [i];
+		}
+	}
+
+	memmove (&items [numKept], &items [numItems], numTracks * sizeof (*items));
+	preview -> sequence.len = numKept + numTracks;
+
+	// stepping state of playing tracks
+	for (BKUSize i = 0; i < ctx -> tracks.len; i ++) {
+		if (isKeptTrack (ctx, preview, i)) {
+			((void **) preview -> trackOpcodes.items) [i] = ((void **) ctx -> trackOpcodes.items) [i];
+			((BKUInt *) preview -> trackFlags.items) [i] = ((BKUInt *) ctx -> trackFlags.items) [i];
+		}
+	}
+
+	for (BKUSize i = 0; i < BKMin (ctx -> instruments.len, preview -> instruments.len); i ++) {
+		if (*(BKTKInstrument **) BKArrayItemAt (&ctx -> instruments, i) != *(BKTKInstrument **) BKArrayItemAt (&preview -> instruments, i)) {
+			instrumentsReplaced = 1;
+			break;
+		}
+	}
+
+	swapArrays (&ctx -> instruments, &preview -> instruments);
+	swapArrays (&ctx -> waveforms, &preview -> waveforms);
+	swapArrays (&ctx -> samples, &preview -> samples);
+	swapArrays (&ctx -> tracks, &preview -> tracks);
+	swapArrays (&ctx -> arpeggios, &preview -> arpeggios);
+	swapArrays (&ctx -> sequence, &preview -> sequence);
+	swapArrays (&ctx -> trackOpcodes, &preview -> trackOpcodes);
+	swapArrays (&ctx -> trackFlags, &preview -> trackFlags);
+
+	// replaced tracks stop playing; their memory is kept with the arena
+	for (BKUSize i = 0; i < preview -> tracks.len; i ++) {
+		old = *(BKTKTrack **) BKArrayItemAt (&preview -> tracks, i);
+
+		if (old && old != *(BKTKTrack **) BKArrayItemAt (&ctx -> tracks, i)) {
+			BKTrackDetach (old -> renderTrack);
+			replaced = 1;
+		}
+	}
+
+	for (BKUSize i = 0; i < ctx -> tracks.len; i ++) {
+		track = *(BKTKTrack **) BKArrayItemAt (&ctx -> tracks, i);
+
+		if (!track) {
+			continue;
+		}
+
+		if (track -> ctx == preview) {
+			track -> ctx = ctx;
+			BKTrackAttach (track -> renderTrack, ctx -> renderContext);
+			continue;
+		}
+
+		// pool was copied
+		if (track -> interpreter.nextArpeggio) {
+			track -> interpreter.nextArpeggio = (BKInt const *) ((char const *) ctx -> arpeggios.items +
+				((char const *) track -> interpreter.nextArpeggio - arpeggios));
+		}
+
+		// may call replaced groups which have not been verified
+		if (replaced) {
+			track -> object.object.flags &= ~BKTKFlagVerified;
+		}
+
+		if (instrumentsReplaced) {
+			trackReplaceInstrument (track, &preview -> instruments, &ctx -> instruments);
+		}
+	}
+
+	for (BKUSize i = 0; i < log -> events.len; i ++) {
+		replayEvent (ctx, log, &events [i]);
+	}
+
+	items = ctx -> sequence.items;
+
+	for (BKUSize i = numKept; i < numKept + numTracks; i ++) {
+		index = sequencerItemTrack (items [i]);
+		due = sequencerItemDue (items [i]);
+
+		while (due < tick) {
+			due += advanceTrack (ctx, index, 0);
+		}
+
+		items [i] = sequencerItemMake (due, index);
+	}
+
+	for (BKUSize i = ctx -> sequence.len / 2; i -- > 0;) {
+		sequencerSiftDown (items, ctx -> sequence.len, i);
+	}
+
+	if (ctx -> sequence.len) {
+		ctx -> beatTime = BKMax (BKMin (ctx -> beatTime, sequencerItemDue (items [0])), tick);
+	}
+
+	// call sequencer at `tick` to wait for the next due track
+	ctx -> resumeTicks = (BKInt) BKMin (ctx -> beatTime - tick, BK_INT_MAX);
+	BKDividerReset (&ctx -> divider);
+
+	BKTKArenaMove (&ctx -> arena, &preview -> arena);
+
+	BKArrayEmpty (&preview -> instruments);
+	BKArrayEmpty (&preview -> waveforms);
+	BKArrayEmpty (&preview -> samples);
+	BKArrayEmpty (&preview -> tracks);
+	BKArrayEmpty (&preview -> arpeggios);
+	BKArrayEmpty (&preview -> sequence);
+	BKArrayEmpty (&preview -> trackOpcodes);
+	BKArrayEmpty (&preview -> trackFlags);
+}
+
+void BKTKContextReleaseObjects (BKTKContext * ctx)
+{
+	BKTKTrack * track;
+
+	for (BKUSize i = 0; i < ctx -> tracks.len; i ++) {
+		track = *(BKTKTrack **) BKArrayItemAt (&ctx -> tracks, i);
+
+		if (track) {
+			BKSetPtr (track -> renderTrack, BK_INSTRUMENT, NULL, 0);
+			BKSetPtr (track -> renderTrack, BK_SAMPLE, NULL, 0);
+			BKSetAttr (track -> renderTrack, BK_WAVEFORM, BK_SQUARE);
+		}
+	}
+
+	BKArrayEmpty (&ctx -> instruments);
+	BKArrayEmpty (&ctx -> waveforms);
+	BKArrayEmpty (&ctx -> samples);
+}
+
+void BKTKContextSetReplayLog (BKTKContext * ctx, BKTKEventLog const * log)
+{
+	ctx -> replayLog = log;
+	BKTKContextReset (ctx);
+}
+
+BKInt BKTKContextAttach (BKTKContext * ctx, BKContext * renderContext)
+{
+	BKInt res;
+	BKTKTrack * track;
+	BKCallback callback;
+
+	if (ctx -> renderContext) {
+		return BK_INVALID_STATE;
+	}
+
+	ctx -> renderContext = renderContext;
+
+	for (BKUSize i = 0; i < ctx -> tracks.len; i ++) {
+		track = *(BKTKTrack **) BKArrayItemAt (&ctx -> tracks, i);
+
+		if (track) {
+			if ((res = BKTrackAttach (track -> renderTrack, ctx -> renderContext)) != 0) {
+				return res;
+			}
+		}
+	}
+
+	callback.func = (BKCallbackFunc) sequencerCallback;
+	callback.userInfo = ctx;
+
+	if ((res = BKDividerInit (&ctx -> divider, 0, &callback)) != 0) {
+		return res;
+	}
+
+	if ((res = BKContextAttachDivider (ctx -> renderContext, &ctx -> divider, BK_CLOCK_TYPE_BEAT)) != 0) {
+		return res;
+	}
+
+	return 0;
+}
+
+void BKTKContextDetach (BKTKContext * ctx)
+{
+	BKTKTrack * track;
+
+	if (!ctx -> renderContext) {
+		return;
+	}
+
+	BKDividerDetach (&ctx -> divider);
+
+	for (BKUSize i = 0; i < ctx -> tracks.len; i ++) {
+		track = *(BKTKTrack **) BKArrayItemAt (&ctx -> tracks, i);
+
+		if (track) {
+			BKTrackDetach (track -> renderTrack);
+		}
+	}
+
+	ctx -> renderContext = NULL;
+}
+
+static void BKTKTrackReset (BKTKTrack * track)
+{
+	BKTKInterpreterReset (&track -> interpreter);
+	BKTrackReset (track -> renderTrack);
+	track -> lineno = 0;
+
+#if BK_TK_PROFILE
+	BKTKGroup * group;
+
+	track -> profile = (BKTKProfileCounter) {0};
+
+	for (BKUSize i = 0; i < track -> code -> groups.len; i ++) {
+		group = ((BKTKGroup **) track -> code -> groups.items) [i];
+
+		if (group) {
+			group -> profile = (BKTKProfileCounter) {0};
+		}
+	}
+#endif
+}
+
+void BKTKContextReset (BKTKContext * ctx)
+{
+	BKTKTrack * track;
+
+	for (BKUSize i = 0; i < ctx -> tracks.len; i ++) {
+		track = *(BKTKTrack **) BKArrayItemAt (&ctx -> tracks, i);
+
+		if (track) {
+			BKTKTrackReset (track);
+		}
+	}
+
+	BKDividerReset (&ctx -> divider);
+	sequencerFill (ctx);
+	ctx -> replayIndex = 0;
+	ctx -> resumeTicks = 0;
+
+#if BK_TK_PROFILE
+	memset (ctx -> dispatches, 0, sizeof (ctx -> dispatches));
+#endif
+
+	BKStringEmpty (&ctx -> error);
+}
+
+static void BKTKContextDispose (BKTKContext * ctx)
+{
+	BKTKContextDetach (ctx);
 
 	BKArrayDispose (&ctx -> instruments);
 	BKArrayDispose (&ctx -> waveforms);
 	BKArrayDispose (&ctx -> samples);
 	BKArrayDispose (&ctx -> tracks);
+	BKArrayDispose (&ctx -> arpeggios);
+	BKArrayDispose (&ctx -> sequence);
+	BKArrayDispose (&ctx -> trackOpcodes);
+	BKArrayDispose (&ctx -> trackFlags);
+	BKDispose (&ctx -> resumeLog);
+
+	// disposes all objects
+	BKTKArenaDispose (&ctx -> arena);
 }
 
 BKClass const BKTKContextClass =
@@ -624,7 +1657,6 @@ BKClass const BKTKContextClass =
 BKClass const BKTKGroupClass =
 {
 	.instanceSize = sizeof (BKTKGroup),
-	.dispose      = (void *) BKTKGroupDispose,
 };
 
 BKClass const BKTKTrackClass =
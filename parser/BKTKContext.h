@@ -24,15 +24,22 @@
 #ifndef _BK_TK_CONTEXT_H_
 #define _BK_TK_CONTEXT_H_
 
+#include "BKTKArena.h"
 #include "BKTKBase.h"
 #include "BKTKInterpreter.h"
 #include "BKTKCompiler.h"
+#include "BKTKEventLog.h"
+#include "BKTKTiming.h"
+
+#define BK_TK_SEQUENCER_INDEX_BITS 24
+#define BK_TK_SEQUENCER_MAX_TRACKS (1 << BK_TK_SEQUENCER_INDEX_BITS)
 
 typedef struct BKTKGroup BKTKGroup;
 typedef struct BKTKInstrument BKTKInstrument;
 typedef struct BKTKWaveform BKTKWaveform;
 typedef struct BKTKSample BKTKSample;
 typedef struct BKTKTrack BKTKTrack;
+typedef struct BKTKTrackCode BKTKTrackCode;
 typedef struct BKTKContext BKTKContext;
 typedef struct BKTKObject BKTKObject;
 
@@ -45,50 +52,80 @@ struct BKTKObject
 
 struct BKTKGroup
 {
-	BKTKObject   object;
-	BKByteBuffer byteCode;
-	BKSize       codeSize;
+	BKTKObject         object;
+	BKTKArenaArray     byteCode; // uint32_t
+	BKSize             codeSize;
+#if BK_TK_PROFILE
+	BKTKProfileCounter profile;
+#endif
 };
 
 struct BKTKInstrument
 {
 	BKTKObject   object;
 	BKInstrument instr;
-	BKString     name;
+	char const * name;
 };
 
 struct BKTKWaveform
 {
-	BKTKObject object;
-	BKData     data;
-	BKString   name;
+	BKTKObject   object;
+	BKData       data;
+	char const * name;
 };
 
 struct BKTKSample
 {
-	BKTKObject object;
-	BKString   path;
-	BKString   name;
-	BKInt      pitch;
-	BKInt      repeat;
-	BKInt      sustainRange [2];
-	BKData     data;
+	BKTKObject   object;
+	char const * path;
+	char const * name;
+	BKInt        pitch;
+	BKInt        repeat;
+	BKInt        sustainRange [2];
+	BKData       data;
+};
+
+/**
+ * Byte code of a track and its groups
+ *
+ * Only read when creating the context and when calling groups.
+ */
+struct BKTKTrackCode
+{
+	BKTKArenaArray groups;   // BKTKGroup *
+	BKTKArenaArray byteCode; // uint32_t
 };
 
+/**
+ * Only state accessed on every advance is kept in the track. The render
+ * track, the call stack of the interpreter and the byte code are allocated
+ * separately in the arena of the track. The instruction pointer and the
+ * stopped and repeated flags are kept by the context in arrays indexed by
+ * track.
+ */
 struct BKTKTrack
 {
 	BKTKObject      object;
-	BKArray         groups; // BKTKGroup
-	BKByteBuffer    byteCode;
-	BKDivider       divider;
 	BKTKContext   * ctx;
-	BKTrack         renderTrack;
+	BKInt           lineno;
 	BKInt           waveform;
 	BKTKInterpreter interpreter;
-	BKByteBuffer    timingData;
-	BKInt           lineno;
+	BKTrack       * renderTrack;
+	BKTKTrackCode * code;
+#if BK_TK_PROFILE
+	BKTKProfileCounter profile;
+#endif
 };
 
+/**
+ * Track waiting for its next event
+ *
+ * Contains the due beat tick above the lower `BK_TK_SEQUENCER_INDEX_BITS`
+ * bits, which contain the track index. Items are thus ordered by due tick and
+ * track index with a single comparison.
+ */
+typedef uint64_t BKTKSequencerItem;
+
 struct BKTKContext
 {
 	BKObject     object;
@@ -97,9 +134,26 @@ struct BKTKContext
 	BKArray      waveforms;    // BKTKWaveform
 	BKArray      samples;      // BKTKSample; may contain shared BKData!
 	BKArray      tracks;       // BKTKTrack
+	BKArray      arpeggios;    // BKTKArpeggio; constant pool of byte code
+	BKArray      sequence;     // BKTKSequencerItem; min-heap by due tick and track index
+	BKArray      trackOpcodes; // void *; instruction pointer of interpreter or native function; by track index
+	BKArray      trackFlags;   // BKUInt; BKTKInterpreterFlagHasStopped/Repeated; by track index
+	uint64_t     beatTime;     // beat tick of next sequencer call
+	BKDivider    divider;      // calls sequencer on beat clock
 	BKString     loadPath;
 	BKString     error;
 	BKTKFileInfo info;
+	BKTKTimingQueue * timingQueue; // receives timing records if set
+	BKTKEventLog * eventLog;   // receives track attributes while capturing
+	BKTKEventLog const * replayLog; // played instead of running interpreters if set
+	BKUSize      replayIndex;  // next event of `replayLog`
+	BKTKEventLog resumeLog;    // last attributes of tracks captured by `BKTKContextFastForward`
+	BKInt        resumeTicks;  // ticks until next sequencer call after resuming
+	BKTKArena    arena;        // owns tracks, groups and objects
+	void      ** nativeEntries; // native function of tracks by index; replace interpreter if set; see BKTKNative.h
+#if BK_TK_PROFILE
+	uint64_t     dispatches [BK_INTR_COUNT]; // by instruction
+#endif
 };
 
 enum BKTKContextOption
@@ -110,6 +164,12 @@ enum BKTKContextOption
 	BKTKContextOptionTimingDataMask  = 3 << 16,
 };
 
+/**
+ * Timing records are pushed to `ctx -> timingQueue` when any of the
+ * `BKTKContextOptionTimingData` options is set. The unit is only a hint for
+ * the consumer; records always contain ticks.
+ */
+
 /**
  * Initialize context
  */
@@ -120,6 +180,30 @@ extern BKInt BKTKContextInit (BKTKContext * ctx, BKUInt flags);
  */
 extern BKInt BKTKContextCreate (BKTKContext * ctx, BKTKCompiler * compiler);
 
+/**
+ * Create context from tracks compiled so far while compiling continues
+ *
+ * Tracks are copied with `BKTKCompilerCopyTracks`; the compiler keeps the
+ * objects, which are flagged with `BKTKFlagShared`. If `playing` is given,
+ * its tracks are kept and only new tracks are sequenced, to be appended with
+ * `BKTKContextAppend` after fast-forwarding. Playing tracks are not modified.
+ */
+extern BKInt BKTKContextCreatePreview (BKTKContext * ctx, BKTKContext const * playing, BKTKCompiler * compiler);
+
+/**
+ * Create context replacing definitions of `playing` which have been compiled
+ *
+ * `compiler` has compiled the changed tracks, groups and instruments with
+ * `BKTKCompilerPutNode` and declared the others with
+ * `BKTKCompilerDeclareNode` without ending. Returns `BK_INVALID_STATE` if
+ * objects or tracks have been added or removed, or groups called by playing
+ * tracks are missing; the song has then to be compiled again. Tracks
+ * containing changed code are sequenced from the beginning, to be appended
+ * with `BKTKContextAppend` after fast-forwarding. Takes over the arena of
+ * `compiler` and resets it. Playing tracks are not modified.
+ */
+extern BKInt BKTKContextCreateUpdate (BKTKContext * ctx, BKTKContext const * playing, BKTKCompiler * compiler);
+
 /**
  * Attach to render context
  */
@@ -136,12 +220,131 @@ extern void BKTKContextDetach (BKTKContext * ctx);
 extern void BKTKContextReset (BKTKContext * ctx);
 
 /**
- * Allocate context objects
+ * Run interpreters until beat tick `endTick` without rendering
+ *
+ * Attributes set by the interpreters are pushed to `log` instead of being
+ * applied to the render tracks. Can be called repeatedly to continue. The
+ * context must not be rendered at the same time.
+ */
+extern BKInt BKTKContextCapture (BKTKContext * ctx, BKTKEventLog * log, uint64_t endTick);
+
+/**
+ * Run interpreters of unattached context until beat tick `tick`
+ *
+ * Only the last value of each track attribute is kept to be applied by
+ * `BKTKContextResume`. Used to continue a reloaded song without rendering it
+ * from the beginning.
+ */
+extern BKInt BKTKContextFastForward (BKTKContext * ctx, uint64_t tick);
+
+/**
+ * Apply attributes captured by `BKTKContextFastForward` after attaching
+ *
+ * `tick` is the beat tick the render context is at and must not be before
+ * the tick passed to `BKTKContextFastForward`; interpreters are advanced to
+ * it. Does not allocate and can be called from the audio thread.
  */
-extern BKInt BKTKTrackAlloc (BKTKTrack ** track);
-extern BKInt BKTKGroupAlloc (BKTKGroup ** group);
-extern BKInt BKTKInstrumentAlloc (BKTKInstrument ** instrument);
-extern BKInt BKTKWaveformAlloc (BKTKWaveform ** waveform);
-extern BKInt BKTKSampleAlloc (BKTKSample ** sample);
+extern void BKTKContextResume (BKTKContext * ctx, uint64_t tick);
+
+/**
+ * Append new and replaced tracks of `preview` to attached context
+ *
+ * `preview` has to be created with `BKTKContextCreatePreview` or
+ * `BKTKContextCreateUpdate` from `ctx` and be fast-forwarded. `tick` is the
+ * beat tick the render context is at; new tracks are advanced to it. Replaced
+ * tracks are detached and playing tracks using replaced instruments get the
+ * new ones. Replaced objects are kept until `ctx` is disposed. The arrays of
+ * both contexts are exchanged, so `preview` is left with no items and only
+ * has to be disposed. Does not allocate and can be called from the audio
+ * thread.
+ */
+extern void BKTKContextAppend (BKTKContext * ctx, BKTKContext * preview, uint64_t tick);
+
+/**
+ * Remove instruments, waveforms and samples from tracks without disposing them
+ *
+ * Used if the objects are still used by another context. Does not allocate
+ * and can be called from the audio thread.
+ */
+extern void BKTKContextReleaseObjects (BKTKContext * ctx);
+
+/**
+ * Play events of `log` instead of running interpreters
+ *
+ * `log` has to be captured from a context created from the same song and
+ * is not copied. Set to NULL to run the interpreters again. Resets the
+ * context.
+ */
+extern void BKTKContextSetReplayLog (BKTKContext * ctx, BKTKEventLog const * log);
+
+/**
+ * Set attributes of render track or push them to `ctx -> eventLog` if
+ * `capture` is set
+ *
+ * Used by the interpreter and native code. `capture` is a constant at each
+ * call, so playback does not check for capturing. `BKTKTrackSetData` passes
+ * `count` values or NULL if `count` is 0. `BKTKTrackSetObject` sets
+ * instrument, waveform or sample at `index` of the context.
+ */
+BK_INLINE BKInt BKTKTrackSetAttr (BKTKTrack * track, BKEnum attr, BKInt value, BKInt capture);
+BK_INLINE BKInt BKTKTrackSetData (BKTKTrack * track, BKEnum attr, BKInt const values [], BKUInt count, BKInt capture);
+BK_INLINE BKInt BKTKTrackSetEffect (BKTKTrack * track, BKEnum effect, BKInt const values [3], BKInt capture);
+extern BKInt BKTKTrackSetObject (BKTKTrack * track, BKEnum attr, BKInt index, BKInt capture);
+
+/**
+ * Set attributes of render context of track or push them to `ctx -> eventLog`
+ * if `capture` is set
+ */
+extern BKInt BKTKTrackSetTickRate (BKTKTrack * track, BKInt factor, BKInt divisor, BKInt capture);
+extern BKInt BKTKTrackSetPulseKernel (BKTKTrack * track, BKInt kernel, BKInt capture);
+
+/**
+ * Push event of track to `ctx -> eventLog`
+ */
+extern BKInt BKTKTrackPushEvent (BKTKTrack * track, BKEnum type, BKEnum attr, BKInt value, BKInt const data [], BKUInt size);
+
+/**
+ * Allocate context objects in `arena`
+ *
+ * Byte code, group arrays and names are allocated in the same arena. Objects
+ * containing BlipKit objects are disposed when the arena is disposed. The
+ * render track and call stack of a track are allocated with it but only
+ * initialized when the track is added to a context.
+ */
+extern BKInt BKTKTrackAlloc (BKTKTrack ** track, BKTKArena * arena);
+extern BKInt BKTKGroupAlloc (BKTKGroup ** group, BKTKArena * arena);
+extern BKInt BKTKInstrumentAlloc (BKTKInstrument ** instrument, BKTKArena * arena);
+extern BKInt BKTKWaveformAlloc (BKTKWaveform ** waveform, BKTKArena * arena);
+extern BKInt BKTKSampleAlloc (BKTKSample ** sample, BKTKArena * arena);
+
+
+// --- Inline implementations
+
+BK_INLINE BKInt BKTKTrackSetAttr (BKTKTrack * track, BKEnum attr, BKInt value, BKInt capture)
+{
+	if (capture) {
+		return BKTKTrackPushEvent (track, BKTKEventTypeAttr, attr, value, NULL, 0);
+	}
+
+	return BKSetAttr (track -> renderTrack, attr, value);
+}
+
+BK_INLINE BKInt BKTKTrackSetData (BKTKTrack * track, BKEnum attr, BKInt const values [], BKUInt count, BKInt capture)
+{
+	if (capture) {
+		return BKTKTrackPushEvent (track, BKTKEventTypeData, attr, 0, values, count);
+	}
+
+	return BKSetPtr (track -> renderTrack, attr, count ? values : NULL, count * sizeof (BKInt));
+}
+
+BK_INLINE BKInt BKTKTrackSetEffect (BKTKTrack * track, BKEnum effect, BKInt const values [3], BKInt capture)
+{
+	if (capture) {
+		return BKTKTrackPushEvent (track, BKTKEventTypeEffect, effect, 0, values, 3);
+	}
+
+	return BKTrackSetEffect (track -> renderTrack, effect, values, sizeof (BKInt [3]));
+}
 
 #endif /* ! _BK_TK_CONTEXT_H_ */
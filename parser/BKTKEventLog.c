@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2012-2016 Simon Schoenenberger
+ * http://blipkit.audio
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "BKTKEventLog.h"
+
+extern BKClass const BKTKEventLogClass;
+
+BKInt BKTKEventLogInit (BKTKEventLog * log)
+{
+	BKInt res;
+
+	if ((res = BKObjectInit (log, &BKTKEventLogClass, sizeof (*log))) != 0) {
+		return res;
+	}
+
+	log -> events = BK_ARRAY_INIT (sizeof (BKTKEvent));
+	log -> data = BK_ARRAY_INIT (sizeof (BKInt));
+
+	return 0;
+}
+
+static void BKTKEventLogDispose (BKTKEventLog * log)
+{
+	BKArrayDispose (&log -> events);
+	BKArrayDispose (&log -> data);
+}
+
+BKInt BKTKEventLogPush (BKTKEventLog * log, uint64_t tick, BKUInt track, BKEnum type, BKEnum attr, BKInt value, BKInt const data [], BKUInt size)
+{
+	BKTKEvent * event;
+
+	// track has to fit into key of `BKTKEventLogCompact`
+	if (track > UINT16_MAX || size > UINT16_MAX) {
+		return BK_INVALID_VALUE;
+	}
+
+	if (size) {
+		value = (BKInt) log -> data.len;
+
+		for (BKUInt i = 0; i < size; i ++) {
+			if (BKArrayPush (&log -> data, &data [i]) != 0) {
+				return BK_ALLOCATION_ERROR;
+			}
+		}
+	}
+
+	event = BKArrayPushPtr (&log -> events);
+
+	if (!event) {
+		return BK_ALLOCATION_ERROR;
+	}
+
+	*event = (BKTKEvent) {
+		.tick  = tick,
+		.track = track,
+		.type  = type,
+		.size  = size,
+		.attr  = attr,
+		.value = value,
+	};
+
+	return 0;
+}
+
+void BKTKEventLogEmpty (BKTKEventLog * log)
+{
+	BKArrayEmpty (&log -> events);
+	BKArrayEmpty (&log -> data);
+}
+
+BKInt BKTKEventLogCompact (BKTKEventLog * log)
+{
+	uint64_t key;
+	uint64_t * slots;
+	BKUSize slot, mask;
+	BKUSize numEvents = log -> events.len;
+	BKUSize numKept = 0;
+	BKTKEvent * events = log -> events.items;
+
+	if (!numEvents) {
+		return 0;
+	}
+
+	mask = BKNextPow2 (numEvents * 2) - 1;
+	slots = calloc (mask + 1, sizeof (*slots));
+
+	if (!slots) {
+		return BK_ALLOCATION_ERROR;
+	}
+
+	// walk backwards and move the last event of each key to the end
+	for (BKUSize i = numEvents; i -- > 0;) {
+		key = ((uint64_t) events [i].track << 40 | (uint64_t) events [i].type << 32 | events [i].attr) + 1;
+
+		for (slot = (key * 0x9E3779B97F4A7C15) >> 32 & mask; slots [slot] && slots [slot] != key; slot = (slot + 1) & mask) {
+		}
+
+		if (slots [slot]) {
+			continue;
+		}
+
+		slots [slot] = key;
+		events [numEvents - ++ numKept] = events [i];
+	}
+
+	free (slots);
+
+	// `BKArrayResize` does not shrink
+	memmove (events, &events [numEvents - numKept], numKept * sizeof (*events));
+	log -> events.len = numKept;
+
+	return 0;
+}
+
+BKInt BKTKEventLogWrite (BKTKEventLog const * log, FILE * file)
+{
+	BKTKEventLogHeader header;
+
+	memcpy (header.magic, BK_EVENT_LOG_MAGIC, sizeof (header.magic));
+	header.version = BK_EVENT_LOG_VERSION;
+	header.numEvents = (uint32_t) log -> events.len;
+	header.numData = (uint32_t) log -> data.len;
+
+	if (fwrite (&header, sizeof (header), 1, file) != 1) {
+		return BK_FILE_ERROR;
+	}
+
+	if (fwrite (log -> events.items, sizeof (BKTKEvent), header.numEvents, file) != header.numEvents) {
+		return BK_FILE_ERROR;
+	}
+
+	if (fwrite (log -> data.items, sizeof (BKInt), header.numData, file) != header.numData) {
+		return BK_FILE_ERROR;
+	}
+
+	return 0;
+}
+
+BKInt BKTKEventLogRead (BKTKEventLog * log, FILE * file)
+{
+	BKTKEventLogHeader header;
+	BKTKEvent const * event;
+
+	BKTKEventLogEmpty (log);
+
+	if (fread (&header, sizeof (header), 1, file) != 1) {
+		return BK_FILE_ERROR;
+	}
+
+	if (memcmp (header.magic, BK_EVENT_LOG_MAGIC, sizeof (header.magic)) != 0 || header.version != BK_EVENT_LOG_VERSION) {
+		return BK_INVALID_VALUE;
+	}
+
+	if (BKArrayResize (&log -> events, header.numEvents) != 0 || BKArrayResize (&log -> data, header.numData) != 0) {
+		return BK_ALLOCATION_ERROR;
+	}
+
+	if (fread (log -> events.items, sizeof (BKTKEvent), header.numEvents, file) != header.numEvents ||
+		fread (log -> data.items, sizeof (BKInt), header.numData, file) != header.numData) {
+		BKTKEventLogEmpty (log);
+		return BK_FILE_ERROR;
+	}
+
+	// data of events has to be in file
+	for (BKUSize i = 0; i < log -> events.len; i ++) {
+		event = BKArrayItemAt (&log -> events, i);
+
+		if (event -> size && (event -> value < 0 || (BKUSize) event -> value + event -> size > log -> data.len)) {
+			BKTKEventLogEmpty (log);
+			return BK_INVALID_VALUE;
+		}
+	}
+
+	return 0;
+}
+
+BKClass const BKTKEventLogClass =
+{
+	.instanceSize = sizeof (BKTKEventLog),
+	.dispose      = (void *) BKTKEventLogDispose,
+};
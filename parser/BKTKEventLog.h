@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2012-2016 Simon Schoenenberger
+ * http://blipkit.audio
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _BK_TK_EVENT_LOG_H_
+#define _BK_TK_EVENT_LOG_H_
+
+#include "BKTKBase.h"
+
+#define BK_EVENT_LOG_MAGIC "BKEL"
+#define BK_EVENT_LOG_VERSION 4
+
+typedef struct BKTKEvent BKTKEvent;
+typedef struct BKTKEventLog BKTKEventLog;
+typedef struct BKTKEventLogHeader BKTKEventLogHeader;
+
+/**
+ * Defines how an event is applied
+ */
+enum BKTKEventType
+{
+	BKTKEventTypeAttr        = 0, // `BKSetAttr` of track with `value`
+	BKTKEventTypeData        = 1, // `BKSetPtr` of track with `size` values at `value` in data; NULL if `size` is 0
+	BKTKEventTypeObject      = 2, // `BKSetPtr` of track with index `value` of instrument, waveform or sample
+	BKTKEventTypeEffect      = 3, // `BKTrackSetEffect` with 3 values at `value` in data
+	BKTKEventTypeTickRate    = 4, // clock period of render context; factor and divisor at `value` in data
+	BKTKEventTypePulseKernel = 5, // pulse kernel of render context; `value` is index
+};
+
+/**
+ * Attribute set by an interpreter at beat tick `tick`
+ *
+ * Events are written in native byte order
+ */
+struct BKTKEvent
+{
+	uint64_t tick;
+	uint32_t track;
+	uint16_t type;
+	uint16_t size;
+	uint32_t attr;
+	int32_t  value;
+};
+
+/**
+ * Event log file
+ *
+ * BKTKEventLogHeader
+ * BKTKEvent [numEvents] sorted by tick
+ * int32_t [numData]
+ */
+struct BKTKEventLogHeader
+{
+	char     magic [4];
+	uint32_t version;
+	uint32_t numEvents;
+	uint32_t numData;
+};
+
+/**
+ * Events captured from a context
+ *
+ * Instruments, waveforms and samples are referenced by index; a log can
+ * only be played back with a context created from the same song.
+ */
+struct BKTKEventLog
+{
+	BKObject object;
+	BKArray  events; // BKTKEvent
+	BKArray  data;   // BKInt
+};
+
+/**
+ * Initialize log
+ */
+extern BKInt BKTKEventLogInit (BKTKEventLog * log);
+
+/**
+ * Append event
+ *
+ * `size` values of `data` are stored with the event for data, effect and
+ * tick rate events; `value` is ignored for those.
+ */
+extern BKInt BKTKEventLogPush (BKTKEventLog * log, uint64_t tick, BKUInt track, BKEnum type, BKEnum attr, BKInt value, BKInt const data [], BKUInt size);
+
+/**
+ * Remove all events
+ */
+extern void BKTKEventLogEmpty (BKTKEventLog * log);
+
+/**
+ * Keep only the last event of each track attribute
+ *
+ * Applying the remaining events in order sets the attributes the tracks have
+ * after all events. Data of removed events is kept.
+ */
+extern BKInt BKTKEventLogCompact (BKTKEventLog * log);
+
+/**
+ * Write log to file
+ */
+extern BKInt BKTKEventLogWrite (BKTKEventLog const * log, FILE * file);
+
+/**
+ * Replace events with those read from file
+ */
+extern BKInt BKTKEventLogRead (BKTKEventLog * log, FILE * file);
+
+#endif /* ! _BK_TK_EVENT_LOG_H_ */
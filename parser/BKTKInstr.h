@@ -0,0 +1,329 @@
+/*
+ * Copyright (c) 2012-2016 Simon Schoenenberger
+ * http://blipkit.audio
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _BK_TK_INSTR_H_
+#define _BK_TK_INSTR_H_
+
+#include "BKTKContext.h"
+#include "BKTKInterpreter.h"
+
+/**
+ * Instructions executed by the interpreter and by native code
+ *
+ * Both execute the same functions, so their output is identical. Functions
+ * returning an address return `next` if execution continues with the next
+ * instruction. If `verified` is set, checks are skipped for byte code which
+ * passed the compiler's verifier. `capture` is passed to the track setters
+ * and is only set by `BKTKInterpreterCapture`. `flags` are the stopped and
+ * repeated flags of the track passed to the advance functions.
+ */
+BK_INLINE void BKTKInstrAttack (BKTKInterpreter * interpreter, BKTKTrack * ctx, BKInt note, BKInt capture);
+BK_INLINE void BKTKInstrArpeggio (BKTKInterpreter * interpreter, BKTKTrack * ctx, BKInt const arpeggio [1 + BK_MAX_ARPEGGIO], BKInt capture);
+BK_INLINE void BKTKInstrRelease (BKTKInterpreter * interpreter, BKTKTrack * ctx, BKInt note, BKInt capture);
+BK_INLINE void BKTKInstrTicksEvent (BKTKInterpreter * interpreter, BKUInt cmd, BKInt ticks, BKInt divisor);
+BK_INLINE void BKTKInstrStep (BKTKInterpreter * interpreter, BKInt steps);
+BK_INLINE void BKTKInstrStepTicks (BKTKTrack * ctx, BKInt stepTicks);
+BK_INLINE void BKTKInstrTickRate (BKTKInterpreter * interpreter, BKTKTrack * ctx, BKInt factor, BKInt divisor, BKInt capture);
+BK_INLINE void BKTKInstrEffect (BKTKInterpreter * interpreter, BKTKTrack * ctx, BKEnum effect, BKInt const args [5], BKInt capture);
+BK_INLINE void BKTKInstrWaveform (BKTKTrack * ctx, BKInt waveform, BKInt capture);
+BK_INLINE void BKTKInstrSample (BKTKTrack * ctx, BKInt sample, BKInt capture);
+BK_INLINE void const * BKTKInstrCall (BKTKInterpreter * interpreter, BKTKTrack * ctx, void const * next, BKUInt type, BKInt groupIdx, BKInt trackIdx, BKInt verified);
+BK_INLINE void const * BKTKInstrReturn (BKTKInterpreter * interpreter, void const * next, BKInt verified);
+BK_INLINE void const * BKTKInstrRepeat (BKTKInterpreter * interpreter, BKUInt * flags, void const * next, BKInt verified);
+BK_INLINE void BKTKInstrEnd (BKTKInterpreter * interpreter, BKUInt * flags);
+BK_INLINE void BKTKInstrLineNo (BKTKInterpreter * interpreter, BKInt lineno);
+
+
+// --- Inline implementations
+
+BK_INLINE void BKTKInstrAttack (BKTKInterpreter * interpreter, BKTKTrack * ctx, BKInt note, BKInt capture)
+{
+	if (interpreter -> object.flags & BKTKInterpreterFlagHasAttackEvent) {
+		// overwrite last note value when more than 2
+		interpreter -> nextNoteIndex = BKMin (interpreter -> nextNoteIndex, 1);
+		interpreter -> nextNotes [interpreter -> nextNoteIndex] = note;
+		interpreter -> nextNoteIndex ++;
+	}
+	else {
+		BKTKTrackSetData (ctx, BK_ARPEGGIO, NULL, 0, capture);
+		BKTKTrackSetAttr (ctx, BK_NOTE, note, capture);
+	}
+
+	interpreter -> object.flags &= ~BKTKInterpreterFlagHasArpeggio;
+}
+
+BK_INLINE void BKTKInstrArpeggio (BKTKInterpreter * interpreter, BKTKTrack * ctx, BKInt const arpeggio [1 + BK_MAX_ARPEGGIO], BKInt capture)
+{
+	BKBitSetCond (interpreter -> object.flags, BKTKInterpreterFlagHasArpeggio, arpeggio [0] > 1);
+
+	if (interpreter -> object.flags & BKTKInterpreterFlagHasAttackEvent) {
+		interpreter -> nextArpeggio = arpeggio;
+	}
+	else {
+		BKTKTrackSetData (ctx, BK_ARPEGGIO, arpeggio, 1 + BK_MAX_ARPEGGIO, capture);
+	}
+}
+
+BK_INLINE void BKTKInstrRelease (BKTKInterpreter * interpreter, BKTKTrack * ctx, BKInt note, BKInt capture)
+{
+	BKTKInterpreterEventSet (interpreter, BKIntrEventRelease | BKIntrEventMute, 0);
+	BKTKTrackSetAttr (ctx, BK_NOTE, note, capture);
+	interpreter -> nextNoteIndex = 0;
+}
+
+/**
+ * `ticks` is relative to the step ticks if `divisor` is set
+ */
+BK_INLINE void BKTKInstrTicksEvent (BKTKInterpreter * interpreter, BKUInt cmd, BKInt ticks, BKInt divisor)
+{
+	if (divisor) {
+		ticks = interpreter -> stepTickCount * ticks / divisor;
+	}
+
+	switch (cmd) {
+		case BKIntrAttackTicks: {
+			BKTKInterpreterEventSet (interpreter, BKIntrEventAttack, ticks);
+			break;
+		}
+		case BKIntrReleaseTicks: {
+			BKTKInterpreterEventSet (interpreter, BKIntrEventMute, 0);
+			BKTKInterpreterEventSet (interpreter, BKIntrEventRelease, ticks);
+			break;
+		}
+		case BKIntrMuteTicks: {
+			BKTKInterpreterEventSet (interpreter, BKIntrEventRelease, 0);
+			BKTKInterpreterEventSet (interpreter, BKIntrEventMute, ticks);
+			break;
+		}
+		case BKIntrTicks: {
+			BKTKInterpreterEventSet (interpreter, BKIntrEventStep, ticks);
+			break;
+		}
+	}
+}
+
+BK_INLINE void BKTKInstrStep (BKTKInterpreter * interpreter, BKInt steps)
+{
+	BKTKInterpreterEventSet (interpreter, BKIntrEventStep, steps * interpreter -> stepTickCount);
+}
+
+BK_INLINE void BKTKInstrStepTicks (BKTKTrack * ctx, BKInt stepTicks)
+{
+	BKTKTrack * track;
+
+	for (BKUSize i = 0; i < ctx -> ctx -> tracks.len; i ++) {
+		track = *(BKTKTrack **) BKArrayItemAt (&ctx -> ctx -> tracks, i);
+
+		if (track) {
+			track -> interpreter.stepTickCount = stepTicks;
+		}
+	}
+}
+
+BK_INLINE void BKTKInstrTickRate (BKTKInterpreter * interpreter, BKTKTrack * ctx, BKInt factor, BKInt divisor, BKInt capture)
+{
+	BKTKTrackSetTickRate (ctx, factor, divisor, capture);
+	BKTKInterpreterPushTickRate (interpreter, ctx, factor, divisor);
+}
+
+/**
+ * `args` are ticks, value, ticks and the divisors of both ticks
+ */
+BK_INLINE void BKTKInstrEffect (BKTKInterpreter * interpreter, BKTKTrack * ctx, BKEnum effect, BKInt const args [5], BKInt capture)
+{
+	BKInt values [8];
+
+	values [0] = args [0];
+	values [1] = args [1];
+	values [2] = args [2];
+
+	if (args [3]) {
+		values [0] = interpreter -> stepTickCount * args [0] / args [3];
+	}
+
+	if (args [4]) {
+		values [2] = interpreter -> stepTickCount * args [2] / args [4];
+	}
+
+	BKTKTrackSetEffect (ctx, effect, values, capture);
+}
+
+BK_INLINE void BKTKInstrWaveform (BKTKTrack * ctx, BKInt waveform, BKInt capture)
+{
+	BKInt masterVolume = 0;
+	BKInt index = waveform & ~BK_INTR_CUSTOM_WAVEFORM_FLAG;
+
+	if (waveform & BK_INTR_CUSTOM_WAVEFORM_FLAG) {
+		waveform = BK_CUSTOM;
+
+		if (*(BKTKWaveform **) BKArrayItemAt (&ctx -> ctx -> waveforms, index) == NULL) {
+			waveform = BK_SQUARE;
+		}
+	}
+
+	switch (waveform) {
+		case BK_SQUARE:
+		case BK_NOISE:
+		case BK_SAWTOOTH:
+		case BK_CUSTOM: {
+			masterVolume = BK_MAX_VOLUME * 0.15;
+			break;
+		}
+		case BK_TRIANGLE:
+		case BK_SINE: {
+			masterVolume = BK_MAX_VOLUME * 0.30;
+			break;
+		}
+		// special waveform type
+		case BK_SAMPLE: {
+			masterVolume = BK_MAX_VOLUME * 0.30;
+			waveform = BK_SQUARE;
+			break;
+		}
+	}
+
+	if (waveform == BK_CUSTOM) {
+		BKTKTrackSetObject (ctx, BK_WAVEFORM, index, capture);
+	}
+	else {
+		BKTKTrackSetAttr (ctx, BK_WAVEFORM, waveform, capture);
+	}
+
+	BKTKTrackSetAttr (ctx, BK_MASTER_VOLUME, masterVolume, capture);
+}
+
+BK_INLINE void BKTKInstrSample (BKTKTrack * ctx, BKInt sample, BKInt capture)
+{
+	BKTKSample * object = *(BKTKSample **) BKArrayItemAt (&ctx -> ctx -> samples, sample);
+
+	if (object) {
+		BKTKTrackSetObject (ctx, BK_SAMPLE, sample, capture);
+		BKTKTrackSetAttr (ctx, BK_SAMPLE_REPEAT, object -> repeat, capture);
+
+		if (object -> sustainRange [0] != object -> sustainRange [1]) {
+			BKTKTrackSetData (ctx, BK_SAMPLE_SUSTAIN_RANGE, object -> sustainRange, 2, capture);
+		}
+	}
+}
+
+/**
+ * Push return address `next` and get first instruction of called group
+ */
+BK_INLINE void const * BKTKInstrCall (BKTKInterpreter * interpreter, BKTKTrack * ctx, void const * next, BKUInt type, BKInt groupIdx, BKInt trackIdx, BKInt verified)
+{
+	BKTKGroup * group = NULL;
+	BKTKTrack * track = NULL;
+	BKTKStackItem * prevItem = NULL;
+	BKTKStackItem * item;
+
+	if (!verified && interpreter -> stackPtr >= interpreter -> stackEnd) {
+		return next;
+	}
+
+	if (interpreter -> stackPtr > interpreter -> stack) {
+		prevItem = interpreter -> stackPtr - 1;
+	}
+
+	item = interpreter -> stackPtr ++;
+	item -> ptr = (uintptr_t) next;
+#if BK_TK_PROFILE
+	item -> group = interpreter -> group;
+#endif
+
+	switch (type) {
+		case BKGroupIndexTypeLocal: {
+			if (prevItem) {
+				track = *(BKTKTrack **) BKArrayItemAt (&ctx -> ctx -> tracks, prevItem -> trackIdx);
+			}
+			else {
+				track = ctx;
+			}
+			break;
+		}
+		case BKGroupIndexTypeGlobal: {
+			track = *(BKTKTrack **) BKArrayItemAt (&ctx -> ctx -> tracks, 0);
+			break;
+		}
+		case BKGroupIndexTypeTrack: {
+			track = *(BKTKTrack **) BKArrayItemAt (&ctx -> ctx -> tracks, trackIdx);
+			break;
+		}
+	}
+
+	if (track) {
+		group = ((BKTKGroup **) track -> code -> groups.items) [groupIdx];
+		next = group -> byteCode.items;
+		item -> trackIdx = track -> object.index;
+#if BK_TK_PROFILE
+		group -> profile.calls ++;
+		interpreter -> group = group;
+#endif
+	}
+
+	return next;
+}
+
+BK_INLINE void const * BKTKInstrReturn (BKTKInterpreter * interpreter, void const * next, BKInt verified)
+{
+	if (verified || interpreter -> stackPtr > interpreter -> stack) {
+		next = (void const *) (-- interpreter -> stackPtr) -> ptr;
+#if BK_TK_PROFILE
+		interpreter -> group = interpreter -> stackPtr -> group;
+#endif
+	}
+
+	return next;
+}
+
+/**
+ * Jump to repeat mark
+ */
+BK_INLINE void const * BKTKInstrRepeat (BKTKInterpreter * interpreter, BKUInt * flags, void const * next, BKInt verified)
+{
+	if (verified || interpreter -> repeatStartAddr) {
+		next = (void const *) interpreter -> repeatStartAddr;
+		*flags |= BKTKInterpreterFlagHasRepeated;
+	}
+
+	return next;
+}
+
+BK_INLINE void BKTKInstrEnd (BKTKInterpreter * interpreter, BKUInt * flags)
+{
+	BKTKInterpreterEventSet (interpreter, BKIntrEventStep, BK_INT_MAX);
+	*flags |= BKTKInterpreterFlagHasStopped;
+}
+
+BK_INLINE void BKTKInstrLineNo (BKTKInterpreter * interpreter, BKInt lineno)
+{
+	// relative to line passed by call of outlined group
+	if ((lineno & BK_INTR_RELATIVE_LINE_FLAG) && interpreter -> stackPtr > interpreter -> stack) {
+		lineno &= ~BK_INTR_RELATIVE_LINE_FLAG;
+		lineno += ((BKInstrMask *) (interpreter -> stackPtr - 1) -> ptr) -> arg1.arg1;
+	}
+
+	interpreter -> lineno = lineno;
+	interpreter -> lineTime = interpreter -> time;
+}
+
+#endif /* ! _BK_TK_INSTR_H_ */
@@ -24,16 +24,10 @@
 #include "BKTone.h"
 #include "BKTKContext.h"
 #include "BKTKInterpreter.h"
+#include "BKTKInstr.h"
 
 extern BKClass const BKTKInterpreterClass;
 
-enum {
-	BKIntrEventStep    = 1 << 0,
-	BKIntrEventAttack  = 1 << 1,
-	BKIntrEventRelease = 1 << 2,
-	BKIntrEventMute    = 1 << 3,
-};
-
 static BKTKTickEvent * BKTKInterpreterEventGet (BKTKInterpreter * interpreter, BKInt eventsMaks)
 {
 	BKTKTickEvent * tickEvent;
@@ -73,7 +67,7 @@ static void BKTKInterpreterEventsUnset (BKTKInterpreter * interpreter, BKInt eve
 	}
 }
 
-static BKInt BKTKInterpreterEventSet (BKTKInterpreter * interpreter, BKInt event, BKInt ticks)
+BKInt BKTKInterpreterEventSet (BKTKInterpreter * interpreter, BKInt event, BKInt ticks)
 {
 	BKTKTickEvent * tickEvent, * otherEvent;
 
@@ -147,12 +141,63 @@ static void BKTKInterpreterEventsAdvance (BKTKInterpreter * interpreter, BKInt t
 	}
 }
 
-BKInt BKTKInterpreterInit (BKTKInterpreter * interpreter)
+/**
+ * Instruction names used for reports
+ */
+static char const * const instrNames [BK_INTR_COUNT] =
+{
+	[BKIntrNoop]               = "noop",
+	[BKIntrArpeggio]           = "arpeggio",
+	[BKIntrArpeggioSpeed]      = "arpeggiospeed",
+	[BKIntrAttack]             = "attack",
+	[BKIntrAttackTicks]        = "attackticks",
+	[BKIntrCall]               = "call",
+	[BKIntrDutyCycle]          = "dutycycle",
+	[BKIntrEffect]             = "effect",
+	[BKIntrEnd]                = "end",
+	[BKIntrGroupDef]           = "groupdef",
+	[BKIntrGroupJump]          = "groupjump",
+	[BKIntrInstrument]         = "instrument",
+	[BKIntrInstrumentDef]      = "instrumentdef",
+	[BKIntrJump]               = "jump",
+	[BKIntrMasterVolume]       = "mastervolume",
+	[BKIntrMute]               = "mute",
+	[BKIntrMuteTicks]          = "muteticks",
+	[BKIntrPanning]            = "panning",
+	[BKIntrPhaseWrap]          = "phasewrap",
+	[BKIntrPitch]              = "pitch",
+	[BKIntrRelease]            = "release",
+	[BKIntrReleaseTicks]       = "releaseticks",
+	[BKIntrRepeat]             = "repeat",
+	[BKIntrRepeatStart]        = "repeatstart",
+	[BKIntrReturn]             = "return",
+	[BKIntrSample]             = "sample",
+	[BKIntrSampleDef]          = "sampledef",
+	[BKIntrSampleRange]        = "samplerange",
+	[BKIntrSampleRepeat]       = "samplerepeat",
+	[BKIntrSampleSustainRange] = "samplesustainrange",
+	[BKIntrStep]               = "step",
+	[BKIntrStepTicks]          = "stepticks",
+	[BKIntrStepTicksTrack]     = "steptickstrack",
+	[BKIntrTickRate]           = "tickrate",
+	[BKIntrTicks]              = "ticks",
+	[BKIntrTrackDef]           = "trackdef",
+	[BKIntrVolume]             = "volume",
+	[BKIntrWaveform]           = "waveform",
+	[BKIntrWaveformDef]        = "waveformdef",
+	[BKIntrLineNo]             = "lineno",
+	[BKIntrPulseKernel]        = "pulsekernel",
+	[BKIntrWide]               = "wide",
+};
+
+BKInt BKTKInterpreterInit (BKTKInterpreter * interpreter, BKTKStackItem * stack)
 {
 	if (BKObjectInit (interpreter, &BKTKInterpreterClass, sizeof (*interpreter))) {
 		return -1;
 	}
 
+	interpreter -> stack = stack;
+
 	BKTKInterpreterReset (interpreter);
 
 	return 0;
@@ -171,18 +216,49 @@ BK_INLINE BKInt value2Pitch (BKInt value)
 	return (BKInt) ((int64_t) value * BK_FINT20_UNIT / 100);
 }
 
-BKInt BKTKInterpreterAdvance (BKTKInterpreter * interpreter, BKTKTrack * ctx, BKInt * outTicks)
+void BKTKInterpreterPushTickRate (BKTKInterpreter * interpreter, BKTKTrack * track, BKInt factor, BKInt divisor)
 {
-	BKInt           value0, value1;
-	BKInt           numSteps = 1;
-	BKInt           run = 1;
-	void          * opcode;
-	BKInt           result = 1;
+	BKTKTimingQueue * queue = track -> ctx -> timingQueue;
+	BKTKTimingRecord record;
+
+	if (!queue) {
+		return;
+	}
+
+	record.tick   = interpreter -> time;
+	record.lineno = (factor << 16) | (divisor & 0xFFFF);
+	record.track  = track -> object.index;
+	record.type   = BKTKTimingRecordTypeTickRate;
+
+	BKTKTimingQueuePush (queue, &record);
+}
+
+#if BK_TK_PROFILE
+/**
+ * Count executed instruction
+ */
+BK_INLINE void BKTKInterpreterProfileDispatch (BKTKInterpreter * interpreter, BKTKTrack * track, BKUInt cmd)
+{
+	track -> ctx -> dispatches [cmd] ++;
+	track -> profile.dispatches ++;
+
+	if (interpreter -> group) {
+		interpreter -> group -> profile.dispatches ++;
+	}
+}
+#endif
+
+/**
+ * Handle pending tick events
+ *
+ * If `capture` is set, attributes are pushed to the event log of the
+ * context.
+ */
+BK_TK_FORCE_INLINE BKInt BKTKInterpreterApplyEvents (BKTKInterpreter * interpreter, BKTKTrack * ctx, BKInt * outTicks, BKInt capture)
+{
+	BKInt           numSteps;
 	BKTKTickEvent * tickEvent;
-	BKInstrMask     cmdMask, argMask;
-	BKTrack       * track = &ctx -> renderTrack;
 
-	opcode   = interpreter -> opcodePtr;
 	numSteps = interpreter -> numSteps;
 
 	if (numSteps) {
@@ -201,25 +277,25 @@ BKInt BKTKInterpreterAdvance (BKTKInterpreter * interpreter, BKTKTrack * ctx, BK
 							break;
 						}
 						case BKIntrEventAttack: {
-							BKSetPtr (track, BK_ARPEGGIO, NULL, 0);
+							BKTKTrackSetData (ctx, BK_ARPEGGIO, NULL, 0, capture);
 
 							for (BKInt i = 0; i < interpreter -> nextNoteIndex; i ++) {
-								BKSetAttr (track, BK_NOTE, interpreter -> nextNotes [i]);
+								BKTKTrackSetAttr (ctx, BK_NOTE, interpreter -> nextNotes [i], capture);
 							}
 
 							if (interpreter -> object.flags & BKTKInterpreterFlagHasArpeggio) {
-								BKSetPtr (track, BK_ARPEGGIO, interpreter -> nextArpeggio, sizeof (interpreter -> nextArpeggio));
+								BKTKTrackSetData (ctx, BK_ARPEGGIO, interpreter -> nextArpeggio, 1 + BK_MAX_ARPEGGIO, capture);
 							}
 
 							break;
 						}
 						case BKIntrEventRelease: {
-							BKSetAttr (track, BK_NOTE, BK_NOTE_RELEASE);
+							BKTKTrackSetAttr (ctx, BK_NOTE, BK_NOTE_RELEASE, capture);
 							break;
 						}
 						case BKIntrEventMute: {
-							BKSetAttr (track, BK_NOTE, BK_NOTE_MUTE);
-							BKSetPtr (track, BK_ARPEGGIO, NULL, 0);
+							BKTKTrackSetAttr (ctx, BK_NOTE, BK_NOTE_MUTE, capture);
+							BKTKTrackSetData (ctx, BK_ARPEGGIO, NULL, 0, capture);
 							break;
 						}
 					}
@@ -249,50 +325,68 @@ BKInt BKTKInterpreterAdvance (BKTKInterpreter * interpreter, BKTKTrack * ctx, BK
 		}
 	}
 
-	do {
-		cmdMask = BKReadIntrMask (&opcode);
+	return 0;
+}
 
-		switch (cmdMask.arg1.cmd) {
-			case BKIntrAttack: {
-				value0 = value2Pitch (cmdMask.arg1.arg1);
+BKInt BKTKInterpreterAdvanceEvents (BKTKInterpreter * interpreter, BKTKTrack * ctx, BKInt * outTicks)
+{
+	return BKTKInterpreterApplyEvents (interpreter, ctx, outTicks, 0);
+}
 
-				if (interpreter -> object.flags & BKTKInterpreterFlagHasAttackEvent) {
-					// overwrite last note value when more than 2
-					interpreter -> nextNoteIndex = BKMin (interpreter -> nextNoteIndex, 1);
-					interpreter -> nextNotes [interpreter -> nextNoteIndex] = value0;
-					interpreter -> nextNoteIndex ++;
-				}
-				else {
-					BKSetPtr (track, BK_ARPEGGIO, NULL, 0);
-					BKSetAttr (track, BK_NOTE, value0);
-				}
+void BKTKInterpreterEndAdvance (BKTKInterpreter * interpreter, BKInt * outTicks)
+{
+	BKInt           numSteps = 1; // default steps
+	BKTKTickEvent * tickEvent;
 
-				interpreter -> object.flags &= ~BKTKInterpreterFlagHasArpeggio;
+	tickEvent = BKTKInterpreterEventGetNext (interpreter);
 
-				break;
-			}
-			case BKIntrArpeggio: {
-				BKInt arpeggio [1 + BK_MAX_ARPEGGIO];
+	if (tickEvent) {
+		numSteps = tickEvent -> ticks;
+	}
 
-				value0 = cmdMask.arg1.arg1;
+	interpreter -> numSteps = numSteps;
+	interpreter -> time += numSteps;
 
-				BKBitSetCond (interpreter -> object.flags, BKTKInterpreterFlagHasArpeggio, value0 != 0);
+	(* outTicks) = numSteps;
+}
 
-				arpeggio [0] = value0 + 1;
-				arpeggio [1] = 0;
+/**
+ * Run byte code until the next step
+ *
+ * If `verified` is set, the stack and repeat checks are skipped for byte code
+ * which passed the compiler's verifier. If `capture` is set, attributes are
+ * pushed to the event log of the context.
+ */
+BK_TK_FORCE_INLINE BKInt BKTKInterpreterRun (BKTKInterpreter * interpreter, BKTKTrack * ctx, void ** opcodePtr, BKUInt * flags, BKInt * outTicks, BKInt verified, BKInt capture)
+{
+	BKInt           value0, value1;
+	BKInt           run = 1;
+	void          * opcode;
+	BKInt           result = 1;
+	BKInstrMask     cmdMask, argMask;
 
-				for (BKInt i = 0; i < value0; i ++) {
-					argMask = BKReadIntrMask (&opcode);
-					arpeggio [i + 2] = value2Pitch (argMask.arg1.arg1);
-				}
+	if (BKTKInterpreterApplyEvents (interpreter, ctx, outTicks, capture)) {
+		return 1;
+	}
 
-				if (interpreter -> object.flags & BKTKInterpreterFlagHasAttackEvent) {
-					memcpy (interpreter -> nextArpeggio, arpeggio, (value0 + 2) * sizeof (BKInt));
-				}
-				else {
-					BKSetPtr (track, BK_ARPEGGIO, arpeggio, sizeof (arpeggio));
-				}
+	opcode = *opcodePtr;
+
+	do {
+		cmdMask = BKReadIntrMask (&opcode);
 
+#if BK_TK_PROFILE
+		BKTKInterpreterProfileDispatch (interpreter, ctx, cmdMask.arg1.cmd);
+#endif
+
+		switch (cmdMask.arg1.cmd) {
+			case BKIntrAttack: {
+				BKTKInstrAttack (interpreter, ctx, value2Pitch (cmdMask.arg1.arg1), capture);
+				break;
+			}
+			case BKIntrArpeggio: {
+				BKTKArpeggio const * arpeggio = (BKTKArpeggio const *) ctx -> ctx -> arpeggios.items + cmdMask.arg1.arg1;
+
+				BKTKInstrArpeggio (interpreter, ctx, arpeggio -> values, capture);
 				break;
 			}
 			case BKIntrArpeggioSpeed: {
@@ -302,111 +396,66 @@ BKInt BKTKInterpreterAdvance (BKTKInterpreter * interpreter, BKTKTrack * ctx, BK
 					value0 = BK_DEFAULT_ARPEGGIO_DIVIDER;
 				}
 
-				BKSetAttr (track, BK_ARPEGGIO_DIVIDER, value0);
+				BKTKTrackSetAttr (ctx, BK_ARPEGGIO_DIVIDER, value0, capture);
 				break;
 			}
 			case BKIntrRelease: {
-				BKTKInterpreterEventSet (interpreter, BKIntrEventRelease | BKIntrEventMute, 0);
-				BKSetAttr (track, BK_NOTE, BK_NOTE_RELEASE);
-				interpreter -> nextNoteIndex = 0;
+				BKTKInstrRelease (interpreter, ctx, BK_NOTE_RELEASE, capture);
 				break;
 			}
 			case BKIntrMute: {
-				BKTKInterpreterEventSet (interpreter, BKIntrEventRelease | BKIntrEventMute, 0);
-				BKSetAttr (track, BK_NOTE, BK_NOTE_MUTE);
-				interpreter -> nextNoteIndex = 0;
+				BKTKInstrRelease (interpreter, ctx, BK_NOTE_MUTE, capture);
 				break;
 			}
 			case BKIntrVolume: {
 				value0 = cmdMask.arg1.arg1;
-				BKSetAttr (track, BK_VOLUME, value0);
+				BKTKTrackSetAttr (ctx, BK_VOLUME, value0, capture);
 				break;
 			}
 			case BKIntrMasterVolume: {
 				value0 = cmdMask.arg1.arg1;
-				BKSetAttr (track, BK_MASTER_VOLUME, value0);
+				BKTKTrackSetAttr (ctx, BK_MASTER_VOLUME, value0, capture);
 				break;
 			}
 			case BKIntrPanning: {
 				value0 = cmdMask.arg1.arg1;
-				BKSetAttr (track, BK_PANNING, value0);
+				BKTKTrackSetAttr (ctx, BK_PANNING, value0, capture);
 				break;
 			}
 			case BKIntrPitch: {
 				value0 = value2Pitch (cmdMask.arg1.arg1);
-				BKSetAttr (track, BK_PITCH, value0);
+				BKTKTrackSetAttr (ctx, BK_PITCH, value0, capture);
 				break;
 			}
 			case BKIntrPulseKernel: {
 				value0 = cmdMask.arg1.arg1;
-				BKSetPtr (track -> unit.ctx, BK_PULSE_KERNEL, (void *) BKBufferPulseKernels [value0], sizeof (void *));
+				BKTKTrackSetPulseKernel (ctx, value0, capture);
 				break;
 			}
 			case BKIntrAttackTicks: {
-				value0 = cmdMask.arg2.arg1;
-				value1 = cmdMask.arg2.arg2;
-
-				if (value1) {
-					value0 = interpreter -> stepTickCount * value0 / value1;
-				}
-
-				BKTKInterpreterEventSet (interpreter, BKIntrEventAttack, value0);
+				BKTKInstrTicksEvent (interpreter, BKIntrAttackTicks, cmdMask.arg2.arg1, cmdMask.arg2.arg2);
 				break;
 			}
 			case BKIntrReleaseTicks: {
-				value0 = cmdMask.arg2.arg1;
-				value1 = cmdMask.arg2.arg2;
-
-				if (value1) {
-					value0 = interpreter -> stepTickCount * value0 / value1;
-				}
-
-				BKTKInterpreterEventSet (interpreter, BKIntrEventMute, 0);
-				BKTKInterpreterEventSet (interpreter, BKIntrEventRelease, value0);
+				BKTKInstrTicksEvent (interpreter, BKIntrReleaseTicks, cmdMask.arg2.arg1, cmdMask.arg2.arg2);
 				break;
 			}
 			case BKIntrMuteTicks: {
-				value0 = cmdMask.arg2.arg1;
-				value1 = cmdMask.arg2.arg2;
-
-				if (value1) {
-					value0 = interpreter -> stepTickCount * value0 / value1;
-				}
-
-				BKTKInterpreterEventSet (interpreter, BKIntrEventRelease, 0);
-				BKTKInterpreterEventSet (interpreter, BKIntrEventMute, value0);
+				BKTKInstrTicksEvent (interpreter, BKIntrMuteTicks, cmdMask.arg2.arg1, cmdMask.arg2.arg2);
 				break;
 			}
 			case BKIntrTicks: {
-				value0 = cmdMask.arg2.arg1;
-				value1 = cmdMask.arg2.arg2;
-
-				if (value1) {
-					value0 = interpreter -> stepTickCount * value0 / value1;
-				}
-
-				BKTKInterpreterEventSet (interpreter, BKIntrEventStep, value0);
+				BKTKInstrTicksEvent (interpreter, BKIntrTicks, cmdMask.arg2.arg1, cmdMask.arg2.arg2);
 				run = 0;
 				break;
 			}
 			case BKIntrStep: {
-				value0 = cmdMask.arg1.arg1;
-				BKTKInterpreterEventSet (interpreter, BKIntrEventStep, value0 * interpreter -> stepTickCount);
+				BKTKInstrStep (interpreter, cmdMask.arg1.arg1);
 				run = 0;
 				break;
 			}
 			case BKIntrStepTicks: {
-				BKTKTrack * track;
-
-				value0 = cmdMask.arg1.arg1;
-
-				for (BKUSize i = 0; i < ctx -> ctx -> tracks.len; i ++) {
-					track = *(BKTKTrack **) BKArrayItemAt (&ctx -> ctx -> tracks, i);
-
-					if (track) {
-						track -> interpreter.stepTickCount = value0;
-					}
-				}
+				BKTKInstrStepTicks (ctx, cmdMask.arg1.arg1);
 				break;
 			}
 			case BKIntrStepTicksTrack: {
@@ -415,20 +464,16 @@ BKInt BKTKInterpreterAdvance (BKTKInterpreter * interpreter, BKTKTrack * ctx, BK
 				break;
 			}
 			case BKIntrTickRate: {
-				BKTime time;
-				BKContext * ctx = track -> unit.ctx;
-
 				value0 = cmdMask.arg2.arg1;
 				value1 = cmdMask.arg2.arg2;
 
 				if (value1) {
-					time = BKTimeFromSeconds (ctx, (float) value0 / (float) value1);
-					BKSetPtr (ctx, BK_CLOCK_PERIOD, &time, sizeof (time));
+					BKTKInstrTickRate (interpreter, ctx, value0, value1, capture);
 				}
 				break;
 			}
 			case BKIntrEffect: {
-				BKInt args [8];
+				BKInt args [5];
 
 				argMask = BKReadIntrMask (&opcode);
 				args [0] = argMask.arg2.arg1;
@@ -440,110 +485,35 @@ BKInt BKTKInterpreterAdvance (BKTKInterpreter * interpreter, BKTKTrack * ctx, BK
 				args [2] = argMask.arg2.arg1;
 				args [4] = argMask.arg2.arg2;
 
-				if (args [3]) {
-					args [0] = interpreter -> stepTickCount * args [0] / args [3];
-				}
-
-				if (args [4]) {
-					args [2] = interpreter -> stepTickCount * args [2] / args [4];
-				}
-
-				BKTrackSetEffect (track, cmdMask.arg1.arg1, args, sizeof (BKInt [3]));
+				BKTKInstrEffect (interpreter, ctx, cmdMask.arg1.arg1, args, capture);
 				break;
 			}
 			case BKIntrDutyCycle: {
 				value0 = cmdMask.arg1.arg1;
-				BKSetAttr (track, BK_DUTY_CYCLE, value0);
+				BKTKTrackSetAttr (ctx, BK_DUTY_CYCLE, value0, capture);
 				break;
 			}
 			case BKIntrPhaseWrap: {
 				value0 = cmdMask.arg1.arg1;
-				BKSetAttr (track, BK_PHASE_WRAP, value0);
+				BKTKTrackSetAttr (ctx, BK_PHASE_WRAP, value0, capture);
 				break;
 			}
 			case BKIntrInstrument: {
-				BKTKInstrument ** instrRef;
-				BKInstrument * instr = NULL;
-
 				value0 = cmdMask.arg1.arg1;
-				instrRef = BKArrayItemAt (&ctx -> ctx -> instruments, value0);
-
-				if (instrRef) {
-					instr = &(*instrRef) -> instr;
-				}
-
-				BKSetPtr (track, BK_INSTRUMENT, instr, sizeof (void *));
+				BKTKTrackSetObject (ctx, BK_INSTRUMENT, value0, capture);
 				break;
 			}
 			case BKIntrWaveform: {
-				BKTKWaveform * waveform = NULL;
-				BKInt masterVolume = 0;
-
-				value0 = cmdMask.arg1.arg1;
-
-				if (value0 & BK_INTR_CUSTOM_WAVEFORM_FLAG) {
-					value0 &= ~BK_INTR_CUSTOM_WAVEFORM_FLAG;
-
-					waveform = *(BKTKWaveform **) BKArrayItemAt (&ctx -> ctx -> waveforms, value0);
-					value0 = BK_CUSTOM;
-
-					if (waveform == NULL) {
-						value0 = BK_SQUARE;
-					}
-				}
-
-				switch (value0) {
-					case BK_SQUARE:
-					case BK_NOISE:
-					case BK_SAWTOOTH:
-					case BK_CUSTOM: {
-						masterVolume = BK_MAX_VOLUME * 0.15;
-						break;
-					}
-					case BK_TRIANGLE:
-					case BK_SINE: {
-						masterVolume = BK_MAX_VOLUME * 0.30;
-						break;
-					}
-					// special waveform type
-					case BK_SAMPLE: {
-						masterVolume = BK_MAX_VOLUME * 0.30;
-						value0 = BK_SQUARE;
-						break;
-					}
-				}
-
-				if (value0 == BK_CUSTOM) {
-					BKSetPtr (track, BK_WAVEFORM, &waveform -> data, sizeof (void *));
-				}
-				else {
-					BKSetAttr (track, BK_WAVEFORM, value0);
-				}
-
-				BKSetAttr (track, BK_MASTER_VOLUME, masterVolume);
-
+				BKTKInstrWaveform (ctx, cmdMask.arg1.arg1, capture);
 				break;
 			}
 			case BKIntrSample: {
-				BKTKSample * sample;
-
-				value0 = cmdMask.arg1.arg1;
-				sample = *(BKTKSample **) BKArrayItemAt (&ctx -> ctx -> samples, value0);
-
-				if (sample) {
-					BKSetPtr (track, BK_SAMPLE, sample ? &sample -> data : NULL, sizeof (void *));
-					BKSetAttr (track, BK_SAMPLE_REPEAT, sample -> repeat);
-
-					if (sample -> sustainRange [0] != sample -> sustainRange [1]) {
-						BKSetPtr (track, BK_SAMPLE_SUSTAIN_RANGE, sample -> sustainRange, sizeof (sample -> sustainRange));
-					}
-				}
-
+				BKTKInstrSample (ctx, cmdMask.arg1.arg1, capture);
 				break;
 			}
 			case BKIntrSampleRepeat: {
 				value0 = cmdMask.arg1.arg1;
-				BKSetAttr (track, BK_SAMPLE_REPEAT, value0);
+				BKTKTrackSetAttr (ctx, BK_SAMPLE_REPEAT, value0, capture);
 				break;
 			}
 			case BKIntrSampleRange: {
@@ -552,7 +522,7 @@ BKInt BKTKInterpreterAdvance (BKTKInterpreter * interpreter, BKTKTrack * ctx, BK
 				range [0] = BKReadIntrMask (&opcode).arg1.arg1;
 				range [1] = BKReadIntrMask (&opcode).arg1.arg1;
 
-				BKSetPtr (track, BK_SAMPLE_RANGE, range, sizeof (range));
+				BKTKTrackSetData (ctx, BK_SAMPLE_RANGE, range, 2, capture);
 				break;
 			}
 			case BKIntrSampleSustainRange: {
@@ -561,61 +531,51 @@ BKInt BKTKInterpreterAdvance (BKTKInterpreter * interpreter, BKTKTrack * ctx, BK
 				range [0] = BKReadIntrMask (&opcode).arg1.arg1;
 				range [1] = BKReadIntrMask (&opcode).arg1.arg1;
 
-				BKSetPtr (track, BK_SAMPLE_SUSTAIN_RANGE, range, sizeof (range));
+				BKTKTrackSetData (ctx, BK_SAMPLE_SUSTAIN_RANGE, range, 2, capture);
 				break;
 			}
 			case BKIntrReturn: {
-				if (interpreter -> stackPtr > interpreter -> stack) {
-					opcode = (void *) (-- interpreter -> stackPtr) -> ptr;
-				}
+				opcode = (void *) BKTKInstrReturn (interpreter, opcode, verified);
 				break;
 			}
 			case BKIntrCall: {
-				BKTKGroup * group = NULL;
-				BKTKTrack * track = NULL;
-				BKTKStackItem * prevItem = NULL;
-				BKTKStackItem * item;
-
-				value0 = cmdMask.grp.idx1;
-				value1 = cmdMask.grp.idx2;
+				opcode = (void *) BKTKInstrCall (interpreter, ctx, opcode, cmdMask.grp.type, cmdMask.grp.idx1, cmdMask.grp.idx2, verified);
+				break;
+			}
+			case BKIntrWide: {
+				BKInt args [5] = {0};
+				BKInt count = BKMin (cmdMask.arg1.arg1, 5);
 
-				if (interpreter -> stackPtr >= interpreter -> stackEnd) {
-					break;
-				}
+				// wrapped instruction
+				argMask = BKReadIntrMask (&opcode);
 
-				if (interpreter -> stackPtr > interpreter -> stack) {
-					prevItem = interpreter -> stackPtr - 1;
+				for (BKInt i = 0; i < count; i ++) {
+					args [i] = BKReadIntrMask (&opcode).arg1.arg1;
 				}
 
-				item = interpreter -> stackPtr ++;
-				item -> ptr = (uintptr_t) opcode;
-
-				switch (cmdMask.grp.type) {
-					case BKGroupIndexTypeLocal: {
-						if (prevItem) {
-							track = *(BKTKTrack **) BKArrayItemAt (&ctx -> ctx -> tracks, prevItem -> trackIdx);
-						}
-						else {
-							track = ctx;
-						}
+				switch (argMask.arg1.cmd) {
+					case BKIntrAttackTicks:
+					case BKIntrReleaseTicks:
+					case BKIntrMuteTicks: {
+						BKTKInstrTicksEvent (interpreter, argMask.arg1.cmd, args [0], args [1]);
 						break;
 					}
-					case BKGroupIndexTypeGlobal: {
-						track = *(BKTKTrack **) BKArrayItemAt (&ctx -> ctx -> tracks, 0);
+					case BKIntrTicks: {
+						BKTKInstrTicksEvent (interpreter, BKIntrTicks, args [0], args [1]);
+						run = 0;
 						break;
 					}
-					case BKGroupIndexTypeTrack: {
-						track = *(BKTKTrack **) BKArrayItemAt (&ctx -> ctx -> tracks, value1);
+					case BKIntrEffect: {
+						BKInt effectArgs [5] = {args [0], args [2], args [3], args [1], args [4]};
+
+						BKTKInstrEffect (interpreter, ctx, argMask.arg1.arg1, effectArgs, capture);
+						break;
+					}
+					case BKIntrCall: {
+						opcode = (void *) BKTKInstrCall (interpreter, ctx, opcode, argMask.grp.type, args [0], args [1], verified);
 						break;
 					}
 				}
-
-				if (track) {
-					group = *(BKTKGroup **) BKArrayItemAt (&track -> groups, value0);
-					opcode = group -> byteCode.first -> data;
-					item -> trackIdx = track -> object.index;
-				}
-
 				break;
 			}
 			case BKIntrRepeatStart: {
@@ -627,10 +587,7 @@ BKInt BKTKInterpreterAdvance (BKTKInterpreter * interpreter, BKTKTrack * ctx, BK
 
 				// jump to repeat mark
 				if (value0 == -1) {
-					if (interpreter -> repeatStartAddr) {
-						opcode = (void *) interpreter -> repeatStartAddr;
-						interpreter -> object.flags |= BKTKInterpreterFlagHasRepeated;
-					}
+					opcode = (void *) BKTKInstrRepeat (interpreter, flags, opcode, verified);
 				}
 				else {
 					// unused
@@ -638,46 +595,46 @@ BKInt BKTKInterpreterAdvance (BKTKInterpreter * interpreter, BKTKTrack * ctx, BK
 				break;
 			}
 			case BKIntrEnd: {
-				BKTKInterpreterEventSet (interpreter, BKIntrEventStep, BK_INT_MAX);
-				interpreter -> object.flags |= BKTKInterpreterFlagHasStopped;
+				BKTKInstrEnd (interpreter, flags);
 				opcode = ((uint32_t *) opcode) - 1; // repeat command forever
 				run = 0;
 				result = 0;
 				break;
 			}
 			case BKIntrLineNo: {
-				value0 = cmdMask.arg1.arg1;
-				interpreter -> lineno = value0;
-				interpreter -> lineTime = interpreter -> time;
+				BKTKInstrLineNo (interpreter, cmdMask.arg1.arg1);
 				break;
 			}
 		}
 	}
 	while (run);
 
-	numSteps  = 1; // default steps
-	tickEvent = BKTKInterpreterEventGetNext (interpreter);
+	BKTKInterpreterEndAdvance (interpreter, outTicks);
+	*opcodePtr = opcode;
 
-	if (tickEvent) {
-		numSteps = tickEvent -> ticks;
-	}
+	return result;
+}
 
-	interpreter -> numSteps = numSteps;
-	interpreter -> opcodePtr = opcode;
-	interpreter -> time += numSteps;
+BKInt BKTKInterpreterAdvance (BKTKInterpreter * interpreter, BKTKTrack * ctx, void ** opcodePtr, BKUInt * flags, BKInt * outTicks)
+{
+	if (ctx -> object.object.flags & BKTKFlagVerified) {
+		return BKTKInterpreterRun (interpreter, ctx, opcodePtr, flags, outTicks, 1, 0);
+	}
 
-	(* outTicks) = numSteps;
+	return BKTKInterpreterRun (interpreter, ctx, opcodePtr, flags, outTicks, 0, 0);
+}
 
-	return result;
+BKInt BKTKInterpreterCapture (BKTKInterpreter * interpreter, BKTKTrack * ctx, void ** opcodePtr, BKUInt * flags, BKInt * outTicks)
+{
+	return BKTKInterpreterRun (interpreter, ctx, opcodePtr, flags, outTicks, 0, 1);
 }
 
 void BKTKInterpreterReset (BKTKInterpreter * interpreter)
 {
 	interpreter -> object.flags   &= ~BKObjectFlagUsableMask;
 	interpreter -> numSteps        = 0;
-	interpreter -> opcodePtr       = interpreter -> opcode;
 	interpreter -> stackPtr        = interpreter -> stack;
-	interpreter -> stackEnd        = (void *) interpreter -> stack + sizeof (interpreter -> stack);
+	interpreter -> stackEnd        = interpreter -> stack + BK_INTR_STACK_SIZE;
 	interpreter -> numEvents       = 0;
 	interpreter -> nextNoteIndex   = 0;
 	interpreter -> repeatStartAddr = 0;
@@ -685,6 +642,20 @@ void BKTKInterpreterReset (BKTKInterpreter * interpreter)
 	interpreter -> lineTime        = 0;
 	interpreter -> lineno          = 0;
 	interpreter -> stepTickCount   = BK_INTR_STEP_TICKS;
+#if BK_TK_PROFILE
+	interpreter -> group           = NULL;
+#endif
+}
+
+char const * BKTKInterpreterInstrName (BKUInt cmd)
+{
+	char const * name = NULL;
+
+	if (cmd < BK_INTR_COUNT) {
+		name = instrNames [cmd];
+	}
+
+	return name ? name : "unknown";
 }
 
 BKClass const BKTKInterpreterClass =
@@ -30,13 +30,18 @@
 #include "BKTKTokenizer.h"
 
 #define BK_INTR_CUSTOM_WAVEFORM_FLAG (1 << 24)
+#define BK_INTR_RELATIVE_LINE_FLAG (1 << 24)
+#define BK_INTR_MAX_LINENO (BK_INTR_RELATIVE_LINE_FLAG - 1)
 #define BK_INTR_STACK_SIZE 16
 #define BK_INTR_MAX_EVENTS 8
 #define BK_INTR_STEP_TICKS 24
+#define BK_INTR_COUNT (1 << 6)
+#define BK_INTR_WIDE_MAX ((1 << 25) - 1)
 
 typedef struct BKTKInterpreter BKTKInterpreter;
 typedef struct BKTKTickEvent BKTKTickEvent;
 typedef struct BKTKStackItem BKTKStackItem;
+typedef struct BKTKArpeggio BKTKArpeggio;
 
 enum BKInstruction
 {
@@ -81,8 +86,21 @@ enum BKInstruction
 	BKIntrWaveformDef        = 38,
 	BKIntrLineNo             = 39,
 	BKIntrPulseKernel        = 40,
+	BKIntrWide               = 41,
 };
 
+enum BKTKInterpreterEvent
+{
+	BKIntrEventStep    = 1 << 0,
+	BKIntrEventAttack  = 1 << 1,
+	BKIntrEventRelease = 1 << 2,
+	BKIntrEventMute    = 1 << 3,
+};
+
+/**
+ * `HasStopped` and `HasRepeated` are set in the flags passed to
+ * `BKTKInterpreterAdvance`, the others on the interpreter object
+ */
 enum BKTKInterpreterFlag
 {
 	BKTKInterpreterFlagHasAttackEvent = 1 << 0,
@@ -118,6 +136,30 @@ typedef union
 	uint32_t value;
 } BKInstrMask;
 
+/**
+ * Operands not fitting into the fields of `BKInstrMask` are encoded by
+ * prefixing the instruction with `BKIntrWide`. Its `arg1` is the number of
+ * operand words following the instruction word; each holds one operand in
+ * `arg1` so it is a no-op when executed. Operands in order:
+ *
+ * ticks commands: ticks, divisor
+ * `BKIntrEffect`: ticks, divisor, value, ticks, divisor
+ * `BKIntrCall`:   group, track; followed by the line and column words
+ */
+
+/**
+ * Arpeggio as passed to `BK_ARPEGGIO`
+ *
+ * The compiler emits `BKIntrArpeggio` followed by one word per note.
+ * Linking replaces them by a single instruction with the index of the
+ * arpeggio in the constant pool of the song. Pitches are already scaled
+ * to `BK_FINT20_UNIT`; `values [0]` is the number of notes.
+ */
+struct BKTKArpeggio
+{
+	BKInt values [1 + BK_MAX_ARPEGGIO];
+};
+
 struct BKTKTickEvent
 {
 	BKInt event;
@@ -126,46 +168,113 @@ struct BKTKTickEvent
 
 struct BKTKStackItem
 {
-	uintptr_t ptr;
-	uint8_t   trackIdx;
+	uintptr_t   ptr;
+	BKUInt      trackIdx;
+	BKInt       lineno; // base of relative lines in native code
+#if BK_TK_PROFILE
+	BKTKGroup * group;
+#endif
 };
 
+/**
+ * Fields are ordered by access frequency
+ *
+ * The first block is touched on every advance, also when only waiting for
+ * ticks. The second block is used when executing instructions. The call
+ * stack is allocated separately. The instruction pointer and the stopped
+ * and repeated flags are kept by the context in arrays indexed by track.
+ */
 struct BKTKInterpreter {
 	BKObject        object;
-	void          * opcode;
-	void          * opcodePtr;
-	uintptr_t       repeatStartAddr;
-	BKTKStackItem   stack [BK_INTR_STACK_SIZE];
-	BKTKStackItem * stackPtr;
-	BKTKStackItem * stackEnd;
-	BKUInt          stepTickCount;
 	BKUInt          numSteps;
-	BKUInt          nextNoteIndex;
-	BKInt           nextNotes [2];
-	BKInt           nextArpeggio [1 + BK_MAX_ARPEGGIO];
-	BKInt           numEvents;
-	BKTKTickEvent   events [BK_INTR_MAX_EVENTS];
+	BKUInt          stepTickCount;
 	BKInt           time;
 	BKInt           lineTime;
 	BKInt           lineno;
+	BKInt           numEvents;
+	BKTKTickEvent   events [BK_INTR_MAX_EVENTS];
+	BKTKStackItem * stackPtr;
+	BKTKStackItem * stackEnd;
+	uintptr_t       repeatStartAddr;
+	BKUInt          nextNoteIndex;
+	BKInt           nextNotes [2];
+	BKInt const   * nextArpeggio; // in constant pool
+#if BK_TK_PROFILE
+	BKTKGroup     * group; // group currently executed
+#endif
+	BKTKStackItem * stack; // BK_INTR_STACK_SIZE items
 };
 
 /**
  * Initialize interpreter
+ *
+ * `stack` has to hold `BK_INTR_STACK_SIZE` items and is not owned by the
+ * interpreter.
  */
-extern BKInt BKTKInterpreterInit (BKTKInterpreter * interpreter);
+extern BKInt BKTKInterpreterInit (BKTKInterpreter * interpreter, BKTKStackItem * stack);
 
 /**
  * Apply commands to track
  *
  * Return 1 if more events are available otherwise 0
+ * Instructions are executed at `*opcodePtr`, which is set to the next
+ * instruction. `BKTKInterpreterFlagHasStopped` and
+ * `BKTKInterpreterFlagHasRepeated` are added to `*flags`. `outTicks` is set
+ * to number of ticks to next event
+ * Tracks flagged with `BKTKFlagVerified` skip the stack and repeat checks.
+ */
+extern BKInt BKTKInterpreterAdvance (BKTKInterpreter * interpreter, BKTKTrack * ctx, void ** opcodePtr, BKUInt * flags, BKInt * outTicks);
+
+/**
+ * Apply commands like `BKTKInterpreterAdvance` but push attributes to the
+ * event log of the context instead of setting them
+ *
+ * Used for capturing only, so playback does not check for it.
+ */
+extern BKInt BKTKInterpreterCapture (BKTKInterpreter * interpreter, BKTKTrack * ctx, void ** opcodePtr, BKUInt * flags, BKInt * outTicks);
+
+/**
+ * Handle pending tick events before executing instructions
+ *
+ * Returns 1 if the track has to wait for more ticks; `outTicks` is set to
+ * the number of ticks. Otherwise 0 is returned and instructions are executed
+ * at the instruction pointer of the track.
+ *
+ * Used by `BKTKInterpreterAdvance` and native code (see BKTKNative.h).
+ */
+extern BKInt BKTKInterpreterAdvanceEvents (BKTKInterpreter * interpreter, BKTKTrack * ctx, BKInt * outTicks);
+
+/**
+ * Wait for next event after executing instructions
+ *
  * `outTicks` is set to number of ticks to next event
  */
-extern BKInt BKTKInterpreterAdvance (BKTKInterpreter * interpreter, BKTKTrack * ctx, BKInt * outTicks);
+extern void BKTKInterpreterEndAdvance (BKTKInterpreter * interpreter, BKInt * outTicks);
+
+/**
+ * Set tick event or remove it if `ticks` is 0
+ *
+ * Returns -1 if there are too many events
+ */
+extern BKInt BKTKInterpreterEventSet (BKTKInterpreter * interpreter, BKInt event, BKInt ticks);
+
+/**
+ * Push tick rate change to timing queue
+ *
+ * Consumers need it to convert ticks of following records to seconds
+ */
+extern void BKTKInterpreterPushTickRate (BKTKInterpreter * interpreter, BKTKTrack * track, BKInt factor, BKInt divisor);
 
 /**
  * Reset interpreter
  */
 extern void BKTKInterpreterReset (BKTKInterpreter * interpreter);
 
+/**
+ * Get name of instruction
+ *
+ * Returns "unknown" for undefined instructions
+ */
+extern char const * BKTKInterpreterInstrName (BKUInt cmd);
+
 #endif /* ! _BK_TK_INTERPRETER_H_ */
@@ -0,0 +1,695 @@
+/*
+ * Copyright (c) 2012-2016 Simon Schoenenberger
+ * http://blipkit.audio
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "BKTone.h"
+#include "BKTKNative.h"
+
+#define NATIVE_HASH_BASIS 0xCBF29CE484222325
+#define NATIVE_HASH_PRIME 0x100000001B3
+
+/**
+ * Hash of byte code to check if generated code matches
+ */
+static uint64_t nativeHash (uint32_t const * words, BKUSize numWords)
+{
+	uint64_t hash = NATIVE_HASH_BASIS;
+
+	for (BKUSize i = 0; i < numWords; i ++) {
+		hash = (hash ^ words [i]) * NATIVE_HASH_PRIME;
+	}
+
+	return hash;
+}
+
+/**
+ * Get byte code of track or group
+ *
+ * Returns NULL if the group does not exist
+ */
+static uint32_t const * nativeBlockCode (BKTKTrack const * track, BKInt groupIdx, BKUSize * outNumWords)
+{
+	BKTKGroup * group;
+	BKTKArenaArray const * byteCode = &track -> code -> byteCode;
+
+	if (groupIdx >= 0) {
+		if ((BKUSize) groupIdx >= track -> code -> groups.len) {
+			return NULL;
+		}
+
+		group = ((BKTKGroup **) track -> code -> groups.items) [groupIdx];
+
+		if (!group) {
+			return NULL;
+		}
+
+		byteCode = &group -> byteCode;
+	}
+
+	if (!byteCode -> items) {
+		return NULL;
+	}
+
+	*outNumWords = byteCode -> len;
+
+	return byteCode -> items;
+}
+
+/**
+ * Get number of words of instruction as read by the interpreter
+ */
+static BKUSize nativeInstrSize (uint32_t const * words, BKUSize numWords)
+{
+	BKInstrMask mask = (BKInstrMask) {.value = words [0]};
+	BKUSize size = 1;
+
+	switch (mask.arg1.cmd) {
+		case BKIntrSampleRange:
+		case BKIntrSampleSustainRange: {
+			size = 3;
+			break;
+		}
+		case BKIntrEffect: {
+			size = 4;
+			break;
+		}
+		case BKIntrWide: {
+			size = 2 + BKMax (mask.arg1.arg1, 0);
+			break;
+		}
+	}
+
+	return BKMin (size, numWords);
+}
+
+BK_INLINE BKInt nativePitch (BKInt value)
+{
+	return (BKInt) ((int64_t) value * BK_FINT20_UNIT / 100);
+}
+
+/**
+ * Get argument word of instruction or 0 if byte code is truncated
+ */
+BK_INLINE BKInstrMask nativeArg (uint32_t const * words, BKUSize size, BKUSize i)
+{
+	return (BKInstrMask) {.value = i < size ? words [i] : 0};
+}
+
+/**
+ * Get instruction wrapped by wide instruction or instruction itself
+ */
+static BKInstrMask nativeInstr (uint32_t const * words, BKUSize size)
+{
+	BKInstrMask mask = (BKInstrMask) {.value = words [0]};
+
+	if (mask.arg1.cmd == BKIntrWide) {
+		mask = nativeArg (words, size, 1);
+	}
+
+	return mask;
+}
+
+/**
+ * Get offset where execution continues after instruction if it ends a
+ * function; otherwise -1
+ *
+ * Repeat marks and ended tracks also continue at a function.
+ */
+static BKInt nativeResumeOffset (BKInstrMask mask, BKUSize offset, BKUSize size)
+{
+	switch (mask.arg1.cmd) {
+		case BKIntrTicks:
+		case BKIntrStep:
+		case BKIntrCall:
+		case BKIntrReturn:
+		case BKIntrRepeatStart: {
+			return (BKInt) (offset + size);
+		}
+		case BKIntrJump: {
+			return mask.arg1.arg1 == -1 ? (BKInt) (offset + size) : -1;
+		}
+		case BKIntrEnd: {
+			return (BKInt) offset;
+		}
+	}
+
+	return -1;
+}
+
+/**
+ * Check if statements of instruction end with return
+ */
+static BKInt nativeInstrReturns (BKInstrMask mask)
+{
+	return nativeResumeOffset (mask, 0, 0) >= 0 && mask.arg1.cmd != BKIntrRepeatStart;
+}
+
+/**
+ * Mark offsets of byte code where functions begin
+ *
+ * Instructions after one ending a function are only compiled if a function
+ * begins before them.
+ */
+static void nativeMarkFuncs (uint32_t const * words, BKUSize numWords, uint8_t * funcs)
+{
+	BKInt live = 1;
+	BKInt resume;
+	BKUSize size = 0;
+	BKInstrMask mask;
+
+	memset (funcs, 0, numWords + 1);
+	funcs [0] = 1;
+
+	for (BKUSize i = 0; i < numWords; i += size) {
+		size = nativeInstrSize (&words [i], numWords - i);
+		live |= funcs [i];
+
+		if (!live) {
+			continue;
+		}
+
+		mask = nativeInstr (&words [i], size);
+
+		if ((resume = nativeResumeOffset (mask, i, size)) >= 0) {
+			funcs [resume] = 1;
+		}
+
+		if (nativeInstrReturns (mask)) {
+			live = 0;
+		}
+	}
+
+	// byte code ends without jump
+	if (live) {
+		funcs [numWords] = 1;
+	}
+}
+
+static void nativeWriteTicks (BKString * out, char const * cmd, BKInt ticks, BKInt divisor)
+{
+	BKStringAppendFormat (out, "\tBKTKInstrTicksEvent (interpreter, %s, %d, %d);\n", cmd, ticks, divisor);
+}
+
+static void nativeWriteAttr (BKString * out, char const * attr, BKInt value)
+{
+	BKStringAppendFormat (out, "\tBKTKTrackSetAttr (ctx, %s, %d, 0);\n", attr, value);
+}
+
+/**
+ * Write statements of a single instruction
+ *
+ * `numWords` is the number of words left in the block.
+ * `prefix` is the name of the functions of the block; functions are named
+ * after the offset where they begin. Calls continue directly in the function
+ * of the group, as the track of a local group is the track of the block.
+ */
+static void nativeWriteInstr (BKString * out, char const * name, char const * prefix, BKTKContext const * ctx, BKInt trackIdx, uint32_t const * words, BKUSize numWords, BKUSize size, BKUSize offset)
+{
+	BKInstrMask mask = (BKInstrMask) {.value = words [0]};
+	BKInt value = mask.arg1.arg1;
+	BKInt ticks = mask.arg2.arg1;
+	BKInt divisor = mask.arg2.arg2;
+	BKInt wide [5] = {0};
+	BKInt isWide = 0;
+	BKUSize next = offset + size;
+	BKUSize groupWords;
+	BKTKTrack * track = NULL;
+	BKInt targetIdx;
+	BKInt groupIdx;
+	BKInt lineno = 0;
+
+	// operands of wide instruction replace the fields of the wrapped one
+	if (mask.arg1.cmd == BKIntrWide) {
+		for (BKInt i = 0; i < BKMin (value, 5); i ++) {
+			wide [i] = nativeArg (words, size, 2 + i).arg1.arg1;
+		}
+
+		mask = nativeArg (words, size, 1);
+		value = mask.arg1.arg1;
+		ticks = wide [0];
+		divisor = wide [1];
+		isWide = 1;
+	}
+
+	switch (mask.arg1.cmd) {
+		case BKIntrAttack: {
+			BKStringAppendFormat (out, "\tBKTKInstrAttack (interpreter, ctx, %d, 0);\n", nativePitch (value));
+			break;
+		}
+		case BKIntrArpeggio: {
+			BKStringAppendFormat (out, "\tBKTKInstrArpeggio (interpreter, ctx, %sArpeggios [%d], 0);\n", name, value);
+			break;
+		}
+		case BKIntrArpeggioSpeed: {
+			if (value <= 0) {
+				BKStringAppend (out, "\tBKTKTrackSetAttr (ctx, BK_ARPEGGIO_DIVIDER, BK_DEFAULT_ARPEGGIO_DIVIDER, 0);\n");
+			}
+			else {
+				nativeWriteAttr (out, "BK_ARPEGGIO_DIVIDER", value);
+			}
+			break;
+		}
+		case BKIntrRelease: {
+			BKStringAppend (out, "\tBKTKInstrRelease (interpreter, ctx, BK_NOTE_RELEASE, 0);\n");
+			break;
+		}
+		case BKIntrMute: {
+			BKStringAppend (out, "\tBKTKInstrRelease (interpreter, ctx, BK_NOTE_MUTE, 0);\n");
+			break;
+		}
+		case BKIntrVolume: {
+			nativeWriteAttr (out, "BK_VOLUME", value);
+			break;
+		}
+		case BKIntrMasterVolume: {
+			nativeWriteAttr (out, "BK_MASTER_VOLUME", value);
+			break;
+		}
+		case BKIntrPanning: {
+			nativeWriteAttr (out, "BK_PANNING", value);
+			break;
+		}
+		case BKIntrPitch: {
+			nativeWriteAttr (out, "BK_PITCH", nativePitch (value));
+			break;
+		}
+		case BKIntrDutyCycle: {
+			nativeWriteAttr (out, "BK_DUTY_CYCLE", value);
+			break;
+		}
+		case BKIntrPhaseWrap: {
+			nativeWriteAttr (out, "BK_PHASE_WRAP", value);
+			break;
+		}
+		case BKIntrSampleRepeat: {
+			nativeWriteAttr (out, "BK_SAMPLE_REPEAT", value);
+			break;
+		}
+		case BKIntrPulseKernel: {
+			BKStringAppendFormat (out, "\tBKTKTrackSetPulseKernel (ctx, %d, 0);\n", value);
+			break;
+		}
+		case BKIntrAttackTicks: {
+			nativeWriteTicks (out, "BKIntrAttackTicks", ticks, divisor);
+			break;
+		}
+		case BKIntrReleaseTicks: {
+			nativeWriteTicks (out, "BKIntrReleaseTicks", ticks, divisor);
+			break;
+		}
+		case BKIntrMuteTicks: {
+			nativeWriteTicks (out, "BKIntrMuteTicks", ticks, divisor);
+			break;
+		}
+		case BKIntrTicks: {
+			nativeWriteTicks (out, "BKIntrTicks", ticks, divisor);
+			BKStringAppendFormat (out, "\t*next = (void *) %s_%zu;\n\n\treturn BKTKNativeResultStep;\n", prefix, (size_t) next);
+			break;
+		}
+		case BKIntrStep: {
+			BKStringAppendFormat (out, "\tBKTKInstrStep (interpreter, %d);\n", value);
+			BKStringAppendFormat (out, "\t*next = (void *) %s_%zu;\n\n\treturn BKTKNativeResultStep;\n", prefix, (size_t) next);
+			break;
+		}
+		case BKIntrStepTicks: {
+			BKStringAppendFormat (out, "\tBKTKInstrStepTicks (ctx, %d);\n", value);
+			break;
+		}
+		case BKIntrStepTicksTrack: {
+			BKStringAppendFormat (out, "\tinterpreter -> stepTickCount = %d;\n", value);
+			break;
+		}
+		case BKIntrTickRate: {
+			if (mask.arg2.arg2) {
+				BKStringAppendFormat (out, "\tBKTKInstrTickRate (interpreter, ctx, %d, %d, 0);\n", mask.arg2.arg1, mask.arg2.arg2);
+			}
+			break;
+		}
+		case BKIntrEffect: {
+			BKInstrMask arg0 = nativeArg (words, size, 1);
+			BKInstrMask arg1 = nativeArg (words, size, 2);
+			BKInstrMask arg2 = nativeArg (words, size, 3);
+			BKInt args [5] = {arg0.arg2.arg1, arg1.arg1.arg1, arg2.arg2.arg1, arg0.arg2.arg2, arg2.arg2.arg2};
+
+			if (isWide) {
+				args [0] = wide [0];
+				args [1] = wide [2];
+				args [2] = wide [3];
+				args [3] = wide [1];
+				args [4] = wide [4];
+			}
+
+			BKStringAppendFormat (out, "\t{\n\t\tstatic BKInt const args [5] = {%d, %d, %d, %d, %d};\n",
+				args [0], args [1], args [2], args [3], args [4]);
+			BKStringAppendFormat (out, "\t\tBKTKInstrEffect (interpreter, ctx, %d, args, 0);\n\t}\n", value);
+			break;
+		}
+		case BKIntrInstrument: {
+			BKStringAppendFormat (out, "\tBKTKTrackSetObject (ctx, BK_INSTRUMENT, %d, 0);\n", value);
+			break;
+		}
+		case BKIntrWaveform: {
+			BKStringAppendFormat (out, "\tBKTKInstrWaveform (ctx, %d, 0);\n", value);
+			break;
+		}
+		case BKIntrSample: {
+			BKStringAppendFormat (out, "\tBKTKInstrSample (ctx, %d, 0);\n", value);
+			break;
+		}
+		case BKIntrSampleRange:
+		case BKIntrSampleSustainRange: {
+			BKStringAppendFormat (out, "\t{\n\t\tBKInt range [2] = {%d, %d};\n",
+				nativeArg (words, size, 1).arg1.arg1, nativeArg (words, size, 2).arg1.arg1);
+			BKStringAppendFormat (out, "\t\tBKTKTrackSetData (ctx, %s, range, 2, 0);\n\t}\n",
+				mask.arg1.cmd == BKIntrSampleRange ? "BK_SAMPLE_RANGE" : "BK_SAMPLE_SUSTAIN_RANGE");
+			break;
+		}
+		case BKIntrReturn: {
+			BKStringAppendFormat (out, "\treturn BKTKNativeReturn (interpreter, %s_%zu, next);\n", prefix, (size_t) next);
+			break;
+		}
+		case BKIntrCall: {
+			groupIdx = isWide ? wide [0] : mask.grp.idx1;
+			targetIdx = trackIdx;
+
+			if (mask.grp.type == BKGroupIndexTypeGlobal) {
+				targetIdx = 0;
+			}
+			else if (mask.grp.type == BKGroupIndexTypeTrack) {
+				targetIdx = isWide ? wide [1] : mask.grp.idx2;
+			}
+
+			if (targetIdx >= 0 && (BKUSize) targetIdx < ctx -> tracks.len) {
+				track = *(BKTKTrack **) BKArrayItemAt (&ctx -> tracks, targetIdx);
+			}
+
+			// group does not exist
+			if (!track || groupIdx < 0 || !nativeBlockCode (track, groupIdx, &groupWords)) {
+				BKStringAppendFormat (out, "\treturn %s_%zu (interpreter, ctx, flags, next);\n", prefix, (size_t) next);
+				break;
+			}
+
+			// word after call is base of relative lines in outlined group
+			if (size < numWords) {
+				lineno = ((BKInstrMask) {.value = words [size]}).arg1.arg1;
+			}
+
+			BKStringAppendFormat (out, "\tif (BKTKNativeCall (interpreter, %s_%zu, %d, %d)) {\n\t\treturn %sT%dG%d_0 (interpreter, ctx, flags, next);\n\t}\n\n",
+				prefix, (size_t) next, track -> object.index, lineno, name, targetIdx, groupIdx);
+			BKStringAppendFormat (out, "\treturn %s_%zu (interpreter, ctx, flags, next);\n", prefix, (size_t) next);
+			break;
+		}
+		case BKIntrRepeatStart: {
+			BKStringAppendFormat (out, "\tinterpreter -> repeatStartAddr = (uintptr_t) %s_%zu;\n", prefix, (size_t) next);
+			break;
+		}
+		case BKIntrJump: {
+			// jump to repeat mark; other jumps are unused
+			if (value == -1) {
+				BKStringAppendFormat (out, "\treturn BKTKNativeRepeat (interpreter, flags, %s_%zu, next);\n", prefix, (size_t) next);
+			}
+			break;
+		}
+		case BKIntrEnd: {
+			// repeat command forever
+			BKStringAppendFormat (out, "\tBKTKInstrEnd (interpreter, flags);\n\t*next = (void *) %s_%zu;\n\n\treturn BKTKNativeResultEnd;\n", prefix, (size_t) offset);
+			break;
+		}
+		case BKIntrLineNo: {
+			if (value & BK_INTR_RELATIVE_LINE_FLAG) {
+				BKStringAppendFormat (out, "\tBKTKNativeLineNo (interpreter, %d);\n", value);
+			}
+			else {
+				BKStringAppendFormat (out, "\tBKTKInstrLineNo (interpreter, %d);\n", value);
+			}
+			break;
+		}
+	}
+}
+
+/**
+ * Write constant pool of arpeggios referenced by index
+ */
+static void nativeWriteArpeggios (BKString * out, char const * name, BKArray const * arpeggios)
+{
+	BKTKArpeggio const * arpeggio;
+
+	if (!arpeggios -> len) {
+		return;
+	}
+
+	BKStringAppendFormat (out, "static BKInt const %sArpeggios [][1 + BK_MAX_ARPEGGIO] =\n{\n", name);
+
+	for (BKUSize i = 0; i < arpeggios -> len; i ++) {
+		arpeggio = BKArrayItemAt (arpeggios, i);
+		BKStringAppend (out, "\t{");
+
+		for (BKInt j = 0; j < 1 + BK_MAX_ARPEGGIO; j ++) {
+			BKStringAppendFormat (out, j ? ", %d" : "%d", arpeggio -> values [j]);
+		}
+
+		BKStringAppend (out, "},\n");
+	}
+
+	BKStringAppend (out, "};\n\n");
+}
+
+/**
+ * Write functions of byte code of a track or group
+ *
+ * Prototypes are written to `decls` as functions call functions of other
+ * blocks. A function falling through continues in the next one.
+ */
+static BKInt nativeWriteBlock (BKString * out, BKString * decls, char const * name, BKTKContext const * ctx, BKInt trackIdx, BKInt groupIdx, uint32_t const * words, BKUSize numWords)
+{
+	BKUSize size = 0;
+	BKInt open = 0;
+	BKInt live = 0;
+	BKInstrMask mask;
+	BKString prefix = BK_STRING_INIT;
+	uint8_t * funcs = malloc (numWords + 1);
+
+	if (groupIdx < 0) {
+		BKStringAppendFormat (&prefix, "%sT%d", name, trackIdx);
+	}
+	else {
+		BKStringAppendFormat (&prefix, "%sT%dG%d", name, trackIdx, groupIdx);
+	}
+
+	if (!funcs || !prefix.str) {
+		free (funcs);
+		BKStringDispose (&prefix);
+		return BK_ALLOCATION_ERROR;
+	}
+
+	nativeMarkFuncs (words, numWords, funcs);
+
+	for (BKUSize i = 0; i <= numWords; i += size) {
+		if (funcs [i]) {
+			if (live) {
+				BKStringAppendFormat (out, "\n\treturn %s_%zu (interpreter, ctx, flags, next);\n", prefix.str, (size_t) i);
+			}
+
+			if (open) {
+				BKStringAppend (out, "}\n\n");
+			}
+
+			BKStringAppendFormat (decls, "static BKInt %s_%zu (BKTKInterpreter * interpreter, BKTKTrack * ctx, BKUInt * flags, void ** next);\n", prefix.str, (size_t) i);
+			BKStringAppendFormat (out, "static BKInt %s_%zu (BKTKInterpreter * interpreter, BKTKTrack * ctx, BKUInt * flags, void ** next)\n{\n", prefix.str, (size_t) i);
+			open = 1;
+			live = 1;
+		}
+
+		if (i == numWords) {
+			break;
+		}
+
+		size = nativeInstrSize (&words [i], numWords - i);
+
+		if (!live) {
+			continue;
+		}
+
+		mask = nativeInstr (&words [i], size);
+		BKStringAppendFormat (out, "\t// %s\n", BKTKInterpreterInstrName (mask.arg1.cmd));
+		nativeWriteInstr (out, name, (char const *) prefix.str, ctx, trackIdx, &words [i], numWords - i, size, i);
+
+		if (nativeInstrReturns (mask)) {
+			live = 0;
+		}
+	}
+
+	if (live) {
+		BKStringAppendFormat (out, "\t// byte code ends without jump\n\tBKTKInstrEnd (interpreter, flags);\n\t*next = (void *) %s_%zu;\n\n\treturn BKTKNativeResultEnd;\n", prefix.str, (size_t) numWords);
+	}
+
+	BKStringAppend (out, "}\n\n");
+
+	free (funcs);
+	BKStringDispose (&prefix);
+
+	return 0;
+}
+
+BKInt BKTKNativeWrite (BKTKContext const * ctx, char const * name, BKTKWriterWriteFunc write, void * userInfo)
+{
+	BKInt res = 0;
+	BKUSize numWords;
+	BKUSize numBlocks = 0;
+	BKTKTrack * track;
+	uint32_t const * words;
+	BKString out = BK_STRING_INIT;
+	BKString decls = BK_STRING_INIT;
+	BKString table = BK_STRING_INIT;
+
+	BKStringAppend (&decls, "// Generated from byte code. Do not edit.\n\n#include \"BKTKNative.h\"\n\n");
+	nativeWriteArpeggios (&decls, name, &ctx -> arpeggios);
+	BKStringAppendFormat (&table, "static BKTKNativeBlock const %sBlocks [] =\n{\n", name);
+
+	for (BKUSize i = 0; i < ctx -> tracks.len; i ++) {
+		track = *(BKTKTrack **) BKArrayItemAt (&ctx -> tracks, i);
+
+		if (!track) {
+			continue;
+		}
+
+		// byte code of track has group index -1
+		for (BKInt j = -1; j < (BKInt) track -> code -> groups.len; j ++) {
+			words = nativeBlockCode (track, j, &numWords);
+
+			if (!words) {
+				continue;
+			}
+
+			if ((res = nativeWriteBlock (&out, &decls, name, ctx, (BKInt) i, j, words, numWords)) != 0) {
+				goto cleanup;
+			}
+
+			BKStringAppendFormat (&table, "\t{%zu, %d, %zu, 0x%016llXULL, %sT%zu", (size_t) i, j, (size_t) numWords, (unsigned long long) nativeHash (words, numWords), name, (size_t) i);
+			BKStringAppendFormat (&table, j < 0 ? "_0},\n" : "G%d_0},\n", j);
+			numBlocks ++;
+		}
+	}
+
+	BKStringAppend (&decls, "\n");
+	BKStringAppend (&table, "};\n\n");
+	BKStringAppendFormat (&table, "BKTKNativeSong const %s =\n{\n\t.numBlocks = %zu,\n\t.blocks    = %sBlocks,\n};\n", name, (size_t) numBlocks, name);
+
+	if (!out.str || !decls.str || !table.str) {
+		res = BK_ALLOCATION_ERROR;
+		goto cleanup;
+	}
+
+	if ((res = write (userInfo, decls.str, decls.len)) != 0 || (res = write (userInfo, out.str, out.len)) != 0) {
+		goto cleanup;
+	}
+
+	res = write (userInfo, table.str, table.len);
+
+	cleanup: {
+		BKStringDispose (&out);
+		BKStringDispose (&decls);
+		BKStringDispose (&table);
+
+		return res;
+	}
+}
+
+BKInt BKTKContextSetNativeSong (BKTKContext * ctx, BKTKNativeSong const * song)
+{
+	BKUSize numWords;
+	BKUSize numBlocks = 0;
+	BKTKTrack * track;
+	BKTKNativeBlock const * block;
+	uint32_t const * words;
+	void ** entries;
+
+	for (BKUSize i = 0; i < ctx -> tracks.len; i ++) {
+		track = *(BKTKTrack **) BKArrayItemAt (&ctx -> tracks, i);
+
+		if (!track) {
+			continue;
+		}
+
+		for (BKInt j = -1; j < (BKInt) track -> code -> groups.len; j ++) {
+			numBlocks += nativeBlockCode (track, j, &numWords) != NULL;
+		}
+	}
+
+	// every block has to be generated from the same byte code
+	if (numBlocks != song -> numBlocks) {
+		return BK_INVALID_VALUE;
+	}
+
+	entries = BKTKArenaAlloc (&ctx -> arena, ctx -> tracks.len * sizeof (*entries));
+
+	if (!entries && ctx -> tracks.len) {
+		return BK_ALLOCATION_ERROR;
+	}
+
+	memset (entries, 0, ctx -> tracks.len * sizeof (*entries));
+
+	for (BKUSize i = 0; i < numBlocks; i ++) {
+		block = &song -> blocks [i];
+		track = NULL;
+		words = NULL;
+
+		if (block -> track >= 0 && (BKUSize) block -> track < ctx -> tracks.len) {
+			track = *(BKTKTrack **) BKArrayItemAt (&ctx -> tracks, block -> track);
+		}
+
+		if (track) {
+			words = nativeBlockCode (track, block -> group, &numWords);
+		}
+
+		if (!words || numWords != block -> numWords || nativeHash (words, numWords) != block -> hash) {
+			return BK_INVALID_VALUE;
+		}
+
+		if (block -> group < 0) {
+			entries [block -> track] = (void *) block -> func;
+		}
+	}
+
+	ctx -> nativeEntries = entries;
+	BKTKContextReset (ctx);
+
+	return 0;
+}
+
+BKInt BKTKNativeAdvance (BKTKInterpreter * interpreter, BKTKTrack * ctx, void ** opcodePtr, BKUInt * flags, BKInt * outTicks)
+{
+	BKInt res;
+
+	if (BKTKInterpreterAdvanceEvents (interpreter, ctx, outTicks)) {
+		return 1;
+	}
+
+	do {
+		res = ((BKTKNativeFunc) *opcodePtr) (interpreter, ctx, flags, opcodePtr);
+	}
+	while (res == BKTKNativeResultJump);
+
+	BKTKInterpreterEndAdvance (interpreter, outTicks);
+
+	return res != BKTKNativeResultEnd;
+}
@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2012-2016 Simon Schoenenberger
+ * http://blipkit.audio
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _BK_TK_NATIVE_H_
+#define _BK_TK_NATIVE_H_
+
+#include "BKTKContext.h"
+#include "BKTKInterpreter.h"
+#include "BKTKInstr.h"
+#include "BKTKWriter.h"
+
+typedef struct BKTKNativeBlock BKTKNativeBlock;
+typedef struct BKTKNativeSong BKTKNativeSong;
+
+/**
+ * Result of native function
+ */
+enum BKTKNativeResult
+{
+	BKTKNativeResultJump = 0, // continue at `*next`
+	BKTKNativeResultStep = 1, // wait for next event
+	BKTKNativeResultEnd  = 2, // track has stopped
+};
+
+/**
+ * Executes instructions of a track or group up to the next step
+ *
+ * Byte code is split into functions at every position where execution can
+ * continue after a step, a call or a jump. Instructions are compiled into
+ * plain calls with constant arguments, so the byte code is not read. `*next`
+ * is set to the function where execution continues. `flags` is passed from
+ * `BKTKNativeAdvance`.
+ */
+typedef BKInt (* BKTKNativeFunc) (BKTKInterpreter * interpreter, BKTKTrack * ctx, BKUInt * flags, void ** next);
+
+/**
+ * Functions generated from byte code of a track or group
+ *
+ * `group` is -1 for the byte code of the track itself. `func` is the
+ * function of the first instruction.
+ */
+struct BKTKNativeBlock
+{
+	BKInt          track;
+	BKInt          group;
+	BKUSize        numWords;
+	uint64_t       hash;
+	BKTKNativeFunc func;
+};
+
+/**
+ * Table of generated functions of a song
+ */
+struct BKTKNativeSong
+{
+	BKUSize                 numBlocks;
+	BKTKNativeBlock const * blocks;
+};
+
+/**
+ * Write C source of native functions for byte code of context
+ *
+ * Defines a `BKTKNativeSong` with the given `name`, which must be a valid C
+ * identifier. The generated code has to be compiled with the same version of
+ * the parser library.
+ */
+extern BKInt BKTKNativeWrite (BKTKContext const * ctx, char const * name, BKTKWriterWriteFunc write, void * userInfo);
+
+/**
+ * Execute tracks of context with native functions of `song`
+ *
+ * Checks that `song` was generated from the same byte code. Returns
+ * `BK_INVALID_VALUE` otherwise and the interpreter is used. Has to be set
+ * before the context is played and tracks cannot be appended with
+ * `BKTKContextAppend` afterwards. Resets the context.
+ */
+extern BKInt BKTKContextSetNativeSong (BKTKContext * ctx, BKTKNativeSong const * song);
+
+/**
+ * Replaces `BKTKInterpreterAdvance` when native functions are set
+ *
+ * `*opcodePtr` is the native function where the track continues.
+ * Instructions are not counted when profiling.
+ */
+extern BKInt BKTKNativeAdvance (BKTKInterpreter * interpreter, BKTKTrack * ctx, void ** opcodePtr, BKUInt * flags, BKInt * outTicks);
+
+/**
+ * Push `next` as return address of a call to a group of track `trackIdx`
+ *
+ * `lineno` is the base of relative lines in outlined groups, which the
+ * interpreter reads from the word after the call. Returns 0 if the stack is
+ * full; the call is skipped then.
+ */
+BK_INLINE BKInt BKTKNativeCall (BKTKInterpreter * interpreter, BKTKNativeFunc next, BKUInt trackIdx, BKInt lineno);
+
+/**
+ * Continue at the return address of the last call or at `next` if there is
+ * none
+ */
+BK_INLINE BKInt BKTKNativeReturn (BKTKInterpreter * interpreter, BKTKNativeFunc next, void ** outNext);
+
+/**
+ * Continue at the repeat mark or at `next` if there is none
+ */
+BK_INLINE BKInt BKTKNativeRepeat (BKTKInterpreter * interpreter, BKUInt * flags, BKTKNativeFunc next, void ** outNext);
+
+/**
+ * Set line relative to line passed by call like `BKTKInstrLineNo`
+ */
+BK_INLINE void BKTKNativeLineNo (BKTKInterpreter * interpreter, BKInt lineno);
+
+
+// --- Inline implementations
+
+BK_INLINE BKInt BKTKNativeCall (BKTKInterpreter * interpreter, BKTKNativeFunc next, BKUInt trackIdx, BKInt lineno)
+{
+	BKTKStackItem * item;
+
+	if (interpreter -> stackPtr >= interpreter -> stackEnd) {
+		return 0;
+	}
+
+	item = interpreter -> stackPtr ++;
+	item -> ptr = (uintptr_t) next;
+	item -> trackIdx = trackIdx;
+	item -> lineno = lineno;
+
+	return 1;
+}
+
+BK_INLINE BKInt BKTKNativeReturn (BKTKInterpreter * interpreter, BKTKNativeFunc next, void ** outNext)
+{
+	if (interpreter -> stackPtr > interpreter -> stack) {
+		next = (BKTKNativeFunc) (-- interpreter -> stackPtr) -> ptr;
+	}
+
+	*outNext = (void *) next;
+
+	return BKTKNativeResultJump;
+}
+
+BK_INLINE BKInt BKTKNativeRepeat (BKTKInterpreter * interpreter, BKUInt * flags, BKTKNativeFunc next, void ** outNext)
+{
+	if (interpreter -> repeatStartAddr) {
+		next = (BKTKNativeFunc) interpreter -> repeatStartAddr;
+		*flags |= BKTKInterpreterFlagHasRepeated;
+	}
+
+	*outNext = (void *) next;
+
+	return BKTKNativeResultJump;
+}
+
+BK_INLINE void BKTKNativeLineNo (BKTKInterpreter * interpreter, BKInt lineno)
+{
+	if (interpreter -> stackPtr > interpreter -> stack) {
+		lineno &= ~BK_INTR_RELATIVE_LINE_FLAG;
+		lineno += (interpreter -> stackPtr - 1) -> lineno;
+	}
+
+	interpreter -> lineno = lineno;
+	interpreter -> lineTime = interpreter -> time;
+}
+
+#endif /* ! _BK_TK_NATIVE_H_ */
@@ -22,6 +22,7 @@
  */
 
 #include "BKTKParser.h"
+#include "BKTKStats.h"
 
 #define STACK_INIT_SIZE 32
 #define BUFFER_INIT_SIZE 4096
@@ -33,6 +34,7 @@
 #define SIZE_ROUND_UP(size) (((size) + PTR_MASK) & ~PTR_MASK)
 
 extern BKClass const BKTKParserClass;
+extern BKClass const BKTKParserFlatTreeClass;
 
 BKInt BKTKParserInit (BKTKParser * parser)
 {
@@ -42,6 +44,10 @@ BKInt BKTKParserInit (BKTKParser * parser)
 		return res;
 	}
 
+	if ((res = BKTKSymbolTableInit (&parser -> symbols)) != 0) {
+		return res;
+	}
+
 	parser -> stackCapacity = STACK_INIT_SIZE;
 	parser -> stack = malloc (parser -> stackCapacity * sizeof (*parser -> stack));
 
@@ -49,6 +55,8 @@ BKInt BKTKParserInit (BKTKParser * parser)
 		goto error;
 	}
 
+	BKTKStatsCountAlloc (BKTKStatsTypeParser, parser -> stackCapacity * sizeof (*parser -> stack));
+
 	parser -> bufferCap = BUFFER_INIT_SIZE;
 	parser -> buffer = malloc (parser -> bufferCap * sizeof (*parser -> buffer));
 
@@ -56,6 +64,8 @@ BKInt BKTKParserInit (BKTKParser * parser)
 		goto error;
 	}
 
+	BKTKStatsCountAlloc (BKTKStatsTypeParser, parser -> bufferCap * sizeof (*parser -> buffer));
+
 	parser -> argLengthsCapacity = ARGS_LEN_INIT_SIZE;
 	parser -> argCursors = malloc (parser -> argLengthsCapacity * sizeof (*parser -> argCursors));
 
@@ -63,24 +73,32 @@ BKInt BKTKParserInit (BKTKParser * parser)
 		goto error;
 	}
 
+	BKTKStatsCountAlloc (BKTKStatsTypeParser, parser -> argLengthsCapacity * sizeof (*parser -> argCursors));
+
 	parser -> argLengths = malloc (parser -> argLengthsCapacity * sizeof (*parser -> argLengths));
 
 	if (!parser -> argLengths) {
 		goto error;
 	}
 
+	BKTKStatsCountAlloc (BKTKStatsTypeParser, parser -> argLengthsCapacity * sizeof (*parser -> argLengths));
+
 	parser -> argTypes = malloc (parser -> argLengthsCapacity * sizeof (*parser -> argTypes));
 
 	if (!parser -> argTypes) {
 		goto error;
 	}
 
+	BKTKStatsCountAlloc (BKTKStatsTypeParser, parser -> argLengthsCapacity * sizeof (*parser -> argTypes));
+
 	parser -> argOffsets = malloc (parser -> argLengthsCapacity * sizeof (*parser -> argOffsets));
 
 	if (!parser -> argOffsets) {
 		goto error;
 	}
 
+	BKTKStatsCountAlloc (BKTKStatsTypeParser, parser -> argLengthsCapacity * sizeof (*parser -> argOffsets));
+
 	if ((res = BKBlockPoolInit (&parser -> blockPool, sizeof (BKTKParserNode), BLOCK_POOL_SEGMENT_CAPACITY)) != 0) {
 		goto error;
 	}
@@ -89,6 +107,9 @@ BKInt BKTKParserInit (BKTKParser * parser)
 		goto error;
 	}
 
+	parser -> nodes       = BK_TK_ARENA_INIT (BKTKStatsTypeParser);
+	parser -> putNode     = NULL;
+	parser -> putNodeArg  = NULL;
 	BKTKParserReset (parser);
 	parser -> escapedName = BK_STRING_INIT;
 
@@ -106,22 +127,52 @@ BKInt BKTKParserInit (BKTKParser * parser)
  */
 static BKInt BKTKParserNodeEnsureAlloc (BKTKParser * parser)
 {
+	if (parser -> putNode) {
+		return BKTKArenaReserve (&parser -> nodes, sizeof (BKTKParserNode));
+	}
+
 	return BKBlockPoolEnsureBlock(&parser -> blockPool);
 }
 
+/**
+ * Allocate node
+ *
+ * Nodes passed to `putNode` are allocated in `nodes`, so they can be kept
+ * by moving the arena.
+ */
 static BKTKParserNode * BKTKParserNodeAlloc (BKTKParser * parser)
 {
-	return BKBlockPoolAlloc (&parser -> blockPool);
+	BKTKParserNode * node;
+
+	if (parser -> putNode) {
+		node = BKTKArenaAlloc (&parser -> nodes, sizeof (BKTKParserNode));
+
+		if (node) {
+			node -> flags = BKTKParserFlagInArena;
+		}
+
+		return node;
+	}
+
+	node = BKBlockPoolAlloc (&parser -> blockPool);
+
+	if (node) {
+		BKTKStatsCountAlloc (BKTKStatsTypeParser, sizeof (BKTKParserNode));
+	}
+
+	return node;
 }
 
 static void BKTKParserNodeFree (BKTKParser * parser, BKTKParserNode * node)
 {
-	BKBlockPoolFree (&parser -> blockPool, node);
+	if (!(node -> flags & BKTKParserFlagInArena)) {
+		BKBlockPoolFree (&parser -> blockPool, node);
+	}
 }
 
 static void BKTKParserNodeFreeArgs (BKTKParserNode * node)
 {
-	if (!(node -> flags & BKTKParserFlagDataIsBlock)) {
+	if (!(node -> flags & (BKTKParserFlagDataIsBlock | BKTKParserFlagInArena))) {
 		BKStringDispose (&node -> name);
 	}
 }
@@ -138,16 +189,20 @@ static void BKTKParserNodeTransferArgs (BKTKParserNode * target, BKTKParserNode
 	// do not transfer group flag
 	target -> flags = (target -> flags & BKTKParserFlagIsGroup) | (source -> flags & ~BKTKParserFlagIsGroup);
 	target -> name = source -> name;
+	target -> nameSymbol = source -> nameSymbol;
 	target -> argCount = source -> argCount;
 	target -> args = source -> args;
+	target -> argSymbols = source -> argSymbols;
 	target -> argTypes = source -> argTypes;
 	target -> offset = source -> offset;
 	target -> argOffsets = source -> argOffsets;
 	target -> type = source -> type;
 
 	source -> name = BK_STRING_INIT;
+	source -> nameSymbol = 0;
 	source -> argCount = 0;
 	source -> args = NULL;
+	source -> argSymbols = NULL;
 	source -> argTypes = NULL;
 	source -> offset = source -> offset;
 	source -> argOffsets = NULL;
@@ -168,6 +223,8 @@ static BKInt BKTKParserBufferEnsureSpace (BKTKParser * parser, BKUSize addSize)
 			return -1;
 		}
 
+		BKTKStatsCountAlloc (BKTKStatsTypeParser, newCapacity);
+
 		parser -> buffer = newBuffer;
 		parser -> bufferCap = newCapacity;
 	}
@@ -175,20 +232,22 @@ static BKInt BKTKParserBufferEnsureSpace (BKTKParser * parser, BKUSize addSize)
 	return 0;
 }
 
-static BKInt BKTKParserStackEnsureSpace (BKTKParser * parser)
+static BKInt BKTKParserStackEnsureSpace (BKTKParser * parser, BKUSize addCount)
 {
 	BKTKParserItem * newBuffer;
 	BKUSize newCapacity;
 	BKUSize const minAddCap = 16;
 
-	if (parser -> stackSize + minAddCap >= parser -> stackCapacity) {
-		newCapacity = BKNextPow2 (parser -> stackSize + minAddCap);
+	if (parser -> stackSize + addCount + minAddCap >= parser -> stackCapacity) {
+		newCapacity = BKNextPow2 (parser -> stackSize + addCount + minAddCap);
 		newBuffer = realloc (parser -> stack, newCapacity * sizeof (*newBuffer));
 
 		if (!newBuffer) {
 			return -1;
 		}
 
+		BKTKStatsCountAlloc (BKTKStatsTypeParser, newCapacity * sizeof (*newBuffer));
+
 		parser -> stack = newBuffer;
 		parser -> stackCapacity = newCapacity;
 	}
@@ -196,22 +255,25 @@ static BKInt BKTKParserStackEnsureSpace (BKTKParser * parser)
 	return 0;
 }
 
-static BKInt BKTKParserArgsEnsureSpace (BKTKParser * parser)
+static BKInt BKTKParserArgsEnsureSpace (BKTKParser * parser, BKUSize addCount)
 {
 	BKUSize * newLengths;
 	BKUSize * newArgCursors;
 	BKTKType * newArgTypes;
+	BKTKOffset * newArgOffsets;
 	BKUSize newCapacity;
 	BKUSize const minAddCap = 16;
 
-	if (parser -> argCount + minAddCap >= parser -> argLengthsCapacity) {
-		newCapacity = BKNextPow2 (parser -> argCount + minAddCap);
+	if (parser -> argCount + addCount + minAddCap >= parser -> argLengthsCapacity) {
+		newCapacity = BKNextPow2 (parser -> argCount + addCount + minAddCap);
 		newLengths = realloc (parser -> argLengths, newCapacity * sizeof (*newLengths));
 
 		if (!newLengths) {
 			return -1;
 		}
 
+		BKTKStatsCountAlloc (BKTKStatsTypeParser, newCapacity * sizeof (*newLengths));
+
 		parser -> argLengths = newLengths;
 		parser -> argLengthsCapacity = newCapacity;
 
@@ -221,6 +283,8 @@ static BKInt BKTKParserArgsEnsureSpace (BKTKParser * parser)
 			return -1;
 		}
 
+		BKTKStatsCountAlloc (BKTKStatsTypeParser, newCapacity * sizeof (*newArgCursors));
+
 		parser -> argCursors = newArgCursors;
 
 		newArgTypes = realloc (parser -> argTypes, newCapacity * sizeof (*newArgTypes));
@@ -229,7 +293,41 @@ static BKInt BKTKParserArgsEnsureSpace (BKTKParser * parser)
 			return -1;
 		}
 
+		BKTKStatsCountAlloc (BKTKStatsTypeParser, newCapacity * sizeof (*newArgTypes));
+
 		parser -> argTypes = newArgTypes;
+
+		newArgOffsets = realloc (parser -> argOffsets, newCapacity * sizeof (*newArgOffsets));
+
+		if (!newArgOffsets) {
+			return -1;
+		}
+
+		BKTKStatsCountAlloc (BKTKStatsTypeParser, newCapacity * sizeof (*newArgOffsets));
+
+		parser -> argOffsets = newArgOffsets;
+	}
+
+	return 0;
+}
+
+/**
+ * Ensure space for `count` tokens with `dataLen` bytes of data in total
+ *
+ * Each token adds at most one argument and one stack item
+ */
+static BKInt BKTKParserEnsureSpace (BKTKParser * parser, BKUSize dataLen, BKUSize count)
+{
+	if (BKTKParserBufferEnsureSpace (parser, dataLen + count * (PTR_MASK + 1)) != 0) {
+		return -1;
+	}
+
+	if (BKTKParserStackEnsureSpace (parser, count) != 0) {
+		return -1;
+	}
+
+	if (BKTKParserArgsEnsureSpace (parser, count) != 0) {
+		return -1;
 	}
 
 	return 0;
@@ -354,6 +452,35 @@ static void BKTKParserFreeNodes (BKTKParserNode * node)
 	}
 }
 
+/**
+ * Pass completed top-level node to `putNode` and free it
+ *
+ * The node is completed if it is the only item on the stack besides the root
+ * and no group is open.
+ */
+static BKInt BKTKParserEmitNode (BKTKParser * parser)
+{
+	BKInt res;
+	BKTKParserNode * node;
+
+	if (!parser -> putNode || parser -> stackSize != 2 || !parser -> itemCount) {
+		return 0;
+	}
+
+	node = BKTKParserStackPop (parser) -> node;
+
+	// next top-level node is linked as first sub node of root again
+	parser -> rootNode.subNode = NULL;
+	parser -> itemCount = 0;
+
+	res = parser -> putNode (parser -> putNodeArg, node, &parser -> nodes);
+
+	// allocations may have been moved to keep the node
+	BKTKArenaClear (&parser -> nodes);
+
+	return res;
+}
+
 void BKTKParserReset (BKTKParser * parser)
 {
 	BKTKParserItem * item;
@@ -363,6 +490,8 @@ void BKTKParserReset (BKTKParser * parser)
 		BKTKParserFreeNodes (item -> node);
 	}
 
+	BKTKArenaClear (&parser -> nodes);
+
 	parser -> state     = BKTKParserStateRoot;
 	parser -> stackSize = 0;
 	parser -> bufferLen = 0;
@@ -391,10 +520,13 @@ static void BKTKParserDispose (BKTKParser * parser)
 	free (parser -> argLengths);
 	free (parser -> argCursors);
 	free (parser -> argTypes);
+	free (parser -> argOffsets);
 
 	BKBlockPoolDispose (&parser -> blockPool);
 	BKBlockPoolDispose (&parser -> argsPool);
+	BKTKArenaDispose (&parser -> nodes);
 	BKStringDispose (&parser -> escapedName);
+	BKDispose (&parser -> symbols);
 }
 
 static BKTKType BKTKParserGetSimpleType (BKTKType type)
@@ -476,6 +608,34 @@ static void BKTKParserBeginCmd (BKTKParser * parser, BKTKToken const * token)
 	BKTKParserPushArg (parser, token);
 }
 
+/**
+ * Intern name and arguments of node
+ */
+static BKInt BKTKParserInternSymbols (BKTKParser * parser, BKTKParserNode * node)
+{
+	BKInt res;
+
+	if (node -> type == BKTKTypeComment) {
+		return 0;
+	}
+
+	if ((res = BKTKSymbolTableIntern (&parser -> symbols, node -> name.str, node -> name.len, &node -> nameSymbol)) != 0) {
+		return res;
+	}
+
+	for (BKUSize i = 0; i < node -> argCount; i ++) {
+		if (node -> argTypes [i] == BKTKTypeData) {
+			continue;
+		}
+
+		if ((res = BKTKSymbolTableIntern (&parser -> symbols, node -> args [i].str, node -> args [i].len, &node -> argSymbols [i])) != 0) {
+			return res;
+		}
+	}
+
+	return 0;
+}
+
 /**
  * Pack buffered arguments of current node
  *
@@ -483,11 +643,13 @@ static void BKTKParserBeginCmd (BKTKParser * parser, BKTKToken const * token)
  */
 static BKInt BKTKParserEndCommand (BKTKParser * parser)
 {
+	BKInt res;
 	uint8_t * buffer;
 	BKString * args;
 	BKTKType * argTypes;
 	BKTKOffset * argOffsets;
-	BKUSize bufferSize, argsSize, argTypesSize, argOffsetsSize;
+	BKUInt * argSymbols;
+	BKUSize bufferSize, argsSize, argTypesSize, argOffsetsSize, argSymbolsSize;
 	BKTKParserNode * node;
 	BKUSize size;
 
@@ -502,11 +664,15 @@ static BKInt BKTKParserEndCommand (BKTKParser * parser)
 		argsSize       = (parser -> argCount - 1) * sizeof (BKString);
 		argTypesSize   = (parser -> argCount - 1) * sizeof (*parser -> argTypes);
 		argOffsetsSize = (parser -> argCount - 1) * sizeof (*parser -> argOffsets);
+		argSymbolsSize = (parser -> argCount - 1) * sizeof (*argSymbols);
 
-		size = bufferSize + argsSize + argTypesSize + argOffsetsSize;
+		size = bufferSize + argsSize + argTypesSize + argOffsetsSize + argSymbolsSize;
 
+		if (node -> flags & BKTKParserFlagInArena) {
+			buffer = BKTKArenaAlloc (&parser -> nodes, size);
+		}
 		// most commands require less than ARGS_POOL_SEGMENT_SIZE bytes
-		if (size <= ARGS_POOL_SEGMENT_SIZE) {
+		else if (size <= ARGS_POOL_SEGMENT_SIZE) {
 			buffer = BKBlockPoolAlloc (&parser -> argsPool);
 			node -> flags |= BKTKParserFlagDataIsBlock;
 		}
@@ -518,9 +684,14 @@ static BKInt BKTKParserEndCommand (BKTKParser * parser)
 			return -1;
 		}
 
+		if (!(node -> flags & BKTKParserFlagInArena)) {
+			BKTKStatsCountAlloc (BKTKStatsTypeParser, node -> flags & BKTKParserFlagDataIsBlock ? ARGS_POOL_SEGMENT_SIZE : size);
+		}
+
 		args       = (void *) &buffer [bufferSize];
 		argTypes   = (void *) &args [parser -> argCount - 1];
 		argOffsets = (void *) &argTypes [parser -> argCount - 1];
+		argSymbols = (void *) &argOffsets [parser -> argCount - 1];
 
 		memcpy (buffer,     parser -> buffer,          bufferSize);
 		memcpy (argTypes,   &parser -> argTypes [1],   argTypesSize);
@@ -532,12 +703,15 @@ static BKInt BKTKParserEndCommand (BKTKParser * parser)
 				.len = parser -> argLengths [i],
 				.cap = parser -> argLengths [i],
 			};
+
+			argSymbols [i - 1] = 0;
 		}
 
 		if (parser -> argCount > 1) {
 			node -> args       = args;
 			node -> argTypes   = argTypes;
 			node -> argOffsets = argOffsets;
+			node -> argSymbols = argSymbols;
 		}
 
 		node -> name = (BKString) {
@@ -551,6 +725,11 @@ static BKInt BKTKParserEndCommand (BKTKParser * parser)
 	}
 
 	node -> argCount = parser -> argCount - 1;
+	node -> nameSymbol = 0;
+
+	if ((res = BKTKParserInternSymbols (parser, node)) != 0) {
+		return res;
+	}
 
 	parser -> argCount = 0;
 	parser -> bufferLen = 0;
@@ -615,6 +794,11 @@ static BKInt BKTKParserCloseGroup (BKTKParser * parser)
 	return res;
 }
 
+/**
+ * Parse token
+ *
+ * Space for the token has to be ensured with `BKTKParserEnsureSpace`
+ */
 static BKInt BKTKParserPutToken (BKTKParser * parser, BKTKToken const * token)
 {
 	BKInt res = 0;
@@ -631,18 +815,6 @@ static BKInt BKTKParserPutToken (BKTKParser * parser, BKTKToken const * token)
 		return 0;
 	}
 
-	if ((res = BKTKParserBufferEnsureSpace (parser, token -> dataLen)) != 0) {
-		goto allocationError;
-	}
-
-	if ((res = BKTKParserStackEnsureSpace (parser)) != 0) {
-		goto allocationError;
-	}
-
-	if ((res = BKTKParserArgsEnsureSpace (parser)) != 0) {
-		goto allocationError;
-	}
-
 	if ((res = BKTKParserNodeEnsureAlloc (parser)) != 0) {
 		goto allocationError;
 	}
@@ -771,6 +943,14 @@ static BKInt BKTKParserPutToken (BKTKParser * parser, BKTKToken const * token)
 				goto allocationError;
 			}
 
+			if ((res = BKTKParserEmitNode (parser)) != 0) {
+				goto putNodeError;
+			}
+
+			if ((res = BKTKParserNodeEnsureAlloc (parser)) != 0) {
+				goto allocationError;
+			}
+
 			BKTKParserOpenGroup (parser, token);
 
 			state = BKTKParserStateRoot;
@@ -791,6 +971,10 @@ static BKInt BKTKParserPutToken (BKTKParser * parser, BKTKToken const * token)
 				goto allocationError;
 			}
 
+			if ((res = BKTKParserEmitNode (parser)) != 0) {
+				goto putNodeError;
+			}
+
 			state = BKTKParserStateRoot;
 			break;
 		}
@@ -799,6 +983,10 @@ static BKInt BKTKParserPutToken (BKTKParser * parser, BKTKToken const * token)
 				goto allocationError;
 			}
 
+			if ((res = BKTKParserEmitNode (parser)) != 0) {
+				goto putNodeError;
+			}
+
 			state = BKTKParserStateRoot;
 			break;
 		}
@@ -807,12 +995,24 @@ static BKInt BKTKParserPutToken (BKTKParser * parser, BKTKToken const * token)
 				goto allocationError;
 			}
 
+			if ((res = BKTKParserEmitNode (parser)) != 0) {
+				goto putNodeError;
+			}
+
+			if ((res = BKTKParserNodeEnsureAlloc (parser)) != 0) {
+				goto allocationError;
+			}
+
 			BKTKParserBeginCmd(parser, token);
 
 			if ((res = BKTKParserEndCommand (parser)) != 0) {
 				goto allocationError;
 			}
 
+			if ((res = BKTKParserEmitNode (parser)) != 0) {
+				goto putNodeError;
+			}
+
 			state = BKTKParserStateRoot;
 			break;
 		}
@@ -826,6 +1026,10 @@ static BKInt BKTKParserPutToken (BKTKParser * parser, BKTKToken const * token)
 				goto allocationError;
 			}
 
+			if ((res = BKTKParserEmitNode (parser)) != 0) {
+				goto putNodeError;
+			}
+
 			break;
 		}
 		default: {
@@ -842,6 +1046,11 @@ static BKInt BKTKParserPutToken (BKTKParser * parser, BKTKToken const * token)
 		goto error;
 	}
 
+	putNodeError: {
+		BKTKParserSetError (parser, "User error: %d", res);
+		goto error;
+	}
+
 	unexpectedError: {
 		BKStringEscape (&parser -> escapedName, (char *) token -> data);
 		BKTKParserSetError (parser, "Unexpected token '%s' on line %u:%u",
@@ -861,8 +1070,21 @@ BKInt BKTKParserPutTokens (BKTKParser * parser, BKTKToken const * tokens, BKUSiz
 {
 	BKInt res;
 	BKTKToken const * token;
+	BKUSize dataLen = 0;
 
-	for (BKInt i = 0; i < count; i ++) {
+	for (BKUSize i = 0; i < count; i ++) {
+		dataLen += tokens [i].dataLen;
+	}
+
+	// reserve space for all tokens at once
+	if (BKTKParserEnsureSpace (parser, dataLen, count) != 0) {
+		BKTKParserSetError (parser, "Allocation error");
+		parser -> state = BKTKParserStateError;
+
+		return -1;
+	}
+
+	for (BKUSize i = 0; i < count; i ++) {
 		token = &tokens [i];
 
 		if ((res = BKTKParserPutToken (parser, token)) != 0) {
@@ -873,6 +1095,26 @@ BKInt BKTKParserPutTokens (BKTKParser * parser, BKTKToken const * tokens, BKUSiz
 	return 0;
 }
 
+BKInt BKTKParserPutChars (BKTKParser * parser, BKTKTokenizer * tok, uint8_t const * chars, BKUSize size)
+{
+	BKTKPutTokensFunc putTokens = (BKTKPutTokensFunc) BKTKParserPutTokens;
+
+	// also terminates tokenizer
+	BKTKTokenizerPutCharsParallel (tok, chars, size, putTokens, parser, 0);
+
+	if (BKTKTokenizerHasError (tok) || BKTKParserHasError (parser)) {
+		return -1;
+	}
+
+	return 0;
+}
+
+void BKTKParserSetPutNodeFunc (BKTKParser * parser, BKTKParserPutNodeFunc putNode, void * arg)
+{
+	parser -> putNode    = putNode;
+	parser -> putNodeArg = arg;
+}
+
 BKTKParserNode * BKTKParserGetNodeTree (BKTKParser * parser)
 {
 	return parser -> stack [0].node -> subNode;
@@ -883,3 +1125,168 @@ BKClass const BKTKParserClass =
 	.instanceSize = sizeof (BKTKParser),
 	.dispose      = (void *) BKTKParserDispose,
 };
+
+/**
+ * Write position in flat tree block
+ */
+struct flatCursor
+{
+	BKTKParserNode * node;
+	BKString       * arg;
+	BKTKOffset     * argOffset;
+	BKUInt         * argSymbol;
+	BKTKType       * argType;
+	uint8_t        * str;
+};
+
+/**
+ * Count nodes, arguments and string bytes including terminators
+ */
+static void BKTKParserFlatTreeMeasure (BKTKParserNode const * node, BKUSize * numNodes, BKUSize * numArgs, BKUSize * numBytes)
+{
+	for (; node; node = node -> nextNode) {
+		(*numNodes) ++;
+		(*numArgs) += node -> argCount;
+		(*numBytes) += node -> name.len + 1;
+
+		for (BKUSize i = 0; i < node -> argCount; i ++) {
+			(*numBytes) += node -> args [i].len + 1;
+		}
+
+		if (node -> subNode) {
+			BKTKParserFlatTreeMeasure (node -> subNode, numNodes, numArgs, numBytes);
+		}
+	}
+}
+
+static BKString BKTKParserFlatTreeCopyString (struct flatCursor * cursor, BKString const * string)
+{
+	BKString copy = {
+		.str = cursor -> str,
+		.len = string -> len,
+		.cap = string -> len,
+	};
+
+	if (string -> len) {
+		memcpy (cursor -> str, string -> str, string -> len);
+	}
+
+	cursor -> str [string -> len] = '\0';
+	cursor -> str += string -> len + 1;
+
+	return copy;
+}
+
+/**
+ * Copy nodes in pre-order
+ *
+ * Returns the copy of `node`
+ */
+static BKTKParserNode * BKTKParserFlatTreeCopy (BKTKParserNode const * node, struct flatCursor * cursor)
+{
+	BKUSize argCount;
+	BKTKParserNode * flatNode;
+	BKTKParserNode * prevNode = NULL;
+	BKTKParserNode * firstNode = cursor -> node;
+
+	for (; node; node = node -> nextNode) {
+		flatNode = cursor -> node ++;
+		argCount = node -> argCount;
+
+		*flatNode = *node;
+		flatNode -> flags &= ~(BKTKParserFlagDataIsBlock | BKTKParserFlagInArena);
+		flatNode -> name = BKTKParserFlatTreeCopyString (cursor, &node -> name);
+		flatNode -> nextNode = NULL;
+
+		if (argCount) {
+			flatNode -> args       = cursor -> arg;
+			flatNode -> argOffsets = cursor -> argOffset;
+			flatNode -> argSymbols = cursor -> argSymbol;
+			flatNode -> argTypes   = cursor -> argType;
+
+			for (BKUSize i = 0; i < argCount; i ++) {
+				flatNode -> args [i] = BKTKParserFlatTreeCopyString (cursor, &node -> args [i]);
+			}
+
+			memcpy (flatNode -> argOffsets, node -> argOffsets, argCount * sizeof (*node -> argOffsets));
+			memcpy (flatNode -> argSymbols, node -> argSymbols, argCount * sizeof (*node -> argSymbols));
+			memcpy (flatNode -> argTypes, node -> argTypes, argCount * sizeof (*node -> argTypes));
+
+			cursor -> arg       += argCount;
+			cursor -> argOffset += argCount;
+			cursor -> argSymbol += argCount;
+			cursor -> argType   += argCount;
+		}
+
+		// sub nodes directly follow their parent
+		if (node -> subNode) {
+			flatNode -> subNode = BKTKParserFlatTreeCopy (node -> subNode, cursor);
+		}
+
+		if (prevNode) {
+			prevNode -> nextNode = flatNode;
+		}
+
+		prevNode = flatNode;
+	}
+
+	return firstNode;
+}
+
+BKInt BKTKParserFlatTreeInit (BKTKParserFlatTree * tree, BKTKParserNode const * nodes)
+{
+	BKInt res;
+	BKUSize size;
+	BKUSize numNodes = 0, numArgs = 0, numBytes = 0;
+	struct flatCursor cursor;
+
+	if ((res = BKObjectInit (tree, &BKTKParserFlatTreeClass, sizeof (*tree))) != 0) {
+		return res;
+	}
+
+	BKTKParserFlatTreeMeasure (nodes, &numNodes, &numArgs, &numBytes);
+
+	if (!numNodes) {
+		return 0;
+	}
+
+	// ordered by alignment
+	size = numNodes * sizeof (BKTKParserNode) + numArgs * (sizeof (BKString) +
+		sizeof (BKTKOffset) + sizeof (BKUInt) + sizeof (BKTKType)) + numBytes;
+	tree -> nodes = malloc (size);
+
+	if (!tree -> nodes) {
+		return BK_ALLOCATION_ERROR;
+	}
+
+	BKTKStatsCountAlloc (BKTKStatsTypeParser, size);
+
+	tree -> nodeCount = numNodes;
+	tree -> argCount  = numArgs;
+
+	cursor.node      = tree -> nodes;
+	cursor.arg       = (void *) &cursor.node [numNodes];
+	cursor.argOffset = (void *) &cursor.arg [numArgs];
+	cursor.argSymbol = (void *) &cursor.argOffset [numArgs];
+	cursor.argType   = (void *) &cursor.argSymbol [numArgs];
+	cursor.str       = (void *) &cursor.argType [numArgs];
+
+	BKTKParserFlatTreeCopy (nodes, &cursor);
+
+	return 0;
+}
+
+static void BKTKParserFlatTreeDispose (BKTKParserFlatTree * tree)
+{
+	free (tree -> nodes);
+
+	tree -> nodes = NULL;
+	tree -> nodeCount = 0;
+	tree -> argCount = 0;
+}
+
+BKClass const BKTKParserFlatTreeClass =
+{
+	.instanceSize = sizeof (BKTKParserFlatTree),
+	.dispose      = (void *) BKTKParserFlatTreeDispose,
+};
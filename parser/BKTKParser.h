@@ -24,13 +24,16 @@
 #ifndef _BK_TK_PARSER_H_
 #define _BK_TK_PARSER_H_
 
+#include "BKTKArena.h"
 #include "BKTKBase.h"
+#include "BKTKSymbols.h"
 #include "BKTKTokenizer.h"
 
 typedef enum BKTKParserState BKTKParserState;
 typedef struct BKTKParser BKTKParser;
 typedef struct BKTKParserNode BKTKParserNode;
 typedef struct BKTKParserItem BKTKParserItem;
+typedef struct BKTKParserFlatTree BKTKParserFlatTree;
 
 /**
  * Defines the parsers internal state
@@ -55,11 +58,15 @@ enum BKTKParserState
 enum BKTKParserFlag {
 	BKTKParserFlagIsGroup     = 1 << 0,
 	BKTKParserFlagDataIsBlock = 1 << 1,
+	BKTKParserFlagInArena     = 1 << 2, // node and arguments are allocated in `nodes`
 };
 
 /**
  * Defines a node
  *
+ * `nameSymbol` and `argSymbols` are the interned strings from the parser's
+ * symbol table; data arguments and comments are not interned and have symbol 0.
+ *
  * Nodes are linked like a tree: arrows pointing to the right are `nextNode`s,
  * arrows pointing downwards are `subNode`s.
  *
@@ -79,7 +86,9 @@ struct BKTKParserNode
 {
 	BKUInt           flags;
 	BKString         name;
+	BKUInt           nameSymbol;
 	BKString       * args;
+	BKUInt         * argSymbols;
 	BKUSize          argCount;
 	BKTKType       * argTypes;
 	BKTKOffset       offset;
@@ -89,6 +98,16 @@ struct BKTKParserNode
 	BKTKParserNode * subNode;
 };
 
+/**
+ * Called with each completed top-level command or group
+ *
+ * `nextNode` of the passed node is NULL. The node and its sub nodes are
+ * allocated in `nodes` and are freed when the function returns, unless the
+ * allocations are moved to another arena with `BKTKArenaMove`. Parsing is
+ * stopped if a value != 0 is returned.
+ */
+typedef BKInt (* BKTKParserPutNodeFunc) (void * arg, BKTKParserNode const * node, BKTKArena * nodes);
+
 /**
  * Defines an internal parser stack item
  */
@@ -120,6 +139,27 @@ struct BKTKParser
 	BKBlockPool      blockPool;
 	BKBlockPool      argsPool;
 	BKString         escapedName;
+	BKTKSymbolTable  symbols;
+	BKTKArena        nodes;
+	BKTKParserPutNodeFunc putNode;
+	void           * putNodeArg;
+};
+
+/**
+ * Node tree stored in a single block
+ *
+ * Nodes are stored in pre-order, so the first sub node of a node directly
+ * follows it and `node - nodes` is its index. `nextNode` and `subNode` point
+ * into `nodes`; the tree can be passed to the compiler and writer like the
+ * tree of the parser. The argument arrays follow the nodes and all names and
+ * arguments are copied into one string slab at the end of the block.
+ */
+struct BKTKParserFlatTree
+{
+	BKObject         object;
+	BKUSize          nodeCount;
+	BKUSize          argCount;
+	BKTKParserNode * nodes;
 };
 
 /**
@@ -141,6 +181,25 @@ extern void BKTKParserReset (BKTKParser * parser);
  */
 extern BKInt BKTKParserPutTokens (BKTKParser * parser, BKTKToken const * tokens, BKUSize count);
 
+/**
+ * Tokenize and parse complete input
+ *
+ * Tokens are passed from `tok` in batches; large inputs are tokenized in
+ * parallel chunks. The tokenizer is terminated afterwards.
+ *
+ * Returns a value != 0 if the tokenizer or parser encountered an error. The
+ * error text is contained in the buffer of the respective object.
+ */
+extern BKInt BKTKParserPutChars (BKTKParser * parser, BKTKTokenizer * tok, uint8_t const * chars, BKUSize size);
+
+/**
+ * Pass completed top-level nodes to `putNode` instead of building the tree
+ *
+ * Only the node being parsed is kept in memory; `BKTKParserGetNodeTree`
+ * does not return the passed nodes. Has to be set before putting tokens.
+ */
+extern void BKTKParserSetPutNodeFunc (BKTKParser * parser, BKTKParserPutNodeFunc putNode, void * arg);
+
 /**
  * Get node tree
  *
@@ -148,6 +207,21 @@ extern BKInt BKTKParserPutTokens (BKTKParser * parser, BKTKToken const * tokens,
  */
 extern BKTKParserNode * BKTKParserGetNodeTree (BKTKParser * parser);
 
+/**
+ * Copy node tree into flat tree
+ *
+ * The copy does not depend on the parser except for the symbol table which
+ * contains the interned symbols.
+ */
+extern BKInt BKTKParserFlatTreeInit (BKTKParserFlatTree * tree, BKTKParserNode const * nodes);
+
+/**
+ * Get first node of flat tree
+ *
+ * Returns NULL if the tree is empty
+ */
+BK_INLINE BKTKParserNode * BKTKParserFlatTreeGetNodes (BKTKParserFlatTree const * tree);
+
 /**
  * Check if parser has encountered an error
  */
@@ -173,4 +247,9 @@ BK_INLINE BKInt BKTKParserIsFinished (BKTKParser const * parser)
 	return parser -> state >= BKTKParserStateEnd;
 }
 
+BK_INLINE BKTKParserNode * BKTKParserFlatTreeGetNodes (BKTKParserFlatTree const * tree)
+{
+	return tree -> nodeCount ? tree -> nodes : NULL;
+}
+
 #endif /* ! _BK_TK_PARSER_H_ */
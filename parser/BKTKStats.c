@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2012-2016 Simon Schoenenberger
+ * http://blipkit.audio
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdatomic.h>
+#include <time.h>
+#include "BKTKStats.h"
+
+static atomic_int statsEnabled;
+static atomic_size_t numAllocs [BKTKStatsTypeCount];
+static atomic_size_t sizes [BKTKStatsTypeCount];
+static atomic_uint_fast64_t wallNanos [BKTKStatsTypeCount];
+static atomic_uint_fast64_t cpuNanos [BKTKStatsTypeCount];
+
+static char const * const typeNames [BKTKStatsTypeCount] =
+{
+	[BKTKStatsTypeTokenizer] = "tokenizer",
+	[BKTKStatsTypeParser]    = "parser",
+	[BKTKStatsTypeCompiler]  = "compiler",
+	[BKTKStatsTypeContext]   = "context",
+	[BKTKStatsTypeByteCode]  = "byte code",
+	[BKTKStatsTypeSamples]   = "samples",
+	[BKTKStatsTypeTiming]    = "timing",
+};
+
+static uint64_t clockNanos (clockid_t clock)
+{
+	struct timespec time;
+
+	clock_gettime (clock, &time);
+
+	return (uint64_t) time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+void BKTKStatsSetEnabled (BKInt enabled)
+{
+	atomic_store (&statsEnabled, enabled != 0);
+}
+
+BKInt BKTKStatsIsEnabled (void)
+{
+	return atomic_load_explicit (&statsEnabled, memory_order_relaxed);
+}
+
+void BKTKStatsCountAlloc (BKTKStatsType type, BKUSize size)
+{
+	if (!BKTKStatsIsEnabled ()) {
+		return;
+	}
+
+	atomic_fetch_add_explicit (&numAllocs [type], 1, memory_order_relaxed);
+	atomic_fetch_add_explicit (&sizes [type], size, memory_order_relaxed);
+}
+
+void BKTKStatsGetTime (BKTKStatsTime * outTime)
+{
+	outTime -> wallNanos = clockNanos (CLOCK_MONOTONIC);
+	outTime -> cpuNanos  = clockNanos (CLOCK_PROCESS_CPUTIME_ID);
+}
+
+void BKTKStatsAddTime (BKTKStatsType type, BKTKStatsTime const * start)
+{
+	BKTKStatsTime now;
+
+	if (!BKTKStatsIsEnabled ()) {
+		return;
+	}
+
+	BKTKStatsGetTime (&now);
+
+	atomic_fetch_add_explicit (&wallNanos [type], now.wallNanos - start -> wallNanos, memory_order_relaxed);
+	atomic_fetch_add_explicit (&cpuNanos [type], now.cpuNanos - start -> cpuNanos, memory_order_relaxed);
+}
+
+void BKTKStatsGetCounter (BKTKStatsType type, BKTKStatsCounter * outCounter)
+{
+	outCounter -> numAllocs      = atomic_load (&numAllocs [type]);
+	outCounter -> size           = atomic_load (&sizes [type]);
+	outCounter -> time.wallNanos = atomic_load (&wallNanos [type]);
+	outCounter -> time.cpuNanos  = atomic_load (&cpuNanos [type]);
+}
+
+char const * BKTKStatsTypeName (BKTKStatsType type)
+{
+	return typeNames [type];
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2012-2016 Simon Schoenenberger
+ * http://blipkit.audio
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _BK_TK_STATS_H_
+#define _BK_TK_STATS_H_
+
+#include "BKTKBase.h"
+
+typedef enum BKTKStatsType BKTKStatsType;
+typedef struct BKTKStatsTime BKTKStatsTime;
+typedef struct BKTKStatsCounter BKTKStatsCounter;
+
+/**
+ * Subsystem allocations are counted for
+ */
+enum BKTKStatsType
+{
+	BKTKStatsTypeTokenizer,
+	BKTKStatsTypeParser,   // buffers and node pools
+	BKTKStatsTypeCompiler, // symbol tables, arena and link buffers
+	BKTKStatsTypeContext,  // objects of the playing song
+	BKTKStatsTypeByteCode, // linked size, allocated in compiler arena
+	BKTKStatsTypeSamples,
+	BKTKStatsTypeTiming,
+	BKTKStatsTypeCount,
+};
+
+/**
+ * Wall and CPU time
+ */
+struct BKTKStatsTime
+{
+	uint64_t wallNanos;
+	uint64_t cpuNanos; // of all threads
+};
+
+/**
+ * Statistics of a subsystem
+ */
+struct BKTKStatsCounter
+{
+	BKUSize       numAllocs;
+	BKUSize       size; // bytes requested
+	BKTKStatsTime time; // only measured for loading samples
+};
+
+/**
+ * Enable or disable counting
+ *
+ * Counters are shared by all threads and are not updated by default.
+ */
+extern void BKTKStatsSetEnabled (BKInt enabled);
+
+/**
+ * Check if counting is enabled
+ */
+extern BKInt BKTKStatsIsEnabled (void);
+
+/**
+ * Count allocation of `size` bytes after it succeeded
+ *
+ * Resizing a buffer counts as allocation of its new size. Only buffers
+ * allocated in this library are counted; growth of `BKArray`, `BKString` and
+ * `BKByteBuffer` inside BlipKit is not.
+ */
+extern void BKTKStatsCountAlloc (BKTKStatsType type, BKUSize size);
+
+/**
+ * Get current wall and CPU time
+ */
+extern void BKTKStatsGetTime (BKTKStatsTime * outTime);
+
+/**
+ * Add time elapsed since `start` to subsystem
+ */
+extern void BKTKStatsAddTime (BKTKStatsType type, BKTKStatsTime const * start);
+
+/**
+ * Get statistics of subsystem
+ */
+extern void BKTKStatsGetCounter (BKTKStatsType type, BKTKStatsCounter * outCounter);
+
+/**
+ * Get name of subsystem
+ */
+extern char const * BKTKStatsTypeName (BKTKStatsType type);
+
+#endif /* ! _BK_TK_STATS_H_ */
@@ -0,0 +1,267 @@
+/*
+ * Copyright (c) 2012-2016 Simon Schoenenberger
+ * http://blipkit.audio
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "BKTKSymbols.h"
+#include "BKTKStats.h"
+
+#define SYMBOLS_INIT_SIZE 64
+#define BUFFER_INIT_SIZE 1024
+
+extern BKClass const BKTKSymbolTableClass;
+
+BKInt BKTKSymbolTableInit (BKTKSymbolTable * table)
+{
+	BKInt res;
+
+	if ((res = BKObjectInit (table, &BKTKSymbolTableClass, sizeof (*table))) != 0) {
+		return res;
+	}
+
+	table -> capacity = SYMBOLS_INIT_SIZE;
+	table -> symbols = malloc (table -> capacity * sizeof (*table -> symbols));
+
+	if (!table -> symbols) {
+		goto allocationError;
+	}
+
+	BKTKStatsCountAlloc (BKTKStatsTypeCompiler, table -> capacity * sizeof (*table -> symbols));
+
+	table -> slotsMask = SYMBOLS_INIT_SIZE * 2 - 1;
+	table -> slots = calloc (table -> slotsMask + 1, sizeof (*table -> slots));
+
+	if (!table -> slots) {
+		goto allocationError;
+	}
+
+	BKTKStatsCountAlloc (BKTKStatsTypeCompiler, (table -> slotsMask + 1) * sizeof (*table -> slots));
+
+	table -> bufferCap = BUFFER_INIT_SIZE;
+	table -> buffer = malloc (table -> bufferCap);
+
+	if (!table -> buffer) {
+		goto allocationError;
+	}
+
+	BKTKStatsCountAlloc (BKTKStatsTypeCompiler, table -> bufferCap);
+
+	return 0;
+
+	allocationError: {
+		BKDispose (table);
+
+		return BK_ALLOCATION_ERROR;
+	}
+}
+
+static void BKTKSymbolTableDispose (BKTKSymbolTable * table)
+{
+	free (table -> symbols);
+	free (table -> slots);
+	free (table -> buffer);
+}
+
+void BKTKSymbolTableEmpty (BKTKSymbolTable * table)
+{
+	table -> count = 0;
+	table -> bufferLen = 0;
+	memset (table -> slots, 0, (table -> slotsMask + 1) * sizeof (*table -> slots));
+}
+
+BK_INLINE uint32_t BKTKSymbolHash (uint8_t const * str, BKUSize len)
+{
+	uint32_t hash = 2166136261u;
+
+	for (BKUSize i = 0; i < len; i ++) {
+		hash = (hash ^ str [i]) * 16777619u;
+	}
+
+	return hash ^ (hash >> 15);
+}
+
+/**
+ * Find slot of string
+ *
+ * Returns pointer to empty slot if string is not interned
+ */
+static uint32_t * BKTKSymbolTableFindSlot (BKTKSymbolTable const * table, uint8_t const * str, BKUSize len, uint32_t hash)
+{
+	BKTKSymbol const * symbol;
+	uint32_t * slot;
+
+	for (BKUSize i = hash; ; i ++) {
+		slot = &table -> slots [i & table -> slotsMask];
+
+		if (!*slot) {
+			return slot;
+		}
+
+		symbol = &table -> symbols [*slot - 1];
+
+		if (symbol -> hash == hash && symbol -> len == len && memcmp (&table -> buffer [symbol -> offset], str, len) == 0) {
+			return slot;
+		}
+	}
+}
+
+static BKInt BKTKSymbolTableGrowSlots (BKTKSymbolTable * table)
+{
+	BKUSize mask = table -> slotsMask * 2 + 1;
+	uint32_t * slots;
+	BKTKSymbol const * symbol;
+
+	slots = calloc (mask + 1, sizeof (*slots));
+
+	if (!slots) {
+		return BK_ALLOCATION_ERROR;
+	}
+
+	BKTKStatsCountAlloc (BKTKStatsTypeCompiler, (mask + 1) * sizeof (*slots));
+
+	for (BKUSize i = 0; i < table -> count; i ++) {
+		symbol = &table -> symbols [i];
+
+		for (BKUSize j = symbol -> hash; ; j ++) {
+			if (!slots [j & mask]) {
+				slots [j & mask] = (uint32_t) i + 1;
+				break;
+			}
+		}
+	}
+
+	free (table -> slots);
+	table -> slots = slots;
+	table -> slotsMask = mask;
+
+	return 0;
+}
+
+static BKInt BKTKSymbolTableEnsureSpace (BKTKSymbolTable * table, BKUSize len)
+{
+	BKUSize newCapacity;
+	BKTKSymbol * newSymbols;
+	uint8_t * newBuffer;
+
+	if (table -> count >= table -> capacity) {
+		newCapacity = table -> capacity * 2;
+		newSymbols = realloc (table -> symbols, newCapacity * sizeof (*newSymbols));
+
+		if (!newSymbols) {
+			return BK_ALLOCATION_ERROR;
+		}
+
+		BKTKStatsCountAlloc (BKTKStatsTypeCompiler, newCapacity * sizeof (*newSymbols));
+
+		table -> symbols = newSymbols;
+		table -> capacity = newCapacity;
+	}
+
+	// keep load factor below 0.5
+	if ((table -> count + 1) * 2 > table -> slotsMask + 1) {
+		if (BKTKSymbolTableGrowSlots (table) != 0) {
+			return BK_ALLOCATION_ERROR;
+		}
+	}
+
+	// string is terminated with '\0'
+	if (table -> bufferLen + len + 1 > table -> bufferCap) {
+		newCapacity = BKNextPow2 (table -> bufferLen + len + 1);
+		newBuffer = realloc (table -> buffer, newCapacity);
+
+		if (!newBuffer) {
+			return BK_ALLOCATION_ERROR;
+		}
+
+		BKTKStatsCountAlloc (BKTKStatsTypeCompiler, newCapacity);
+
+		table -> buffer = newBuffer;
+		table -> bufferCap = newCapacity;
+	}
+
+	return 0;
+}
+
+BKInt BKTKSymbolTableIntern (BKTKSymbolTable * table, uint8_t const * str, BKUSize len, BKUInt * outSymbol)
+{
+	BKInt res;
+	uint32_t hash = BKTKSymbolHash (str, len);
+	uint32_t * slot;
+	BKTKSymbol * symbol;
+
+	slot = BKTKSymbolTableFindSlot (table, str, len, hash);
+
+	if (*slot) {
+		*outSymbol = *slot;
+		return 0;
+	}
+
+	if ((res = BKTKSymbolTableEnsureSpace (table, len)) != 0) {
+		return res;
+	}
+
+	// slots may have been rehashed
+	slot = BKTKSymbolTableFindSlot (table, str, len, hash);
+	symbol = &table -> symbols [table -> count ++];
+
+	symbol -> offset = (uint32_t) table -> bufferLen;
+	symbol -> len    = (uint32_t) len;
+	symbol -> hash   = hash;
+
+	memcpy (&table -> buffer [table -> bufferLen], str, len);
+	table -> bufferLen += len;
+	table -> buffer [table -> bufferLen ++] = '\0';
+
+	*slot = (uint32_t) table -> count;
+	*outSymbol = *slot;
+
+	return 0;
+}
+
+BKUInt BKTKSymbolTableLookup (BKTKSymbolTable const * table, uint8_t const * str, BKUSize len)
+{
+	return *BKTKSymbolTableFindSlot (table, str, len, BKTKSymbolHash (str, len));
+}
+
+BKInt BKTKSymbolTableGetString (BKTKSymbolTable const * table, BKUInt symbol, BKString * outString)
+{
+	BKTKSymbol const * item;
+
+	if (symbol == 0 || symbol > table -> count) {
+		return -1;
+	}
+
+	item = &table -> symbols [symbol - 1];
+
+	*outString = (BKString) {
+		.str = &table -> buffer [item -> offset],
+		.len = item -> len,
+		.cap = item -> len,
+	};
+
+	return 0;
+}
+
+BKClass const BKTKSymbolTableClass =
+{
+	.instanceSize = sizeof (BKTKSymbolTable),
+	.dispose      = (void *) BKTKSymbolTableDispose,
+};
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2012-2016 Simon Schoenenberger
+ * http://blipkit.audio
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _BK_TK_SYMBOLS_H_
+#define _BK_TK_SYMBOLS_H_
+
+#include "BKTKBase.h"
+
+typedef struct BKTKSymbol BKTKSymbol;
+typedef struct BKTKSymbolTable BKTKSymbolTable;
+
+/**
+ * Interned string
+ *
+ * `offset` points into the string buffer of the table
+ */
+struct BKTKSymbol
+{
+	uint32_t offset;
+	uint32_t len;
+	uint32_t hash;
+};
+
+/**
+ * Maps strings to unique symbol numbers
+ *
+ * Symbols are numbered from 1 in the order they are interned; 0 means no
+ * symbol. Numbers stay valid until the table is emptied.
+ */
+struct BKTKSymbolTable
+{
+	BKObject     object;
+	BKUSize      count;
+	BKUSize      capacity;
+	BKTKSymbol * symbols;
+	BKUSize      slotsMask;
+	uint32_t   * slots;
+	BKUSize      bufferLen;
+	BKUSize      bufferCap;
+	uint8_t    * buffer;
+};
+
+/**
+ * Initialize symbol table
+ */
+extern BKInt BKTKSymbolTableInit (BKTKSymbolTable * table);
+
+/**
+ * Remove all symbols
+ *
+ * Keeps the allocated buffers
+ */
+extern void BKTKSymbolTableEmpty (BKTKSymbolTable * table);
+
+/**
+ * Get symbol of string and insert it if not existing
+ */
+extern BKInt BKTKSymbolTableIntern (BKTKSymbolTable * table, uint8_t const * str, BKUSize len, BKUInt * outSymbol);
+
+/**
+ * Get symbol of string
+ *
+ * Returns 0 if string is not interned
+ */
+extern BKUInt BKTKSymbolTableLookup (BKTKSymbolTable const * table, uint8_t const * str, BKUSize len);
+
+/**
+ * Get string of symbol
+ *
+ * The string is only valid until the next symbol is interned
+ * Returns -1 if symbol does not exist
+ */
+extern BKInt BKTKSymbolTableGetString (BKTKSymbolTable const * table, BKUInt symbol, BKString * outString);
+
+#endif /* ! _BK_TK_SYMBOLS_H_ */
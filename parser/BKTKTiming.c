@@ -0,0 +1,626 @@
+/*
+ * Copyright (c) 2012-2016 Simon Schoenenberger
+ * http://blipkit.audio
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <stdatomic.h>
+#include "BKTKTiming.h"
+#include "BKTKStats.h"
+
+#define RECORDS_BATCH_SIZE 256
+
+/**
+ * Defined here to not expose atomics in public headers
+ */
+struct BKTKTimingQueue
+{
+	BKObject           object;
+	BKUSize            capacity;
+	BKTKTimingRecord * records;
+	atomic_size_t      head;    // written by producer
+	atomic_size_t      tail;    // written by consumer
+	atomic_size_t      numDropped;
+};
+
+extern BKClass const BKTKTimingQueueClass;
+extern BKClass const BKTKTimingIndexClass;
+
+BKInt BKTKTimingQueueAlloc (BKTKTimingQueue ** outQueue, BKUSize capacity)
+{
+	BKInt res;
+	BKTKTimingQueue * queue;
+
+	if ((res = BKObjectAlloc ((void **) &queue, &BKTKTimingQueueClass, 0)) != 0) {
+		return res;
+	}
+
+	queue -> capacity = BKNextPow2 (capacity);
+	queue -> records = malloc (queue -> capacity * sizeof (*queue -> records));
+
+	if (!queue -> records) {
+		BKDispose (queue);
+		return BK_ALLOCATION_ERROR;
+	}
+
+	BKTKStatsCountAlloc (BKTKStatsTypeTiming, queue -> capacity * sizeof (*queue -> records));
+
+	atomic_init (&queue -> head, 0);
+	atomic_init (&queue -> tail, 0);
+	atomic_init (&queue -> numDropped, 0);
+
+	*outQueue = queue;
+
+	return 0;
+}
+
+static void BKTKTimingQueueDispose (BKTKTimingQueue * queue)
+{
+	free (queue -> records);
+}
+
+BKInt BKTKTimingQueuePush (BKTKTimingQueue * queue, BKTKTimingRecord const * record)
+{
+	BKUSize head = atomic_load_explicit (&queue -> head, memory_order_relaxed);
+	BKUSize tail = atomic_load_explicit (&queue -> tail, memory_order_acquire);
+
+	if (head - tail >= queue -> capacity) {
+		atomic_fetch_add_explicit (&queue -> numDropped, 1, memory_order_relaxed);
+		return -1;
+	}
+
+	queue -> records [head & (queue -> capacity - 1)] = *record;
+	atomic_store_explicit (&queue -> head, head + 1, memory_order_release);
+
+	return 0;
+}
+
+BKUSize BKTKTimingQueuePop (BKTKTimingQueue * queue, BKTKTimingRecord records [], BKUSize count)
+{
+	BKUSize tail = atomic_load_explicit (&queue -> tail, memory_order_relaxed);
+	BKUSize head = atomic_load_explicit (&queue -> head, memory_order_acquire);
+	BKUSize mask = queue -> capacity - 1;
+
+	count = BKMin (count, head - tail);
+
+	for (BKUSize i = 0; i < count; i ++) {
+		records [i] = queue -> records [(tail + i) & mask];
+	}
+
+	atomic_store_explicit (&queue -> tail, tail + count, memory_order_release);
+
+	return count;
+}
+
+BKUSize BKTKTimingQueueSize (BKTKTimingQueue * queue)
+{
+	BKUSize tail = atomic_load_explicit (&queue -> tail, memory_order_acquire);
+	BKUSize head = atomic_load_explicit (&queue -> head, memory_order_acquire);
+
+	return head - tail;
+}
+
+BKUSize BKTKTimingQueueNumDropped (BKTKTimingQueue * queue)
+{
+	return atomic_load_explicit (&queue -> numDropped, memory_order_relaxed);
+}
+
+static BKInt BKTKTimingRateAdd (BKArray * rates, BKTKTimingRecord const * record)
+{
+	BKTKTimingRate rate;
+	BKTKTimingRate * last = BKArrayLast (rates);
+	uint32_t tick = BKMax (record -> tick, last -> tick);
+
+	rate.secs    = last -> secs + (double) (tick - last -> tick) * last -> factor / last -> divisor;
+	rate.tick    = tick;
+	rate.factor  = record -> lineno >> 16;
+	rate.divisor = record -> lineno & 0xFFFF;
+
+	if (!rate.divisor) {
+		return 0;
+	}
+
+	// replace rate set at same tick
+	if (tick == last -> tick) {
+		*last = rate;
+		return 0;
+	}
+
+	return BKArrayPush (rates, &rate);
+}
+
+/**
+ * Read records and collect tracks and tick rates
+ *
+ * Events of each track are counted in `numEvents`. `slots` maps a track
+ * number to its entry index + 1.
+ */
+static BKInt BKTKTimingIndexScan (FILE * records, BKArray * tracks, BKArray * rates, uint32_t slots [])
+{
+	BKInt res;
+	BKUSize count;
+	BKTKTimingRecord const * record;
+	BKTKTimingRecord batch [RECORDS_BATCH_SIZE];
+	BKTKTimingTrackEntry * entry;
+	BKTKTimingRate rate;
+
+	memset (&rate, 0, sizeof (rate));
+	rate.factor  = 1;
+	rate.divisor = BK_DEFAULT_CLOCK_RATE;
+
+	if ((res = BKArrayPush (rates, &rate)) != 0) {
+		return res;
+	}
+
+	rewind (records);
+
+	while ((count = fread (batch, sizeof (*batch), RECORDS_BATCH_SIZE, records)) > 0) {
+		for (BKUSize i = 0; i < count; i ++) {
+			record = &batch [i];
+
+			switch (record -> type) {
+				case BKTKTimingRecordTypeLine: {
+					if (!slots [record -> track]) {
+						if (!(entry = BKArrayPushPtr (tracks))) {
+							return BK_ALLOCATION_ERROR;
+						}
+
+						memset (entry, 0, sizeof (*entry));
+						entry -> track = record -> track;
+						slots [record -> track] = (uint32_t) tracks -> len;
+					}
+
+					entry = BKArrayItemAt (tracks, slots [record -> track] - 1);
+					entry -> numEvents ++;
+					break;
+				}
+				case BKTKTimingRecordTypeTickRate: {
+					if ((res = BKTKTimingRateAdd (rates, record)) != 0) {
+						return res;
+					}
+					break;
+				}
+			}
+		}
+	}
+
+	return ferror (records) ? BK_FILE_ERROR : 0;
+}
+
+/**
+ * Read events of all tracks into one block ordered by track
+ *
+ * `starts` has the index of the first event of each entry.
+ */
+static BKInt BKTKTimingIndexSortEvents (FILE * records, BKTKTimingEvent events [], BKUSize starts [], uint32_t const slots [])
+{
+	BKUSize count;
+	BKUSize * start;
+	BKTKTimingRecord const * record;
+	BKTKTimingRecord batch [RECORDS_BATCH_SIZE];
+
+	rewind (records);
+
+	while ((count = fread (batch, sizeof (*batch), RECORDS_BATCH_SIZE, records)) > 0) {
+		for (BKUSize i = 0; i < count; i ++) {
+			record = &batch [i];
+
+			if (record -> type != BKTKTimingRecordTypeLine) {
+				continue;
+			}
+
+			start = &starts [slots [record -> track] - 1];
+			events [*start].tick   = record -> tick;
+			events [*start].lineno = record -> lineno;
+			(*start) ++;
+		}
+	}
+
+	return ferror (records) ? BK_FILE_ERROR : 0;
+}
+
+static int BKTKTimingEventCompareLine (BKTKTimingEvent const * a, BKTKTimingEvent const * b)
+{
+	if (a -> lineno != b -> lineno) {
+		return a -> lineno < b -> lineno ? -1 : 1;
+	}
+
+	return (a -> tick > b -> tick) - (a -> tick < b -> tick);
+}
+
+/**
+ * Write events of track and first tick of each line
+ *
+ * `lines` must have space for the events of the track.
+ */
+static BKInt BKTKTimingIndexWriteTrack (FILE * file, BKTKTimingTrackEntry * entry, BKTKTimingEvent const events [], BKTKTimingEvent lines [])
+{
+	BKUSize numEvents = entry -> numEvents;
+
+	entry -> eventsOffset = ftell (file);
+
+	if (fwrite (events, sizeof (*events), numEvents, file) != numEvents) {
+		return BK_FILE_ERROR;
+	}
+
+	memcpy (lines, events, numEvents * sizeof (*lines));
+	qsort (lines, numEvents, sizeof (*lines), (void *) BKTKTimingEventCompareLine);
+
+	entry -> linesOffset = ftell (file);
+
+	// first event of each line has the lowest tick
+	for (BKUSize i = 0; i < numEvents; i ++) {
+		if (i > 0 && lines [i].lineno == lines [i - 1].lineno) {
+			continue;
+		}
+
+		if (fwrite (&lines [i], sizeof (lines [i]), 1, file) != 1) {
+			return BK_FILE_ERROR;
+		}
+
+		entry -> numLines ++;
+	}
+
+	return 0;
+}
+
+BKInt BKTKTimingIndexWrite (FILE * file, FILE * records)
+{
+	BKInt res = 0;
+	BKTKTimingIndexHeader header;
+	BKTKTimingTrackEntry * entry;
+	long tracksOffset;
+	BKUSize numEvents = 0;
+	BKUSize maxEvents = 0;
+	uint32_t * slots = NULL;
+	BKUSize * starts = NULL;
+	BKTKTimingEvent * events = NULL;
+	BKTKTimingEvent * lines = NULL;
+
+	BKArray tracks = BK_ARRAY_INIT (sizeof (BKTKTimingTrackEntry));
+	BKArray rates = BK_ARRAY_INIT (sizeof (BKTKTimingRate));
+
+	slots = calloc (1 << 16, sizeof (*slots));
+
+	if (!slots) {
+		res = BK_ALLOCATION_ERROR;
+		goto cleanup;
+	}
+
+	BKTKStatsCountAlloc (BKTKStatsTypeTiming, (1 << 16) * sizeof (*slots));
+
+	if ((res = BKTKTimingIndexScan (records, &tracks, &rates, slots)) != 0) {
+		goto cleanup;
+	}
+
+	starts = malloc ((tracks.len + 1) * sizeof (*starts));
+
+	if (!starts) {
+		res = BK_ALLOCATION_ERROR;
+		goto cleanup;
+	}
+
+	BKTKStatsCountAlloc (BKTKStatsTypeTiming, (tracks.len + 1) * sizeof (*starts));
+
+	for (BKUSize i = 0; i < tracks.len; i ++) {
+		entry = BKArrayItemAt (&tracks, i);
+		starts [i] = numEvents;
+		numEvents += entry -> numEvents;
+		maxEvents = BKMax (maxEvents, entry -> numEvents);
+	}
+
+	events = malloc ((numEvents + maxEvents + 1) * sizeof (*events));
+
+	if (!events) {
+		res = BK_ALLOCATION_ERROR;
+		goto cleanup;
+	}
+
+	BKTKStatsCountAlloc (BKTKStatsTypeTiming, (numEvents + maxEvents + 1) * sizeof (*events));
+
+	lines = &events [numEvents];
+
+	if ((res = BKTKTimingIndexSortEvents (records, events, starts, slots)) != 0) {
+		goto cleanup;
+	}
+
+	memset (&header, 0, sizeof (header));
+	memcpy (header.magic, BK_TIMING_MAGIC, sizeof (header.magic));
+	header.version   = BK_TIMING_VERSION;
+	header.numTracks = (uint32_t) tracks.len;
+	header.numRates  = (uint32_t) rates.len;
+
+	if (fwrite (&header, sizeof (header), 1, file) != 1) {
+		goto fileError;
+	}
+
+	if (fwrite (rates.items, sizeof (BKTKTimingRate), header.numRates, file) != header.numRates) {
+		goto fileError;
+	}
+
+	// entries are rewritten after data offsets are known
+	tracksOffset = ftell (file);
+
+	if (fwrite (tracks.items, sizeof (BKTKTimingTrackEntry), header.numTracks, file) != header.numTracks) {
+		goto fileError;
+	}
+
+	numEvents = 0;
+
+	for (BKUSize i = 0; i < header.numTracks; i ++) {
+		entry = BKArrayItemAt (&tracks, i);
+
+		if ((res = BKTKTimingIndexWriteTrack (file, entry, &events [numEvents], lines)) != 0) {
+			goto cleanup;
+		}
+
+		numEvents += entry -> numEvents;
+	}
+
+	if (fseek (file, tracksOffset, SEEK_SET) != 0) {
+		goto fileError;
+	}
+
+	if (fwrite (tracks.items, sizeof (BKTKTimingTrackEntry), header.numTracks, file) != header.numTracks) {
+		goto fileError;
+	}
+
+	fseek (file, 0, SEEK_END);
+
+	goto cleanup;
+
+	fileError: {
+		res = BK_FILE_ERROR;
+	}
+
+	cleanup: {
+		BKArrayDispose (&tracks);
+		BKArrayDispose (&rates);
+		free (slots);
+		free (starts);
+		free (events);
+	}
+
+	return res;
+}
+
+BKInt BKTKTimingIndexInit (BKTKTimingIndex * index)
+{
+	return BKObjectInit (index, &BKTKTimingIndexClass, sizeof (*index));
+}
+
+static void BKTKTimingIndexDispose (BKTKTimingIndex * index)
+{
+	free (index -> data);
+}
+
+BKInt BKTKTimingIndexLoad (BKTKTimingIndex * index, FILE * file)
+{
+	long size;
+	BKTKTimingIndexHeader const * header;
+	BKTKTimingTrackEntry const * entry;
+	BKUSize offset;
+
+	if (fseek (file, 0, SEEK_END) != 0 || (size = ftell (file)) < 0) {
+		return BK_FILE_ERROR;
+	}
+
+	rewind (file);
+
+	free (index -> data);
+	index -> numTracks = 0;
+	index -> numRates = 0;
+	index -> size = size;
+	index -> data = malloc (size ? size : 1);
+
+	if (!index -> data) {
+		return BK_ALLOCATION_ERROR;
+	}
+
+	BKTKStatsCountAlloc (BKTKStatsTypeTiming, size);
+
+	if (fread (index -> data, 1, size, file) != (BKUSize) size) {
+		return BK_FILE_ERROR;
+	}
+
+	header = (void *) index -> data;
+
+	if (index -> size < sizeof (*header)) {
+		return BK_INVALID_VALUE;
+	}
+
+	if (memcmp (header -> magic, BK_TIMING_MAGIC, sizeof (header -> magic)) != 0 || header -> version != BK_TIMING_VERSION) {
+		return BK_INVALID_VALUE;
+	}
+
+	offset = sizeof (*header);
+	index -> rates = (void *) &index -> data [offset];
+	offset += header -> numRates * sizeof (BKTKTimingRate);
+	index -> tracks = (void *) &index -> data [offset];
+	offset += header -> numTracks * sizeof (BKTKTimingTrackEntry);
+
+	if (header -> numRates == 0 || offset > index -> size) {
+		return BK_INVALID_VALUE;
+	}
+
+	for (BKUSize i = 0; i < header -> numTracks; i ++) {
+		entry = &index -> tracks [i];
+
+		if (entry -> eventsOffset + entry -> numEvents * sizeof (BKTKTimingEvent) > index -> size ||
+			entry -> linesOffset + entry -> numLines * sizeof (BKTKTimingEvent) > index -> size) {
+			return BK_INVALID_VALUE;
+		}
+	}
+
+	index -> numTracks = header -> numTracks;
+	index -> numRates = header -> numRates;
+
+	return 0;
+}
+
+BKUInt BKTKTimingIndexLineAtTick (BKTKTimingIndex const * index, BKUSize trackIdx, uint32_t tick)
+{
+	BKTKTimingTrackEntry const * entry;
+	BKTKTimingEvent const * events;
+	BKUSize low, high, mid;
+
+	if (trackIdx >= index -> numTracks) {
+		return 0;
+	}
+
+	entry = &index -> tracks [trackIdx];
+	events = (void *) &index -> data [entry -> eventsOffset];
+	low = 0;
+	high = entry -> numEvents;
+
+	// find first event after `tick`
+	while (low < high) {
+		mid = low + (high - low) / 2;
+
+		if (events [mid].tick <= tick) {
+			low = mid + 1;
+		}
+		else {
+			high = mid;
+		}
+	}
+
+	return low ? events [low - 1].lineno : 0;
+}
+
+BKUSize BKTKTimingIndexLinesAtTick (BKTKTimingIndex const * index, uint32_t tick, BKUInt outLines [], BKUSize count)
+{
+	count = BKMin (count, index -> numTracks);
+
+	for (BKUSize i = 0; i < count; i ++) {
+		outLines [i] = BKTKTimingIndexLineAtTick (index, i, tick);
+	}
+
+	return count;
+}
+
+BKInt BKTKTimingIndexFirstTickOfLine (BKTKTimingIndex const * index, BKUInt lineno, uint32_t * outTick, BKInt * outTrack)
+{
+	BKInt found = -1;
+	BKTKTimingTrackEntry const * entry;
+	BKTKTimingEvent const * lines;
+	BKUSize low, high, mid;
+
+	for (BKUSize i = 0; i < index -> numTracks; i ++) {
+		entry = &index -> tracks [i];
+		lines = (void *) &index -> data [entry -> linesOffset];
+		low = 0;
+		high = entry -> numLines;
+
+		while (low < high) {
+			mid = low + (high - low) / 2;
+
+			if (lines [mid].lineno < lineno) {
+				low = mid + 1;
+			}
+			else {
+				high = mid;
+			}
+		}
+
+		if (low >= entry -> numLines || lines [low].lineno != lineno) {
+			continue;
+		}
+
+		if (found < 0 || lines [low].tick < *outTick) {
+			*outTick = lines [low].tick;
+			found = entry -> track;
+		}
+	}
+
+	if (found < 0) {
+		return -1;
+	}
+
+	if (outTrack) {
+		*outTrack = found;
+	}
+
+	return 0;
+}
+
+double BKTKTimingIndexSecsFromTicks (BKTKTimingIndex const * index, uint32_t tick)
+{
+	BKTKTimingRate const * rate;
+	BKUSize low = 0, high = index -> numRates, mid;
+
+	if (!index -> numRates) {
+		return 0.0;
+	}
+
+	while (low < high) {
+		mid = low + (high - low) / 2;
+
+		if (index -> rates [mid].tick <= tick) {
+			low = mid + 1;
+		}
+		else {
+			high = mid;
+		}
+	}
+
+	rate = &index -> rates [low ? low - 1 : 0];
+
+	return rate -> secs + (double) ((int64_t) tick - rate -> tick) * rate -> factor / rate -> divisor;
+}
+
+uint32_t BKTKTimingIndexTicksFromSecs (BKTKTimingIndex const * index, double secs)
+{
+	BKTKTimingRate const * rate;
+	BKUSize low = 0, high = index -> numRates, mid;
+	double ticks;
+
+	if (!index -> numRates) {
+		return 0;
+	}
+
+	while (low < high) {
+		mid = low + (high - low) / 2;
+
+		if (index -> rates [mid].secs <= secs) {
+			low = mid + 1;
+		}
+		else {
+			high = mid;
+		}
+	}
+
+	rate = &index -> rates [low ? low - 1 : 0];
+	ticks = rate -> tick + (secs - rate -> secs) * rate -> divisor / rate -> factor;
+
+	return ticks > 0.0 ? (uint32_t) ticks : 0;
+}
+
+BKClass const BKTKTimingQueueClass =
+{
+	.instanceSize = sizeof (BKTKTimingQueue),
+	.dispose      = (void *) BKTKTimingQueueDispose,
+};
+
+BKClass const BKTKTimingIndexClass =
+{
+	.instanceSize = sizeof (BKTKTimingIndex),
+	.dispose      = (void *) BKTKTimingIndexDispose,
+};
@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2012-2016 Simon Schoenenberger
+ * http://blipkit.audio
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _BK_TK_TIMING_H_
+#define _BK_TK_TIMING_H_
+
+#include "BKTKBase.h"
+
+#define BK_TIMING_MAGIC "BKTI"
+#define BK_TIMING_VERSION 1
+
+typedef enum BKTKTimingRecordType BKTKTimingRecordType;
+typedef struct BKTKTimingRecord BKTKTimingRecord;
+typedef struct BKTKTimingQueue BKTKTimingQueue;
+typedef struct BKTKTimingEvent BKTKTimingEvent;
+typedef struct BKTKTimingRate BKTKTimingRate;
+typedef struct BKTKTimingTrackEntry BKTKTimingTrackEntry;
+typedef struct BKTKTimingIndexHeader BKTKTimingIndexHeader;
+typedef struct BKTKTimingIndex BKTKTimingIndex;
+
+/**
+ * Defines a timing record type
+ */
+enum BKTKTimingRecordType
+{
+	BKTKTimingRecordTypeLine     = 0, // `tick` and `lineno` of track
+	BKTKTimingRecordTypeTickRate = 1, // `lineno` is factor << 16 | divisor
+};
+
+/**
+ * A single timing record
+ *
+ * Records are written in native byte order
+ */
+struct BKTKTimingRecord
+{
+	uint32_t tick;
+	uint32_t lineno;
+	uint16_t track;
+	uint16_t type;
+};
+
+/**
+ * Indexed timing file
+ *
+ * All values are in native byte order; offsets are relative to the file start.
+ *
+ * BKTKTimingIndexHeader
+ * BKTKTimingRate [numRates]         sorted by tick
+ * BKTKTimingTrackEntry [numTracks]
+ * BKTKTimingEvent [numEvents]       per track; `tick` -> `lineno` sorted by tick
+ * BKTKTimingEvent [numLines]        per track; first `tick` of `lineno` sorted by line
+ */
+struct BKTKTimingIndexHeader
+{
+	char     magic [4];
+	uint32_t version;
+	uint32_t numTracks;
+	uint32_t numRates;
+};
+
+struct BKTKTimingRate
+{
+	double   secs; // time at `tick`
+	uint32_t tick;
+	uint16_t factor;
+	uint16_t divisor;
+};
+
+struct BKTKTimingTrackEntry
+{
+	uint32_t track;
+	uint32_t numEvents;
+	uint32_t numLines;
+	uint32_t reserved;
+	uint64_t eventsOffset;
+	uint64_t linesOffset;
+};
+
+struct BKTKTimingEvent
+{
+	uint32_t tick;
+	uint32_t lineno;
+};
+
+/**
+ * Loaded timing index
+ */
+struct BKTKTimingIndex
+{
+	BKObject                     object;
+	uint8_t                    * data;
+	BKUSize                      size;
+	BKUSize                      numTracks;
+	BKUSize                      numRates;
+	BKTKTimingTrackEntry const * tracks;
+	BKTKTimingRate const       * rates;
+};
+
+/**
+ * Allocate lock-free queue with a single producer and a single consumer
+ *
+ * The producer is the audio thread, the consumer writes the records to disk.
+ * `capacity` is rounded up to the next power of 2. The queue is opaque and is
+ * freed with `BKDispose`.
+ */
+extern BKInt BKTKTimingQueueAlloc (BKTKTimingQueue ** outQueue, BKUSize capacity);
+
+/**
+ * Push record
+ *
+ * Does not block. Returns -1 and counts the record as dropped if the queue is
+ * full.
+ */
+extern BKInt BKTKTimingQueuePush (BKTKTimingQueue * queue, BKTKTimingRecord const * record);
+
+/**
+ * Pop up to `count` records
+ *
+ * Returns the number of records written to `records`
+ */
+extern BKUSize BKTKTimingQueuePop (BKTKTimingQueue * queue, BKTKTimingRecord records [], BKUSize count);
+
+/**
+ * Get number of queued records
+ */
+extern BKUSize BKTKTimingQueueSize (BKTKTimingQueue * queue);
+
+/**
+ * Get number of records dropped because the queue was full
+ */
+extern BKUSize BKTKTimingQueueNumDropped (BKTKTimingQueue * queue);
+
+/**
+ * Write indexed timing file from a file of `BKTKTimingRecord`s
+ *
+ * Records are read twice and sorted by track in memory.
+ */
+extern BKInt BKTKTimingIndexWrite (FILE * file, FILE * records);
+
+/**
+ * Initialize index
+ */
+extern BKInt BKTKTimingIndexInit (BKTKTimingIndex * index);
+
+/**
+ * Load indexed timing file
+ */
+extern BKInt BKTKTimingIndexLoad (BKTKTimingIndex * index, FILE * file);
+
+/**
+ * Get line of track entry `trackIdx` playing at `tick`
+ *
+ * Returns 0 if no line is playing
+ */
+extern BKUInt BKTKTimingIndexLineAtTick (BKTKTimingIndex const * index, BKUSize trackIdx, uint32_t tick);
+
+/**
+ * Get lines of all tracks playing at `tick`
+ *
+ * Writes at most `count` lines ordered like `index -> tracks`
+ * Returns number of lines written
+ */
+extern BKUSize BKTKTimingIndexLinesAtTick (BKTKTimingIndex const * index, uint32_t tick, BKUInt outLines [], BKUSize count);
+
+/**
+ * Get first tick at which `lineno` is played in any track
+ *
+ * `outTrack` is set to the track number and may be NULL
+ * Returns -1 if line is never played
+ */
+extern BKInt BKTKTimingIndexFirstTickOfLine (BKTKTimingIndex const * index, BKUInt lineno, uint32_t * outTick, BKInt * outTrack);
+
+/**
+ * Convert between ticks and seconds respecting tick rate changes
+ */
+extern double BKTKTimingIndexSecsFromTicks (BKTKTimingIndex const * index, uint32_t tick);
+extern uint32_t BKTKTimingIndexTicksFromSecs (BKTKTimingIndex const * index, double secs);
+
+#endif /* ! _BK_TK_TIMING_H_ */
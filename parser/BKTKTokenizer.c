@@ -21,12 +21,22 @@
  * IN THE SOFTWARE.
  */
 
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
 #include "BKTKTokenizer.h"
+#include "BKTKStats.h"
 
 #define BUF_INIT_LEN 4096
 #define MIN_BUFFER_FREE_SPACE 256
 #define CHAR_END 256
 
+#define PARALLEL_CHUNK_SIZE    (256 * 1024)
+#define PARALLEL_MIN_SIZE      (4 * PARALLEL_CHUNK_SIZE)
+#define PARALLEL_BOUNDARY_SCAN (16 * 1024)
+#define PARALLEL_LINE_SCAN     256
+#define MAX_WORKERS            32
+
 static BKTKType const tokenChars [257] =
 {
 	[(uint8_t) ':']    = BKTKTypeArgSep,
@@ -127,6 +137,8 @@ BKInt BKTKTokenizerInit (BKTKTokenizer * tok)
 		return -1;
 	}
 
+	BKTKStatsCountAlloc (BKTKStatsTypeTokenizer, tok -> bufferCap);
+
 	BKTKTokenizerReset (tok);
 
 	return 0;
@@ -143,6 +155,7 @@ void BKTKTokenizerReset (BKTKTokenizer * tok)
 	tok -> offset.colno  = 0;
 	tok -> bufferLen     = 0;
 	tok -> base64Len     = 0;
+	tok -> tokenCount    = 0;
 }
 
 /**
@@ -169,6 +182,8 @@ static BKInt BKTKTokenizerEnsureBufferSpace (BKTKTokenizer * tok, BKUSize additi
 			return -1;
 		}
 
+		BKTKStatsCountAlloc (BKTKStatsTypeTokenizer, newCapacity);
+
 		BKTKTokenizerRelocateTokenData (tok, newBuffer);
 
 		tok -> buffer = newBuffer;
@@ -250,7 +265,46 @@ static void BKTKTokenizerSetError (BKTKTokenizer * tok, char const * msg, ...)
 	tok -> bufferLen = strnlen ((char *) tok -> buffer, tok -> bufferCap);
 }
 
-static BKInt BKTKTokenizerPutCharsChunk (BKTKTokenizer * tok, uint8_t const * chars, BKUSize size, BKTKPutTokenFunc putToken, void * arg)
+/**
+ * Pass batched tokens
+ */
+static BKInt BKTKTokenizerFlushTokens (BKTKTokenizer * tok, BKTKPutTokensFunc putTokens, void * arg)
+{
+	BKInt res = 0;
+
+	if (tok -> tokenCount) {
+		res = putTokens (arg, tok -> tokens, tok -> tokenCount);
+		tok -> tokenCount = 0;
+	}
+
+	return res;
+}
+
+/**
+ * Move data of unfinished token to start of buffer
+ *
+ * Batched tokens keep their data in the buffer until they are flushed;
+ * `tokensEnd` is the end of their data.
+ */
+static void BKTKTokenizerCompactBuffer (BKTKTokenizer * tok, BKUSize tokensEnd)
+{
+	BKTKToken * token = &tok -> token;
+
+	memmove (tok -> buffer, &tok -> buffer [tokensEnd], tok -> bufferLen - tokensEnd);
+	tok -> bufferLen -= tokensEnd;
+
+	if (token -> data >= &tok -> buffer [tokensEnd]) {
+		token -> data -= tokensEnd;
+	}
+}
+
+/**
+ * Scan chunk of chars
+ *
+ * Tokens are passed to `putTokens` in batches if given, otherwise to
+ * `putToken` one by one
+ */
+static BKInt BKTKTokenizerPutCharsChunk (BKTKTokenizer * tok, uint8_t const * chars, BKUSize size, BKTKPutTokenFunc putToken, BKTKPutTokensFunc putTokens, void * arg)
 {
 	BKInt c;
 	BKInt res = -1;
@@ -260,14 +314,16 @@ static BKInt BKTKTokenizerPutCharsChunk (BKTKTokenizer * tok, uint8_t const * ch
 	BKTKType type, charType;
 	BKTKToken * token;
 	BKTKOffset offset;
+	BKUSize tokensEnd = 0;
 	uint8_t const * end = &chars [size];
 
 	if (tok -> state >= BKTKStateEnd) {
 		return 0;
 	}
 
-	// ensure space for worst case
-	if (BKTKTokenizerEnsureBufferSpace (tok, size * 2) < 0) {
+	// ensure space for worst case; batched tokens keep their data and a
+	// separator after an argument needs 3 bytes
+	if (BKTKTokenizerEnsureBufferSpace (tok, size * (putTokens ? 3 : 2)) < 0) {
 		goto allocationError;
 	}
 
@@ -647,11 +703,27 @@ static BKInt BKTKTokenizerPutCharsChunk (BKTKTokenizer * tok, uint8_t const * ch
 			if (accept) {
 				token = &tok -> token;
 				token -> dataLen = &tok -> buffer [tok -> bufferLen] - token -> data;
-				BKTKTokenizerEndBuffer (tok);
 
-				if ((res = putToken (&tok -> token, arg)) != 0) {
-					BKTKTokenizerSetError (tok, "User error: %d", res);
-					goto error;
+				if (putTokens) {
+					// keep data until tokens are flushed
+					BKTKTokenizerBufferPutChar (tok, '\0');
+					tokensEnd = tok -> bufferLen;
+					tok -> tokens [tok -> tokenCount ++] = *token;
+
+					if (tok -> tokenCount >= BK_TK_TOKEN_BATCH_SIZE) {
+						if ((res = BKTKTokenizerFlushTokens (tok, putTokens, arg)) != 0) {
+							BKTKTokenizerSetError (tok, "User error: %d", res);
+							goto error;
+						}
+					}
+				}
+				else {
+					BKTKTokenizerEndBuffer (tok);
+
+					if ((res = putToken (&tok -> token, arg)) != 0) {
+						BKTKTokenizerSetError (tok, "User error: %d", res);
+						goto error;
+					}
 				}
 			}
 		}
@@ -662,6 +734,15 @@ static BKInt BKTKTokenizerPutCharsChunk (BKTKTokenizer * tok, uint8_t const * ch
 	tok -> state = state;
 	tok -> offset = offset;
 
+	if (putTokens) {
+		if ((res = BKTKTokenizerFlushTokens (tok, putTokens, arg)) != 0) {
+			BKTKTokenizerSetError (tok, "User error: %d", res);
+			goto error;
+		}
+
+		BKTKTokenizerCompactBuffer (tok, tokensEnd);
+	}
+
 	return 0;
 
 	allocationError: {
@@ -678,7 +759,7 @@ static BKInt BKTKTokenizerPutCharsChunk (BKTKTokenizer * tok, uint8_t const * ch
 /**
  * Splits input chars into smaller chunks for better buffer usage
  */
-BKInt BKTKTokenizerPutChars (BKTKTokenizer * tok, uint8_t const * chars, BKUSize size, BKTKPutTokenFunc putToken, void * arg)
+static BKInt BKTKTokenizerPutCharsChunks (BKTKTokenizer * tok, uint8_t const * chars, BKUSize size, BKTKPutTokenFunc putToken, BKTKPutTokensFunc putTokens, void * arg)
 {
 	int res;
 	size_t chunkSize;
@@ -687,7 +768,7 @@ BKInt BKTKTokenizerPutChars (BKTKTokenizer * tok, uint8_t const * chars, BKUSize
 	do {
 		chunkSize = size > maxSize ? maxSize : size;
 
-		if ((res = BKTKTokenizerPutCharsChunk (tok, chars, chunkSize, putToken, arg)) != 0) {
+		if ((res = BKTKTokenizerPutCharsChunk (tok, chars, chunkSize, putToken, putTokens, arg)) != 0) {
 			break;
 		}
 
@@ -699,6 +780,615 @@ BKInt BKTKTokenizerPutChars (BKTKTokenizer * tok, uint8_t const * chars, BKUSize
 	return 0;
 }
 
+BKInt BKTKTokenizerPutChars (BKTKTokenizer * tok, uint8_t const * chars, BKUSize size, BKTKPutTokenFunc putToken, void * arg)
+{
+	return BKTKTokenizerPutCharsChunks (tok, chars, size, putToken, NULL, arg);
+}
+
+BKInt BKTKTokenizerPutCharsBatched (BKTKTokenizer * tok, uint8_t const * chars, BKUSize size, BKTKPutTokensFunc putTokens, void * arg)
+{
+	return BKTKTokenizerPutCharsChunks (tok, chars, size, NULL, putTokens, arg);
+}
+
+/**
+ * Chunk tokenized speculatively
+ *
+ * Offsets are relative to the chunk starting on line 1. Token data is
+ * collected in `data` with a terminating NUL each; the data pointers of the
+ * tokens are set when they are passed on.
+ */
+struct tokenSpec
+{
+	BKTKTokenizer tok;
+	BKArray       tokens; // BKTKToken
+	BKInt         res;
+	uint8_t     * data;
+	BKUSize       dataLen;
+	BKUSize       dataCap;
+};
+
+/**
+ * Input chunk
+ *
+ * The chunk is tokenized once from the state guessed when splitting the
+ * input: root state or continuing a data literal at the start of a base64
+ * group.
+ */
+struct tokenChunk
+{
+	uint8_t const  * chars;
+	BKUSize          size;
+	BKTKState        state;
+	struct tokenSpec spec;
+};
+
+struct chunkQueue
+{
+	struct tokenChunk * chunks;
+	BKUSize             numChunks;
+	atomic_size_t       nextJob;
+};
+
+static BKInt tokenSpecPutTokens (struct tokenSpec * spec, BKTKToken const * tokens, BKUSize count)
+{
+	BKUSize size = 0;
+	BKUSize offset;
+	BKTKToken * token;
+	uint8_t * newData;
+	BKUSize newCapacity;
+
+	for (BKUSize i = 0; i < count; i ++) {
+		size += tokens [i].dataLen + 1;
+	}
+
+	if (spec -> dataLen + size > spec -> dataCap) {
+		newCapacity = BKNextPow2 (spec -> dataLen + size);
+		newData = realloc (spec -> data, newCapacity);
+
+		if (!newData) {
+			return -1;
+		}
+
+		BKTKStatsCountAlloc (BKTKStatsTypeTokenizer, newCapacity);
+
+		spec -> data = newData;
+		spec -> dataCap = newCapacity;
+	}
+
+	offset = spec -> tokens.len;
+
+	if (BKArrayResize (&spec -> tokens, offset + count) != 0) {
+		return -1;
+	}
+
+	token = BKArrayItemAt (&spec -> tokens, offset);
+
+	for (BKUSize i = 0; i < count; i ++) {
+		token [i] = tokens [i];
+		token [i].data = NULL;
+
+		memcpy (&spec -> data [spec -> dataLen], tokens [i].data, tokens [i].dataLen);
+		spec -> dataLen += tokens [i].dataLen;
+		spec -> data [spec -> dataLen ++] = '\0';
+	}
+
+	return 0;
+}
+
+/**
+ * Prepare tokenizing chunk from `state`
+ */
+static void tokenSpecReset (struct tokenSpec * spec, BKTKState state)
+{
+	BKTKTokenizer * tok = &spec -> tok;
+
+	BKTKTokenizerReset (tok);
+	tok -> state = state;
+	spec -> res = 0;
+	spec -> dataLen = 0;
+	BKArrayEmpty (&spec -> tokens);
+
+	// data is joined with the literal started before the chunk
+	if (state == BKTKStateData) {
+		tok -> token.type = BKTKTypeData;
+		tok -> token.data = tok -> buffer;
+		tok -> token.offset = tok -> offset;
+		tok -> base64Value = 0;
+	}
+}
+
+static void * BKTKTokenizerWorker (struct chunkQueue * queue)
+{
+	BKUSize index;
+	struct tokenChunk * chunk;
+
+	while ((index = atomic_fetch_add (&queue -> nextJob, 1)) < queue -> numChunks) {
+		chunk = &queue -> chunks [index];
+		chunk -> spec.res = BKTKTokenizerPutCharsBatched (&chunk -> spec.tok, chunk -> chars, chunk -> size,
+			(BKTKPutTokensFunc) tokenSpecPutTokens, &chunk -> spec);
+	}
+
+	return NULL;
+}
+
+/**
+ * Check if line is unlikely to be inside a string or data block
+ *
+ * Separators, comments and groups are not contained in base64 data, and
+ * strings rarely span multiple lines.
+ */
+static BKInt lineIsLikelyRoot (uint8_t const * chars, BKUSize size)
+{
+	BKInt c;
+	BKInt first = 1;
+
+	size = BKMin (size, PARALLEL_LINE_SCAN);
+
+	for (BKUSize i = 0; i < size; i ++) {
+		c = chars [i];
+
+		switch (tokenChars [c]) {
+			case BKTKTypeArgSep:
+			case BKTKTypeCmdSep: {
+				return 1;
+			}
+			case BKTKTypeComment:
+			case BKTKTypeGrpOpen:
+			case BKTKTypeGrpClose: {
+				return first;
+			}
+			case BKTKTypeLineBreak: {
+				return 0;
+			}
+			case BKTKTypeSpace: {
+				break;
+			}
+			default: {
+				first = 0;
+				break;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Check if line is likely inside a data block
+ *
+ * Only base64 chars and spaces may precede the end of the line or literal.
+ */
+static BKInt lineIsLikelyData (uint8_t const * chars, BKUSize size)
+{
+	BKInt c;
+
+	size = BKMin (size, PARALLEL_LINE_SCAN);
+
+	for (BKUSize i = 0; i < size; i ++) {
+		c = chars [i];
+
+		if (base64Chars [c] >= 0) {
+			continue;
+		}
+
+		switch (tokenChars [c]) {
+			case BKTKTypeString:
+			case BKTKTypeLineBreak: {
+				return 1;
+			}
+			case BKTKTypeSpace: {
+				break;
+			}
+			default: {
+				return 0;
+			}
+		}
+	}
+
+	return size > 0;
+}
+
+/**
+ * Get end of chunk inside a long line
+ *
+ * A line of commands is split after a command separator. Other long lines
+ * are most likely base64 data. The chunk ends before the first char of a
+ * base64 group; groups are counted from the last quote or from the start of
+ * the chunk, which is assumed to start a group. Returns 0 if there is no such
+ * position in the scanned range.
+ */
+static BKUSize chunkSplitLine (uint8_t const * chars, BKUSize size)
+{
+	BKUSize count = 0;
+	BKUSize scanEnd = BKMin (size, PARALLEL_CHUNK_SIZE + PARALLEL_BOUNDARY_SCAN);
+	uint8_t const * cmdSep = memchr (&chars [PARALLEL_CHUNK_SIZE], ';', scanEnd - PARALLEL_CHUNK_SIZE);
+
+	if (cmdSep) {
+		return cmdSep - chars + 1;
+	}
+
+	for (BKUSize i = 0; i < scanEnd; i ++) {
+		if (base64Chars [chars [i]] >= 0) {
+			if (i >= PARALLEL_CHUNK_SIZE && count % 4 == 0) {
+				return i;
+			}
+
+			count ++;
+		}
+		else if (chars [i] == '"') {
+			count = 0;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Get size of next chunk
+ *
+ * Chunks end after a line break, preferably before a line which is likely
+ * tokenized from root state. Lines without a line break in the scanned range
+ * are split.
+ */
+static BKUSize chunkSize (uint8_t const * chars, BKUSize size)
+{
+	BKUSize scanEnd;
+	BKUSize split;
+	BKUSize fallback = 0;
+	uint8_t const * lineBreak;
+
+	// avoid small last chunk
+	if (size < PARALLEL_CHUNK_SIZE * 3 / 2) {
+		return size;
+	}
+
+	scanEnd = BKMin (size, PARALLEL_CHUNK_SIZE + PARALLEL_BOUNDARY_SCAN);
+
+	for (BKUSize i = PARALLEL_CHUNK_SIZE; i < scanEnd; ) {
+		lineBreak = memchr (&chars [i], '\n', scanEnd - i);
+
+		if (!lineBreak) {
+			break;
+		}
+
+		i = lineBreak - chars + 1;
+
+		if (!fallback) {
+			fallback = i;
+		}
+
+		if (lineIsLikelyRoot (&chars [i], size - i)) {
+			return i;
+		}
+	}
+
+	if (fallback) {
+		return fallback;
+	}
+
+	if ((split = chunkSplitLine (chars, size)) != 0) {
+		return split;
+	}
+
+	lineBreak = memchr (&chars [scanEnd], '\n', size - scanEnd);
+
+	return lineBreak ? (BKUSize) (lineBreak - chars + 1) : size;
+}
+
+/**
+ * Guess state of tokenizer at start of chunk
+ *
+ * `prev` is the char before the chunk. A chunk split after a command
+ * separator starts in root state; split elsewhere inside a line, it continues
+ * a base64 data literal. A chunk starting after a line break continues a data
+ * literal only if its first line looks like base64 data and not like
+ * commands.
+ */
+static BKTKState chunkState (uint8_t const * chars, BKUSize size, BKInt prev)
+{
+	switch (tokenChars [prev]) {
+		case BKTKTypeCmdSep: {
+			return BKTKStateRoot;
+		}
+		case BKTKTypeLineBreak: {
+			break;
+		}
+		default: {
+			return BKTKStateData;
+		}
+	}
+
+	if (!lineIsLikelyRoot (chars, size) && lineIsLikelyData (chars, size)) {
+		return BKTKStateData;
+	}
+
+	return BKTKStateRoot;
+}
+
+/**
+ * Check if chunk tokenized from `state` can be used
+ *
+ * The tokenizer has to be in the state assumed for the chunk; a data literal
+ * has to be continued at the start of a base64 group. The chunk has to end
+ * in root state or inside a data literal, which the tokenizer continues.
+ */
+static BKInt BKTKTokenizerCanUseSpec (BKTKTokenizer const * tok, struct tokenSpec const * spec, BKTKState state)
+{
+	if (tok -> state != state || (state == BKTKStateData && tok -> base64Len != 0)) {
+		return 0;
+	}
+
+	// error messages contain line numbers relative to chunk
+	if (spec -> res || BKTKTokenizerHasError (&spec -> tok)) {
+		return 0;
+	}
+
+	return spec -> tok.state == BKTKStateRoot || spec -> tok.state == BKTKStateData;
+}
+
+/**
+ * Make offset in chunk relative to input
+ */
+BK_INLINE void chunkOffset (BKTKOffset * offset, BKTKOffset start)
+{
+	if (offset -> lineno == 1) {
+		offset -> colno += start.colno;
+	}
+
+	offset -> lineno += start.lineno - 1;
+}
+
+/**
+ * Append data to token of tokenizer
+ */
+static BKInt BKTKTokenizerAppendData (BKTKTokenizer * tok, uint8_t const * data, BKUSize size)
+{
+	if (BKTKTokenizerEnsureBufferSpace (tok, size) < 0) {
+		BKTKTokenizerSetError (tok, "Allocation error");
+		tok -> state = BKTKStateError;
+		return -1;
+	}
+
+	memcpy (&tok -> buffer [tok -> bufferLen], data, size);
+	tok -> bufferLen += size;
+
+	return 0;
+}
+
+/**
+ * Pass tokens of chunk and advance tokenizer to end of chunk
+ *
+ * If `continued` is set, the first data of the chunk belongs to the data
+ * literal of the tokenizer. A data literal which is not finished at the end
+ * of the chunk is continued by the tokenizer.
+ */
+static BKInt BKTKTokenizerUseSpec (BKTKTokenizer * tok, struct tokenSpec * spec, BKInt continued, BKTKPutTokensFunc putTokens, void * arg)
+{
+	BKInt res;
+	BKUSize count;
+	BKTKToken * token;
+	BKTKToken * pending = &spec -> tok.token;
+	BKUSize pendingLen = &spec -> tok.buffer [spec -> tok.bufferLen] - pending -> data;
+	BKUSize numTokens = spec -> tokens.len;
+	BKUSize dataOffset = 0;
+	BKTKOffset start = tok -> offset;
+
+	for (BKUSize i = 0; i < numTokens; i ++) {
+		token = BKArrayItemAt (&spec -> tokens, i);
+		token -> data = &spec -> data [dataOffset];
+		chunkOffset (&token -> offset, start);
+		dataOffset += token -> dataLen + 1;
+	}
+
+	chunkOffset (&spec -> tok.offset, start);
+
+	if (continued) {
+		// literal continues after chunk
+		if (!numTokens) {
+			if (BKTKTokenizerAppendData (tok, pending -> data, pendingLen) != 0) {
+				return -1;
+			}
+
+			tok -> base64Len   = spec -> tok.base64Len;
+			tok -> base64Value = spec -> tok.base64Value;
+			tok -> offset      = spec -> tok.offset;
+
+			return 0;
+		}
+
+		token = BKArrayItemAt (&spec -> tokens, 0);
+
+		if (BKTKTokenizerAppendData (tok, token -> data, token -> dataLen + 1) != 0) {
+			return -1;
+		}
+
+		token -> data    = tok -> token.data;
+		token -> dataLen = &tok -> buffer [tok -> bufferLen - 1] - token -> data;
+		token -> offset  = tok -> token.offset;
+	}
+
+	for (BKUSize i = 0; i < numTokens; i += count) {
+		count = BKMin (numTokens - i, BK_TK_TOKEN_BATCH_SIZE);
+
+		if ((res = putTokens (arg, BKArrayItemAt (&spec -> tokens, i), count)) != 0) {
+			BKTKTokenizerSetError (tok, "User error: %d", res);
+			tok -> state = BKTKStateError;
+			return res;
+		}
+	}
+
+	tok -> bufferLen = 0;
+
+	// continue literal started in chunk
+	if (spec -> tok.state == BKTKStateData) {
+		tok -> token = *pending;
+		tok -> token.data = tok -> buffer;
+		chunkOffset (&tok -> token.offset, start);
+
+		if (BKTKTokenizerAppendData (tok, pending -> data, pendingLen) != 0) {
+			return -1;
+		}
+
+		tok -> base64Len   = spec -> tok.base64Len;
+		tok -> base64Value = spec -> tok.base64Value;
+	}
+
+	tok -> state  = spec -> tok.state;
+	tok -> offset = spec -> tok.offset;
+
+	return 0;
+}
+
+static BKUInt BKTKTokenizerNumWorkers (BKUInt numWorkers, BKUSize size)
+{
+	long numCPUs;
+
+	if (size < PARALLEL_MIN_SIZE) {
+		return 1;
+	}
+
+	if (!numWorkers) {
+		numCPUs = sysconf (_SC_NPROCESSORS_ONLN);
+		numWorkers = numCPUs > 0 ? (BKUInt) numCPUs : 1;
+	}
+
+	return BKMin (numWorkers, MAX_WORKERS);
+}
+
+static BKInt tokenChunkInit (struct tokenChunk * chunk)
+{
+	chunk -> spec.tokens = BK_ARRAY_INIT (sizeof (BKTKToken));
+
+	return BKTKTokenizerInit (&chunk -> spec.tok);
+}
+
+static void chunksDispose (struct tokenChunk * chunks, BKUInt numChunks)
+{
+	struct tokenSpec * spec;
+
+	for (BKUInt i = 0; i < numChunks; i ++) {
+		spec = &chunks [i].spec;
+		BKDispose (&spec -> tok);
+		BKArrayDispose (&spec -> tokens);
+		free (spec -> data);
+	}
+
+	free (chunks);
+}
+
+/**
+ * Tokenize chunks in parallel and pass their tokens
+ *
+ * Chunks whose state was guessed wrong are tokenized again.
+ */
+static BKInt BKTKTokenizerPutChunks (BKTKTokenizer * tok, struct chunkQueue * queue, BKTKPutTokensFunc putTokens, void * arg)
+{
+	BKInt res = 0;
+	BKUInt numThreads = 0;
+	struct tokenChunk * chunk;
+	pthread_t threads [MAX_WORKERS];
+
+	atomic_init (&queue -> nextJob, 0);
+
+	// calling thread is a worker too
+	for (; numThreads < queue -> numChunks - 1; numThreads ++) {
+		if (pthread_create (&threads [numThreads], NULL, (void *) BKTKTokenizerWorker, queue) != 0) {
+			break;
+		}
+	}
+
+	BKTKTokenizerWorker (queue);
+
+	for (BKUInt i = 0; i < numThreads; i ++) {
+		pthread_join (threads [i], NULL);
+	}
+
+	for (BKUSize i = 0; i < queue -> numChunks && !res; i ++) {
+		chunk = &queue -> chunks [i];
+
+		if (BKTKTokenizerCanUseSpec (tok, &chunk -> spec, chunk -> state)) {
+			res = BKTKTokenizerUseSpec (tok, &chunk -> spec, chunk -> state == BKTKStateData, putTokens, arg);
+		}
+		else {
+			BKTKTokenizerPutCharsBatched (tok, chunk -> chars, chunk -> size, putTokens, arg);
+			res = BKTKTokenizerHasError (tok) ? -1 : 0;
+		}
+	}
+
+	return res;
+}
+
+BKInt BKTKTokenizerPutCharsParallel (BKTKTokenizer * tok, uint8_t const * chars, BKUSize size, BKTKPutTokensFunc putTokens, void * arg, BKUInt numWorkers)
+{
+	BKInt res = 0;
+	BKUSize numChunks;
+	struct tokenChunk * chunk;
+	struct tokenChunk * chunks = NULL;
+	struct chunkQueue queue;
+
+	numWorkers = BKTKTokenizerNumWorkers (numWorkers, size);
+
+	if (numWorkers > 1) {
+		chunks = calloc (numWorkers, sizeof (*chunks));
+
+		if (!chunks) {
+			numWorkers = 1;
+		}
+
+		BKTKStatsCountAlloc (BKTKStatsTypeTokenizer, numWorkers * sizeof (*chunks));
+	}
+
+	for (BKUInt i = 0; i < numWorkers && chunks; i ++) {
+		if (tokenChunkInit (&chunks [i]) != 0) {
+			chunksDispose (chunks, i);
+			chunks = NULL;
+			numWorkers = 1;
+		}
+	}
+
+	// split input into chunks for all workers until the end
+	while (numWorkers > 1 && size && !res) {
+		for (numChunks = 0; numChunks < numWorkers && size; numChunks ++) {
+			chunk = &chunks [numChunks];
+			chunk -> chars = chars;
+			chunk -> size = chunkSize (chars, size);
+
+			// state is known after joining the previous chunks
+			if (numChunks == 0) {
+				chunk -> state = tok -> state == BKTKStateData ? BKTKStateData : BKTKStateRoot;
+			}
+			else {
+				chunk -> state = chunkState (chars, chunk -> size, chars [-1]);
+			}
+
+			tokenSpecReset (&chunk -> spec, chunk -> state);
+
+			chars += chunk -> size;
+			size -= chunk -> size;
+		}
+
+		queue.chunks = chunks;
+		queue.numChunks = numChunks;
+
+		res = BKTKTokenizerPutChunks (tok, &queue, putTokens, arg);
+	}
+
+	if (!res) {
+		if (size) {
+			BKTKTokenizerPutCharsBatched (tok, chars, size, putTokens, arg);
+		}
+
+		// terminate tokenizer
+		BKTKTokenizerPutCharsBatched (tok, NULL, 0, putTokens, arg);
+	}
+
+	if (chunks) {
+		chunksDispose (chunks, numWorkers);
+	}
+
+	return BKTKTokenizerHasError (tok) ? -1 : 0;
+}
+
 BKClass const BKTKTokenizerClass =
 {
 	.instanceSize = sizeof (BKTKTokenizer),
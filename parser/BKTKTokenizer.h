@@ -32,6 +32,12 @@ typedef struct BKTKTokenizer BKTKTokenizer;
 typedef struct BKTKToken BKTKToken;
 
 typedef BKInt (* BKTKPutTokenFunc) (BKTKToken const * token, void * arg);
+typedef BKInt (* BKTKPutTokensFunc) (void * arg, BKTKToken const * tokens, BKUSize count);
+
+/**
+ * Maximum number of tokens passed at once to `BKTKPutTokensFunc`
+ */
+#define BK_TK_TOKEN_BATCH_SIZE 128
 
 /**
  * Defines a token type
@@ -101,6 +107,8 @@ struct BKTKTokenizer
 	uint32_t   base64Value;
 	BKUInt     charCount;
 	uint32_t   charValue;
+	BKUSize    tokenCount;
+	BKTKToken  tokens [BK_TK_TOKEN_BATCH_SIZE]; // batched tokens
 };
 
 /**
@@ -128,6 +136,36 @@ extern void BKTKTokenizerReset (BKTKTokenizer * tok);
  */
 extern BKInt BKTKTokenizerPutChars (BKTKTokenizer * tok, uint8_t const * chars, BKUSize size, BKTKPutTokenFunc putToken, void * arg);
 
+/**
+ * Parse full string or multiple partial strings and pass tokens in batches
+ *
+ * Same as `BKTKTokenizerPutChars` but tokens are collected and `putTokens`
+ * is called with up to `BK_TK_TOKEN_BATCH_SIZE` tokens at once. The data of
+ * the tokens is only valid during the call.
+ *
+ * `putTokens` has the signature of `BKTKParserPutTokens`, which can be passed
+ * directly with the parser as `arg`.
+ */
+extern BKInt BKTKTokenizerPutCharsBatched (BKTKTokenizer * tok, uint8_t const * chars, BKUSize size, BKTKPutTokensFunc putTokens, void * arg);
+
+/**
+ * Tokenize complete input in parallel and terminate the tokenizer
+ *
+ * The input is split into chunks after line breaks; long lines of base64
+ * data are split between groups of 4 chars. Chunks are tokenized once on
+ * separate threads, either from root state or as continuing a data literal,
+ * which is guessed from where the chunk starts. A chunk is used only if the
+ * tokenizer is in the guessed state when the preceding chunks have been
+ * joined; otherwise it is tokenized again. Tokens and their offsets are the same as from
+ * `BKTKTokenizerPutCharsBatched`.
+ *
+ * `numWorkers` limits the number of threads; 0 uses one per online CPU. Small
+ * inputs are tokenized on the calling thread.
+ *
+ * Returns a value != 0 if an error occured.
+ */
+extern BKInt BKTKTokenizerPutCharsParallel (BKTKTokenizer * tok, uint8_t const * chars, BKUSize size, BKTKPutTokensFunc putTokens, void * arg, BKUInt numWorkers);
+
 /**
  * Check if tokenizer is finished
  *
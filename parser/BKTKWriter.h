@@ -33,6 +33,8 @@ typedef BKInt (* BKTKWriterWriteFunc) (void * userInfo, uint8_t const * data, BK
 
 /**
  * Write node
+ *
+ * `node` may also be a node of a `BKTKParserFlatTree`
  */
 extern BKInt BKTKWriterWriteNode (BKTKParserNode const * node, BKTKWriterWriteFunc write, void * userInfo, uint8_t const * indent);
 